@@ -18,6 +18,13 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <csignal>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
 #include "base/timer.h"
 #include "base/kaldi-common.h"
 #include "base/kaldi-utils.h"
@@ -36,10 +43,88 @@ void TimerTest() {
     KALDI_ERR << "Timer fail: waited " << f << " seconds instead of "
               <<  time_secs << " secs.";
 }
+
+void ProfileEvents(int32 n) {
+  for (int32 i = 0; i < n; i++) {
+    KALDI_PROFILE_SCOPE("ProfileEvents");
+    KALDI_PROFILE_COUNT("profile-test-events", 2);
+  }
+}
+
+// Reads the line for 'name' from a report, returning false if not present.
+bool GetProfileLine(const std::string &report, const std::string &name,
+                    std::vector<std::string> *fields) {
+  std::istringstream is(report);
+  std::string line;
+  while (std::getline(is, line)) {
+    std::istringstream line_is(line);
+    std::string field;
+    fields->clear();
+    while (line_is >> field)
+      fields->push_back(field);
+    if (!fields->empty() && (*fields)[0] == name)
+      return true;
+  }
+  return false;
+}
+
+void ProfileTest() {
+  std::vector<std::string> fields;
+  ProfileEvents(10);  // Not counted, as profiling is off.
+  std::ostringstream os;
+  WriteProfileReport(os);
+  KALDI_ASSERT(!GetProfileLine(os.str(), "ProfileEvents", &fields));
+
+  EnableProfiling("tmp.profile");
+  std::vector<std::thread> threads;
+  for (int32 i = 0; i < 4; i++)
+    threads.push_back(std::thread(ProfileEvents, 1000));
+  {
+    KALDI_PROFILE_SCOPE("ProfileTest-sleep");
+    Sleep(0.05);
+  }
+  for (int32 i = 0; i < 2; i++)
+    threads[i].join();  // The others may still be running.
+  for (int32 i = 2; i < 4; i++)
+    threads[i].join();
+  ProfileEvents(1000);  // In this thread, which is still alive.
+
+  std::ostringstream os2;
+  os2.precision(3);
+  WriteProfileReport(os2);
+  // The report must not change the format of the caller's stream.
+  KALDI_ASSERT(!(os2.flags() & std::ios_base::fixed) && os2.precision() == 3);
+  KALDI_ASSERT(GetProfileLine(os2.str(), "ProfileEvents", &fields) &&
+               fields.size() == 4 && fields[1] == "5000");
+  KALDI_ASSERT(GetProfileLine(os2.str(), "profile-test-events", &fields) &&
+               fields.size() == 2 && fields[1] == "10000");
+  KALDI_ASSERT(GetProfileLine(os2.str(), "ProfileTest-sleep", &fields) &&
+               fields.size() == 4 && atof(fields[2].c_str()) >= 0.04);
+
+#ifndef _MSC_VER
+  std::remove("tmp.profile");
+  std::raise(SIGUSR1);
+  ProfileEvents(1);  // The report is written at the next event.
+  std::ifstream is("tmp.profile");
+  std::string line;
+  KALDI_ASSERT(std::getline(is, line) && line[0] == '#');
+#endif
+  EnableProfiling("");  // Don't write a report at exit.
+  std::remove("tmp.profile");
+
+  // Measure the cost of a profiled scope.
+  int32 n = 1000000;
+  Timer timer;
+  ProfileEvents(n);
+  KALDI_LOG << "A profiled scope and counter take "
+            << (timer.Elapsed() * 1.0e+09 / n) << " ns.";
+}
+
 }
 
 
 int main() {
   for (int i = 0; i < 4; i++)
     kaldi::TimerTest();
+  kaldi::ProfileTest();
 }
@@ -20,8 +20,14 @@
 #include "base/timer.h"
 #include "base/kaldi-error.h"
 #include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
 #include <iomanip>
 #include <map>
+#include <mutex>
+#include <set>
 #include <unordered_map>
 
 namespace kaldi {
@@ -82,4 +88,166 @@ Profiler::~Profiler() {
   g_profile_stats.AccStats(name_, tim_.Elapsed());
 }
 
+
+std::atomic<bool> g_profiling_enabled(false);
+
+namespace {
+
+struct ProfileStatsEntry {
+  int64 count;
+  double seconds;
+  bool timed;
+  ProfileStatsEntry(): count(0), seconds(0.0), timed(false) { }
+  void Add(const ProfileStatsEntry &other) {
+    count += other.count;
+    seconds += other.seconds;
+    timed = timed || other.timed;
+  }
+};
+
+// Keyed by name, as different copies of a string constant may have different
+// addresses.
+typedef std::map<std::string, ProfileStatsEntry> ProfileStatsMap;
+
+class ThreadProfileStats;
+
+// The statistics of all threads.  We never delete this, as threads may still
+// be using it while static objects are destroyed at exit.
+struct ProfileRegistry {
+  std::mutex mutex;  // Protects the members, and locks them for a report.
+  std::set<ThreadProfileStats*> threads;
+  ProfileStatsMap finished_threads;  // Stats of threads that have exited.
+  std::string filename;
+};
+
+ProfileRegistry *GetProfileRegistry() {
+  static ProfileRegistry *registry = new ProfileRegistry();
+  return registry;
+}
+
+// Set by the SIGUSR1 handler.  It is lock-free, so the handler may set it;
+// the thread that resets it is the one that writes the report.
+std::atomic<int> g_profile_report_requested(0);
+
+class ThreadProfileStats {
+ public:
+  ThreadProfileStats() {
+    ProfileRegistry *registry = GetProfileRegistry();
+    std::lock_guard<std::mutex> lock(registry->mutex);
+    registry->threads.insert(this);
+  }
+
+  void Acc(const char *name, int64 count, double seconds, bool timed) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ProfileStatsEntry &entry = map_[name];
+    entry.count += count;
+    entry.seconds += seconds;
+    entry.timed = entry.timed || timed;
+  }
+
+  // Adds our stats to 'stats'.
+  void AddTo(ProfileStatsMap *stats) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto iter = map_.begin(); iter != map_.end(); ++iter)
+      (*stats)[iter->first].Add(iter->second);
+  }
+
+  ~ThreadProfileStats() {
+    ProfileRegistry *registry = GetProfileRegistry();
+    std::lock_guard<std::mutex> lock(registry->mutex);
+    AddTo(&(registry->finished_threads));
+    registry->threads.erase(this);
+  }
+
+ private:
+  std::mutex mutex_;  // Only contended while a report is being written.
+  // As for ProfileStats, keyed on the address of the name.
+  std::unordered_map<const char*, ProfileStatsEntry> map_;
+};
+
+struct ReverseSecondsComparator {
+  bool operator () (const std::pair<std::string, ProfileStatsEntry> &a,
+                    const std::pair<std::string, ProfileStatsEntry> &b) {
+    return a.second.seconds > b.second.seconds;
+  }
+};
+
+void WriteProfileReportToFile() {
+  std::string filename;
+  {
+    ProfileRegistry *registry = GetProfileRegistry();
+    std::lock_guard<std::mutex> lock(registry->mutex);
+    filename = registry->filename;
+  }
+  if (filename.empty())
+    return;
+  std::ofstream os(filename.c_str());
+  WriteProfileReport(os);
+  os.close();
+  if (os.fail())
+    KALDI_WARN << "Error writing profile report to " << filename;
+}
+
+#ifndef _MSC_VER
+void ProfileSignalHandler(int) {
+  g_profile_report_requested.store(1, std::memory_order_relaxed);
+}
+#endif
+
+}  // namespace
+
+void AccProfileStats(const char *name, int64 count, double seconds,
+                     bool timed) {
+  static thread_local ThreadProfileStats stats;
+  stats.Acc(name, count, seconds, timed);
+  if (g_profile_report_requested.load(std::memory_order_relaxed) &&
+      g_profile_report_requested.exchange(0) != 0)
+    WriteProfileReportToFile();
+}
+
+void WriteProfileReport(std::ostream &os) {
+  ProfileStatsMap stats;
+  {
+    ProfileRegistry *registry = GetProfileRegistry();
+    std::lock_guard<std::mutex> lock(registry->mutex);
+    stats = registry->finished_threads;
+    for (auto iter = registry->threads.begin();
+         iter != registry->threads.end(); ++iter)
+      (*iter)->AddTo(&stats);
+  }
+  std::vector<std::pair<std::string, ProfileStatsEntry> > timers, counters;
+  for (auto iter = stats.begin(); iter != stats.end(); ++iter)
+    (iter->second.timed ? timers : counters).push_back(*iter);
+  std::sort(timers.begin(), timers.end(), ReverseSecondsComparator());
+  std::ios_base::fmtflags flags = os.flags();
+  std::streamsize precision = os.precision();
+  os << "# timers: name num-calls total-seconds milliseconds-per-call\n";
+  for (size_t i = 0; i < timers.size(); i++) {
+    const ProfileStatsEntry &entry = timers[i].second;
+    os << timers[i].first << ' ' << entry.count << ' ' << std::fixed
+       << std::setprecision(6) << entry.seconds << ' '
+       << (1000.0 * entry.seconds / std::max<int64>(entry.count, 1)) << '\n';
+  }
+  os << "# counters: name count\n";
+  for (size_t i = 0; i < counters.size(); i++)
+    os << counters[i].first << ' ' << counters[i].second.count << '\n';
+  os.flags(flags);
+  os.precision(precision);
+}
+
+void EnableProfiling(const std::string &filename) {
+  ProfileRegistry *registry = GetProfileRegistry();
+  {
+    std::lock_guard<std::mutex> lock(registry->mutex);
+    if (!filename.empty() && registry->filename.empty()) {
+      std::atexit(WriteProfileReportToFile);
+#ifndef _MSC_VER
+      std::signal(SIGUSR1, ProfileSignalHandler);
+#endif
+    }
+    registry->filename = filename;
+  }
+  g_profiling_enabled.store(true);
+}
+
 }  // namespace kaldi
@@ -19,6 +19,11 @@
 #ifndef KALDI_BASE_TIMER_H_
 #define KALDI_BASE_TIMER_H_
 
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <string>
+
 #include "base/kaldi-utils.h"
 #include "base/kaldi-error.h"
 
@@ -108,6 +113,79 @@ class Profiler {
 #define KALDI_PROFILE Profiler _profiler(__func__)
 
 
+// The following is for instrumentation that stays in the code and is only
+// active when profiling has been switched on, as programs do with the
+// standard option --profile-output (see ParseOptions).  Each thread keeps its
+// own statistics, which are only locked by other threads while a report is
+// written, so an event costs two reads of the clock and an uncontended hash
+// table update when profiling is on, and a test of a flag when it is off.
+//
+// Use
+//  KALDI_PROFILE_SCOPE("NnetComputer::Run");
+// at the beginning of a scope to time it, and
+//  KALDI_PROFILE_COUNT("decoder-frames", num_frames);
+// to count events.  Caution: the names should always be string constants,
+// as for Profiler, and should not contain whitespace.
+
+extern std::atomic<bool> g_profiling_enabled;
+
+inline bool ProfilingEnabled() {
+  return g_profiling_enabled.load(std::memory_order_relaxed);
+}
+
+/// Adds 'count' to the number of times the event 'name' happened, and
+/// 'seconds' to its total time, in this thread's statistics.  Events with
+/// 'timed' == false are reported as counters, without times.  Normally
+/// called through the macros above, which only call it if profiling is on.
+void AccProfileStats(const char *name, int64 count, double seconds,
+                     bool timed);
+
+/// Times the scope it is declared in, if profiling is on when it is created.
+class ScopedProfileTimer {
+ public:
+  explicit ScopedProfileTimer(const char *name):
+      name_(ProfilingEnabled() ? name : NULL) {
+    if (name_ != NULL)
+      start_ = std::chrono::steady_clock::now();
+  }
+  ~ScopedProfileTimer() {
+    if (name_ != NULL) {
+      std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start_;
+      AccProfileStats(name_, 1, elapsed.count(), true);
+    }
+  }
+ private:
+  const char *name_;  // NULL if we are not timing.
+  std::chrono::steady_clock::time_point start_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(ScopedProfileTimer);
+};
+
+#define KALDI_PROFILE_SCOPE(name) \
+  ::kaldi::ScopedProfileTimer _kaldi_profile_timer(name)
+
+#define KALDI_PROFILE_COUNT(name, count)                         \
+  do {                                                           \
+    if (::kaldi::ProfilingEnabled())                             \
+      ::kaldi::AccProfileStats(name, count, 0.0, false);         \
+  } while (0)
+
+/// Switches profiling on.  If 'filename' is nonempty, a report (see
+/// WriteProfileReport()) is written to it when the program exits and, except
+/// on Windows, each time the process receives the signal SIGUSR1, which lets
+/// long-running servers be inspected; the report is then written by the
+/// thread of the next profiled event, so it is delayed if nothing is running.
+/// Calling it again with an empty filename stops the reports.
+void EnableProfiling(const std::string &filename);
+
+/// Writes the statistics of all threads so far, one line per timer, as
+///  <name> <num-calls> <total-seconds> <milliseconds-per-call>
+/// with the most expensive first, followed by one line per counter, as
+///  <name> <count>
+/// with comment lines starting with '#' before each section.
+void WriteProfileReport(std::ostream &os);
+
+
 
 }  // namespace kaldi
 
@@ -0,0 +1,435 @@
+// bin/benchmark-decoders-mapped.cc
+
+// Copyright 2026  agent <agent@local>
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <sys/resource.h>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <new>
+#include <sstream>
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "hmm/transition-model.h"
+#include "fstext/fstext-lib.h"
+#include "decoder/simple-decoder.h"
+#include "decoder/faster-decoder.h"
+#include "decoder/lattice-faster-decoder.h"
+#include "decoder/lattice-incremental-decoder.h"
+#include "decoder/lattice-biglm-faster-decoder.h"
+#include "decoder/decodable-matrix.h"
+#include "base/timer.h"
+#include "lat/kaldi-lattice.h"
+#include "lat/lattice-functions.h"
+
+
+// We count the heap allocations made while decoding by replacing the global
+// operator new; this program is single-threaded.
+static kaldi::int64 g_num_allocs = 0;
+
+void *operator new(size_t size) {
+  g_num_allocs++;
+  void *p = std::malloc(size == 0 ? 1 : size);
+  if (p == NULL) throw std::bad_alloc();
+  return p;
+}
+void *operator new[](size_t size) {
+  return operator new(size);
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+
+
+namespace kaldi {
+
+// Resets the peak resident set size of this process ("VmHWM"), which is
+// supported by Linux kernels since 4.0.  Returns false on failure.
+static bool ResetPeakRss() {
+  std::ofstream os("/proc/self/clear_refs");
+  if (!os.good()) return false;
+  os << "5";
+  os.close();
+  return !os.fail();
+}
+
+// Returns the peak resident set size in megabytes, since the last successful
+// call to ResetPeakRss() (or since the start of the process).
+static double PeakRssMb() {
+  std::ifstream is("/proc/self/status");
+  std::string line;
+  while (std::getline(is, line)) {
+    if (line.compare(0, 6, "VmHWM:") == 0)
+      return std::atof(line.c_str() + 6) / 1024.0;  // value is in kB.
+  }
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss / 1024.0;
+}
+
+struct BenchmarkResult {
+  int64 num_frames;
+  int32 num_utts;
+  int32 num_fail;  // number of utterances with no traceback.
+  double time;  // seconds spent decoding.
+  int64 num_allocs;  // heap allocations while decoding.
+  int64 num_lattice_states;  // raw-lattice states; -1 if not available.
+  double tot_like;
+  BenchmarkResult(): num_frames(0), num_utts(0), num_fail(0), time(0.0),
+                     num_allocs(0), num_lattice_states(0), tot_like(0.0) { }
+};
+
+// Gets the best path from the decoder, after Decode().
+template <class Decoder>
+bool GetTraceback(Decoder *decoder, Lattice *best_path) {
+  return decoder->GetBestPath(best_path);
+}
+
+// LatticeIncrementalDecoder has no GetBestPath(); Decode() has already
+// produced the determinized lattice, so we take its best path.
+template <>
+bool GetTraceback(LatticeIncrementalDecoder *decoder, Lattice *best_path) {
+  const CompactLattice &clat =
+      decoder->GetLattice(decoder->NumFramesDecoded(), true);
+  if (clat.NumStates() == 0) return false;
+  CompactLattice best_clat;
+  CompactLatticeShortestPath(clat, &best_clat);
+  ConvertLattice(best_clat, best_path);
+  return true;
+}
+
+// Decodes all the utterances with 'decoder', which may be any decoder class
+// with the Decode() interface of FasterDecoder, and adds to the statistics in
+// 'result'.  Only the call to Decode() is timed.
+template <class Decoder>
+void RunDecoder(const TransitionModel &trans_model,
+                const std::vector<Matrix<BaseFloat>* > &loglikes,
+                BaseFloat acoustic_scale,
+                Decoder *decoder,
+                BenchmarkResult *result) {
+  for (size_t i = 0; i < loglikes.size(); i++) {
+    DecodableMatrixScaledMapped decodable(trans_model, *(loglikes[i]),
+                                          acoustic_scale);
+    int64 allocs_begin = g_num_allocs;
+    Timer timer;
+    bool ans = decoder->Decode(&decodable);
+    result->time += timer.Elapsed();
+    result->num_allocs += g_num_allocs - allocs_begin;
+    result->num_utts++;
+    result->num_frames += loglikes[i]->NumRows();
+    Lattice decoded;
+    if (!ans || !GetTraceback(decoder, &decoded) || decoded.NumStates() == 0) {
+      result->num_fail++;
+      continue;
+    }
+    std::vector<int32> alignment, words;
+    LatticeWeight weight;
+    GetLinearSymbolSequence(decoded, &alignment, &words, &weight);
+    result->tot_like -= weight.Value1() + weight.Value2();
+  }
+}
+
+// For the decoders that have GetRawLattice(), this counts the states in the
+// raw lattice of the last utterance decoded.
+template <class Decoder>
+int64 NumRawLatticeStates(const Decoder &decoder) {
+  Lattice lat;
+  decoder.GetRawLattice(&lat);
+  return lat.NumStates();
+}
+
+// LatticeBiglmFasterDecoder has no const version of GetRawLattice().
+template <>
+int64 NumRawLatticeStates(const LatticeBiglmFasterDecoder &decoder) {
+  Lattice lat;
+  const_cast<LatticeBiglmFasterDecoder&>(decoder).GetRawLattice(&lat);
+  return lat.NumStates();
+}
+
+// As RunDecoder(), but also adds up the sizes of the raw lattices.
+template <class Decoder>
+void RunLatticeDecoder(const TransitionModel &trans_model,
+                       const std::vector<Matrix<BaseFloat>* > &loglikes,
+                       BaseFloat acoustic_scale,
+                       Decoder *decoder,
+                       BenchmarkResult *result) {
+  for (size_t i = 0; i < loglikes.size(); i++) {
+    std::vector<Matrix<BaseFloat>* > this_utt(1, loglikes[i]);
+    RunDecoder(trans_model, this_utt, acoustic_scale, decoder, result);
+    result->num_lattice_states += NumRawLatticeStates(*decoder);
+  }
+}
+
+void PrintResult(const std::string &decoder_name, BaseFloat beam,
+                 int32 max_active, const BenchmarkResult &result,
+                 double peak_rss_mb) {
+  int64 num_frames = std::max<int64>(result.num_frames, 1);
+  std::ostringstream tokens_per_frame;
+  if (result.num_lattice_states >= 0)
+    tokens_per_frame << (result.num_lattice_states /
+                         static_cast<double>(num_frames));
+  else
+    tokens_per_frame << "-";
+  std::cout << decoder_name << ' ' << beam << ' '
+            << (max_active == std::numeric_limits<int32>::max() ? -1 :
+                max_active) << ' '
+            << (result.num_frames / std::max(result.time, 1.0e-06)) << ' '
+            << tokens_per_frame.str() << ' '
+            << (result.num_allocs / static_cast<double>(num_frames)) << ' '
+            << peak_rss_mb << ' '
+            << (result.tot_like / num_frames) << ' '
+            << result.num_fail << '\n';
+  std::cout.flush();
+  KALDI_LOG << decoder_name << " with beam " << beam << ", max-active "
+            << max_active << ": decoded " << result.num_frames
+            << " frames of " << result.num_utts << " utterances in "
+            << result.time << " seconds ("
+            << (result.num_frames / std::max(result.time, 1.0e-06))
+            << " frames/sec), " << result.num_fail << " failed.";
+}
+
+}  // namespace kaldi
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+    using fst::Fst;
+    using fst::VectorFst;
+    using fst::StdArc;
+
+    const char *usage =
+        "Benchmark the search of several decoders on the same graph, replaying\n"
+        "log-likelihoods saved as matrices (e.g. by nnet3-compute), so that the\n"
+        "cost of the search is measured without the cost of the neural net.\n"
+        "All utterances are read into memory first.  For each decoder and each\n"
+        "combination of beam and max-active, prints one line to the standard\n"
+        "output:\n"
+        "  <decoder> <beam> <max-active> <frames-per-sec> <tokens-per-frame>\n"
+        "  <allocations-per-frame> <peak-rss-MB> <log-like-per-frame> <num-failed>\n"
+        "where tokens-per-frame is the number of raw-lattice states per frame\n"
+        "(i.e. tokens surviving lattice pruning; '-' for decoders that produce\n"
+        "no lattice), and peak-rss-MB is measured separately for each line if\n"
+        "the kernel supports it.  If --synthetic-utts is set, random\n"
+        "log-likelihoods are used instead and <loglikes-rspecifier> is not\n"
+        "needed.\n"
+        "Usage: benchmark-decoders-mapped [options] <model-in> <fst-in> "
+        "[<loglikes-rspecifier>]\n"
+        "e.g.: benchmark-decoders-mapped --beams=10:13:16 --max-actives=3000:7000 \\\n"
+        "    final.mdl HCLG.fst ark:loglikes.ark\n";
+    ParseOptions po(usage);
+    BaseFloat acoustic_scale = 0.1;
+    BaseFloat lattice_beam = 8.0;
+    std::string decoders = "simple,faster,lattice-faster,lattice-incremental";
+    std::string beams_str = "13.0", max_actives_str = "7000";
+    std::string old_lm_fst_rxfilename, new_lm_fst_rxfilename;
+    int32 max_utts = -1, synthetic_utts = 0, synthetic_frames = 500,
+        srand_seed = 0;
+
+    po.Register("acoustic-scale", &acoustic_scale,
+                "Scaling factor for acoustic likelihoods");
+    po.Register("lattice-beam", &lattice_beam,
+                "Lattice beam for the lattice-generating decoders.");
+    po.Register("decoders", &decoders, "Comma-separated list of decoders to "
+                "run, from: simple, faster, lattice-faster, "
+                "lattice-incremental, lattice-biglm (lattice-biglm needs "
+                "--old-lm-fst and --new-lm-fst).");
+    po.Register("beams", &beams_str, "Colon-separated list of beams to try.");
+    po.Register("max-actives", &max_actives_str, "Colon-separated list of "
+                "max-active values to try (-1 means no limit).  Ignored by "
+                "the simple decoder.");
+    po.Register("old-lm-fst", &old_lm_fst_rxfilename, "For lattice-biglm: "
+                "the LM the graph was compiled with.");
+    po.Register("new-lm-fst", &new_lm_fst_rxfilename, "For lattice-biglm: "
+                "the LM to decode with.");
+    po.Register("max-utts", &max_utts, "If >= 0, the maximum number of "
+                "utterances to read.");
+    po.Register("synthetic-utts", &synthetic_utts, "If > 0, decode this many "
+                "utterances of random log-likelihoods instead of reading "
+                "them.");
+    po.Register("synthetic-frames", &synthetic_frames, "Number of frames per "
+                "utterance with --synthetic-utts.");
+    po.Register("srand", &srand_seed, "Seed for the random number generator "
+                "used with --synthetic-utts.");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != (synthetic_utts > 0 ? 2 : 3)) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string model_in_filename = po.GetArg(1),
+        fst_in_filename = po.GetArg(2),
+        loglikes_rspecifier = po.GetOptArg(3);
+
+    std::vector<BaseFloat> beams;
+    std::vector<int32> max_actives;
+    std::vector<std::string> decoder_names;
+    if (!SplitStringToFloats(beams_str, ":", true, &beams) || beams.empty())
+      KALDI_ERR << "Invalid --beams option " << beams_str;
+    if (!SplitStringToIntegers(max_actives_str, ":", true, &max_actives) ||
+        max_actives.empty())
+      KALDI_ERR << "Invalid --max-actives option " << max_actives_str;
+    for (size_t i = 0; i < max_actives.size(); i++)
+      if (max_actives[i] < 0)
+        max_actives[i] = std::numeric_limits<int32>::max();
+    SplitStringToVector(decoders, ",", true, &decoder_names);
+    for (size_t i = 0; i < decoder_names.size(); i++) {
+      const std::string &name = decoder_names[i];
+      if (name != "simple" && name != "faster" && name != "lattice-faster" &&
+          name != "lattice-incremental" && name != "lattice-biglm")
+        KALDI_ERR << "Unknown decoder " << name << " in --decoders";
+      if (name == "lattice-biglm" && (old_lm_fst_rxfilename.empty() ||
+                                      new_lm_fst_rxfilename.empty()))
+        KALDI_ERR << "lattice-biglm needs --old-lm-fst and --new-lm-fst";
+    }
+
+    TransitionModel trans_model;
+    ReadKaldiObject(model_in_filename, &trans_model);
+
+    std::vector<Matrix<BaseFloat>* > loglikes;
+    if (synthetic_utts > 0) {
+      srand(srand_seed);
+      for (int32 i = 0; i < synthetic_utts; i++) {
+        Matrix<BaseFloat> *mat = new Matrix<BaseFloat>(synthetic_frames,
+                                                       trans_model.NumPdfs());
+        mat->SetRandn();
+        for (int32 t = 0; t < mat->NumRows(); t++) {
+          SubVector<BaseFloat> row(*mat, t);
+          row.Scale(4.0);  // make the distributions reasonably peaky.
+          row.ApplyLogSoftMax();
+        }
+        loglikes.push_back(mat);
+      }
+    } else {
+      SequentialBaseFloatMatrixReader loglikes_reader(loglikes_rspecifier);
+      for (; !loglikes_reader.Done() &&
+               (max_utts < 0 || static_cast<int32>(loglikes.size()) < max_utts);
+           loglikes_reader.Next()) {
+        if (loglikes_reader.Value().NumRows() == 0) {
+          KALDI_WARN << "Zero-length utterance: " << loglikes_reader.Key();
+          continue;
+        }
+        loglikes.push_back(new Matrix<BaseFloat>());
+        loglikes.back()->Swap(&loglikes_reader.Value());
+      }
+    }
+    if (loglikes.empty())
+      KALDI_ERR << "No utterances to decode.";
+
+    Fst<StdArc> *decode_fst = fst::ReadFstKaldiGeneric(fst_in_filename);
+
+    VectorFst<StdArc> *old_lm_fst = NULL, *new_lm_fst = NULL;
+    fst::BackoffDeterministicOnDemandFst<StdArc> *old_lm_dfst = NULL,
+        *new_lm_dfst = NULL;
+    fst::ComposeDeterministicOnDemandFst<StdArc> *compose_dfst = NULL;
+    if (!old_lm_fst_rxfilename.empty() && !new_lm_fst_rxfilename.empty()) {
+      old_lm_fst = fst::CastOrConvertToVectorFst(
+          fst::ReadFstKaldiGeneric(old_lm_fst_rxfilename));
+      ApplyProbabilityScale(-1.0, old_lm_fst);  // Negate old LM probs...
+      new_lm_fst = fst::CastOrConvertToVectorFst(
+          fst::ReadFstKaldiGeneric(new_lm_fst_rxfilename));
+      old_lm_dfst = new fst::BackoffDeterministicOnDemandFst<StdArc>(
+          *old_lm_fst);
+      new_lm_dfst = new fst::BackoffDeterministicOnDemandFst<StdArc>(
+          *new_lm_fst);
+      compose_dfst = new fst::ComposeDeterministicOnDemandFst<StdArc>(
+          old_lm_dfst, new_lm_dfst);
+    }
+
+    std::cout << "# decoder beam max-active frames-per-sec tokens-per-frame "
+              << "allocs-per-frame peak-rss-MB like-per-frame num-failed\n";
+    bool rss_reset_ok = true;
+    for (size_t d = 0; d < decoder_names.size(); d++) {
+      const std::string &name = decoder_names[d];
+      for (size_t b = 0; b < beams.size(); b++) {
+        for (size_t m = 0; m < max_actives.size(); m++) {
+          // The simple decoder has no max-active.
+          if (name == "simple" && m > 0) break;
+          rss_reset_ok = ResetPeakRss() && rss_reset_ok;
+          BenchmarkResult result;
+          BaseFloat beam = beams[b];
+          int32 max_active = max_actives[m];
+          if (name == "simple") {
+            SimpleDecoder decoder(*decode_fst, beam);
+            result.num_lattice_states = -1;
+            RunDecoder(trans_model, loglikes, acoustic_scale, &decoder,
+                       &result);
+            max_active = -1;
+          } else if (name == "faster") {
+            FasterDecoderOptions config;
+            config.beam = beam;
+            config.max_active = max_active;
+            FasterDecoder decoder(*decode_fst, config);
+            result.num_lattice_states = -1;
+            RunDecoder(trans_model, loglikes, acoustic_scale, &decoder,
+                       &result);
+          } else if (name == "lattice-faster") {
+            LatticeFasterDecoderConfig config;
+            config.beam = beam;
+            config.max_active = max_active;
+            config.lattice_beam = lattice_beam;
+            LatticeFasterDecoder decoder(*decode_fst, config);
+            RunLatticeDecoder(trans_model, loglikes, acoustic_scale, &decoder,
+                              &result);
+          } else if (name == "lattice-incremental") {
+            LatticeIncrementalDecoderConfig config;
+            config.beam = beam;
+            config.max_active = max_active;
+            config.lattice_beam = lattice_beam;
+            LatticeIncrementalDecoder decoder(*decode_fst, trans_model, config);
+            // This decoder only exposes the determinized lattice.
+            result.num_lattice_states = -1;
+            RunDecoder(trans_model, loglikes, acoustic_scale, &decoder,
+                       &result);
+          } else {  // lattice-biglm
+            LatticeBiglmFasterDecoderConfig config;
+            config.beam = beam;
+            config.max_active = max_active;
+            config.lattice_beam = lattice_beam;
+            // The cache is per decoder, so every configuration starts with
+            // an empty one.
+            fst::CacheDeterministicOnDemandFst<StdArc> cache_dfst(
+                compose_dfst);
+            LatticeBiglmFasterDecoder decoder(*decode_fst, config,
+                                              &cache_dfst);
+            RunLatticeDecoder(trans_model, loglikes, acoustic_scale, &decoder,
+                              &result);
+          }
+          PrintResult(name, beam, max_active, result, PeakRssMb());
+        }
+      }
+    }
+    if (!rss_reset_ok)
+      KALDI_WARN << "Could not reset the peak RSS between runs (needs Linux "
+                 << ">= 4.0); peak-rss-MB is the peak for the whole process.";
+
+    delete compose_dfst;
+    delete new_lm_dfst;
+    delete old_lm_dfst;
+    delete new_lm_fst;
+    delete old_lm_fst;
+    delete decode_fst;
+    DeletePointers(&loglikes);
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -0,0 +1,224 @@
+// bin/decode-faster-mapped-batched.cc
+
+// Copyright 2009-2011  Microsoft Corporation
+//                2013  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "tree/context-dep.h"
+#include "hmm/transition-model.h"
+#include "fstext/fstext-lib.h"
+#include "decoder/batched-faster-decoder.h"
+#include "decoder/decodable-matrix.h"
+#include "base/timer.h"
+#include "lat/kaldi-lattice.h" // for {Compact}LatticeArc
+
+namespace kaldi {
+
+// Decodes the utterances in 'keys'/'loglikes' as one batch and writes the
+// output.  Updates the statistics, and clears 'keys' and 'loglikes'.
+void DecodeBatch(const TransitionModel &trans_model,
+                 BaseFloat acoustic_scale,
+                 bool allow_partial,
+                 const fst::SymbolTable *word_syms,
+                 BatchedFasterDecoder *decoder,
+                 std::vector<std::string> *keys,
+                 std::vector<Matrix<BaseFloat>* > *loglikes,
+                 Int32VectorWriter *words_writer,
+                 Int32VectorWriter *alignment_writer,
+                 int32 *num_success, int32 *num_fail,
+                 int64 *frame_count, double *tot_like) {
+  using fst::VectorFst;
+  if (keys->empty()) return;
+  std::vector<DecodableMatrixScaledMapped*> decodables(keys->size());
+  std::vector<DecodableInterface*> decodable_ptrs(keys->size());
+  for (size_t i = 0; i < keys->size(); i++) {
+    decodables[i] = new DecodableMatrixScaledMapped(trans_model,
+                                                    *((*loglikes)[i]),
+                                                    acoustic_scale);
+    decodable_ptrs[i] = decodables[i];
+  }
+  decoder->Decode(decodable_ptrs);
+
+  for (size_t i = 0; i < keys->size(); i++) {
+    const std::string &key = (*keys)[i];
+    int32 num_frames = (*loglikes)[i]->NumRows();
+    VectorFst<LatticeArc> decoded;  // linear FST.
+    if ( (allow_partial || decoder->ReachedFinal(i))
+         && decoder->GetBestPath(i, &decoded) ) {
+      (*num_success)++;
+      if (!decoder->ReachedFinal(i))
+        KALDI_WARN << "Decoder did not reach end-state for utterance " << key
+                   << ", outputting partial traceback.";
+
+      std::vector<int32> alignment;
+      std::vector<int32> words;
+      LatticeWeight weight;
+      *frame_count += num_frames;
+
+      GetLinearSymbolSequence(decoded, &alignment, &words, &weight);
+
+      words_writer->Write(key, words);
+      if (alignment_writer->IsOpen())
+        alignment_writer->Write(key, alignment);
+      if (word_syms != NULL) {
+        std::cerr << key << ' ';
+        for (size_t j = 0; j < words.size(); j++) {
+          std::string s = word_syms->Find(words[j]);
+          if (s == "")
+            KALDI_ERR << "Word-id " << words[j] <<" not in symbol table.";
+          std::cerr << s << ' ';
+        }
+        std::cerr << '\n';
+      }
+      BaseFloat like = -weight.Value1() -weight.Value2();
+      *tot_like += like;
+      KALDI_LOG << "Log-like per frame for utterance " << key << " is "
+                << (like / num_frames) << " over "
+                << num_frames << " frames.";
+    } else {
+      (*num_fail)++;
+      KALDI_WARN << "Did not successfully decode utterance " << key
+                 << ", len = " << num_frames;
+    }
+  }
+  DeletePointers(&decodables);
+  DeletePointers(loglikes);
+  loglikes->clear();
+  keys->clear();
+}
+
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+    using fst::SymbolTable;
+    using fst::Fst;
+    using fst::StdArc;
+
+    const char *usage =
+        "Decode, reading log-likelihoods as matrices, several utterances at a\n"
+        "time, so that the graph is traversed once for the whole batch (see\n"
+        "BatchedFasterDecoder).  Output is the same as decode-faster-mapped.\n"
+        " (model is needed only for the integer mappings in its transition-model)\n"
+        "Usage:   decode-faster-mapped-batched [options] <model-in> <fst-in> "
+        "<loglikes-rspecifier> <words-wspecifier> [<alignments-wspecifier>]\n";
+    ParseOptions po(usage);
+    bool binary = true;
+    BaseFloat acoustic_scale = 0.1;
+    bool allow_partial = true;
+    int32 batch_size = 16;
+    std::string word_syms_filename;
+    FasterDecoderOptions decoder_opts;
+    decoder_opts.Register(&po, true);  // true == include obscure settings.
+    po.Register("binary", &binary, "Write output in binary mode");
+    po.Register("acoustic-scale", &acoustic_scale, "Scaling factor for acoustic likelihoods");
+    po.Register("allow-partial", &allow_partial, "Produce output even when final state was not reached");
+    po.Register("word-symbol-table", &word_syms_filename, "Symbol table for words [for debug output]");
+    po.Register("batch-size", &batch_size, "Number of utterances decoded "
+                "together (at most 64).");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() < 4 || po.NumArgs() > 5) {
+      po.PrintUsage();
+      exit(1);
+    }
+    if (batch_size <= 0 || batch_size > BatchedFasterDecoder::kMaxBatchSize)
+      KALDI_ERR << "Invalid --batch-size " << batch_size;
+
+    std::string model_in_filename = po.GetArg(1),
+        fst_in_filename = po.GetArg(2),
+        loglikes_rspecifier = po.GetArg(3),
+        words_wspecifier = po.GetArg(4),
+        alignment_wspecifier = po.GetOptArg(5);
+
+    TransitionModel trans_model;
+    ReadKaldiObject(model_in_filename, &trans_model);
+
+    Int32VectorWriter words_writer(words_wspecifier);
+
+    Int32VectorWriter alignment_writer(alignment_wspecifier);
+
+    fst::SymbolTable *word_syms = NULL;
+    if (word_syms_filename != "") {
+      word_syms = fst::SymbolTable::ReadText(word_syms_filename);
+      if (!word_syms)
+        KALDI_ERR << "Could not read symbol table from file "<<word_syms_filename;
+    }
+
+    SequentialBaseFloatMatrixReader loglikes_reader(loglikes_rspecifier);
+
+    // It's important that we initialize decode_fst after loglikes_reader, as it
+    // can prevent crashes on systems installed without enough virtual memory.
+    // It has to do with what happens on UNIX systems if you call fork() on a
+    // large process: the page-table entries are duplicated, which requires a
+    // lot of virtual memory.
+    Fst<StdArc> *decode_fst = fst::ReadFstKaldiGeneric(fst_in_filename);
+
+    double tot_like = 0.0;
+    kaldi::int64 frame_count = 0;
+    int32 num_success = 0, num_fail = 0;
+    BatchedFasterDecoder decoder(*decode_fst, decoder_opts);
+
+    Timer timer;
+
+    std::vector<std::string> keys;
+    std::vector<Matrix<BaseFloat>* > loglikes;
+    for (; !loglikes_reader.Done(); loglikes_reader.Next()) {
+      std::string key = loglikes_reader.Key();
+      if (loglikes_reader.Value().NumRows() == 0) {
+        KALDI_WARN << "Zero-length utterance: " << key;
+        num_fail++;
+        continue;
+      }
+      keys.push_back(key);
+      loglikes.push_back(new Matrix<BaseFloat>());
+      loglikes.back()->Swap(&loglikes_reader.Value());
+      if (static_cast<int32>(keys.size()) == batch_size)
+        DecodeBatch(trans_model, acoustic_scale, allow_partial, word_syms,
+                    &decoder, &keys, &loglikes, &words_writer,
+                    &alignment_writer, &num_success, &num_fail,
+                    &frame_count, &tot_like);
+    }
+    DecodeBatch(trans_model, acoustic_scale, allow_partial, word_syms,
+                &decoder, &keys, &loglikes, &words_writer,
+                &alignment_writer, &num_success, &num_fail,
+                &frame_count, &tot_like);
+
+    double elapsed = timer.Elapsed();
+    KALDI_LOG << "Time taken [excluding initialization] "<< elapsed
+              << "s: real-time factor assuming 100 frames/sec is "
+              << (elapsed*100.0/frame_count);
+    KALDI_LOG << "Done " << num_success << " utterances, failed for "
+              << num_fail;
+    KALDI_LOG << "Overall log-likelihood per frame is " << (tot_like/frame_count)
+              << " over " << frame_count << " frames.";
+
+    delete word_syms;
+    delete decode_fst;
+    if (num_success != 0) return 0;
+    else return 1;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
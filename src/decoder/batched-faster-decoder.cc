@@ -0,0 +1,492 @@
+// decoder/batched-faster-decoder.cc
+
+// Copyright 2009-2011 Microsoft Corporation
+//           2012-2013 Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder/batched-faster-decoder.h"
+
+namespace kaldi {
+
+// Returns the index of the lowest set bit of 'mask', which must be nonzero.
+static inline int32 LowestSetBit(uint64 mask) {
+#if defined(__GNUC__)
+  return __builtin_ctzll(mask);
+#else
+  int32 i = 0;
+  while (!(mask & 1)) { mask >>= 1; i++; }
+  return i;
+#endif
+}
+
+
+BatchedFasterDecoder::BatchedFasterDecoder(const fst::Fst<fst::StdArc> &fst,
+                                           const FasterDecoderOptions &opts):
+    fst_(fst), fst_type_(kOtherFst), config_(opts) {
+  if (fst_.Type() == "const")
+    fst_type_ = kConstFst;
+  else if (fst_.Type() == "vector")
+    fst_type_ = kVectorFst;
+  KALDI_ASSERT(config_.hash_ratio >= 1.0);  // less doesn't make much sense.
+  KALDI_ASSERT(config_.max_active > 1);
+  KALDI_ASSERT(config_.min_active >= 0 && config_.min_active < config_.max_active);
+  toks_.SetSize(1000);  // just so on the first frame we do something reasonable.
+}
+
+BatchedFasterDecoder::~BatchedFasterDecoder() {
+  ClearToks(toks_.Clear());
+  ClearFinalToks();
+  for (size_t i = 0; i < free_entries_.size(); i++)
+    delete free_entries_[i];
+}
+
+
+void BatchedFasterDecoder::Decode(
+    const std::vector<DecodableInterface*> &decodables) {
+  int32 num_utts = decodables.size();
+  KALDI_ASSERT(num_utts > 0 && num_utts <= kMaxBatchSize);
+  // clean up from last time:
+  ClearToks(toks_.Clear());
+  ClearFinalToks();
+
+  utts_.clear();
+  utts_.resize(num_utts);
+  tmp_costs_.resize(num_utts);
+  uint64 active_mask = (num_utts == 64 ? ~static_cast<uint64>(0) :
+                        (static_cast<uint64>(1) << num_utts) - 1);
+  for (int32 u = 0; u < num_utts; u++) {
+    UttInfo &info = utts_[u];
+    info.decodable = decodables[u];
+    info.num_frames = decodables[u]->NumFramesReady();
+    info.cutoff = std::numeric_limits<double>::infinity();
+    info.next_cutoff = std::numeric_limits<float>::max();
+    info.adaptive_beam = config_.beam;
+    info.best_tok = NULL;
+    info.best_state = fst::kNoStateId;
+  }
+
+  StateId start_state = fst_.Start();
+  KALDI_ASSERT(start_state != fst::kNoStateId);
+  Arc dummy_arc(0, 0, Weight::One(), start_state);
+  StateEntry *start_entry = NewEntry();
+  for (int32 u = 0; u < num_utts; u++)
+    start_entry->toks[u] = new Token(dummy_arc, NULL);
+  start_entry->tok_mask = active_mask;
+  start_entry->queued_mask = active_mask;
+  toks_.Insert(start_state, start_entry);
+  ProcessNonemitting(active_mask);
+
+  for (int32 u = 0; u < num_utts; u++) {
+    if (utts_[u].num_frames == 0) {
+      FinishUtterance(u);
+      active_mask &= ~(static_cast<uint64>(1) << u);
+    }
+  }
+  for (int32 frame = 0; active_mask != 0; frame++) {
+    ProcessEmitting(frame, active_mask);
+    ProcessNonemitting(active_mask);
+    for (uint64 mask = active_mask; mask != 0; mask &= mask - 1) {
+      int32 u = LowestSetBit(mask);
+      if (utts_[u].num_frames == frame + 1) {
+        FinishUtterance(u);
+        active_mask &= ~(static_cast<uint64>(1) << u);
+      }
+    }
+  }
+}
+
+int32 BatchedFasterDecoder::NumFramesDecoded(int32 utt) const {
+  KALDI_ASSERT(utt >= 0 && utt < NumUtterances());
+  return utts_[utt].num_frames;
+}
+
+bool BatchedFasterDecoder::ReachedFinal(int32 utt) const {
+  KALDI_ASSERT(utt >= 0 && utt < NumUtterances());
+  const std::vector<std::pair<StateId, Token*> > &final_toks =
+      utts_[utt].final_toks;
+  for (size_t i = 0; i < final_toks.size(); i++) {
+    if (final_toks[i].second->cost_ != std::numeric_limits<double>::infinity() &&
+        fst_.Final(final_toks[i].first) != Weight::Zero())
+      return true;
+  }
+  return false;
+}
+
+bool BatchedFasterDecoder::GetBestPath(int32 utt,
+                                       fst::MutableFst<LatticeArc> *fst_out,
+                                       bool use_final_probs) const {
+  KALDI_ASSERT(utt >= 0 && utt < NumUtterances());
+  const std::vector<std::pair<StateId, Token*> > &final_toks =
+      utts_[utt].final_toks;
+  fst_out->DeleteStates();
+  Token *best_tok = NULL;
+  bool is_final = ReachedFinal(utt);
+  if (!is_final) {
+    for (size_t i = 0; i < final_toks.size(); i++)
+      if (best_tok == NULL || *best_tok < *(final_toks[i].second))
+        best_tok = final_toks[i].second;
+  } else {
+    double infinity =  std::numeric_limits<double>::infinity(),
+        best_cost = infinity;
+    for (size_t i = 0; i < final_toks.size(); i++) {
+      double this_cost = final_toks[i].second->cost_ +
+          fst_.Final(final_toks[i].first).Value();
+      if (this_cost < best_cost && this_cost != infinity) {
+        best_cost = this_cost;
+        best_tok = final_toks[i].second;
+      }
+    }
+  }
+  if (best_tok == NULL) return false;  // No output.
+
+  std::vector<LatticeArc> arcs_reverse;  // arcs in reverse order.
+
+  for (Token *tok = best_tok; tok != NULL; tok = tok->prev_) {
+    BaseFloat tot_cost = tok->cost_ -
+        (tok->prev_ ? tok->prev_->cost_ : 0.0),
+        graph_cost = tok->arc_.weight.Value(),
+        ac_cost = tot_cost - graph_cost;
+    LatticeArc l_arc(tok->arc_.ilabel,
+                     tok->arc_.olabel,
+                     LatticeWeight(graph_cost, ac_cost),
+                     tok->arc_.nextstate);
+    arcs_reverse.push_back(l_arc);
+  }
+  KALDI_ASSERT(arcs_reverse.back().nextstate == fst_.Start());
+  arcs_reverse.pop_back();  // that was a "fake" token... gives no info.
+
+  StateId cur_state = fst_out->AddState();
+  fst_out->SetStart(cur_state);
+  for (ssize_t i = static_cast<ssize_t>(arcs_reverse.size())-1; i >= 0; i--) {
+    LatticeArc arc = arcs_reverse[i];
+    arc.nextstate = fst_out->AddState();
+    fst_out->AddArc(cur_state, arc);
+    cur_state = arc.nextstate;
+  }
+  if (is_final && use_final_probs) {
+    Weight final_weight = fst_.Final(best_tok->arc_.nextstate);
+    fst_out->SetFinal(cur_state, LatticeWeight(final_weight.Value(), 0.0));
+  } else {
+    fst_out->SetFinal(cur_state, LatticeWeight::One());
+  }
+  RemoveEpsLocal(fst_out);
+  return true;
+}
+
+
+void BatchedFasterDecoder::ComputeCutoffs(const Elem *list_head,
+                                          uint64 active_mask) {
+  int32 num_utts = NumUtterances();
+  std::vector<double> best_cost(num_utts,
+                                std::numeric_limits<double>::infinity());
+  for (int32 u = 0; u < num_utts; u++) {
+    tmp_costs_[u].clear();
+    utts_[u].best_tok = NULL;
+  }
+  size_t num_states = 0, num_toks = 0;
+  for (const Elem *e = list_head; e != NULL; e = e->tail, num_states++) {
+    const StateEntry *entry = e->val;
+    for (uint64 mask = entry->tok_mask & active_mask; mask != 0;
+         mask &= mask - 1, num_toks++) {
+      int32 u = LowestSetBit(mask);
+      Token *tok = entry->toks[u];
+      double w = tok->cost_;
+      tmp_costs_[u].push_back(w);
+      if (w < best_cost[u]) {
+        best_cost[u] = w;
+        utts_[u].best_tok = tok;
+        utts_[u].best_state = e->key;
+      }
+    }
+  }
+  KALDI_VLOG(3) << num_toks << " tokens active on " << num_states
+                << " states.";
+  PossiblyResizeHash(num_states);  // This makes sure the hash is always big
+                                   // enough.
+  for (uint64 mask = active_mask; mask != 0; mask &= mask - 1) {
+    int32 u = LowestSetBit(mask);
+    UttInfo &info = utts_[u];
+    info.cutoff = GetCutoff(&(tmp_costs_[u]), best_cost[u],
+                            &(info.adaptive_beam));
+  }
+}
+
+double BatchedFasterDecoder::GetCutoff(std::vector<BaseFloat> *costs,
+                                       double best_cost,
+                                       BaseFloat *adaptive_beam) const {
+  double beam_cutoff = best_cost + config_.beam,
+      min_active_cutoff = std::numeric_limits<double>::infinity(),
+      max_active_cutoff = std::numeric_limits<double>::infinity();
+  *adaptive_beam = config_.beam;
+  if (config_.max_active == std::numeric_limits<int32>::max() &&
+      config_.min_active == 0)
+    return beam_cutoff;
+
+  if (costs->size() > static_cast<size_t>(config_.max_active)) {
+    std::nth_element(costs->begin(),
+                     costs->begin() + config_.max_active,
+                     costs->end());
+    max_active_cutoff = (*costs)[config_.max_active];
+  }
+  if (max_active_cutoff < beam_cutoff) { // max_active is tighter than beam.
+    *adaptive_beam = max_active_cutoff - best_cost + config_.beam_delta;
+    return max_active_cutoff;
+  }
+  if (costs->size() > static_cast<size_t>(config_.min_active)) {
+    if (config_.min_active == 0) min_active_cutoff = best_cost;
+    else {
+      std::nth_element(costs->begin(),
+                       costs->begin() + config_.min_active,
+                       costs->size() > static_cast<size_t>(config_.max_active) ?
+                       costs->begin() + config_.max_active :
+                       costs->end());
+      min_active_cutoff = (*costs)[config_.min_active];
+    }
+  }
+  if (min_active_cutoff > beam_cutoff) { // min_active is looser than beam.
+    *adaptive_beam = min_active_cutoff - best_cost + config_.beam_delta;
+    return min_active_cutoff;
+  } else {
+    return beam_cutoff;
+  }
+}
+
+void BatchedFasterDecoder::PossiblyResizeHash(size_t num_states) {
+  size_t new_sz = static_cast<size_t>(static_cast<BaseFloat>(num_states)
+                                      * config_.hash_ratio);
+  if (new_sz > toks_.Size()) {
+    toks_.SetSize(new_sz);
+  }
+}
+
+inline BatchedFasterDecoder::Elem* BatchedFasterDecoder::InsertToken(
+    StateId state, int32 utt, Token *tok) {
+  Elem *e = toks_.Insert(state, NULL);
+  if (e->val == NULL)
+    e->val = NewEntry();
+  StateEntry *entry = e->val;
+  uint64 bit = static_cast<uint64>(1) << utt;
+  Token *&cur_tok = entry->toks[utt];
+  if (cur_tok == NULL) {
+    cur_tok = tok;
+    entry->tok_mask |= bit;
+  } else if (*cur_tok < *tok) {
+    Token::TokenDelete(cur_tok);
+    cur_tok = tok;
+  } else {
+    Token::TokenDelete(tok);
+    return NULL;
+  }
+  bool was_queued = (entry->queued_mask != 0);
+  entry->queued_mask |= bit;
+  return (was_queued ? NULL : e);
+}
+
+void BatchedFasterDecoder::ProcessEmitting(int32 frame, uint64 active_mask) {
+  switch (fst_type_) {
+    case kConstFst:
+      ProcessEmittingTpl<fst::ConstFst<Arc> >(frame, active_mask);
+      break;
+    case kVectorFst:
+      ProcessEmittingTpl<fst::VectorFst<Arc> >(frame, active_mask);
+      break;
+    default:
+      ProcessEmittingTpl<fst::Fst<Arc> >(frame, active_mask);
+  }
+}
+
+void BatchedFasterDecoder::ProcessNonemitting(uint64 active_mask) {
+  switch (fst_type_) {
+    case kConstFst:
+      ProcessNonemittingTpl<fst::ConstFst<Arc> >(active_mask);
+      break;
+    case kVectorFst:
+      ProcessNonemittingTpl<fst::VectorFst<Arc> >(active_mask);
+      break;
+    default:
+      ProcessNonemittingTpl<fst::Fst<Arc> >(active_mask);
+  }
+}
+
+template <typename FstType>
+void BatchedFasterDecoder::ProcessEmittingTpl(int32 frame,
+                                              uint64 active_mask) {
+  // fst_ is really of type FstType; see the constructor.
+  const FstType &fst = static_cast<const FstType&>(fst_);
+  Elem *last_toks = toks_.Clear();
+  ComputeCutoffs(last_toks, active_mask);
+
+  // next_cutoff is the cutoff we use after adding in the log-likes (i.e. for
+  // the next frame).  First process the best token of each utterance to get a
+  // hopefully reasonably tight bound on it.
+  for (uint64 mask = active_mask; mask != 0; mask &= mask - 1) {
+    int32 u = LowestSetBit(mask);
+    UttInfo &info = utts_[u];
+    info.next_cutoff = std::numeric_limits<double>::infinity();
+    if (info.best_tok == NULL) continue;
+    for (fst::ArcIterator<FstType> aiter(fst, info.best_state);
+         !aiter.Done();
+         aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      if (arc.ilabel != 0) {  // we'd propagate..
+        BaseFloat ac_cost = - info.decodable->LogLikelihood(frame, arc.ilabel);
+        double new_weight = arc.weight.Value() + info.best_tok->cost_ + ac_cost;
+        if (new_weight + info.adaptive_beam < info.next_cutoff)
+          info.next_cutoff = new_weight + info.adaptive_beam;
+      }
+    }
+  }
+
+  // the entries are now owned here, in last_toks, and the hash is empty.
+  for (Elem *e = last_toks, *e_tail; e != NULL; e = e_tail) {  // loop this way
+    // because we delete "e" as we go.
+    StateId state = e->key;
+    StateEntry *entry = e->val;
+    // 'live_mask' is the set of utterances whose token on this state survives
+    // pruning; the arcs of the state are visited once for all of them.
+    uint64 live_mask = 0;
+    for (uint64 mask = entry->tok_mask & active_mask; mask != 0;
+         mask &= mask - 1) {
+      int32 u = LowestSetBit(mask);
+      if (entry->toks[u]->cost_ < utts_[u].cutoff)
+        live_mask |= static_cast<uint64>(1) << u;
+    }
+    if (live_mask != 0) {
+      for (fst::ArcIterator<FstType> aiter(fst, state);
+           !aiter.Done();
+           aiter.Next()) {
+        const Arc &arc = aiter.Value();
+        if (arc.ilabel == 0) continue;
+        for (uint64 mask = live_mask; mask != 0; mask &= mask - 1) {
+          int32 u = LowestSetBit(mask);
+          UttInfo &info = utts_[u];
+          Token *tok = entry->toks[u];
+          BaseFloat ac_cost = - info.decodable->LogLikelihood(frame,
+                                                              arc.ilabel);
+          double new_weight = arc.weight.Value() + tok->cost_ + ac_cost;
+          if (new_weight < info.next_cutoff) {  // not pruned..
+            if (new_weight + info.adaptive_beam < info.next_cutoff)
+              info.next_cutoff = new_weight + info.adaptive_beam;
+            InsertToken(arc.nextstate, u, new Token(arc, ac_cost, tok));
+          }
+        }
+      }
+    }
+    e_tail = e->tail;
+    DeleteEntry(entry);
+    toks_.Delete(e);
+  }
+}
+
+template <typename FstType>
+void BatchedFasterDecoder::ProcessNonemittingTpl(uint64 active_mask) {
+  const FstType &fst = static_cast<const FstType&>(fst_);
+  // Processes nonemitting arcs for one frame.
+  KALDI_ASSERT(queue_.empty());
+  for (const Elem *e = toks_.GetList(); e != NULL;  e = e->tail)
+    if (e->val->queued_mask != 0)
+      queue_.push_back(const_cast<Elem*>(e));
+  while (!queue_.empty()) {
+    Elem *e = queue_.back();
+    queue_.pop_back();
+    StateId state = e->key;
+    StateEntry *entry = e->val;
+    uint64 live_mask = 0;
+    for (uint64 mask = entry->queued_mask & active_mask; mask != 0;
+         mask &= mask - 1) {
+      int32 u = LowestSetBit(mask);
+      if (entry->toks[u]->cost_ <= utts_[u].next_cutoff)
+        live_mask |= static_cast<uint64>(1) << u;
+    }
+    entry->queued_mask = 0;
+    if (live_mask == 0)  // Don't bother processing successors.
+      continue;
+    for (fst::ArcIterator<FstType> aiter(fst, state);
+         !aiter.Done();
+         aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      if (arc.ilabel != 0) continue;  // propagate nonemitting only...
+      for (uint64 mask = live_mask; mask != 0; mask &= mask - 1) {
+        int32 u = LowestSetBit(mask);
+        // note: we re-read the token each time, as an epsilon self-loop could
+        // have replaced it.
+        Token *new_tok = new Token(arc, entry->toks[u]);
+        if (new_tok->cost_ > utts_[u].next_cutoff) {  // prune
+          Token::TokenDelete(new_tok);
+        } else {
+          Elem *e_found = InsertToken(arc.nextstate, u, new_tok);
+          if (e_found != NULL)
+            queue_.push_back(e_found);
+        }
+      }
+    }
+  }
+}
+
+void BatchedFasterDecoder::FinishUtterance(int32 utt) {
+  uint64 bit = static_cast<uint64>(1) << utt;
+  UttInfo &info = utts_[utt];
+  KALDI_ASSERT(info.final_toks.empty());
+  for (const Elem *e = toks_.GetList(); e != NULL; e = e->tail) {
+    StateEntry *entry = e->val;
+    if (entry->tok_mask & bit) {
+      info.final_toks.push_back(std::make_pair(e->key, entry->toks[utt]));
+      entry->toks[utt] = NULL;
+      entry->tok_mask &= ~bit;
+      entry->queued_mask &= ~bit;
+    }
+  }
+}
+
+BatchedFasterDecoder::StateEntry* BatchedFasterDecoder::NewEntry() {
+  StateEntry *entry;
+  if (free_entries_.empty()) {
+    entry = new StateEntry();
+  } else {
+    entry = free_entries_.back();
+    free_entries_.pop_back();
+  }
+  entry->toks.assign(utts_.size(), NULL);
+  entry->tok_mask = 0;
+  entry->queued_mask = 0;
+  return entry;
+}
+
+void BatchedFasterDecoder::DeleteEntry(StateEntry *entry) {
+  for (uint64 mask = entry->tok_mask; mask != 0; mask &= mask - 1)
+    Token::TokenDelete(entry->toks[LowestSetBit(mask)]);
+  free_entries_.push_back(entry);
+}
+
+void BatchedFasterDecoder::ClearToks(Elem *list) {
+  for (Elem *e = list, *e_tail; e != NULL; e = e_tail) {
+    DeleteEntry(e->val);
+    e_tail = e->tail;
+    toks_.Delete(e);
+  }
+}
+
+void BatchedFasterDecoder::ClearFinalToks() {
+  for (size_t u = 0; u < utts_.size(); u++) {
+    std::vector<std::pair<StateId, Token*> > &final_toks = utts_[u].final_toks;
+    for (size_t i = 0; i < final_toks.size(); i++)
+      Token::TokenDelete(final_toks[i].second);
+    final_toks.clear();
+  }
+}
+
+} // end namespace kaldi.
@@ -0,0 +1,222 @@
+// decoder/batched-faster-decoder.h
+
+// Copyright 2009-2011  Microsoft Corporation
+//                2013  Johns Hopkins University (author: Daniel Povey)
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_BATCHED_FASTER_DECODER_H_
+#define KALDI_DECODER_BATCHED_FASTER_DECODER_H_
+
+#include "util/stl-utils.h"
+#include "itf/options-itf.h"
+#include "util/hash-list.h"
+#include "fst/fstlib.h"
+#include "itf/decodable-itf.h"
+#include "lat/kaldi-lattice.h" // for CompactLatticeArc
+#include "decoder/faster-decoder.h"  // for FasterDecoderOptions
+
+namespace kaldi {
+
+/**
+   BatchedFasterDecoder decodes several utterances at once, frame-synchronously,
+   against a single shared graph.  It is the CPU analogue of what
+   cudadecoder/cuda-decoder.h does on GPU: the tokens of all utterances in the
+   batch that sit on the same FST state are grouped together, so the arcs
+   leaving that state are fetched (and their ArcIterator constructed) once per
+   frame for the whole batch rather than once per utterance.  On dense batches
+   of utterances decoded with a large HCLG this reduces cache traffic
+   considerably compared with running one FasterDecoder per thread.
+
+   The search itself (beam, max-active, min-active, adaptive beam) is identical
+   to FasterDecoder's, applied separately for each utterance, so the output for
+   each utterance is equivalent to FasterDecoder's up to tie-breaking: tokens
+   are visited in a different order, so where two paths have the same cost a
+   different one may be kept.  The batch size is limited to kMaxBatchSize
+   utterances.
+
+   Utterances may have different lengths; an utterance stops taking part in the
+   search after its last frame, and its final tokens are kept for traceback.
+ */
+class BatchedFasterDecoder {
+ public:
+  typedef fst::StdArc Arc;
+  typedef Arc::Label Label;
+  typedef Arc::StateId StateId;
+  typedef Arc::Weight Weight;
+
+  // Utterance masks are stored in a uint64, which limits the batch size.
+  static const int32 kMaxBatchSize = 64;
+
+  BatchedFasterDecoder(const fst::Fst<fst::StdArc> &fst,
+                       const FasterDecoderOptions &config);
+
+  void SetOptions(const FasterDecoderOptions &config) { config_ = config; }
+
+  ~BatchedFasterDecoder();
+
+  /// Decodes all the utterances in 'decodables' (at most kMaxBatchSize of
+  /// them) together.  All frames ready in each decodable object are decoded
+  /// (this decoder is intended for offline use).  The decodable objects must
+  /// remain valid until this call returns.
+  void Decode(const std::vector<DecodableInterface*> &decodables);
+
+  /// Returns the number of utterances in the batch last decoded.
+  int32 NumUtterances() const { return static_cast<int32>(utts_.size()); }
+
+  /// Returns the number of frames decoded for utterance 'utt'.
+  int32 NumFramesDecoded(int32 utt) const;
+
+  /// Returns true if a final state was active on the last frame of
+  /// utterance 'utt'.
+  bool ReachedFinal(int32 utt) const;
+
+  /// GetBestPath gets the decoding traceback of utterance 'utt'; its
+  /// behavior is the same as FasterDecoder::GetBestPath().
+  bool GetBestPath(int32 utt, fst::MutableFst<LatticeArc> *fst_out,
+                   bool use_final_probs = true) const;
+
+ protected:
+  // The token type is the same as FasterDecoder's.
+  class Token {
+   public:
+    Arc arc_;
+    Token *prev_;
+    int32 ref_count_;
+    double cost_;
+    inline Token(const Arc &arc, BaseFloat ac_cost, Token *prev):
+        arc_(arc), prev_(prev), ref_count_(1) {
+      if (prev) {
+        prev->ref_count_++;
+        cost_ = prev->cost_ + arc.weight.Value() + ac_cost;
+      } else {
+        cost_ = arc.weight.Value() + ac_cost;
+      }
+    }
+    inline Token(const Arc &arc, Token *prev):
+        arc_(arc), prev_(prev), ref_count_(1) {
+      if (prev) {
+        prev->ref_count_++;
+        cost_ = prev->cost_ + arc.weight.Value();
+      } else {
+        cost_ = arc.weight.Value();
+      }
+    }
+    inline bool operator < (const Token &other) {
+      return cost_ > other.cost_;
+    }
+    inline static void TokenDelete(Token *tok) {
+      while (--tok->ref_count_ == 0) {
+        Token *prev = tok->prev_;
+        delete tok;
+        if (prev == NULL) return;
+        else tok = prev;
+      }
+    }
+  };
+
+  // StateEntry holds, for one FST state, the token of each utterance in the
+  // batch that is currently on that state (NULL if none).
+  struct StateEntry {
+    std::vector<Token*> toks;  // indexed by utterance; size == batch size.
+    uint64 tok_mask;  // bit u is set iff toks[u] != NULL.
+    uint64 queued_mask;  // utterances whose token here still has to have its
+                         // epsilon arcs expanded in ProcessNonemitting().
+  };
+
+  typedef HashList<StateId, StateEntry*>::Elem Elem;
+
+  // Per-utterance search state.
+  struct UttInfo {
+    DecodableInterface *decodable;
+    int32 num_frames;  // number of frames to decode.
+    // Cutoff applied to the tokens of the previous frame, and cutoff applied
+    // to the new tokens of the current frame (set in ProcessEmitting()).
+    double cutoff;
+    double next_cutoff;
+    BaseFloat adaptive_beam;
+    // Best token (with its state) on the previous frame; may be NULL.
+    Token *best_tok;
+    StateId best_state;
+    // Final tokens, kept once the utterance has finished.
+    std::vector<std::pair<StateId, Token*> > final_toks;
+  };
+
+  // Works out, for each active utterance, the cutoff, the adaptive beam and
+  // the best token on the list starting at 'list_head'.
+  void ComputeCutoffs(const Elem *list_head, uint64 active_mask);
+
+  // Works out the cutoff from the costs in 'costs' (which it may reorder);
+  // this is the same computation as FasterDecoder::GetCutoff().
+  double GetCutoff(std::vector<BaseFloat> *costs, double best_cost,
+                   BaseFloat *adaptive_beam) const;
+
+  void PossiblyResizeHash(size_t num_toks);
+
+  // Processes emitting arcs of frame 'frame' for the utterances in
+  // 'active_mask'.  Sets utts_[u].next_cutoff, which is the cutoff used in
+  // ProcessNonemitting().
+  void ProcessEmitting(int32 frame, uint64 active_mask);
+
+  // Processes nonemitting arcs for the utterances in 'active_mask'.  Expects
+  // the utterances to be processed to be set in queued_mask of each entry.
+  void ProcessNonemitting(uint64 active_mask);
+
+  // The versions of ProcessEmitting() and ProcessNonemitting() that do the
+  // work, templated on the actual type of fst_ (as in FasterDecoder).
+  template <typename FstType>
+  void ProcessEmittingTpl(int32 frame, uint64 active_mask);
+  template <typename FstType>
+  void ProcessNonemittingTpl(uint64 active_mask);
+
+  // Moves the tokens of utterance 'utt' out of toks_ and into
+  // utts_[utt].final_toks.
+  void FinishUtterance(int32 utt);
+
+  // Inserts 'tok' as the token of utterance 'utt' for state 'state', if
+  // it is better than the existing one; takes ownership of 'tok'.  Returns the
+  // Elem if it has to be added to the queue of ProcessNonemitting() (i.e. the
+  // token was kept and no other token on that state was already queued), else
+  // NULL.
+  inline Elem *InsertToken(StateId state, int32 utt, Token *tok);
+
+  StateEntry *NewEntry();
+  void DeleteEntry(StateEntry *entry);
+
+  // Deletes all tokens and entries on the list, and gives the Elems back to
+  // toks_.
+  void ClearToks(Elem *list);
+  // Deletes the final tokens of all utterances.
+  void ClearFinalToks();
+
+  HashList<StateId, StateEntry*> toks_;
+  const fst::Fst<fst::StdArc> &fst_;
+  // The actual type of fst_, worked out in the constructor.
+  enum { kOtherFst, kConstFst, kVectorFst } fst_type_;
+  FasterDecoderOptions config_;
+  std::vector<UttInfo> utts_;
+  std::vector<Elem*> queue_;  // temp variable used in ProcessNonemitting.
+  std::vector<std::vector<BaseFloat> > tmp_costs_;  // used in ComputeCutoffs.
+  std::vector<StateEntry*> free_entries_;  // pool of unused entries.
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(BatchedFasterDecoder);
+};
+
+
+} // end namespace kaldi.
+
+
+#endif
@@ -0,0 +1,192 @@
+// decoder/dynamic-compose-fst.cc
+
+// Copyright 2026  agent <agent@local>
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder/dynamic-compose-fst.h"
+
+namespace fst {
+
+
+DynamicComposeFst::DynamicComposeFst(
+    const DynamicComposeFstOptions &opts,
+    const ConstFst<StdArc> &hcl_fst,
+    DeterministicOnDemandFst<StdArc> *g_fst,
+    const std::vector<int32> &disambig_syms):
+    opts_(opts), hcl_fst_(hcl_fst), g_fst_(g_fst),
+    disambig_syms_(disambig_syms),
+    cache_size_bytes_(static_cast<size_t>(opts.cache_size_mb) << 20),
+    access_count_(0) {
+  opts_.Check();
+  KALDI_ASSERT(hcl_fst_.Start() != kNoStateId && g_fst_->Start() != kNoStateId);
+  StateId num_states = hcl_fst_.NumStates();
+  has_input_eps_.resize(num_states, 0);
+  for (StateId s = 0; s < num_states; s++) {
+    for (ArcIterator<ConstFst<StdArc> > aiter(hcl_fst_, s); !aiter.Done();
+         aiter.Next()) {
+      Label ilabel = aiter.Value().ilabel;
+      if (ilabel == 0 || disambig_syms_.count(ilabel) != 0) {
+        has_input_eps_[s] = 1;
+        break;
+      }
+    }
+  }
+}
+
+DynamicComposeFst::~DynamicComposeFst() {
+  ClearStates();
+}
+
+DynamicComposeFst::StateId DynamicComposeFst::Start() const {
+  DynamicComposeFst *self = const_cast<DynamicComposeFst*>(this);
+  return self->FindState(hcl_fst_.Start(), g_fst_->Start());
+}
+
+DynamicComposeFst::Weight DynamicComposeFst::Final(StateId s) const {
+  const ComposedState &state = states_[s];
+  Weight hcl_final = hcl_fst_.Final(state.hcl_state);
+  if (hcl_final == Weight::Zero())
+    return hcl_final;
+  return Times(hcl_final, g_fst_->Final(state.g_state));
+}
+
+DynamicComposeFst::StateId DynamicComposeFst::FindState(StateId hcl_state,
+                                                        StateId g_state) {
+  std::pair<StateId, StateId> pr(hcl_state, g_state);
+  typedef std::unordered_map<std::pair<StateId, StateId>, StateId,
+                             kaldi::PairHasher<StateId> >::iterator IterType;
+  std::pair<IterType, bool> ans =
+      state_map_.insert(std::make_pair(pr, static_cast<StateId>(0)));
+  if (ans.second) {
+    ans.first->second = states_.size();
+    states_.push_back(ComposedState(hcl_state, g_state));
+    stats_.num_states = states_.size();
+  }
+  return ans.first->second;
+}
+
+const std::vector<DynamicComposeFst::Arc>& DynamicComposeFst::GetArcs(
+    StateId s) {
+  KALDI_ASSERT(static_cast<size_t>(s) < states_.size());
+  std::vector<Arc> *arcs = states_[s].arcs;
+  if (arcs != NULL) {
+    stats_.num_cache_hits++;
+  } else {
+    // Note: ExpandState() may add states, invalidating references into
+    // states_.
+    arcs = ExpandState(s);
+    states_[s].arcs = arcs;
+    stats_.num_expansions++;
+    stats_.num_expanded++;
+    stats_.cur_bytes += ArcBytes(*arcs);
+    if (stats_.cur_bytes > stats_.peak_bytes)
+      stats_.peak_bytes = stats_.cur_bytes;
+    if (stats_.cur_bytes > cache_size_bytes_)
+      GarbageCollect(s);
+  }
+  states_[s].last_access = access_count_++;
+  return *arcs;
+}
+
+std::vector<DynamicComposeFst::Arc>* DynamicComposeFst::ExpandState(
+    StateId s) {
+  StateId hcl_state = states_[s].hcl_state,
+      g_state = states_[s].g_state;
+  std::vector<Arc> *arcs = new std::vector<Arc>();
+  arcs->reserve(hcl_fst_.NumArcs(hcl_state));
+  for (ArcIterator<ConstFst<StdArc> > aiter(hcl_fst_, hcl_state);
+       !aiter.Done(); aiter.Next()) {
+    const StdArc &hcl_arc = aiter.Value();
+    Label ilabel = hcl_arc.ilabel;
+    if (ilabel != 0 && disambig_syms_.count(ilabel) != 0)
+      ilabel = 0;
+    if (hcl_arc.olabel == 0) {
+      arcs->push_back(Arc(ilabel, 0, hcl_arc.weight,
+                          FindState(hcl_arc.nextstate, g_state)));
+    } else {
+      StdArc g_arc;
+      if (g_fst_->GetArc(g_state, hcl_arc.olabel, &g_arc))
+        arcs->push_back(Arc(ilabel, hcl_arc.olabel,
+                            Times(hcl_arc.weight, g_arc.weight),
+                            FindState(hcl_arc.nextstate, g_arc.nextstate)));
+      // else the word is not allowed by the LM from this state: no arc.
+    }
+  }
+  // we reserved space for all HCL arcs; give back what we did not use.
+  if (arcs->capacity() > 2 * arcs->size())
+    std::vector<Arc>(*arcs).swap(*arcs);
+  return arcs;
+}
+
+void DynamicComposeFst::GarbageCollect(StateId keep) {
+  std::vector<std::pair<int64, StateId> > expanded;
+  expanded.reserve(stats_.num_expanded);
+  for (size_t s = 0; s < states_.size(); s++)
+    if (states_[s].arcs != NULL && static_cast<StateId>(s) != keep)
+      expanded.push_back(std::make_pair(states_[s].last_access,
+                                        static_cast<StateId>(s)));
+  std::sort(expanded.begin(), expanded.end());
+  size_t target_bytes = static_cast<size_t>(cache_size_bytes_ *
+                                            opts_.gc_fraction);
+  for (size_t i = 0; i < expanded.size() && stats_.cur_bytes > target_bytes;
+       i++) {
+    ComposedState &state = states_[expanded[i].second];
+    stats_.cur_bytes -= ArcBytes(*state.arcs);
+    delete state.arcs;
+    state.arcs = NULL;
+    stats_.num_expanded--;
+    stats_.num_evicted++;
+  }
+  stats_.num_gc++;
+  KALDI_VLOG(2) << "Garbage-collected dynamic-composition cache, size is now "
+                << stats_.cur_bytes << " bytes for " << stats_.num_expanded
+                << " states.";
+}
+
+void DynamicComposeFst::ClearStates() {
+  for (size_t s = 0; s < states_.size(); s++)
+    delete states_[s].arcs;
+  states_.clear();
+  state_map_.clear();
+  stats_.num_states = 0;
+  stats_.num_expanded = 0;
+  stats_.cur_bytes = 0;
+}
+
+void DynamicComposeFst::MaybeResetStateTable() {
+  if (states_.size() > static_cast<size_t>(opts_.max_states)) {
+    KALDI_VLOG(1) << "Clearing dynamic-composition state table with "
+                  << states_.size() << " states.";
+    ClearStates();
+    stats_.num_state_table_resets++;
+  }
+}
+
+void DynamicComposeFst::PrintStats() const {
+  KALDI_LOG << "Dynamic composition: " << stats_.num_states
+            << " states in table, " << stats_.num_expanded
+            << " with cached arcs (" << (stats_.cur_bytes >> 20)
+            << " MB; peak " << (stats_.peak_bytes >> 20) << " MB); "
+            << stats_.num_expansions << " expansions, "
+            << stats_.num_cache_hits << " cache hits, "
+            << stats_.num_evicted << " evictions in " << stats_.num_gc
+            << " garbage collections, " << stats_.num_state_table_resets
+            << " state-table resets.";
+}
+
+
+}  // namespace fst
@@ -0,0 +1,260 @@
+// decoder/dynamic-compose-fst.h
+
+// Copyright 2026  agent <agent@local>
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_DYNAMIC_COMPOSE_FST_H_
+#define KALDI_DECODER_DYNAMIC_COMPOSE_FST_H_
+
+/**
+   This header implements a special FST type, DynamicComposeFst, which composes
+   an HCL graph with a language model G on the fly, during decoding.  Like
+   GrammarFst, it is not a "real" OpenFst FST: it only has the interface that
+   the decoders need (Start(), Final(), NumInputEpsilons(), Type() and an
+   ArcIterator specialization).
+
+   Compared with the generic ComposeFst used by fst::LookaheadComposeFst() (see
+   fstext-utils.h), the memory used for cached arcs is bounded by a
+   user-specified budget: when it is exceeded, the arcs of the least recently
+   visited composed states are discarded (they are recomputed if those states
+   become active again).  The table that maps (HCL-state, G-state) pairs to
+   composed state-ids is cleared between utterances once it grows beyond a
+   configurable size, which garbage-collects the composed states that are no
+   longer reachable.  Statistics about the cache are kept and can be printed.
+ */
+
+
+#include <unordered_map>
+#include "fst/fstlib.h"
+#include "itf/options-itf.h"
+#include "fstext/deterministic-fst.h"
+#include "util/stl-utils.h"
+#include "util/const-integer-set.h"
+
+namespace fst {
+
+
+struct DynamicComposeFstOptions {
+  kaldi::int32 cache_size_mb;
+  kaldi::BaseFloat gc_fraction;
+  kaldi::int32 max_states;
+
+  DynamicComposeFstOptions(): cache_size_mb(512),
+                              gc_fraction(0.5),
+                              max_states(20000000) { }
+
+  void Register(kaldi::OptionsItf *opts) {
+    opts->Register("compose-cache-size", &cache_size_mb, "Memory budget, in "
+                   "megabytes, for the arcs of composed states cached by the "
+                   "dynamic composition.");
+    opts->Register("compose-gc-fraction", &gc_fraction, "When the cache "
+                   "exceeds its budget, cached arcs of the least recently used "
+                   "states are discarded until its size is this fraction of "
+                   "the budget.");
+    opts->Register("compose-max-states", &max_states, "If the number of "
+                   "composed states exceeds this, the state table is cleared "
+                   "before the next utterance.");
+  }
+  void Check() const {
+    KALDI_ASSERT(cache_size_mb > 0 && gc_fraction > 0.0 && gc_fraction < 1.0 &&
+                 max_states > 0);
+  }
+};
+
+
+class DynamicComposeFst;
+
+// Declare that we'll be overriding class ArcIterator for class
+// DynamicComposeFst.
+template<> class ArcIterator<DynamicComposeFst>;
+
+
+/**
+   DynamicComposeFst represents the composition of an HCL graph (whose output
+   labels are words) with a language model presented as a
+   DeterministicOnDemandFst, e.g. a BackoffDeterministicOnDemandFst wrapping
+   G.fst.  Input symbols of HCL that are in 'disambig_syms' are replaced with
+   epsilon.
+
+   An HCL arc with output epsilon leaves the G state unchanged; an arc with
+   output label w takes the G arc for w (following backoff arcs as the
+   DeterministicOnDemandFst does), and is dropped if there is none.  The LM
+   weight is therefore applied at the point where the word label appears in
+   HCL, which for graphs built with Kaldi's lexicon FST is the first arc of the
+   word, so no explicit lookahead is needed for good pruning.
+
+   This class is not thread safe, but several threads can each use their own
+   instance sharing the same HCL and G (if the G object is thread safe, or one
+   G object per thread is used).  Only one ArcIterator may be in use at a time.
+ */
+class DynamicComposeFst {
+ public:
+  typedef StdArc Arc;
+  typedef TropicalWeight Weight;
+  typedef Arc::StateId StateId;
+  typedef Arc::Label Label;
+
+  struct Stats {
+    size_t num_states;  // current size of the state table.
+    size_t num_expanded;  // number of states whose arcs are currently cached.
+    int64 num_expansions;  // number of times a state's arcs were computed.
+    int64 num_cache_hits;  // number of times cached arcs were reused.
+    int64 num_evicted;  // number of states whose cached arcs were discarded.
+    int64 num_gc;  // number of garbage collections of the arc cache.
+    int64 num_state_table_resets;
+    size_t cur_bytes;  // memory currently used by cached arcs.
+    size_t peak_bytes;
+    Stats(): num_states(0), num_expanded(0), num_expansions(0),
+             num_cache_hits(0), num_evicted(0), num_gc(0),
+             num_state_table_resets(0), cur_bytes(0), peak_bytes(0) { }
+  };
+
+  /**
+     Constructor.  This does not take ownership of any of its pointer/reference
+     arguments, which must outlive this object.
+       @param [in] opts  The options, e.g. the memory budget.
+       @param [in] hcl_fst  The HCL graph, with words as output labels.  As for
+                 GrammarFst, for simplicity we require a ConstFst; if the FST
+                 was read from disk it may already be of that type.
+       @param [in] g_fst  The language model, whose input labels are words.
+       @param [in] disambig_syms  Input symbols of 'hcl_fst' to be replaced
+                 with epsilon (the disambiguation symbols).
+  */
+  DynamicComposeFst(const DynamicComposeFstOptions &opts,
+                    const ConstFst<StdArc> &hcl_fst,
+                    DeterministicOnDemandFst<StdArc> *g_fst,
+                    const std::vector<int32> &disambig_syms);
+
+  StateId Start() const;
+
+  Weight Final(StateId s) const;
+
+  // This is called in LatticeFasterDecoder.  We return 1 if the HCL state has
+  // any arcs with epsilon (or disambiguation-symbol) input, meaning 'yes,
+  // there may be input epsilons'; the calling code doesn't care about the
+  // exact number.
+  inline size_t NumInputEpsilons(StateId s) const {
+    return has_input_eps_[states_[s].hcl_state];
+  }
+
+  inline std::string Type() const { return "dynamic-compose"; }
+
+  /// Clears the state table if it has grown beyond opts.max_states, which
+  /// discards composed states that are no longer reachable.  This invalidates
+  /// all state-ids, so it must only be called between utterances, i.e. before
+  /// the decoder's InitDecoding().
+  void MaybeResetStateTable();
+
+  const Stats &GetStats() const { return stats_; }
+
+  /// Prints the statistics with KALDI_LOG.
+  void PrintStats() const;
+
+  ~DynamicComposeFst();
+
+ private:
+  friend class ArcIterator<DynamicComposeFst>;
+
+  struct ComposedState {
+    StateId hcl_state;
+    StateId g_state;
+    // The arcs leaving this state, or NULL if they are not currently cached.
+    std::vector<Arc> *arcs;
+    // Value of access_count_ when the arcs were last visited.
+    int64 last_access;
+    ComposedState(StateId hcl_state, StateId g_state):
+        hcl_state(hcl_state), g_state(g_state), arcs(NULL), last_access(0) { }
+  };
+
+  // Returns the state-id for the pair (hcl_state, g_state), adding it to the
+  // state table if needed.
+  StateId FindState(StateId hcl_state, StateId g_state);
+
+  // Returns the arcs leaving state s, computing them if they are not cached.
+  // The returned pointer is valid until the next call to this function.
+  const std::vector<Arc> &GetArcs(StateId s);
+
+  // Computes the arcs leaving state s.
+  std::vector<Arc> *ExpandState(StateId s);
+
+  // Discards the cached arcs of the least recently used states (other than
+  // state 'keep') until the cache size is below opts_.gc_fraction times the
+  // budget.
+  void GarbageCollect(StateId keep);
+
+  // Frees all cached arcs and clears the state table.
+  void ClearStates();
+
+  static inline size_t ArcBytes(const std::vector<Arc> &arcs) {
+    return sizeof(arcs) + arcs.capacity() * sizeof(Arc);
+  }
+
+  DynamicComposeFstOptions opts_;
+  const ConstFst<StdArc> &hcl_fst_;
+  DeterministicOnDemandFst<StdArc> *g_fst_;
+  kaldi::ConstIntegerSet<Label> disambig_syms_;
+  // has_input_eps_[s] is 1 if HCL state s has arcs whose input label is
+  // epsilon or a disambiguation symbol.
+  std::vector<char> has_input_eps_;
+  size_t cache_size_bytes_;
+
+  std::vector<ComposedState> states_;
+  std::unordered_map<std::pair<StateId, StateId>, StateId,
+                     kaldi::PairHasher<StateId> > state_map_;
+  int64 access_count_;
+  Stats stats_;
+};
+
+
+/**
+   This is the overridden template for class ArcIterator for
+   DynamicComposeFst.  As for ArcIterator<GrammarFst>, it only implements what
+   the decoder needs.
+ */
+template <>
+class ArcIterator<DynamicComposeFst> {
+ public:
+  using Arc = typename DynamicComposeFst::Arc;
+  using StateId = typename Arc::StateId;
+
+  // Caution: uses const_cast to evade const rules on DynamicComposeFst.  This
+  // is for compatibility with how things work in OpenFst.
+  inline ArcIterator(const DynamicComposeFst &fst_in, StateId s) {
+    DynamicComposeFst &fst = const_cast<DynamicComposeFst&>(fst_in);
+    const std::vector<Arc> &arcs = fst.GetArcs(s);
+    arcs_ = (arcs.empty() ? NULL : &(arcs[0]));
+    narcs_ = arcs.size();
+    i_ = 0;
+  }
+
+  inline bool Done() const { return i_ >= narcs_; }
+
+  inline void Next() { i_++; }
+
+  inline const Arc &Value() const { return arcs_[i_]; }
+
+ private:
+  const Arc *arcs_;
+  size_t narcs_;
+  size_t i_;
+};
+
+
+}  // namespace fst
+
+
+#endif  // KALDI_DECODER_DYNAMIC_COMPOSE_FST_H_
@@ -25,7 +25,11 @@ namespace kaldi {
 
 FasterDecoder::FasterDecoder(const fst::Fst<fst::StdArc> &fst,
                              const FasterDecoderOptions &opts):
-    fst_(fst), config_(opts), num_frames_decoded_(-1) {
+    fst_(fst), fst_type_(kOtherFst), config_(opts), num_frames_decoded_(-1) {
+  if (fst_.Type() == "const")
+    fst_type_ = kConstFst;
+  else if (fst_.Type() == "vector")
+    fst_type_ = kVectorFst;
   KALDI_ASSERT(config_.hash_ratio >= 1.0);  // less doesn't make much sense.
   KALDI_ASSERT(config_.max_active > 1);
   KALDI_ASSERT(config_.min_active >= 0 && config_.min_active < config_.max_active);
@@ -219,6 +223,33 @@ void FasterDecoder::PossiblyResizeHash(size_t num_toks) {
 
 // ProcessEmitting returns the likelihood cutoff used.
 double FasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
+  switch (fst_type_) {
+    case kConstFst:
+      return ProcessEmittingTpl<fst::ConstFst<Arc> >(decodable);
+    case kVectorFst:
+      return ProcessEmittingTpl<fst::VectorFst<Arc> >(decodable);
+    default:
+      return ProcessEmittingTpl<fst::Fst<Arc> >(decodable);
+  }
+}
+
+void FasterDecoder::ProcessNonemitting(double cutoff) {
+  switch (fst_type_) {
+    case kConstFst:
+      ProcessNonemittingTpl<fst::ConstFst<Arc> >(cutoff);
+      break;
+    case kVectorFst:
+      ProcessNonemittingTpl<fst::VectorFst<Arc> >(cutoff);
+      break;
+    default:
+      ProcessNonemittingTpl<fst::Fst<Arc> >(cutoff);
+  }
+}
+
+template <typename FstType>
+double FasterDecoder::ProcessEmittingTpl(DecodableInterface *decodable) {
+  // fst_ is really of type FstType; see the constructor.
+  const FstType &fst = static_cast<const FstType&>(fst_);
   int32 frame = num_frames_decoded_;
   Elem *last_toks = toks_.Clear();
   size_t tok_cnt;
@@ -239,7 +270,7 @@ double FasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
   if (best_elem) {
     StateId state = best_elem->key;
     Token *tok = best_elem->val;
-    for (fst::ArcIterator<fst::Fst<Arc> > aiter(fst_, state);
+    for (fst::ArcIterator<FstType> aiter(fst, state);
          !aiter.Done();
          aiter.Next()) {
       const Arc &arc = aiter.Value();
@@ -265,7 +296,7 @@ double FasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
     if (tok->cost_ < weight_cutoff) {  // not pruned.
       // np++;
       KALDI_ASSERT(state == tok->arc_.nextstate);
-      for (fst::ArcIterator<fst::Fst<Arc> > aiter(fst_, state);
+      for (fst::ArcIterator<FstType> aiter(fst, state);
            !aiter.Done();
            aiter.Next()) {
         Arc arc = aiter.Value();
@@ -298,7 +329,9 @@ double FasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
 }
 
 // TODO: first time we go through this, could avoid using the queue.
-void FasterDecoder::ProcessNonemitting(double cutoff) {
+template <typename FstType>
+void FasterDecoder::ProcessNonemittingTpl(double cutoff) {
+  const FstType &fst = static_cast<const FstType&>(fst_);
   // Processes nonemitting arcs for one frame.
   KALDI_ASSERT(queue_.empty());
   for (const Elem *e = toks_.GetList(); e != NULL;  e = e->tail)
@@ -313,7 +346,7 @@ void FasterDecoder::ProcessNonemitting(double cutoff) {
       continue;
     }
     KALDI_ASSERT(tok != NULL && state == tok->arc_.nextstate);
-    for (fst::ArcIterator<fst::Fst<Arc> > aiter(fst_, state);
+    for (fst::ArcIterator<FstType> aiter(fst, state);
          !aiter.Done();
          aiter.Next()) {
       const Arc &arc = aiter.Value();
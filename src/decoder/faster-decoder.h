@@ -164,11 +164,23 @@ class FasterDecoder {
   // TODO: first time we go through this, could avoid using the queue.
   void ProcessNonemitting(double cutoff);
 
+  // The versions of ProcessEmitting() and ProcessNonemitting() that do the
+  // work; they are templated on the actual type of fst_ so that, for
+  // ConstFst and VectorFst, the arc iteration is not done through virtual
+  // functions.
+  template <typename FstType>
+  double ProcessEmittingTpl(DecodableInterface *decodable);
+  template <typename FstType>
+  void ProcessNonemittingTpl(double cutoff);
+
   // HashList defined in ../util/hash-list.h.  It actually allows us to maintain
   // more than one list (e.g. for current and previous frames), but only one of
   // them at a time can be indexed by StateId.
   HashList<StateId, Token*> toks_;
   const fst::Fst<fst::StdArc> &fst_;
+  // The actual type of fst_, worked out in the constructor; it decides which
+  // version of ProcessEmittingTpl() and ProcessNonemittingTpl() is used.
+  enum { kOtherFst, kConstFst, kVectorFst } fst_type_;
   FasterDecoderOptions config_;
   std::vector<const Elem* > queue_;  // temp variable used in ProcessNonemitting,
   std::vector<BaseFloat> tmp_array_;  // used in GetCutoff.
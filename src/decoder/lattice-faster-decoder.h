@@ -32,6 +32,7 @@
 #include "lat/determinize-lattice-pruned.h"
 #include "lat/kaldi-lattice.h"
 #include "decoder/grammar-fst.h"
+#include "decoder/dynamic-compose-fst.h"
 
 namespace kaldi {
 
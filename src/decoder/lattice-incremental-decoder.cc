@@ -52,6 +52,13 @@ LatticeIncrementalDecoderTpl<FST, Token>::LatticeIncrementalDecoderTpl(
 
 template <typename FST, typename Token>
 LatticeIncrementalDecoderTpl<FST, Token>::~LatticeIncrementalDecoderTpl() {
+  // Not WaitForDeterminization(): we must not throw from the destructor.
+  if (determinize_thread_.joinable()) {
+    determinize_thread_.join();
+    if (determinize_error_)
+      KALDI_WARN << "Ignoring the error from lattice determinization, as the "
+                 << "decoder is being destroyed.";
+  }
   DeleteElems(toks_.Clear());
   ClearActiveTokens();
   if (delete_fst_) delete fst_;
@@ -60,6 +67,7 @@ LatticeIncrementalDecoderTpl<FST, Token>::~LatticeIncrementalDecoderTpl() {
 template <typename FST, typename Token>
 void LatticeIncrementalDecoderTpl<FST, Token>::InitDecoding() {
   // clean up from last time:
+  WaitForDeterminization();
   DeleteElems(toks_.Clear());
   cost_offsets_.clear();
   ClearActiveTokens();
@@ -110,10 +118,59 @@ void LatticeIncrementalDecoderTpl<FST, Token>::UpdateLatticeDeterminization() {
   }
   /* OK, determinize the chunk that spans from num_frames_in_lattice_ to
      best_frame. */
-  bool use_final_probs = false;
-  GetLattice(best_frame, use_final_probs);
+  if (config_.determinize_async) {
+    DeterminizeChunkAsync(best_frame);
+  } else {
+    bool use_final_probs = false;
+    GetLattice(best_frame, use_final_probs);
+  }
   return;
 }
+
+template <typename FST, typename Token>
+void LatticeIncrementalDecoderTpl<FST, Token>::DeterminizeChunkAsync(
+    int32 num_frames_to_include) {
+  // The previous chunk must have been determinized before we can create the
+  // next raw chunk, as its initial states come from determinizer_.
+  WaitForDeterminization();
+  KALDI_ASSERT(num_frames_to_include > num_frames_in_lattice_ &&
+               num_frames_to_include <= NumFramesDecoded() &&
+               !decoding_finalized_);
+  if (num_frames_in_lattice_ > 0 &&
+      determinizer_.GetLattice().NumStates() == 0) {
+    // Something went wrong earlier; see the same check in GetLattice().
+    num_frames_in_lattice_ = num_frames_to_include;
+    return;
+  }
+  // Creating the raw chunk reads the tokens, so it is done on this thread;
+  // after this the chunk is independent of the search.
+  pending_chunk_.DeleteStates();
+  if (!GetRawLatticeChunk(num_frames_to_include, &pending_chunk_))
+    return;
+  num_frames_in_lattice_ = num_frames_to_include;
+  determinize_thread_ = std::thread([this] () {
+      try {
+        determinizer_.AcceptRawLatticeChunk(&pending_chunk_);
+        // The same as what GetLattice() does with use_final_probs == false.
+        if (determinizer_.GetLattice().NumStates() != 0)
+          determinizer_.SetFinalCosts(NULL);
+      } catch (...) {
+        determinize_error_ = std::current_exception();
+      }
+    });
+}
+
+template <typename FST, typename Token>
+void LatticeIncrementalDecoderTpl<FST, Token>::WaitForDeterminization() {
+  if (determinize_thread_.joinable()) {
+    determinize_thread_.join();
+    if (determinize_error_) {
+      std::exception_ptr error = determinize_error_;
+      determinize_error_ = nullptr;
+      std::rethrow_exception(error);
+    }
+  }
+}
 // Returns true if any kind of traceback is available (not necessarily from
 // a final state).  It should only very rarely return false; this indicates
 // an unusual search error.
@@ -866,10 +923,174 @@ void LatticeIncrementalDecoderTpl<
 }
 
 
+template <typename FST, typename Token>
+bool LatticeIncrementalDecoderTpl<FST, Token>::GetRawLatticeChunk(
+    int32 num_frames_to_include, Lattice *chunk_lat) {
+  /* Make sure the token-pruning is up to date.   If we just pruned the tokens,
+     this will do very little work. */
+  PruneActiveTokens(config_.lattice_beam * config_.prune_scale);
+
+  if (determinizer_.GetLattice().NumStates() == 0 ||
+      determinizer_.GetLattice().Final(0) != CompactLatticeWeight::Zero()) {
+    num_frames_in_lattice_ = 0;
+    determinizer_.Init();
+  }
+
+  unordered_map<Label, LatticeArc::StateId> token_label2state;
+  if (num_frames_in_lattice_ != 0) {
+    determinizer_.InitializeRawLatticeChunk(chunk_lat,
+                                            &token_label2state);
+  }
+
+  // tok_map will map from Token* to state-id in chunk_lat.
+  // The cur and prev versions alternate on different frames.
+  unordered_map<Token*, StateId> &tok2state_map(temp_token_map_);
+  tok2state_map.clear();
+
+  unordered_map<Token*, Label> &next_token2label_map(token2label_map_temp_);
+  next_token2label_map.clear();
+
+  { // Deal with the last frame in the chunk, the one numbered `num_frames_to_include`.
+    // (Yes, this is backwards).   We allocate token labels, and set tokens as
+    // final, but don't add any transitions.  This may leave some states
+    // disconnected (e.g. due to chains of nonemitting arcs), but it's OK; we'll
+    // fix it when we generate the next chunk of lattice.
+    int32 frame = num_frames_to_include;
+    // Allocate state-ids for all tokens on this frame.
+
+    for (Token *tok = active_toks_[frame].toks; tok != NULL; tok = tok->next) {
+      /* If we included the final-costs at this stage, they will cause
+         non-final states to be pruned out from the end of the lattice. */
+      BaseFloat final_cost;
+      {  // This block computes final_cost
+        if (decoding_finalized_) {
+          if (final_costs_.empty()) {
+            final_cost = 0.0;  /* No final-state survived, so treat all as final
+                                * with probability One(). */
+          } else {
+            auto iter = final_costs_.find(tok);
+            if (iter == final_costs_.end())
+              final_cost = std::numeric_limits<BaseFloat>::infinity();
+            else
+              final_cost = iter->second;
+          }
+        } else {
+          /* this is a `fake` final-cost used to guide pruning.  It's as if we
+             set the betas (backward-probs) on the final frame to the
+             negatives of the corresponding alphas, so all tokens on the last
+             frae will be on a best path..  the extra_cost for each token
+             always corresponds to its alpha+beta on this assumption.  We want
+             the final_cost here to correspond to the beta (backward-prob), so
+             we get that by final_cost = extra_cost - tot_cost.
+             [The tot_cost is the forward/alpha cost.]
+          */
+          final_cost = tok->extra_cost - tok->tot_cost;
+        }
+      }
+
+      StateId state = chunk_lat->AddState();
+      tok2state_map[tok] = state;
+      if (final_cost < std::numeric_limits<BaseFloat>::infinity()) {
+        next_token2label_map[tok] = AllocateNewTokenLabel();
+        StateId token_final_state = chunk_lat->AddState();
+        LatticeArc::Label ilabel = 0,
+            olabel = (next_token2label_map[tok] = AllocateNewTokenLabel());
+        chunk_lat->AddArc(state,
+                         LatticeArc(ilabel, olabel,
+                                    LatticeWeight::One(),
+                                    token_final_state));
+        chunk_lat->SetFinal(token_final_state, LatticeWeight(final_cost, 0.0));
+      }
+    }
+  }
+
+  // Go in reverse order over the remaining frames so we can create arcs as we
+  // go, and their destination-states will already be in the map.
+  for (int32 frame = num_frames_to_include;
+       frame >= num_frames_in_lattice_; frame--) {
+    // The conditional below is needed for the last frame of the utterance.
+    BaseFloat cost_offset = (frame < cost_offsets_.size() ?
+                             cost_offsets_[frame] : 0.0);
+
+    // For the first frame of the chunk, we need to make sure the states are
+    // the ones created by InitializeRawLatticeChunk() (where not pruned away).
+    if (frame == num_frames_in_lattice_ && num_frames_in_lattice_ != 0) {
+      for (Token *tok = active_toks_[frame].toks; tok != NULL; tok = tok->next) {
+        auto iter = token2label_map_.find(tok);
+        KALDI_ASSERT(iter != token2label_map_.end());
+        Label token_label = iter->second;
+        auto iter2 = token_label2state.find(token_label);
+        if (iter2 != token_label2state.end()) {
+          StateId state = iter2->second;
+          tok2state_map[tok] = state;
+        } else {
+          // Some states may have been pruned out, but we should still allocate
+          // them.  They might have been part of chains of nonemitting arcs
+          // where the state became disconnected because the last chunk didn't
+          // include arcs starting at this frame.
+          StateId state = chunk_lat->AddState();
+          tok2state_map[tok] = state;
+        }
+      }
+    } else if (frame != num_frames_to_include) {  // We already created states
+                                                  // for the last frame.
+      for (Token *tok = active_toks_[frame].toks; tok != NULL; tok = tok->next) {
+        StateId state = chunk_lat->AddState();
+        tok2state_map[tok] = state;
+      }
+    }
+    for (Token *tok = active_toks_[frame].toks; tok != NULL; tok = tok->next) {
+      auto iter = tok2state_map.find(tok);
+      KALDI_ASSERT(iter != tok2state_map.end());
+      StateId cur_state = iter->second;
+      for (ForwardLinkT *l = tok->links; l != NULL; l = l->next) {
+        auto next_iter = tok2state_map.find(l->next_tok);
+        if (next_iter == tok2state_map.end()) {
+          // Emitting arcs from the last frame we're including -- ignore
+          // these.
+          KALDI_ASSERT(frame == num_frames_to_include);
+          continue;
+        }
+        StateId next_state = next_iter->second;
+        BaseFloat this_offset = (l->ilabel != 0 ? cost_offset : 0);
+        LatticeArc arc(l->ilabel, l->olabel,
+                       LatticeWeight(l->graph_cost, l->acoustic_cost - this_offset),
+                       next_state);
+        // Note: the epsilons get redundantly included at the end and beginning
+        // of successive chunks.  These will get removed in the determinization.
+        chunk_lat->AddArc(cur_state, arc);
+      }
+    }
+  }
+  if (num_frames_in_lattice_ == 0) {
+    // This block locates the start token.  NOTE: we use the fact that in the
+    // linked list of tokens, things are added at the head, so the start state
+    // must be at the tail.  If this data structure is changed in future, we
+    // might need to explicitly store the start token as a class member.
+    Token *tok = active_toks_[0].toks;
+    if (tok == NULL) {
+      KALDI_WARN << "No tokens exist on start frame";
+      return false;
+    }
+    while (tok->next != NULL)
+      tok = tok->next;
+    Token *start_token = tok;
+    auto iter = tok2state_map.find(start_token);
+    KALDI_ASSERT(iter != tok2state_map.end());
+    StateId start_state = iter->second;
+    chunk_lat->SetStart(start_state);
+  }
+  token2label_map_.swap(next_token2label_map);
+  return true;
+}
+
 template <typename FST, typename Token>
 const CompactLattice& LatticeIncrementalDecoderTpl<FST, Token>::GetLattice(
     int32 num_frames_to_include,
     bool use_final_probs) {
+  // If a chunk is being determinized in the background, it must be finished
+  // before we touch determinizer_.
+  WaitForDeterminization();
   KALDI_ASSERT(num_frames_to_include >= num_frames_in_lattice_ &&
                num_frames_to_include <= NumFramesDecoded());
 
@@ -897,163 +1118,9 @@ const CompactLattice& LatticeIncrementalDecoderTpl<FST, Token>::GetLattice(
 
 
   if (num_frames_to_include > num_frames_in_lattice_) {
-    /* Make sure the token-pruning is up to date.   If we just pruned the tokens,
-       this will do very little work. */
-    PruneActiveTokens(config_.lattice_beam * config_.prune_scale);
-
-    if (determinizer_.GetLattice().NumStates() == 0 ||
-        determinizer_.GetLattice().Final(0) != CompactLatticeWeight::Zero()) {
-      num_frames_in_lattice_ = 0;
-      determinizer_.Init();
-    }
-
     Lattice chunk_lat;
-
-    unordered_map<Label, LatticeArc::StateId> token_label2state;
-    if (num_frames_in_lattice_ != 0) {
-      determinizer_.InitializeRawLatticeChunk(&chunk_lat,
-                                              &token_label2state);
-    }
-
-    // tok_map will map from Token* to state-id in chunk_lat.
-    // The cur and prev versions alternate on different frames.
-    unordered_map<Token*, StateId> &tok2state_map(temp_token_map_);
-    tok2state_map.clear();
-
-    unordered_map<Token*, Label> &next_token2label_map(token2label_map_temp_);
-    next_token2label_map.clear();
-
-    { // Deal with the last frame in the chunk, the one numbered `num_frames_to_include`.
-      // (Yes, this is backwards).   We allocate token labels, and set tokens as
-      // final, but don't add any transitions.  This may leave some states
-      // disconnected (e.g. due to chains of nonemitting arcs), but it's OK; we'll
-      // fix it when we generate the next chunk of lattice.
-      int32 frame = num_frames_to_include;
-      // Allocate state-ids for all tokens on this frame.
-
-      for (Token *tok = active_toks_[frame].toks; tok != NULL; tok = tok->next) {
-        /* If we included the final-costs at this stage, they will cause
-           non-final states to be pruned out from the end of the lattice. */
-        BaseFloat final_cost;
-        {  // This block computes final_cost
-          if (decoding_finalized_) {
-            if (final_costs_.empty()) {
-              final_cost = 0.0;  /* No final-state survived, so treat all as final
-                                  * with probability One(). */
-            } else {
-              auto iter = final_costs_.find(tok);
-              if (iter == final_costs_.end())
-                final_cost = std::numeric_limits<BaseFloat>::infinity();
-              else
-                final_cost = iter->second;
-            }
-          } else {
-            /* this is a `fake` final-cost used to guide pruning.  It's as if we
-               set the betas (backward-probs) on the final frame to the
-               negatives of the corresponding alphas, so all tokens on the last
-               frae will be on a best path..  the extra_cost for each token
-               always corresponds to its alpha+beta on this assumption.  We want
-               the final_cost here to correspond to the beta (backward-prob), so
-               we get that by final_cost = extra_cost - tot_cost.
-               [The tot_cost is the forward/alpha cost.]
-            */
-            final_cost = tok->extra_cost - tok->tot_cost;
-          }
-        }
-
-        StateId state = chunk_lat.AddState();
-        tok2state_map[tok] = state;
-        if (final_cost < std::numeric_limits<BaseFloat>::infinity()) {
-          next_token2label_map[tok] = AllocateNewTokenLabel();
-          StateId token_final_state = chunk_lat.AddState();
-          LatticeArc::Label ilabel = 0,
-              olabel = (next_token2label_map[tok] = AllocateNewTokenLabel());
-          chunk_lat.AddArc(state,
-                           LatticeArc(ilabel, olabel,
-                                      LatticeWeight::One(),
-                                      token_final_state));
-          chunk_lat.SetFinal(token_final_state, LatticeWeight(final_cost, 0.0));
-        }
-      }
-    }
-
-    // Go in reverse order over the remaining frames so we can create arcs as we
-    // go, and their destination-states will already be in the map.
-    for (int32 frame = num_frames_to_include;
-         frame >= num_frames_in_lattice_; frame--) {
-      // The conditional below is needed for the last frame of the utterance.
-      BaseFloat cost_offset = (frame < cost_offsets_.size() ?
-                               cost_offsets_[frame] : 0.0);
-
-      // For the first frame of the chunk, we need to make sure the states are
-      // the ones created by InitializeRawLatticeChunk() (where not pruned away).
-      if (frame == num_frames_in_lattice_ && num_frames_in_lattice_ != 0) {
-        for (Token *tok = active_toks_[frame].toks; tok != NULL; tok = tok->next) {
-          auto iter = token2label_map_.find(tok);
-          KALDI_ASSERT(iter != token2label_map_.end());
-          Label token_label = iter->second;
-          auto iter2 = token_label2state.find(token_label);
-          if (iter2 != token_label2state.end()) {
-            StateId state = iter2->second;
-            tok2state_map[tok] = state;
-          } else {
-            // Some states may have been pruned out, but we should still allocate
-            // them.  They might have been part of chains of nonemitting arcs
-            // where the state became disconnected because the last chunk didn't
-            // include arcs starting at this frame.
-            StateId state = chunk_lat.AddState();
-            tok2state_map[tok] = state;
-          }
-        }
-      } else if (frame != num_frames_to_include) {  // We already created states
-                                                    // for the last frame.
-        for (Token *tok = active_toks_[frame].toks; tok != NULL; tok = tok->next) {
-          StateId state = chunk_lat.AddState();
-          tok2state_map[tok] = state;
-        }
-      }
-      for (Token *tok = active_toks_[frame].toks; tok != NULL; tok = tok->next) {
-        auto iter = tok2state_map.find(tok);
-        KALDI_ASSERT(iter != tok2state_map.end());
-        StateId cur_state = iter->second;
-        for (ForwardLinkT *l = tok->links; l != NULL; l = l->next) {
-          auto next_iter = tok2state_map.find(l->next_tok);
-          if (next_iter == tok2state_map.end()) {
-            // Emitting arcs from the last frame we're including -- ignore
-            // these.
-            KALDI_ASSERT(frame == num_frames_to_include);
-            continue;
-          }
-          StateId next_state = next_iter->second;
-          BaseFloat this_offset = (l->ilabel != 0 ? cost_offset : 0);
-          LatticeArc arc(l->ilabel, l->olabel,
-                         LatticeWeight(l->graph_cost, l->acoustic_cost - this_offset),
-                         next_state);
-          // Note: the epsilons get redundantly included at the end and beginning
-          // of successive chunks.  These will get removed in the determinization.
-          chunk_lat.AddArc(cur_state, arc);
-        }
-      }
-    }
-    if (num_frames_in_lattice_ == 0) {
-      // This block locates the start token.  NOTE: we use the fact that in the
-      // linked list of tokens, things are added at the head, so the start state
-      // must be at the tail.  If this data structure is changed in future, we
-      // might need to explicitly store the start token as a class member.
-      Token *tok = active_toks_[0].toks;
-      if (tok == NULL) {
-        KALDI_WARN << "No tokens exist on start frame";
-        return determinizer_.GetLattice();  // will be empty.
-      }
-      while (tok->next != NULL)
-        tok = tok->next;
-      Token *start_token = tok;
-      auto iter = tok2state_map.find(start_token);
-      KALDI_ASSERT(iter != tok2state_map.end());
-      StateId start_state = iter->second;
-      chunk_lat.SetStart(start_state);
-    }
-    token2label_map_.swap(next_token2label_map);
+    if (!GetRawLatticeChunk(num_frames_to_include, &chunk_lat))
+      return determinizer_.GetLattice();  // will be empty.
 
     // bool finished_before_beam =
     determinizer_.AcceptRawLatticeChunk(&chunk_lat);
@@ -20,6 +20,8 @@
 #ifndef KALDI_DECODER_LATTICE_INCREMENTAL_DECODER_H_
 #define KALDI_DECODER_LATTICE_INCREMENTAL_DECODER_H_
 
+#include <exception>
+#include <thread>
 #include "util/stl-utils.h"
 #include "util/hash-list.h"
 #include "fst/fstlib.h"
@@ -128,6 +130,7 @@ struct LatticeIncrementalDecoderConfig {
   // If you call
   int32 determinize_max_delay;
   int32 determinize_min_chunk_size;
+  bool determinize_async;
 
 
   LatticeIncrementalDecoderConfig()
@@ -140,7 +143,8 @@ struct LatticeIncrementalDecoderConfig {
         hash_ratio(2.0),
         prune_scale(0.01),
         determinize_max_delay(60),
-        determinize_min_chunk_size(20) {
+        determinize_min_chunk_size(20),
+        determinize_async(false) {
     det_opts.minimize = false;
   }
   void Register(OptionsItf *opts) {
@@ -168,6 +172,10 @@ struct LatticeIncrementalDecoderConfig {
                    "determinizing it");
     opts->Register("determinize-min-chunk-size", &determinize_min_chunk_size,
                    "Minimum chunk size used in determinization");
+    opts->Register("determinize-async", &determinize_async,
+                   "If true, the chunks of lattice are determinized on a "
+                   "background thread while decoding continues.  The "
+                   "lattices are the same either way.");
 
   }
   void Check() const {
@@ -716,6 +724,34 @@ class LatticeIncrementalDecoderTpl {
   */
   void UpdateLatticeDeterminization();
 
+  /**
+     Creates the raw lattice chunk (see glossary) covering frames
+     num_frames_in_lattice_ through `num_frames_to_include` from the tokens;
+     this is the part of GetLattice() that must be done on the decoding thread.
+     Returns false if there was nothing to create (no tokens on the start
+     frame).  Does not update num_frames_in_lattice_.
+  */
+  bool GetRawLatticeChunk(int32 num_frames_to_include, Lattice *chunk_lat);
+
+  /**
+     Used in UpdateLatticeDeterminization() if config_.determinize_async is
+     true.  Like GetLattice(num_frames_to_include, false) except that the
+     determinization of the raw chunk is started on determinize_thread_ and this
+     function returns without waiting for it.
+  */
+  void DeterminizeChunkAsync(int32 num_frames_to_include);
+
+  /** Waits for any determinization started by DeterminizeChunkAsync() to
+      finish (rethrowing any exception it threw).  Must be called before
+      determinizer_ is accessed.  The destructor joins the thread itself, as it
+      must not throw. */
+  void WaitForDeterminization();
+
+  // The thread, if any, on which the determinization of pending_chunk_ is
+  // running (only used if config_.determinize_async is true).
+  std::thread determinize_thread_;
+  Lattice pending_chunk_;
+  std::exception_ptr determinize_error_;
 
   KALDI_DISALLOW_COPY_AND_ASSIGN(LatticeIncrementalDecoderTpl);
 };
@@ -61,9 +61,11 @@ void OfflineFeatureTpl<F>::Compute(
     const VectorBase<BaseFloat> &wave,
     BaseFloat vtln_warp,
     Matrix<BaseFloat> *output) {
+  KALDI_PROFILE_SCOPE("OfflineFeatureTpl::Compute");
   KALDI_ASSERT(output != NULL);
   int32 rows_out = NumFrames(wave.Dim(), computer_.GetFrameOptions()),
       cols_out = computer_.Dim();
+  KALDI_PROFILE_COUNT("feature-frames", rows_out);
   if (rows_out == 0) {
     output->Resize(0, 0);
     return;
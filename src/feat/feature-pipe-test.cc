@@ -0,0 +1,118 @@
+// feat/feature-pipe-test.cc
+
+// Copyright 2026  agent <agent@local>
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "feat/feature-pipe.h"
+#include "feat/feature-functions.h"
+#include "transform/cmvn.h"
+
+namespace kaldi {
+
+void UnitTestParseFeaturePipe() {
+  std::string in;
+  std::vector<FeaturePipeStage*> stages;
+  KALDI_ASSERT(ParseFeaturePipe(
+      "ark,s,cs:copy-feats scp:feats.scp ark:- | "
+      "splice-feats --left-context=3 ark:- ark,t:- | add-deltas ark:- ark:- |",
+      &in, &stages));
+  KALDI_ASSERT(in == "scp:feats.scp" && stages.size() == 2);
+  DeletePointers(&stages);
+  stages.clear();
+  KALDI_ASSERT(ParseFeaturePipe("ark:copy-feats scp:a.scp ark:- |",
+                                &in, &stages) && stages.empty());
+
+  const char *not_understood[] = {
+    "scp:feats.scp",
+    "ark:feats.ark",
+    "ark:copy-feats --compress=true scp:a.scp ark:- |",  // unknown option.
+    "ark:copy-feats ark:- ark:- |",  // reads standard input.
+    "ark:copy-feats scp:a.scp ark:b.ark |",  // does not write to the pipe.
+    "ark:copy-feats scp:a.scp ark:- | splice-feats ark:b.ark ark:- |",
+    "ark:copy-feats scp:a.scp ark:- | subsample-feats ark:- ark:- |",
+    "ark:copy-feats 'scp:a b.scp' ark:- |",
+    "ark:copy-feats scp:a.scp ark:- 2>log |",
+    "ark:add-deltas --delta-order=x scp:a.scp ark:- |",
+    "ark:transform-feats ark:trans.ark scp:a.scp ark:- |"  // not global.
+  };
+  for (size_t i = 0; i < sizeof(not_understood) / sizeof(char*); i++)
+    KALDI_ASSERT(!ParseFeaturePipe(not_understood[i], &in, &stages));
+  KALDI_ASSERT(stages.empty());
+}
+
+// Checks that the reader gives the same features as doing the computation
+// directly, for a pipe that it runs in-process and one that it doesn't.
+void UnitTestSequentialFeaturePipeReader() {
+  int32 num_utts = 1 + Rand() % 5, dim = 1 + Rand() % 5;
+  std::vector<std::string> keys(num_utts);
+  std::vector<Matrix<BaseFloat> > feats(num_utts);
+  {
+    BaseFloatMatrixWriter feats_writer("ark:tmp.feats");
+    DoubleMatrixWriter cmvn_writer("ark:tmp.cmvn");
+    for (int32 i = 0; i < num_utts; i++) {
+      keys[i] = std::string("utt") + static_cast<char>('a' + i);
+      feats[i].Resize(1 + Rand() % 10, dim);
+      feats[i].SetRandn();
+      feats_writer.Write(keys[i], feats[i]);
+      if (i != 0) {  // no stats for the first utterance.
+        Matrix<double> stats;
+        InitCmvnStats(dim, &stats);
+        AccCmvnStats(feats[i], NULL, &stats);
+        cmvn_writer.Write(keys[i], stats);
+      }
+    }
+  }
+
+  SequentialFeaturePipeReader reader(
+      "ark:apply-cmvn --norm-vars=true ark:tmp.cmvn ark:tmp.feats ark:- | "
+      "splice-feats --left-context=1 --right-context=2 ark:- ark:- | "
+      "add-deltas --delta-order=1 ark:- ark:- |");
+  for (int32 i = 1; i < num_utts; i++) {  // The first one has no stats.
+    Matrix<BaseFloat> normalized(feats[i]), spliced, expected;
+    Matrix<double> stats;
+    InitCmvnStats(dim, &stats);
+    AccCmvnStats(feats[i], NULL, &stats);
+    ApplyCmvn(stats, true, &normalized);
+    SpliceFrames(normalized, 1, 2, &spliced);
+    ComputeDeltas(DeltaFeaturesOptions(1), spliced, &expected);
+    KALDI_ASSERT(!reader.Done() && reader.Key() == keys[i]);
+    KALDI_ASSERT(reader.Value().ApproxEqual(expected));
+    reader.Next();
+  }
+  KALDI_ASSERT(reader.Done() && reader.Close());
+
+  // This pipe is run with popen().
+  SequentialFeaturePipeReader cat_reader("ark:cat tmp.feats |");
+  for (int32 i = 0; i < num_utts; i++, cat_reader.Next())
+    KALDI_ASSERT(cat_reader.Key() == keys[i] &&
+                 cat_reader.Value().ApproxEqual(feats[i]));
+  KALDI_ASSERT(cat_reader.Done() && cat_reader.Close());
+
+  unlink("tmp.feats");
+  unlink("tmp.cmvn");
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  UnitTestParseFeaturePipe();
+  for (int32 i = 0; i < 10; i++)
+    UnitTestSequentialFeaturePipeReader();
+  std::cout << "Test OK.\n";
+  return 0;
+}
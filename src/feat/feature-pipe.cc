@@ -0,0 +1,459 @@
+// feat/feature-pipe.cc
+
+// Copyright 2026  agent <agent@local>
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <map>
+
+#include "feat/feature-pipe.h"
+#include "feat/feature-functions.h"
+#include "transform/cmvn.h"
+
+namespace kaldi {
+
+namespace {
+
+// A command of the pipe, split into its options (--name=value) and its
+// positional arguments.
+struct PipeCommand {
+  std::string name;
+  std::map<std::string, std::string> options;
+  std::vector<std::string> args;
+};
+
+// Parses "--name=value" options of 'command' into ints or bools; returns
+// false if an option has a bad value.
+bool GetOption(const PipeCommand &command, const std::string &name,
+               int32 *value) {
+  std::map<std::string, std::string>::const_iterator iter =
+      command.options.find(name);
+  return iter == command.options.end() ||
+      ConvertStringToInteger(iter->second, value);
+}
+
+bool GetOption(const PipeCommand &command, const std::string &name,
+               bool *value) {
+  std::map<std::string, std::string>::const_iterator iter =
+      command.options.find(name);
+  if (iter == command.options.end())
+    return true;
+  if (iter->second == "true" || iter->second == "") {
+    *value = true;
+    return true;
+  } else if (iter->second == "false") {
+    *value = false;
+    return true;
+  }
+  return false;
+}
+
+bool GetOption(const PipeCommand &command, const std::string &name,
+               std::string *value) {
+  std::map<std::string, std::string>::const_iterator iter =
+      command.options.find(name);
+  if (iter != command.options.end())
+    *value = iter->second;
+  return true;
+}
+
+// Returns true if all of the command's options are in 'allowed', which is a
+// space-separated list.
+bool OptionsAllowed(const PipeCommand &command, const std::string &allowed) {
+  std::vector<std::string> names;
+  SplitStringToVector(allowed, " ", true, &names);
+  std::map<std::string, std::string>::const_iterator iter;
+  for (iter = command.options.begin(); iter != command.options.end(); ++iter)
+    if (iter->first != "print-args" &&
+        std::find(names.begin(), names.end(), iter->first) == names.end())
+      return false;
+  return true;
+}
+
+
+class ApplyCmvnStage: public FeaturePipeStage {
+ public:
+  // Reads the stats from a table if 'stats_in' is an rspecifier, else from
+  // a file.
+  ApplyCmvnStage(const std::string &stats_in,
+                 const std::string &utt2spk_rspecifier,
+                 const std::vector<int32> &skip_dims,
+                 bool norm_vars, bool reverse):
+      skip_dims_(skip_dims), norm_vars_(norm_vars), reverse_(reverse) {
+    if (ClassifyRspecifier(stats_in, NULL, NULL) != kNoRspecifier) {
+      if (!stats_reader_.Open(stats_in, utt2spk_rspecifier))
+        KALDI_ERR << "Could not open CMVN stats " << stats_in;
+    } else {
+      if (utt2spk_rspecifier != "")
+        KALDI_ERR << "--utt2spk option not compatible with rxfilename as input "
+                  << "(did you forget ark:?)";
+      ReadKaldiObject(stats_in, &global_stats_);
+      if (!skip_dims_.empty())
+        FakeStatsForSomeDims(skip_dims_, &global_stats_);
+    }
+  }
+
+  virtual bool Apply(const std::string &utt, Matrix<BaseFloat> *feats) {
+    if (!stats_reader_.IsOpen()) {
+      Cmvn(global_stats_, feats);
+      return true;
+    }
+    if (!stats_reader_.HasKey(utt)) {
+      KALDI_WARN << "No normalization statistics available for key "
+                 << utt << ", producing no output for this utterance";
+      return false;
+    }
+    Matrix<double> stats(stats_reader_.Value(utt));
+    if (!skip_dims_.empty())
+      FakeStatsForSomeDims(skip_dims_, &stats);
+    Cmvn(stats, feats);
+    return true;
+  }
+
+ private:
+  void Cmvn(const Matrix<double> &stats, Matrix<BaseFloat> *feats) const {
+    if (reverse_)
+      ApplyCmvnReverse(stats, norm_vars_, feats);
+    else
+      ApplyCmvn(stats, norm_vars_, feats);
+  }
+
+  RandomAccessDoubleMatrixReaderMapped stats_reader_;  // Not open if global.
+  Matrix<double> global_stats_;
+  std::vector<int32> skip_dims_;
+  bool norm_vars_;
+  bool reverse_;
+};
+
+
+class SpliceFeatsStage: public FeaturePipeStage {
+ public:
+  SpliceFeatsStage(int32 left_context, int32 right_context):
+      left_context_(left_context), right_context_(right_context) { }
+
+  virtual bool Apply(const std::string &utt, Matrix<BaseFloat> *feats) {
+    Matrix<BaseFloat> spliced;
+    SpliceFrames(*feats, left_context_, right_context_, &spliced);
+    feats->Swap(&spliced);
+    return true;
+  }
+
+ private:
+  int32 left_context_;
+  int32 right_context_;
+};
+
+
+class AddDeltasStage: public FeaturePipeStage {
+ public:
+  AddDeltasStage(const DeltaFeaturesOptions &opts, int32 truncate):
+      opts_(opts), truncate_(truncate) { }
+
+  virtual bool Apply(const std::string &utt, Matrix<BaseFloat> *feats) {
+    if (feats->NumRows() == 0) {
+      KALDI_WARN << "Empty feature matrix for key " << utt;
+      return false;
+    }
+    Matrix<BaseFloat> new_feats;
+    if (truncate_ != 0) {
+      if (truncate_ > feats->NumCols())
+        KALDI_ERR << "Cannot truncate features as dimension "
+                  << feats->NumCols()
+                  << " is smaller than truncation dimension.";
+      SubMatrix<BaseFloat> feats_sub(*feats, 0, feats->NumRows(),
+                                     0, truncate_);
+      ComputeDeltas(opts_, feats_sub, &new_feats);
+    } else {
+      ComputeDeltas(opts_, *feats, &new_feats);
+    }
+    feats->Swap(&new_feats);
+    return true;
+  }
+
+ private:
+  DeltaFeaturesOptions opts_;
+  int32 truncate_;
+};
+
+
+class TransformFeatsStage: public FeaturePipeStage {
+ public:
+  explicit TransformFeatsStage(const std::string &transform_rxfilename) {
+    ReadKaldiObject(transform_rxfilename, &transform_);
+  }
+
+  virtual bool Apply(const std::string &utt, Matrix<BaseFloat> *feats) {
+    int32 feat_dim = feats->NumCols(),
+        transform_rows = transform_.NumRows(),
+        transform_cols = transform_.NumCols();
+    Matrix<BaseFloat> feats_out(feats->NumRows(), transform_rows);
+    if (transform_cols == feat_dim) {
+      feats_out.AddMatMat(1.0, *feats, kNoTrans, transform_, kTrans, 0.0);
+    } else if (transform_cols == feat_dim + 1) {
+      SubMatrix<BaseFloat> linear_part(transform_, 0, transform_rows,
+                                       0, feat_dim);
+      feats_out.AddMatMat(1.0, *feats, kNoTrans, linear_part, kTrans, 0.0);
+      Vector<BaseFloat> offset(transform_rows);
+      offset.CopyColFromMat(transform_, feat_dim);
+      feats_out.AddVecToRows(1.0, offset);
+    } else {
+      KALDI_WARN << "Transform matrix for utterance " << utt
+                 << " has bad dimension " << transform_rows << "x"
+                 << transform_cols << " versus feat dim " << feat_dim;
+      return false;
+    }
+    feats->Swap(&feats_out);
+    return true;
+  }
+
+ private:
+  Matrix<BaseFloat> transform_;
+};
+
+
+// Returns true if 'in' is an rspecifier that reads an archive from the
+// standard input, as commands after the first one in the pipe must.
+bool IsStdinArchive(const std::string &in) {
+  std::string rxfilename;
+  return ClassifyRspecifier(in, &rxfilename, NULL) == kArchiveRspecifier &&
+      rxfilename == "-";
+}
+
+// Returns true if 'out' is a wspecifier that writes an archive to the
+// standard output.
+bool IsStdoutArchive(const std::string &out) {
+  std::string wxfilename;
+  return ClassifyWspecifier(out, &wxfilename, NULL, NULL) ==
+      kArchiveWspecifier && wxfilename == "-";
+}
+
+// Splits the pipe into commands; returns false if it contains anything that
+// the shell would treat specially apart from the '|'s.
+bool SplitPipe(const std::string &pipe, std::vector<PipeCommand> *commands) {
+  if (pipe.find_first_of("'\"`$\\;&<>(){}*?~#") != std::string::npos)
+    return false;
+  std::vector<std::string> command_strs;
+  SplitStringToVector(pipe, "|", false, &command_strs);
+  // The pipe ends with '|', so the last string is empty.
+  if (command_strs.size() < 2 || !command_strs.back().empty())
+    return false;
+  command_strs.pop_back();
+  for (size_t i = 0; i < command_strs.size(); i++) {
+    std::vector<std::string> fields;
+    SplitStringToVector(command_strs[i], " \t", true, &fields);
+    if (fields.empty())
+      return false;
+    PipeCommand command;
+    command.name = fields[0];
+    for (size_t j = 1; j < fields.size(); j++) {
+      const std::string &field = fields[j];
+      if (field.compare(0, 2, "--") == 0) {
+        size_t pos = field.find('=');
+        std::string name = field.substr(2, pos == std::string::npos ?
+                                        std::string::npos : pos - 2),
+            value = (pos == std::string::npos ? "" : field.substr(pos + 1));
+        if (name.empty() || command.options.count(name) != 0)
+          return false;
+        command.options[name] = value;
+      } else {
+        command.args.push_back(field);
+      }
+    }
+    commands->push_back(command);
+  }
+  return true;
+}
+
+// Creates the stage for a command with input and output already checked;
+// outputs NULL for copy-feats.  Returns false if we don't know the command
+// or one of its options.
+bool NewStage(const PipeCommand &command, FeaturePipeStage **stage) {
+  *stage = NULL;
+  if (command.name == "copy-feats") {
+    return command.args.size() == 2 && OptionsAllowed(command, "");
+  } else if (command.name == "apply-cmvn") {
+    std::string utt2spk_rspecifier, skip_dims_str;
+    bool norm_means = true, norm_vars = false, reverse = false;
+    std::vector<int32> skip_dims;
+    if (command.args.size() != 3 ||
+        !OptionsAllowed(command,
+                        "utt2spk norm-means norm-vars skip-dims reverse") ||
+        !GetOption(command, "utt2spk", &utt2spk_rspecifier) ||
+        !GetOption(command, "norm-means", &norm_means) ||
+        !GetOption(command, "norm-vars", &norm_vars) ||
+        !GetOption(command, "skip-dims", &skip_dims_str) ||
+        !GetOption(command, "reverse", &reverse) ||
+        !SplitStringToIntegers(skip_dims_str, ":", false, &skip_dims) ||
+        (norm_vars && !norm_means))
+      return false;
+    if (norm_means)  // Else apply-cmvn just copies its input.
+      *stage = new ApplyCmvnStage(command.args[0], utt2spk_rspecifier,
+                                  skip_dims, norm_vars, reverse);
+    return true;
+  } else if (command.name == "splice-feats") {
+    int32 left_context = 4, right_context = 4;
+    if (command.args.size() != 2 ||
+        !OptionsAllowed(command, "left-context right-context") ||
+        !GetOption(command, "left-context", &left_context) ||
+        !GetOption(command, "right-context", &right_context) ||
+        left_context < 0 || right_context < 0)
+      return false;
+    *stage = new SpliceFeatsStage(left_context, right_context);
+    return true;
+  } else if (command.name == "add-deltas") {
+    DeltaFeaturesOptions opts;
+    int32 truncate = 0;
+    if (command.args.size() != 2 ||
+        !OptionsAllowed(command, "delta-order delta-window truncate") ||
+        !GetOption(command, "delta-order", &opts.order) ||
+        !GetOption(command, "delta-window", &opts.window) ||
+        !GetOption(command, "truncate", &truncate) ||
+        opts.order < 0 || opts.window <= 0 || truncate < 0)
+      return false;
+    *stage = new AddDeltasStage(opts, truncate);
+    return true;
+  } else if (command.name == "transform-feats") {
+    // Per-utterance or per-speaker transforms are not supported.
+    if (command.args.size() != 3 || !OptionsAllowed(command, "") ||
+        ClassifyRspecifier(command.args[0], NULL, NULL) != kNoRspecifier)
+      return false;
+    *stage = new TransformFeatsStage(command.args[0]);
+    return true;
+  }
+  return false;
+}
+
+}  // namespace
+
+
+bool ParseFeaturePipe(const std::string &rspecifier,
+                      std::string *input_rspecifier,
+                      std::vector<FeaturePipeStage*> *stages) {
+  std::string rxfilename;
+  std::vector<PipeCommand> commands;
+  if (ClassifyRspecifier(rspecifier, &rxfilename, NULL) != kArchiveRspecifier ||
+      ClassifyRxfilename(rxfilename) != kPipeInput ||
+      !SplitPipe(rxfilename, &commands))
+    return false;
+  // Check the inputs and outputs before creating any stage, as creating them
+  // reads files.
+  for (size_t i = 0; i < commands.size(); i++) {
+    const std::vector<std::string> &args = commands[i].args;
+    if (args.size() < 2 || !IsStdoutArchive(args.back()))
+      return false;
+    const std::string &in = args[args.size() - 2];
+    if (i == 0 ? (ClassifyRspecifier(in, NULL, NULL) == kNoRspecifier ||
+                  IsStdinArchive(in)) : !IsStdinArchive(in))
+      return false;
+  }
+  std::vector<FeaturePipeStage*> new_stages;
+  for (size_t i = 0; i < commands.size(); i++) {
+    FeaturePipeStage *stage;
+    if (!NewStage(commands[i], &stage)) {
+      DeletePointers(&new_stages);
+      return false;
+    }
+    if (stage != NULL)
+      new_stages.push_back(stage);
+  }
+  const std::vector<std::string> &first_args = commands[0].args;
+  *input_rspecifier = first_args[first_args.size() - 2];
+  stages->insert(stages->end(), new_stages.begin(), new_stages.end());
+  return true;
+}
+
+
+SequentialFeaturePipeReader::SequentialFeaturePipeReader(
+    const std::string &rspecifier) {
+  if (!Open(rspecifier))
+    KALDI_ERR << "Error opening feature rspecifier " << rspecifier;
+}
+
+bool SequentialFeaturePipeReader::Open(const std::string &rspecifier) {
+  if (IsOpen() && !Close())
+    KALDI_ERR << "Could not close previously open object.";
+  std::string input_rspecifier;
+  if (!ParseFeaturePipe(rspecifier, &input_rspecifier, &stages_))
+    return reader_.Open(rspecifier);
+  KALDI_VLOG(1) << "Reading features from " << input_rspecifier
+                << " and applying the commands of the pipe in-process.";
+  if (!reader_.Open(input_rspecifier)) {
+    DeletePointers(&stages_);
+    stages_.clear();
+    return false;
+  }
+  ApplyStages();
+  return true;
+}
+
+void SequentialFeaturePipeReader::ApplyStages() {
+  if (stages_.empty())
+    return;
+  for (; !reader_.Done(); reader_.Next()) {
+    std::string key = reader_.Key();
+    value_.Resize(0, 0);
+    value_.Swap(&reader_.Value());
+    size_t i = 0;
+    for (; i < stages_.size(); i++)
+      if (!stages_[i]->Apply(key, &value_))
+        break;
+    if (i == stages_.size())
+      return;
+  }
+  value_.Resize(0, 0);
+}
+
+bool SequentialFeaturePipeReader::Done() {
+  return reader_.Done();
+}
+
+std::string SequentialFeaturePipeReader::Key() {
+  return reader_.Key();
+}
+
+const Matrix<BaseFloat> &SequentialFeaturePipeReader::Value() {
+  if (stages_.empty())
+    return reader_.Value();
+  if (reader_.Done())
+    KALDI_ERR << "Value() called at the wrong time.";
+  return value_;
+}
+
+void SequentialFeaturePipeReader::Next() {
+  reader_.Next();
+  ApplyStages();
+}
+
+void SequentialFeaturePipeReader::FreeCurrent() {
+  if (stages_.empty())
+    reader_.FreeCurrent();
+  else
+    value_.Resize(0, 0);
+}
+
+bool SequentialFeaturePipeReader::Close() {
+  DeletePointers(&stages_);
+  stages_.clear();
+  value_.Resize(0, 0);
+  return reader_.Close();
+}
+
+SequentialFeaturePipeReader::~SequentialFeaturePipeReader() {
+  DeletePointers(&stages_);
+}
+
+}  // namespace kaldi
@@ -0,0 +1,124 @@
+// feat/feature-pipe.h
+
+// Copyright 2026  agent <agent@local>
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_FEAT_FEATURE_PIPE_H_
+#define KALDI_FEAT_FEATURE_PIPE_H_
+
+#include <string>
+#include <vector>
+
+#include "matrix/matrix-lib.h"
+#include "util/common-utils.h"
+
+namespace kaldi {
+
+/// @addtogroup  feat FeatureExtraction
+/// @{
+
+/// This file lets programs read features from rspecifiers like
+///  "ark,s,cs:apply-cmvn --utt2spk=ark:data/utt2spk scp:data/cmvn.scp
+///     scp:data/feats.scp ark:- | add-deltas ark:- ark:- |"
+/// without starting the commands: the features are read from the input of the
+/// first command (here scp:data/feats.scp) and the commands are applied to
+/// each matrix in this process, which saves writing and parsing each matrix
+/// once per command and the context switches between the processes.
+///
+/// The commands that are understood are
+///   copy-feats <in> <out>                   [no options]
+///   apply-cmvn [--utt2spk=] [--norm-means=] [--norm-vars=] [--skip-dims=]
+///              [--reverse=] (<stats-rspecifier>|<stats-rxfilename>) <in> <out>
+///   splice-feats [--left-context=] [--right-context=] <in> <out>
+///   add-deltas [--delta-order=] [--delta-window=] [--truncate=] <in> <out>
+///   transform-feats <transform-rxfilename> <in> <out>  [global transform]
+/// where <out> is "ark:-" (or "ark,t:-" etc.), <in> is "ark:-" except for the
+/// first command, and --print-args is ignored.  Anything else (other commands
+/// or options, shell syntax such as quotes or redirections, or a first command
+/// reading its standard input) makes us run the pipe as usual, so the output
+/// does not depend on whether the pipe was understood, except that matrices
+/// are not rounded as they would be by text-mode output.  As with the
+/// commands, utterances are skipped, with a warning, if apply-cmvn has no
+/// statistics for them or add-deltas gets an empty matrix.
+
+
+/// One command of the pipe.
+class FeaturePipeStage {
+ public:
+  /// Transforms the features of utterance 'utt'; returns false (after
+  /// printing a warning) if the command would produce no output for it.
+  virtual bool Apply(const std::string &utt, Matrix<BaseFloat> *feats) = 0;
+  virtual ~FeaturePipeStage() { }
+};
+
+
+/// If 'rspecifier' is an archive read from a pipe of commands that we can
+/// run in-process (see above), outputs the rspecifier of the pipe's input
+/// to 'input_rspecifier', appends the commands to 'stages' (the caller takes
+/// ownership) and returns true.  Otherwise returns false without changing
+/// the outputs.  It dies (KALDI_ERR) if a command's files (e.g. CMVN stats)
+/// cannot be read, as the command would have.
+bool ParseFeaturePipe(const std::string &rspecifier,
+                      std::string *input_rspecifier,
+                      std::vector<FeaturePipeStage*> *stages);
+
+
+/// This has the same interface as SequentialBaseFloatMatrixReader, and can be
+/// used in place of it by programs that read features; it runs pipes of the
+/// commands above in-process and reads any other rspecifier as usual.
+class SequentialFeaturePipeReader {
+ public:
+  SequentialFeaturePipeReader() { }
+
+  /// Like the default constructor plus Open(), but dies on error.
+  explicit SequentialFeaturePipeReader(const std::string &rspecifier);
+
+  bool Open(const std::string &rspecifier);
+
+  bool IsOpen() const { return reader_.IsOpen(); }
+
+  bool Done();
+
+  std::string Key();
+
+  const Matrix<BaseFloat> &Value();
+
+  void Next();
+
+  void FreeCurrent();
+
+  bool Close();
+
+  ~SequentialFeaturePipeReader();
+
+ private:
+  // Skips utterances for which some stage produces no output, and leaves the
+  // output of the stages for the current one in value_.
+  void ApplyStages();
+
+  SequentialBaseFloatMatrixReader reader_;
+  std::vector<FeaturePipeStage*> stages_;  // Empty if not running a pipe.
+  Matrix<BaseFloat> value_;  // The output of stages_, if nonempty.
+  KALDI_DISALLOW_COPY_AND_ASSIGN(SequentialFeaturePipeReader);
+};
+
+/// @} End of "addtogroup feat"
+}  // namespace kaldi
+
+
+#endif  // KALDI_FEAT_FEATURE_PIPE_H_
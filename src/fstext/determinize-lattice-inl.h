@@ -59,10 +59,10 @@ template<class IntType> class LatticeStringRepository {
 
     std::pair<typename SetType::iterator, bool> pr = set_.insert(new_entry_);
     if (pr.second) { // Was successfully inserted (was not there).  We need to
-                     // replace the element we inserted, which resides on the
-                     // stack, with one from the heap.
+                     // replace the element we inserted with a fresh one
+                     // from the arena.
       const Entry *ans = new_entry_;
-      new_entry_ = new Entry();
+      new_entry_ = NewEntry();
       return ans;
     } else { // Was not inserted because an equivalent Entry already
              // existed.
@@ -166,19 +166,20 @@ template<class IntType> class LatticeStringRepository {
     return e;
   }
 
-  LatticeStringRepository() { new_entry_ = new Entry; }
+  LatticeStringRepository(): block_used_(kBlockSize) {
+    new_entry_ = NewEntry();
+  }
 
   void Destroy() {
-    for (typename SetType::iterator iter = set_.begin();
-         iter != set_.end();
-         ++iter)
-      delete *iter;
     SetType tmp;
     tmp.swap(set_);
-    if (new_entry_) {
-      delete new_entry_;
-      new_entry_ = NULL;
-    }
+    for (size_t i = 0; i < blocks_.size(); i++)
+      delete [] blocks_[i];
+    std::vector<Entry*> tmp_blocks, tmp_free;
+    tmp_blocks.swap(blocks_);
+    tmp_free.swap(free_entries_);
+    block_used_ = kBlockSize;
+    new_entry_ = NULL;
   }
 
   // Rebuild will rebuild this object, guaranteeing only
@@ -191,11 +192,11 @@ template<class IntType> class LatticeStringRepository {
              iter = to_keep.begin();
          iter != to_keep.end(); ++iter)
       RebuildHelper(*iter, &tmp_set);
-    // Now delete all elems not in tmp_set.
+    // Now give back all elems not in tmp_set to the free list.
     for (typename SetType::iterator iter = set_.begin();
          iter != set_.end(); ++iter) {
-      if (tmp_set.count(*iter) == 0)
-        delete (*iter); // delete the Entry; not needed.
+      if (tmp_set.count(*iter) == 0)  // the Entry is not needed.
+        free_entries_.push_back(const_cast<Entry*>(*iter));
     }
     set_.swap(tmp_set);
   }
@@ -206,12 +207,17 @@ template<class IntType> class LatticeStringRepository {
     // on the size this structure might take.
   }
  private:
+  // Entries are allocated in blocks of this many, to avoid a separate new and
+  // delete for each string.
+  static const size_t kBlockSize = 1024;
+
   class EntryKey { // Hash function object.
    public:
     inline size_t operator()(const Entry *entry) const {
       size_t prime = 49109;
+      // Entries are aligned, so the low bits of 'parent' carry no information.
       return static_cast<size_t>(entry->i)
-          + prime * reinterpret_cast<size_t>(entry->parent);
+          + prime * (reinterpret_cast<size_t>(entry->parent) >> 3);
     }
   };
   class EntryEqual {
@@ -235,9 +241,27 @@ template<class IntType> class LatticeStringRepository {
     }
   }
 
+  // Returns an unused Entry, from the free list if possible, else from the
+  // current block (allocating a new block if needed).
+  inline Entry *NewEntry() {
+    if (!free_entries_.empty()) {
+      Entry *ans = free_entries_.back();
+      free_entries_.pop_back();
+      return ans;
+    }
+    if (block_used_ == kBlockSize) {
+      blocks_.push_back(new Entry[kBlockSize]);
+      block_used_ = 0;
+    }
+    return blocks_.back() + block_used_++;
+  }
+
   KALDI_DISALLOW_COPY_AND_ASSIGN(LatticeStringRepository);
   Entry *new_entry_; // We always have a pre-allocated Entry ready to use,
                      // to avoid unnecessary news and deletes.
+  std::vector<Entry*> blocks_;  // The blocks the Entries live in; owned here.
+  size_t block_used_;  // Number of Entries used in blocks_.back().
+  std::vector<Entry*> free_entries_;  // Entries given back by Rebuild().
   SetType set_;
 
 };
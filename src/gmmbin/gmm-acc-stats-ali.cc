@@ -23,6 +23,7 @@
 #include "gmm/am-diag-gmm.h"
 #include "hmm/transition-model.h"
 #include "gmm/mle-am-diag-gmm.h"
+#include "feat/feature-pipe.h"
 
 
 
@@ -69,7 +70,7 @@ int main(int argc, char *argv[]) {
     double tot_like = 0.0;
     kaldi::int64 tot_t = 0;
 
-    SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
+    SequentialFeaturePipeReader feature_reader(feature_rspecifier);
     RandomAccessInt32VectorReader alignments_reader(alignments_rspecifier);
 
     int32 num_done = 0, num_err = 0;
@@ -30,6 +30,7 @@
 #include "gmm/decodable-am-diag-gmm.h"
 #include "base/timer.h"
 #include "feat/feature-functions.h"  // feature reversal
+#include "feat/feature-pipe.h"
 
 int main(int argc, char *argv[]) {
   try {
@@ -104,7 +105,7 @@ int main(int argc, char *argv[]) {
     int num_done = 0, num_err = 0;
 
     if (ClassifyRspecifier(fst_in_str, NULL, NULL) == kNoRspecifier) {
-      SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
+      SequentialFeaturePipeReader feature_reader(feature_rspecifier);
       // Input FST is just one FST, not a table of FSTs.
       Fst<StdArc> *decode_fst = fst::ReadFstKaldiGeneric(fst_in_str);
       timer.Reset();
@@ -193,7 +193,8 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
                             DeterminizeLatticePrunedOptions opts):
       num_arcs_(0), num_elems_(0), ifst_(ifst.Copy()), beam_(beam), opts_(opts),
       equal_(opts_.delta), determinized_(false),
-      minimal_hash_(3, hasher_, equal_), initial_hash_(3, hasher_, equal_) {
+      minimal_hash_(3, hasher_, equal_), initial_hash_(3, hasher_, equal_),
+      subset_block_used_(kSubsetBlockSize) {
     KALDI_ASSERT(Weight::Properties() & kIdempotent); // this algorithm won't
     // work correctly otherwise.
   }
@@ -213,20 +214,10 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
       ifst_ = NULL;
     }
     { MinimalSubsetHash tmp; tmp.swap(minimal_hash_); }
-
-    for (size_t i = 0; i < output_states_.size(); i++) {
-      vector<Element> empty_subset;
-      empty_subset.swap(output_states_[i]->minimal_subset);
-    }
-
-    for (typename InitialSubsetHash::iterator iter = initial_hash_.begin();
-         iter != initial_hash_.end(); ++iter)
-      delete iter->first;
     { InitialSubsetHash tmp; tmp.swap(initial_hash_); }
-    for (size_t i = 0; i < output_states_.size(); i++) {
-      vector<Element> tmp;
-      tmp.swap(output_states_[i]->minimal_subset);
-    }
+    for (size_t i = 0; i < output_states_.size(); i++)
+      output_states_[i]->minimal_subset = Subset();
+    FreeSubsets();
     { vector<char> tmp;  tmp.swap(isymbol_or_final_); }
     { // Free up the queue.  I'm not sure how to make sure all
       // the memory is really freed (no swap() function)... doesn't really
@@ -275,9 +266,8 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     for (typename InitialSubsetHash::const_iterator
              iter = initial_hash_.begin();
          iter != initial_hash_.end(); ++iter) {
-      const vector<Element> &vec = *(iter->first);
       Element elem = iter->second;
-      AddStrings(vec, &needed_strings);
+      AddStrings(iter->first, &needed_strings);
       needed_strings.push_back(elem.string);
     }
     std::sort(needed_strings.begin(), needed_strings.end());
@@ -420,8 +410,22 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     Weight weight;
   };
 
+  // A subset of Elements that has been interned: the Elements live in
+  // subset_blocks_ (see InternSubset()) and are sorted on state id, without
+  // repeated states.  The hash is computed once, when the subset is created,
+  // so hash-table lookups and rehashing don't have to go over the Elements.
+  // A Subset may also be a view of a vector<Element> (see MakeSubset()), for
+  // lookups.
+  struct Subset {
+    const Element *elems;
+    size_t size;
+    size_t hash;
+    Subset(): elems(NULL), size(0), hash(0) { }
+    inline const Element *begin() const { return elems; }
+    inline const Element *end() const { return elems + size; }
+  };
+
   // Hashing function used in hash of subsets.
-  // A subset is a pointer to vector<Element>.
   // The Elements are in sorted order on state id, and without repeated states.
   // Because the order of Elements is fixed, we can use a hashing function that is
   // order-dependent.  However the weights are not included in the hashing function--
@@ -432,17 +436,25 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   //   We don't quantize the weights, in order to avoid inexactness in simple cases.
   // Instead we apply the delta when comparing subsets for equality, and allow a small
   // difference.
+  //   The hash is accumulated one Element at a time, so that it can be
+  // computed while a subset is being built (see NormalizeSubset()).
+  static inline size_t SubsetHashAppend(size_t hash, const Element &elem) {
+    return hash * 23531 + static_cast<size_t>(elem.state)
+        + 7853 * (reinterpret_cast<size_t>(elem.string) >> 3);
+  }
+
+  static size_t SubsetHash(const vector<Element> &subset) {
+    size_t hash = 0;
+    for (typename vector<Element>::const_iterator iter = subset.begin();
+         iter != subset.end(); ++iter)
+      hash = SubsetHashAppend(hash, *iter);
+    return hash;
+  }
 
   class SubsetKey {
    public:
-    size_t operator ()(const vector<Element> * subset) const {  // hashes only the state and string.
-      size_t hash = 0, factor = 1;
-      for (typename vector<Element>::const_iterator iter= subset->begin(); iter != subset->end(); ++iter) {
-        hash *= factor;
-        hash += iter->state + reinterpret_cast<size_t>(iter->string);
-        factor *= 23531;  // these numbers are primes.
-      }
-      return hash;
+    inline size_t operator ()(const Subset &subset) const {
+      return subset.hash;
     }
   };
 
@@ -450,12 +462,10 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   // and string, and approximate match on weights.
   class SubsetEqual {
    public:
-    bool operator ()(const vector<Element> * s1, const vector<Element> * s2) const {
-      size_t sz = s1->size();
-      KALDI_ASSERT(sz>=0);
-      if (sz != s2->size()) return false;
-      typename vector<Element>::const_iterator iter1 = s1->begin(),
-          iter1_end = s1->end(), iter2=s2->begin();
+    bool operator ()(const Subset &s1, const Subset &s2) const {
+      if (s1.hash != s2.hash || s1.size != s2.size) return false;
+      const Element *iter1 = s1.elems, *iter1_end = s1.elems + s1.size,
+          *iter2 = s2.elems;
       for (; iter1 < iter1_end; ++iter1, ++iter2) {
         if (iter1->state != iter2->state ||
            iter1->string != iter2->string ||
@@ -468,26 +478,9 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     SubsetEqual(): delta_(kDelta) {}
   };
 
-  // Operator that says whether two Elements have the same states.
-  // Used only for debug.
-  class SubsetEqualStates {
-   public:
-    bool operator ()(const vector<Element> * s1, const vector<Element> * s2) const {
-      size_t sz = s1->size();
-      KALDI_ASSERT(sz>=0);
-      if (sz != s2->size()) return false;
-      typename vector<Element>::const_iterator iter1 = s1->begin(),
-          iter1_end = s1->end(), iter2=s2->begin();
-      for (; iter1 < iter1_end; ++iter1, ++iter2) {
-        if (iter1->state != iter2->state) return false;
-      }
-      return true;
-    }
-  };
-
   // Define the hash type we use to map subsets (in minimal
   // representation) to OutputStateId.
-  typedef unordered_map<const vector<Element>*, OutputStateId,
+  typedef unordered_map<Subset, OutputStateId,
                         SubsetKey, SubsetEqual> MinimalSubsetHash;
 
   // Define the hash type we use to map subsets (in initial
@@ -495,9 +488,55 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   // extra weight. [note: we interpret the Element.state in here
   // as an OutputStateId even though it's declared as InputStateId;
   // these types are the same anyway].
-  typedef unordered_map<const vector<Element>*, Element,
+  typedef unordered_map<Subset, Element,
                         SubsetKey, SubsetEqual> InitialSubsetHash;
 
+  // Returns a Subset that is a view of "subset", whose hash must be "hash";
+  // it is only valid while "subset" is unchanged.
+  static inline Subset MakeSubset(const vector<Element> &subset, size_t hash) {
+    Subset ans;
+    ans.elems = (subset.empty() ? NULL : &(subset[0]));
+    ans.size = subset.size();
+    ans.hash = hash;
+    return ans;
+  }
+
+  // Copies the Elements of "subset" into subset_blocks_ and returns the
+  // interned Subset.  Subsets are never freed individually; all of them are
+  // freed together in FreeMostMemory().
+  Subset InternSubset(const vector<Element> &subset, size_t hash) {
+    Subset ans;
+    ans.size = subset.size();
+    ans.hash = hash;
+    if (ans.size == 0) return ans;
+    Element *elems;
+    if (ans.size > kSubsetBlockSize / 4) {
+      // Large subsets get a block of their own, so we don't waste the rest
+      // of the current block.
+      elems = new Element[ans.size];
+      subset_blocks_.insert(subset_blocks_.end() -
+                            (subset_blocks_.empty() ? 0 : 1), elems);
+    } else {
+      if (ans.size > kSubsetBlockSize - subset_block_used_) {
+        subset_blocks_.push_back(new Element[kSubsetBlockSize]);
+        subset_block_used_ = 0;
+      }
+      elems = subset_blocks_.back() + subset_block_used_;
+      subset_block_used_ += ans.size;
+    }
+    std::copy(subset.begin(), subset.end(), elems);
+    ans.elems = elems;
+    return ans;
+  }
+
+  void FreeSubsets() {
+    for (size_t i = 0; i < subset_blocks_.size(); i++)
+      delete [] subset_blocks_[i];
+    vector<Element*> tmp;
+    tmp.swap(subset_blocks_);
+    subset_block_used_ = kSubsetBlockSize;
+  }
+
 
   // converts the representation of the subset from canonical (all states) to
   // minimal (only states with output symbols on arcs leaving them, and final
@@ -521,10 +560,12 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   // If it creates a new OutputStateId, it creates a new record for it, works
   // out its final-weight, and puts stuff on the queue relating to its
   // transitions.
+  // "hash" must be the hash of "subset" (see SubsetHash()).
   OutputStateId MinimalToStateId(const vector<Element> &subset,
+                                 size_t hash,
                                  const double forward_cost) {
     typename MinimalSubsetHash::const_iterator iter
-        = minimal_hash_.find(&subset);
+        = minimal_hash_.find(MakeSubset(subset, hash));
     if (iter != minimal_hash_.end()) { // Found a matching subset.
       OutputStateId state_id = iter->second;
       const OutputState &state = *(output_states_[state_id]);
@@ -538,8 +579,9 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
       return state_id;
     }
     OutputStateId state_id = static_cast<OutputStateId>(output_states_.size());
-    OutputState *new_state = new OutputState(subset, forward_cost);
-    minimal_hash_[&(new_state->minimal_subset)] = state_id;
+    OutputState *new_state = new OutputState(InternSubset(subset, hash),
+                                             forward_cost);
+    minimal_hash_[new_state->minimal_subset] = state_id;
     output_states_.push_back(new_state);
     num_elems_ += subset.size();
     // Note: in the previous algorithm, we pushed the new state-id onto the queue
@@ -552,13 +594,15 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
 
 
   // Given a normalized initial subset of elements (i.e. before epsilon closure),
-  // compute the corresponding output-state.
+  // compute the corresponding output-state.  "hash" must be the hash of
+  // "subset_in".
   OutputStateId InitialToStateId(const vector<Element> &subset_in,
+                                 size_t hash,
                                  double forward_cost,
                                  Weight *remaining_weight,
                                  StringId *common_prefix) {
     typename InitialSubsetHash::const_iterator iter
-        = initial_hash_.find(&subset_in);
+        = initial_hash_.find(MakeSubset(subset_in, hash));
     if (iter != initial_hash_.end()) { // Found a matching subset.
       const Element &elem = iter->second;
       *remaining_weight = elem.weight;
@@ -578,12 +622,14 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
 
     Element elem; // will be used to store remaining weight and string, and
                  // OutputStateId, in initial_hash_;
-    NormalizeSubset(&subset, &elem.weight, &elem.string); // normalize subset; put
+    size_t minimal_hash;
+    NormalizeSubset(&subset, &elem.weight, &elem.string,
+                    &minimal_hash); // normalize subset; put
     // common string and weight in "elem".  The subset is now a minimal,
     // normalized subset.
 
     forward_cost += ConvertToCost(elem.weight);
-    OutputStateId ans = MinimalToStateId(subset, forward_cost);
+    OutputStateId ans = MinimalToStateId(subset, minimal_hash, forward_cost);
     *remaining_weight = elem.weight;
     *common_prefix = elem.string;
     if (elem.weight == Weight::Zero())
@@ -592,10 +638,9 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     // Before returning "ans", add the initial subset to the hash,
     // so that we can bypass the epsilon-closure etc., next time
     // we process the same initial subset.
-    vector<Element> *initial_subset_ptr = new vector<Element>(subset_in);
     elem.state = ans;
-    initial_hash_[initial_subset_ptr] = elem;
-    num_elems_ += initial_subset_ptr->size(); // keep track of memory usage.
+    initial_hash_[InternSubset(subset_in, hash)] = elem;
+    num_elems_ += subset_in.size(); // keep track of memory usage.
     return ans;
   }
 
@@ -735,7 +780,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
 
   void ProcessFinal(OutputStateId output_state_id) {
     OutputState &state = *(output_states_[output_state_id]);
-    const vector<Element> &minimal_subset = state.minimal_subset;
+    const Subset &minimal_subset = state.minimal_subset;
     // processes final-weights for this subset.  state.minimal_subset_ may be
     // empty if the graphs is not connected/trimmed, I think, do don't check
     // that it's nonempty.
@@ -743,7 +788,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     // compiler happy; if it doesn't get set in the loop, we won't use the value anyway.
     Weight final_weight = Weight::Zero();
     bool is_final = false;
-    typename vector<Element>::const_iterator iter = minimal_subset.begin(), end = minimal_subset.end();
+    const Element *iter = minimal_subset.begin(), *end = minimal_subset.end();
     for (; iter != end; ++iter) {
       const Element &elem = *iter;
       Weight this_final_weight = Times(elem.weight, ifst_->Final(elem.state));
@@ -776,9 +821,13 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   // NormalizeSubset normalizes the subset "elems" by
   // removing any common string prefix (putting it in common_str),
   // and dividing by the total weight (putting it in tot_weight).
+  // It also outputs the hash of the normalized subset to "hash", as it
+  // is cheaper to compute it here than in a separate pass.
   void NormalizeSubset(vector<Element> *elems,
                        Weight *tot_weight,
-                       StringId *common_str) {
+                       StringId *common_str,
+                       size_t *hash) {
+    *hash = 0;
     if(elems->empty()) { // just set common_str, tot_weight
       // to defaults and return...
       KALDI_WARN << "empty subset";
@@ -801,6 +850,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
       (*elems)[i].weight = Divide((*elems)[i].weight, weight, DIVIDE_LEFT);
       (*elems)[i].string =
           repository_.RemovePrefix((*elems)[i].string, prefix_len);
+      *hash = SubsetHashAppend(*hash, (*elems)[i]);
     }
     *common_str = repository_.ConvertFromVector(common_prefix);
     *tot_weight = weight;
@@ -851,7 +901,8 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     double forward_cost = output_states_[ostate_id]->forward_cost;
     StringId common_str;
     Weight tot_weight;
-    NormalizeSubset(subset, &tot_weight, &common_str);
+    size_t hash;
+    NormalizeSubset(subset, &tot_weight, &common_str, &hash);
     forward_cost += ConvertToCost(tot_weight);
 
     OutputStateId nextstate;
@@ -859,6 +910,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
       Weight next_tot_weight;
       StringId next_common_str;
       nextstate = InitialToStateId(*subset,
+                                   hash,
                                    forward_cost,
                                    &next_tot_weight,
                                    &next_common_str);
@@ -903,7 +955,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   // the information we need to process the transition.
 
   void ProcessTransitions(OutputStateId output_state_id) {
-    const vector<Element> &minimal_subset = output_states_[output_state_id]->minimal_subset;
+    const Subset &minimal_subset = output_states_[output_state_id]->minimal_subset;
     // it's possible that minimal_subset could be empty if there are
     // unreachable parts of the graph, so don't check that it's nonempty.
     vector<pair<Label, Element> > &all_elems(all_elems_tmp_); // use class member
@@ -911,7 +963,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     {
       // Push back into "all_elems", elements corresponding to all
       // non-epsilon-input transitions out of all states in "minimal_subset".
-      typename vector<Element>::const_iterator iter = minimal_subset.begin(), end = minimal_subset.end();
+      const Element *iter = minimal_subset.begin(), *end = minimal_subset.end();
       for (;iter != end; ++iter) {
         const Element &elem = *iter;
         for (ArcIterator<ExpandedFst<Arc> > aiter(*ifst_, elem.state); ! aiter.Done(); aiter.Next()) {
@@ -1080,12 +1132,13 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
       // Weight::One() is the "forward-weight" of this determinized state...
       // i.e. the minimal cost from the start of the determinized FST to this
       // state [One() because it's the start state].
-      OutputState *initial_state = new OutputState(subset, 0);
+      OutputState *initial_state =
+          new OutputState(InternSubset(subset, SubsetHash(subset)), 0);
       KALDI_ASSERT(output_states_.empty());
       output_states_.push_back(initial_state);
       num_elems_ += subset.size();
       OutputStateId initial_state_id = 0;
-      minimal_hash_[&(initial_state->minimal_subset)] = initial_state_id;
+      minimal_hash_[initial_state->minimal_subset] = initial_state_id;
       ProcessFinal(initial_state_id);
       ProcessTransitions(initial_state_id); // this will add tasks to
       // the queue, which we'll start processing in Determinize().
@@ -1095,7 +1148,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   KALDI_DISALLOW_COPY_AND_ASSIGN(LatticeDeterminizerPruned);
 
   struct OutputState {
-    vector<Element> minimal_subset;
+    Subset minimal_subset;  // interned; also a key of minimal_hash_.
     vector<TempArc> arcs; // arcs out of the state-- those that have been processed.
     // Note: the final-weight is included here with kNoStateId as the state id.  We
     // always process the final-weight regardless of the beam; when producing the
@@ -1105,7 +1158,7 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     // Note: we know this minimal cost from when we first create the OutputState;
     // this is because of the priority-queue we use, that ensures that the
     // "best" path into the state will be expanded first.
-    OutputState(const vector<Element> &minimal_subset,
+    OutputState(const Subset &minimal_subset,
                 double forward_cost): minimal_subset(minimal_subset),
                                       forward_cost(forward_cost) { }
   };
@@ -1133,8 +1186,8 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   // sure this object is used correctly.
   MinimalSubsetHash minimal_hash_;  // hash from Subset to OutputStateId.  Subset is "minimal
                                     // representation" (only include final and states and states with
-                                    // nonzero ilabel on arc out of them.  Owns the pointers
-                                    // in its keys.
+                                    // nonzero ilabel on arc out of them.  Its keys are
+                                    // interned in subset_blocks_.
   InitialSubsetHash initial_hash_;   // hash from Subset to Element, which
                                      // represents the OutputStateId together
                                      // with an extra weight and string.  Subset
@@ -1142,8 +1195,15 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
                                      // weight and string is needed because after
                                      // we convert to minimal representation and
                                      // normalize, there may be an extra weight
-                                     // and string.  Owns the pointers
-                                     // in its keys.
+                                     // and string.  Its keys are interned
+                                     // in subset_blocks_.
+
+  // Subsets are interned in blocks of this many Elements (see InternSubset()).
+  static const size_t kSubsetBlockSize = 4096;
+  vector<Element*> subset_blocks_;  // Storage for the Elements of all interned
+                                    // subsets; the last one is the current
+                                    // block.  Owned here.
+  size_t subset_block_used_;  // Number of Elements used in the current block.
 
   struct Task {
     OutputStateId state; // State from which we're processing the transition.
@@ -1185,6 +1245,12 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
          iter != vec.end(); ++iter)
       needed_strings->push_back(iter->string);
   }
+
+  void AddStrings(const Subset &subset,
+                  vector<StringId> *needed_strings) {
+    for (const Element *iter = subset.begin(); iter != subset.end(); ++iter)
+      needed_strings->push_back(iter->string);
+  }
 };
 
 
@@ -155,6 +155,36 @@ void TestLatticeTableCross(bool binary) {
 }
 
 
+// CompactLattice in the packed format, read by random access via the scp file.
+void TestCompactLatticeTablePacked() {
+  CompactLatticeWriter writer("ark,scp,compact:tmpf,tmpf.scp");
+  int N = 10;
+  std::vector<CompactLattice*> lat_vec(N);
+  for (int i = 0; i < N; i++) {
+    std::string key = "key" + std::to_string(i);
+    CompactLattice *fst = RandCompactLattice();
+    lat_vec[i] = fst;
+    writer.Write(key, *fst);
+  }
+  writer.Close();
+
+  RandomAccessCompactLatticeReader reader("scp:tmpf.scp");
+  SequentialLatticeReader lat_reader("ark:tmpf");
+  for (int i = N - 1; i >= 0; i--) {
+    std::string key = "key" + std::to_string(i);
+    const CompactLattice &fst = reader.Value(key);
+    // The weights are quantized, so they are only approximately equal.
+    KALDI_ASSERT(fst::Equal(fst, *(lat_vec[i]), 0.01));
+  }
+  for (int i = 0; i < N; i++, lat_reader.Next()) {
+    KALDI_ASSERT(!lat_reader.Done());
+    Lattice lat;
+    ConvertLattice(*(lat_vec[i]), &lat);
+    KALDI_ASSERT(fst::RandEquivalent(lat_reader.Value(), lat, 5, 0.01,
+                                     Rand(), 10));
+    delete lat_vec[i];
+  }
+}
 
 } // end namespace kaldi
 
@@ -167,7 +197,9 @@ int main() {
     TestLatticeTable(binary);
     TestLatticeTableCross(binary);
   }
+  TestCompactLatticeTablePacked();
   std::cout << "Test OK\n";
   
   unlink("tmpf");
+  unlink("tmpf.scp");
 }
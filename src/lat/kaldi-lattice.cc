@@ -19,6 +19,9 @@
 // limitations under the License.
 
 
+#include <cmath>
+#include <cstring>
+#include <limits>
 #include "lat/kaldi-lattice.h"
 #include "fst/script/print-impl.h"
 
@@ -363,6 +366,234 @@ bool ReadCompactLattice(std::istream &is, bool binary,
 }
 
 
+// The packed format starts with this magic string; its first character also
+// distinguishes it from the text format (which begins with whitespace) and
+// from the OpenFst binary format (which begins with char 214).
+static const char kPackedLatticeMagic[4] = { 'P', 'L', 'a', 't' };
+
+// Appends x to *buf as a variable-length integer, 7 bits per byte, least
+// significant first; the high bit of a byte is set if more bytes follow.
+static inline void PutVarint(uint64 x, std::string *buf) {
+  while (x >= 0x80) {
+    buf->push_back(static_cast<char>((x & 0x7F) | 0x80));
+    x >>= 7;
+  }
+  buf->push_back(static_cast<char>(x));
+}
+
+// Reads a variable-length integer from [*cur, end); returns false if the data
+// ends first or the integer is too long.
+static inline bool GetVarint(const char **cur, const char *end, uint64 *x) {
+  uint64 ans = 0;
+  for (int32 shift = 0; shift < 64; shift += 7) {
+    if (*cur == end) return false;
+    uint64 byte = static_cast<unsigned char>(*((*cur)++));
+    ans |= (byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      *x = ans;
+      return true;
+    }
+  }
+  return false;
+}
+
+static inline uint64 ZigZag(int64 x) {
+  return (static_cast<uint64>(x) << 1) ^ static_cast<uint64>(x >> 63);
+}
+
+static inline int64 UnZigZag(uint64 x) {
+  return static_cast<int64>(x >> 1) ^ -static_cast<int64>(x & 1);
+}
+
+// A cost is written as 0 for +infinity, else as 1 + ZigZag(q), where q is the
+// cost divided by weight_step and rounded.
+static inline bool PutPackedCost(float cost, BaseFloat weight_step,
+                                 std::string *buf) {
+  if (cost == std::numeric_limits<float>::infinity()) {
+    PutVarint(0, buf);
+    return true;
+  }
+  double q = std::floor(cost / weight_step + 0.5);
+  if (!(std::abs(q) < 4.0e+18))  // also catches NaN and -infinity.
+    return false;
+  PutVarint(1 + ZigZag(static_cast<int64>(q)), buf);
+  return true;
+}
+
+static inline bool GetPackedCost(const char **cur, const char *end,
+                                 BaseFloat weight_step, float *cost) {
+  uint64 code;
+  if (!GetVarint(cur, end, &code)) return false;
+  if (code == 0)
+    *cost = std::numeric_limits<float>::infinity();
+  else
+    *cost = static_cast<float>(UnZigZag(code - 1) * weight_step);
+  return true;
+}
+
+static inline bool PutPackedWeight(const CompactLatticeWeight &w,
+                                   BaseFloat weight_step, std::string *buf) {
+  if (!PutPackedCost(w.Weight().Value1(), weight_step, buf) ||
+      !PutPackedCost(w.Weight().Value2(), weight_step, buf))
+    return false;
+  const std::vector<int32> &str = w.String();
+  PutVarint(str.size(), buf);
+  for (size_t i = 0; i < str.size(); i++)
+    PutVarint(static_cast<uint32>(str[i]), buf);
+  return true;
+}
+
+static inline bool GetPackedWeight(const char **cur, const char *end,
+                                   BaseFloat weight_step,
+                                   CompactLatticeWeight *w) {
+  float value1, value2;
+  uint64 len, label;
+  if (!GetPackedCost(cur, end, weight_step, &value1) ||
+      !GetPackedCost(cur, end, weight_step, &value2) ||
+      !GetVarint(cur, end, &len) || len > static_cast<uint64>(end - *cur))
+    return false;
+  std::vector<int32> str(len);
+  for (size_t i = 0; i < len; i++) {
+    if (!GetVarint(cur, end, &label)) return false;
+    str[i] = static_cast<int32>(static_cast<uint32>(label));
+  }
+  *w = CompactLatticeWeight(LatticeWeight(value1, value2), str);
+  return true;
+}
+
+bool WriteCompactLatticePacked(std::ostream &os, const CompactLattice &clat,
+                               BaseFloat weight_step) {
+  typedef CompactLatticeArc::StateId StateId;
+  KALDI_ASSERT(weight_step > 0.0);
+  // The body is encoded in memory first so that we can write its size ahead
+  // of it; this lets the reader get it with a single read.
+  std::string body;
+  StateId num_states = clat.NumStates();
+  PutVarint(num_states, &body);
+  PutVarint(clat.Start() + 1, &body);  // kNoStateId (-1) becomes 0.
+  for (StateId s = 0; s < num_states; s++) {
+    const CompactLatticeWeight &final_weight = clat.Final(s);
+    bool is_final = (final_weight != CompactLatticeWeight::Zero());
+    PutVarint((static_cast<uint64>(clat.NumArcs(s)) << 1) | is_final, &body);
+    if (is_final && !PutPackedWeight(final_weight, weight_step, &body)) {
+      KALDI_WARN << "Cannot write weight " << final_weight
+                 << " in packed lattice format.";
+      return false;
+    }
+    for (fst::ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done();
+         aiter.Next()) {
+      const CompactLatticeArc &arc = aiter.Value();
+      // Lattices are usually acceptors; then we don't write the olabel.
+      bool same_labels = (arc.ilabel == arc.olabel);
+      PutVarint((static_cast<uint64>(static_cast<uint32>(arc.ilabel)) << 1) |
+                !same_labels, &body);
+      if (!same_labels)
+        PutVarint(static_cast<uint32>(arc.olabel), &body);
+      PutVarint(ZigZag(static_cast<int64>(arc.nextstate) - s), &body);
+      if (!PutPackedWeight(arc.weight, weight_step, &body)) {
+        KALDI_WARN << "Cannot write weight " << arc.weight
+                   << " in packed lattice format.";
+        return false;
+      }
+    }
+  }
+  std::string header(kPackedLatticeMagic, sizeof(kPackedLatticeMagic));
+  float step = weight_step;
+  header.append(reinterpret_cast<const char*>(&step), sizeof(step));
+  PutVarint(body.size(), &header);
+  os.write(header.data(), header.size());
+  os.write(body.data(), body.size());
+  return os.good();
+}
+
+bool ReadCompactLatticePacked(std::istream &is, CompactLattice **clat) {
+  typedef CompactLatticeArc::StateId StateId;
+  KALDI_ASSERT(*clat == NULL);
+  char magic[sizeof(kPackedLatticeMagic)];
+  float weight_step;
+  is.read(magic, sizeof(magic));
+  is.read(reinterpret_cast<char*>(&weight_step), sizeof(weight_step));
+  if (!is.good() ||
+      memcmp(magic, kPackedLatticeMagic, sizeof(magic)) != 0) {
+    KALDI_WARN << "Reading packed lattice: bad header.";
+    return false;
+  }
+  uint64 body_size = 0;
+  for (int32 shift = 0; shift < 64; shift += 7) {
+    int c = is.get();
+    if (c == EOF) {
+      KALDI_WARN << "Reading packed lattice: unexpected end of stream.";
+      return false;
+    }
+    body_size |= static_cast<uint64>(c & 0x7F) << shift;
+    if (!(c & 0x80)) break;
+  }
+  std::string body(body_size, '\0');
+  if (body_size != 0)
+    is.read(&(body[0]), body_size);
+  if (!is.good()) {
+    KALDI_WARN << "Reading packed lattice: unexpected end of stream.";
+    return false;
+  }
+
+  const char *cur = body.data(), *end = body.data() + body.size();
+  uint64 num_states, start, code, olabel, delta;
+  if (!GetVarint(&cur, end, &num_states) || !GetVarint(&cur, end, &start) ||
+      num_states > body_size || start > num_states) {
+    KALDI_WARN << "Reading packed lattice: bad data.";
+    return false;
+  }
+  CompactLattice *ans = new CompactLattice();
+  ans->ReserveStates(num_states);
+  for (uint64 s = 0; s < num_states; s++)
+    ans->AddState();
+  ans->SetStart(static_cast<StateId>(start) - 1);
+  bool ok = true;
+  for (StateId s = 0; ok && s < static_cast<StateId>(num_states); s++) {
+    if (!GetVarint(&cur, end, &code)) {
+      ok = false;
+      break;
+    }
+    uint64 num_arcs = code >> 1;
+    if (code & 1) {
+      CompactLatticeWeight final_weight;
+      if (!(ok = GetPackedWeight(&cur, end, weight_step, &final_weight)))
+        break;
+      ans->SetFinal(s, final_weight);
+    }
+    if (num_arcs > static_cast<uint64>(end - cur)) {
+      ok = false;
+      break;
+    }
+    ans->ReserveArcs(s, num_arcs);
+    for (uint64 a = 0; a < num_arcs; a++) {
+      CompactLatticeArc arc;
+      if (!GetVarint(&cur, end, &code)) { ok = false; break; }
+      arc.ilabel = static_cast<int32>(static_cast<uint32>(code >> 1));
+      olabel = code >> 1;
+      if ((code & 1) && !GetVarint(&cur, end, &olabel)) { ok = false; break; }
+      arc.olabel = static_cast<int32>(static_cast<uint32>(olabel));
+      if (!GetVarint(&cur, end, &delta)) { ok = false; break; }
+      int64 nextstate = s + UnZigZag(delta);
+      if (nextstate < 0 || nextstate >= static_cast<int64>(num_states) ||
+          !GetPackedWeight(&cur, end, weight_step, &arc.weight)) {
+        ok = false;
+        break;
+      }
+      arc.nextstate = static_cast<StateId>(nextstate);
+      ans->AddArc(s, arc);
+    }
+  }
+  if (!ok || cur != end) {
+    KALDI_WARN << "Reading packed lattice: bad data.";
+    delete ans;
+    return false;
+  }
+  *clat = ans;
+  return true;
+}
+
+
 bool CompactLatticeHolder::Read(std::istream &is) {
   Clear(); // in case anything currently stored.
   int c = is.peek();
@@ -374,6 +605,8 @@ bool CompactLatticeHolder::Read(std::istream &is) {
     // cannot begin with space because it starts with the FST Type() which is not
     // space).
     return ReadCompactLattice(is, false, &t_);
+  } else if (c == kPackedLatticeMagic[0]) {
+    return ReadCompactLatticePacked(is, &t_);
   } else if (c != 214) { // 214 is first char of FST magic number,
     // on little-endian machines which is all we support (\326 octal)
     KALDI_WARN << "Reading compact lattice: does not appear to be an FST "
@@ -490,6 +723,14 @@ bool LatticeHolder::Read(std::istream &is) {
     // cannot begin with space because it starts with the FST Type() which is not
     // space).
     return ReadLattice(is, false, &t_);
+  } else if (c == kPackedLatticeMagic[0]) {
+    CompactLattice *clat = NULL;
+    if (!ReadCompactLatticePacked(is, &clat))
+      return false;
+    t_ = new Lattice();
+    ConvertLattice(*clat, t_);
+    delete clat;
+    return true;
   } else if (c != 214) { // 214 is first char of FST magic number,
     // on little-endian machines which is all we support (\326 octal)
     KALDI_WARN << "Reading compact lattice: does not appear to be an FST "
@@ -65,6 +65,24 @@ bool ReadCompactLattice(std::istream &is, bool binary,
 bool ReadLattice(std::istream &is, bool binary,
                  Lattice **lat);
 
+// The following functions write and read CompactLattice in a compact binary
+// format (the "packed" format), in which labels, string lengths and
+// destination states (as the difference from the source state) are written as
+// variable-length integers and the weights are quantized to multiples of
+// "weight_step".  It is typically a few times smaller than the OpenFst binary
+// format, but it is lossy in the weights: each cost is rounded by at most
+// weight_step / 2.  CompactLatticeWriter uses it if the wspecifier has the
+// "compact" option, e.g. "ark,scp,compact:foo.ark,foo.scp" (the scp file
+// gives byte offsets for random access); CompactLatticeHolder::Read() and
+// LatticeHolder::Read() recognize it.
+const BaseFloat kPackedLatticeWeightStep = 1.0 / 1024;
+
+bool WriteCompactLatticePacked(std::ostream &os, const CompactLattice &clat,
+                               BaseFloat weight_step = kPackedLatticeWeightStep);
+// the following function requires that *clat be
+// NULL when called.
+bool ReadCompactLatticePacked(std::istream &is, CompactLattice **clat);
+
 
 class CompactLatticeHolder {
  public:
@@ -79,6 +97,11 @@ class CompactLatticeHolder {
     return WriteCompactLattice(os, binary, t);
   }
 
+  // Used instead of Write() with the "compact" wspecifier option.
+  static bool WriteCompact(std::ostream &os, const T &t) {
+    return WriteCompactLatticePacked(os, t);
+  }
+
   bool Read(std::istream &is);
 
   static bool IsReadInBinary() { return true; }
@@ -147,81 +147,138 @@ int32 CompactLatticeStateTimes(const CompactLattice &lat, vector<int32> *times)
   return utt_len;
 }
 
-bool ComputeCompactLatticeAlphas(const CompactLattice &clat,
-                                 vector<double> *alpha) {
-  using namespace fst;
+// Gets the negated total cost and the acoustic cost of a lattice weight.
+static inline void GetLikes(const LatticeWeight &w, double *like,
+                            double *acoustic_cost) {
+  *like = -(static_cast<double>(w.Value1()) + w.Value2());
+  *acoustic_cost = w.Value2();
+}
 
-  // typedef the arc, weight types
-  typedef CompactLattice::Arc Arc;
-  typedef Arc::Weight Weight;
-  typedef Arc::StateId StateId;
+static inline void GetLikes(const CompactLatticeWeight &w, double *like,
+                            double *acoustic_cost) {
+  GetLikes(w.Weight(), like, acoustic_cost);
+}
 
-  //Make sure the lattice is topologically sorted.
-  if (clat.Properties(fst::kTopSorted, true) == 0) {
+template<typename LatticeType>
+bool ConvertToLatticeCsr(const LatticeType &lat, LatticeCsr *csr) {
+  typedef typename LatticeType::Arc Arc;
+  typedef typename Arc::StateId StateId;
+
+  if (lat.Properties(fst::kTopSorted, true) == 0) {
     KALDI_WARN << "Input lattice must be topologically sorted.";
     return false;
   }
-  if (clat.Start() != 0) {
+  if (lat.Start() != 0) {
     KALDI_WARN << "Input lattice must start from state 0.";
     return false;
   }
-
-  int32 num_states = clat.NumStates();
-  (*alpha).resize(0);
-  (*alpha).resize(num_states, kLogZeroDouble);
-
-  // Now propagate alphas forward. Note that we don't acount the weight of the
-  // final state to alpha[final_state] -- we acount it to beta[final_state];
-  (*alpha)[0] = 0.0;
+  StateId num_states = lat.NumStates();
+  size_t num_arcs = 0;
+  for (StateId s = 0; s < num_states; s++)
+    num_arcs += lat.NumArcs(s);
+
+  csr->num_states = num_states;
+  csr->arc_begin.resize(num_states + 1);
+  csr->arc_src.resize(num_arcs);
+  csr->arc_dest.resize(num_arcs);
+  csr->arc_ilabel.resize(num_arcs);
+  csr->arc_like.resize(num_arcs);
+  csr->arc_acoustic_cost.resize(num_arcs);
+  csr->final_like.resize(num_states);
+  csr->final_acoustic_cost.resize(num_states);
+  csr->in_arc_begin.assign(num_states + 1, 0);
+  csr->in_arcs.resize(num_arcs);
+
+  int32 a = 0;
   for (StateId s = 0; s < num_states; s++) {
-    double this_alpha = (*alpha)[s];
-    for (ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done(); aiter.Next()) {
+    csr->arc_begin[s] = a;
+    for (fst::ArcIterator<LatticeType> aiter(lat, s); !aiter.Done();
+         aiter.Next(), a++) {
       const Arc &arc = aiter.Value();
-      double arc_like = -(arc.weight.Weight().Value1() + arc.weight.Weight().Value2());
-      (*alpha)[arc.nextstate] = LogAdd((*alpha)[arc.nextstate], this_alpha + arc_like);
+      csr->arc_src[a] = s;
+      csr->arc_dest[a] = arc.nextstate;
+      csr->arc_ilabel[a] = arc.ilabel;
+      GetLikes(arc.weight, &(csr->arc_like[a]), &(csr->arc_acoustic_cost[a]));
+      csr->in_arc_begin[arc.nextstate + 1]++;
     }
-  }
-
+    GetLikes(lat.Final(s), &(csr->final_like[s]),
+             &(csr->final_acoustic_cost[s]));
+  }
+  csr->arc_begin[num_states] = a;
+
+  // Counting sort of the arcs on their destination state.
+  for (StateId s = 0; s < num_states; s++)
+    csr->in_arc_begin[s + 1] += csr->in_arc_begin[s];
+  std::vector<int32> next_in(csr->in_arc_begin.begin(),
+                             csr->in_arc_begin.end() - 1);
+  for (a = 0; a < static_cast<int32>(num_arcs); a++)
+    csr->in_arcs[next_in[csr->arc_dest[a]]++] = a;
   return true;
 }
 
-bool ComputeCompactLatticeBetas(const CompactLattice &clat,
-                                vector<double> *beta) {
-  using namespace fst;
-
-  // typedef the arc, weight types
-  typedef CompactLattice::Arc Arc;
-  typedef Arc::Weight Weight;
-  typedef Arc::StateId StateId;
+// instantiate the template for Lattice and CompactLattice
+template
+bool ConvertToLatticeCsr(const Lattice &lat, LatticeCsr *csr);
 
-  // Make sure the lattice is topologically sorted.
-  if (clat.Properties(fst::kTopSorted, true) == 0) {
-    KALDI_WARN << "Input lattice must be topologically sorted.";
-    return false;
-  }
-  if (clat.Start() != 0) {
-    KALDI_WARN << "Input lattice must start from state 0.";
-    return false;
+template
+bool ConvertToLatticeCsr(const CompactLattice &lat, LatticeCsr *csr);
+
+
+double LatticeCsrAlphas(const LatticeCsr &csr, bool viterbi,
+                        vector<double> *alpha) {
+  int32 num_states = csr.num_states;
+  alpha->resize(num_states);
+  vector<double> terms;
+  for (int32 s = 0; s < num_states; s++) {
+    terms.clear();
+    if (s == 0)
+      terms.push_back(0.0);  // the start state.
+    for (int32 i = csr.in_arc_begin[s]; i < csr.in_arc_begin[s + 1]; i++) {
+      int32 a = csr.in_arcs[i];
+      terms.push_back((*alpha)[csr.arc_src[a]] + csr.arc_like[a]);
+    }
+    (*alpha)[s] = LogSumExpArray(terms.data(), terms.size(), viterbi);
   }
+  terms.resize(num_states);
+  for (int32 s = 0; s < num_states; s++)
+    terms[s] = (*alpha)[s] + csr.final_like[s];
+  return LogSumExpArray(terms.data(), num_states, viterbi);
+}
 
-  int32 num_states = clat.NumStates();
-  (*beta).resize(0);
-  (*beta).resize(num_states, kLogZeroDouble);
+double LatticeCsrBetas(const LatticeCsr &csr, bool viterbi,
+                       vector<double> *beta) {
+  int32 num_states = csr.num_states;
+  beta->resize(num_states);
+  vector<double> terms;
+  for (int32 s = num_states - 1; s >= 0; s--) {
+    terms.clear();
+    terms.push_back(csr.final_like[s]);
+    for (int32 a = csr.arc_begin[s]; a < csr.arc_begin[s + 1]; a++)
+      terms.push_back((*beta)[csr.arc_dest[a]] + csr.arc_like[a]);
+    (*beta)[s] = LogSumExpArray(terms.data(), terms.size(), viterbi);
+  }
+  return (num_states == 0 ? kLogZeroDouble : (*beta)[0]);
+}
 
-  // Now propagate betas backward. Note that beta[final_state] contains the
-  // weight of the final state in the lattice -- compare that with alpha.
-  for (StateId s = num_states-1; s >= 0; s--) {
-    Weight f = clat.Final(s);
-    double this_beta = -(f.Weight().Value1()+f.Weight().Value2());
-    for (ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done(); aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      double arc_like = -(arc.weight.Weight().Value1()+arc.weight.Weight().Value2());
-      double arc_beta = (*beta)[arc.nextstate] + arc_like;
-      this_beta = LogAdd(this_beta, arc_beta);
-    }
-    (*beta)[s] = this_beta;
-  }
+bool ComputeCompactLatticeAlphas(const CompactLattice &clat,
+                                 vector<double> *alpha) {
+  // Note that we don't acount the weight of the final state to
+  // alpha[final_state] -- we acount it to beta[final_state];
+  LatticeCsr csr;
+  if (!ConvertToLatticeCsr(clat, &csr))
+    return false;
+  LatticeCsrAlphas(csr, false, alpha);
+  return true;
+}
 
+bool ComputeCompactLatticeBetas(const CompactLattice &clat,
+                                vector<double> *beta) {
+  // Note that beta[final_state] contains the weight of the final state in the
+  // lattice -- compare that with alpha.
+  LatticeCsr csr;
+  if (!ConvertToLatticeCsr(clat, &csr))
+    return false;
+  LatticeCsrBetas(csr, false, beta);
   return true;
 }
 
@@ -316,78 +373,52 @@ BaseFloat LatticeForwardBackward(const Lattice &lat, Posterior *post,
   // Note, Posterior is defined as follows:  Indexed [frame], then a list
   // of (transition-id, posterior-probability) pairs.
   // typedef std::vector<std::vector<std::pair<int32, BaseFloat> > > Posterior;
-  using namespace fst;
-  typedef Lattice::Arc Arc;
-  typedef Arc::Weight Weight;
-  typedef Arc::StateId StateId;
-
   if (acoustic_like_sum) *acoustic_like_sum = 0.0;
 
+  LatticeCsr csr;
   // Make sure the lattice is topologically sorted.
-  if (lat.Properties(fst::kTopSorted, true) == 0)
-    KALDI_ERR << "Input lattice must be topologically sorted.";
-  KALDI_ASSERT(lat.Start() == 0);
+  if (!ConvertToLatticeCsr(lat, &csr))
+    KALDI_ERR << "Input lattice must be topologically sorted and start from "
+              << "state 0.";
 
-  int32 num_states = lat.NumStates();
+  int32 num_states = csr.num_states,
+      num_arcs = csr.arc_begin[num_states];
   vector<int32> state_times;
   int32 max_time = LatticeStateTimes(lat, &state_times);
-  std::vector<double> alpha(num_states, kLogZeroDouble);
-  std::vector<double> &beta(alpha); // we re-use the same memory for
-  // this, but it's semantically distinct so we name it differently.
-  double tot_forward_prob = kLogZeroDouble;
+  std::vector<double> alpha, beta;
+  double tot_forward_prob = LatticeCsrAlphas(csr, false, &alpha),
+      tot_backward_prob = LatticeCsrBetas(csr, false, &beta);
+  if (!ApproxEqual(tot_forward_prob, tot_backward_prob, 1e-8)) {
+    KALDI_WARN << "Total forward probability over lattice = " << tot_forward_prob
+              << ", while total backward probability = " << tot_backward_prob;
+  }
 
   post->clear();
   post->resize(max_time);
 
-  alpha[0] = 0.0;
-  // Propagate alphas forward.
-  for (StateId s = 0; s < num_states; s++) {
-    double this_alpha = alpha[s];
-    for (ArcIterator<Lattice> aiter(lat, s); !aiter.Done(); aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      double arc_like = -ConvertToCost(arc.weight);
-      alpha[arc.nextstate] = LogAdd(alpha[arc.nextstate], this_alpha + arc_like);
+  for (int32 a = 0; a < num_arcs; a++) {
+    int32 transition_id = csr.arc_ilabel[a];
+    // The following "if" is an optimization to avoid un-needed exp().
+    if (transition_id != 0 || acoustic_like_sum != NULL) {
+      int32 s = csr.arc_src[a];
+      double posterior = Exp(alpha[s] + csr.arc_like[a] +
+                             beta[csr.arc_dest[a]] - tot_forward_prob);
+      if (transition_id != 0) // Arc has a transition-id on it [not epsilon]
+        (*post)[state_times[s]].push_back(
+            std::make_pair(transition_id, static_cast<BaseFloat>(posterior)));
+      if (acoustic_like_sum != NULL)
+        *acoustic_like_sum -= posterior * csr.arc_acoustic_cost[a];
     }
-    Weight f = lat.Final(s);
-    if (f != Weight::Zero()) {
-      double final_like = this_alpha - (f.Value1() + f.Value2());
-      tot_forward_prob = LogAdd(tot_forward_prob, final_like);
+  }
+  for (int32 s = 0; s < num_states; s++) {
+    if (csr.final_like[s] != kLogZeroDouble) {
       KALDI_ASSERT(state_times[s] == max_time &&
                    "Lattice is inconsistent (final-prob not at max_time)");
-    }
-  }
-  for (StateId s = num_states-1; s >= 0; s--) {
-    Weight f = lat.Final(s);
-    double this_beta = -(f.Value1() + f.Value2());
-    for (ArcIterator<Lattice> aiter(lat, s); !aiter.Done(); aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      double arc_like = -ConvertToCost(arc.weight),
-          arc_beta = beta[arc.nextstate] + arc_like;
-      this_beta = LogAdd(this_beta, arc_beta);
-      int32 transition_id = arc.ilabel;
-
-      // The following "if" is an optimization to avoid un-needed exp().
-      if (transition_id != 0 || acoustic_like_sum != NULL) {
-        double posterior = Exp(alpha[s] + arc_beta - tot_forward_prob);
-
-        if (transition_id != 0) // Arc has a transition-id on it [not epsilon]
-          (*post)[state_times[s]].push_back(std::make_pair(transition_id,
-                                                           static_cast<kaldi::BaseFloat>(posterior)));
-        if (acoustic_like_sum != NULL)
-          *acoustic_like_sum -= posterior * arc.weight.Value2();
+      if (acoustic_like_sum != NULL) {
+        double posterior = Exp(alpha[s] + csr.final_like[s] - tot_forward_prob);
+        *acoustic_like_sum -= posterior * csr.final_acoustic_cost[s];
       }
     }
-    if (acoustic_like_sum != NULL && f != Weight::Zero()) {
-      double final_logprob = - ConvertToCost(f),
-          posterior = Exp(alpha[s] + final_logprob - tot_forward_prob);
-      *acoustic_like_sum -= posterior * f.Value2();
-    }
-    beta[s] = this_beta;
-  }
-  double tot_backward_prob = beta[0];
-  if (!ApproxEqual(tot_forward_prob, tot_backward_prob, 1e-8)) {
-    KALDI_WARN << "Total forward probability over lattice = " << tot_forward_prob
-              << ", while total backward probability = " << tot_backward_prob;
   }
   // Now combine any posteriors with the same transition-id.
   for (int32 t = 0; t < max_time; t++)
@@ -441,60 +472,17 @@ void ConvertLatticeToPhones(const TransitionModel &trans,
 }
 
 
-static inline double LogAddOrMax(bool viterbi, double a, double b) {
-  if (viterbi)
-    return std::max(a, b);
-  else
-    return LogAdd(a, b);
-}
-
 template<typename LatticeType>
 double ComputeLatticeAlphasAndBetas(const LatticeType &lat,
                                     bool viterbi,
                                     vector<double> *alpha,
                                     vector<double> *beta) {
-  typedef typename LatticeType::Arc Arc;
-  typedef typename Arc::Weight Weight;
-  typedef typename Arc::StateId StateId;
-
-  StateId num_states = lat.NumStates();
+  LatticeCsr csr;
   KALDI_ASSERT(lat.Properties(fst::kTopSorted, true) == fst::kTopSorted);
   KALDI_ASSERT(lat.Start() == 0);
-  alpha->clear();
-  beta->clear();
-  alpha->resize(num_states, kLogZeroDouble);
-  beta->resize(num_states, kLogZeroDouble);
-
-  double tot_forward_prob = kLogZeroDouble;
-  (*alpha)[0] = 0.0;
-  // Propagate alphas forward.
-  for (StateId s = 0; s < num_states; s++) {
-    double this_alpha = (*alpha)[s];
-    for (fst::ArcIterator<LatticeType> aiter(lat, s); !aiter.Done();
-         aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      double arc_like = -ConvertToCost(arc.weight);
-      (*alpha)[arc.nextstate] = LogAddOrMax(viterbi, (*alpha)[arc.nextstate],
-                                                this_alpha + arc_like);
-    }
-    Weight f = lat.Final(s);
-    if (f != Weight::Zero()) {
-      double final_like = this_alpha - ConvertToCost(f);
-      tot_forward_prob = LogAddOrMax(viterbi, tot_forward_prob, final_like);
-    }
-  }
-  for (StateId s = num_states-1; s >= 0; s--) { // it's guaranteed signed.
-    double this_beta = -ConvertToCost(lat.Final(s));
-    for (fst::ArcIterator<LatticeType> aiter(lat, s); !aiter.Done();
-         aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      double arc_like = -ConvertToCost(arc.weight),
-          arc_beta = (*beta)[arc.nextstate] + arc_like;
-      this_beta = LogAddOrMax(viterbi, this_beta, arc_beta);
-    }
-    (*beta)[s] = this_beta;
-  }
-  double tot_backward_prob = (*beta)[lat.Start()];
+  ConvertToLatticeCsr(lat, &csr);
+  double tot_forward_prob = LatticeCsrAlphas(csr, viterbi, alpha),
+      tot_backward_prob = LatticeCsrBetas(csr, viterbi, beta);
   if (!ApproxEqual(tot_forward_prob, tot_backward_prob, 1e-8)) {
     KALDI_WARN << "Total forward probability over lattice = " << tot_forward_prob
                << ", while total backward probability = " << tot_backward_prob;
@@ -799,109 +787,79 @@ BaseFloat LatticeForwardBackwardMpeVariants(
     std::string criterion,
     bool one_silence_class,
     Posterior *post) {
-  using namespace fst;
-  typedef Lattice::Arc Arc;
-  typedef Arc::Weight Weight;
-  typedef Arc::StateId StateId;
-
   KALDI_ASSERT(criterion == "mpfe" || criterion == "smbr");
   bool is_mpfe = (criterion == "mpfe");
 
-  if (lat.Properties(fst::kTopSorted, true) == 0)
-    KALDI_ERR << "Input lattice must be topologically sorted.";
-  KALDI_ASSERT(lat.Start() == 0);
+  LatticeCsr csr;
+  if (!ConvertToLatticeCsr(lat, &csr))
+    KALDI_ERR << "Input lattice must be topologically sorted and start from "
+              << "state 0.";
 
-  int32 num_states = lat.NumStates();
+  int32 num_states = csr.num_states,
+      num_arcs = csr.arc_begin[num_states];
   vector<int32> state_times;
   int32 max_time = LatticeStateTimes(lat, &state_times);
   KALDI_ASSERT(max_time == static_cast<int32>(num_ali.size()));
-  std::vector<double> alpha(num_states, kLogZeroDouble),
+  std::vector<double> alpha, beta,
       alpha_smbr(num_states, 0), //forward variable for sMBR
-      beta(num_states, kLogZeroDouble),
       beta_smbr(num_states, 0); //backward variable for sMBR
 
-  double tot_forward_prob = kLogZeroDouble;
   double tot_forward_score = 0;
 
   post->clear();
   post->resize(max_time);
 
-  alpha[0] = 0.0;
-  // First Pass Forward,
-  for (StateId s = 0; s < num_states; s++) {
-    double this_alpha = alpha[s];
-    for (ArcIterator<Lattice> aiter(lat, s); !aiter.Done(); aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      double arc_like = -ConvertToCost(arc.weight);
-      alpha[arc.nextstate] = LogAdd(alpha[arc.nextstate], this_alpha + arc_like);
-    }
-    Weight f = lat.Final(s);
-    if (f != Weight::Zero()) {
-      double final_like = this_alpha - (f.Value1() + f.Value2());
-      tot_forward_prob = LogAdd(tot_forward_prob, final_like);
-      KALDI_ASSERT(state_times[s] == max_time &&
-                   "Lattice is inconsistent (final-prob not at max_time)");
-    }
-  }
-  // First Pass Backward,
-  for (StateId s = num_states-1; s >= 0; s--) {
-    Weight f = lat.Final(s);
-    double this_beta = -(f.Value1() + f.Value2());
-    for (ArcIterator<Lattice> aiter(lat, s); !aiter.Done(); aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      double arc_like = -ConvertToCost(arc.weight),
-          arc_beta = beta[arc.nextstate] + arc_like;
-      this_beta = LogAdd(this_beta, arc_beta);
-    }
-    beta[s] = this_beta;
-  }
+  // First Pass Forward and Backward,
+  double tot_forward_prob = LatticeCsrAlphas(csr, false, &alpha),
+      tot_backward_prob = LatticeCsrBetas(csr, false, &beta);
   // First Pass Forward-Backward Check
-  double tot_backward_prob = beta[0];
   // may loose the condition somehow here 1e-6 (was 1e-8)
   if (!ApproxEqual(tot_forward_prob, tot_backward_prob, 1e-6)) {
     KALDI_ERR << "Total forward probability over lattice = " << tot_forward_prob
               << ", while total backward probability = " << tot_backward_prob;
   }
 
+  // The accuracy of each arc is needed in both passes below, so we work it
+  // out once.
+  std::vector<double> frame_acc(num_arcs, 0.0);
+  for (int32 a = 0; a < num_arcs; a++) {
+    int32 transition_id = csr.arc_ilabel[a];
+    if (transition_id == 0) continue;
+    int32 cur_time = state_times[csr.arc_src[a]];
+    int32 phone = trans.TransitionIdToPhone(transition_id),
+        ref_phone = trans.TransitionIdToPhone(num_ali[cur_time]);
+    bool phone_is_sil = std::binary_search(silence_phones.begin(),
+                                           silence_phones.end(),
+                                           phone),
+        ref_phone_is_sil = std::binary_search(silence_phones.begin(),
+                                              silence_phones.end(),
+                                              ref_phone),
+        both_sil = phone_is_sil && ref_phone_is_sil;
+    if (!is_mpfe) { // smbr.
+      int32 pdf = trans.TransitionIdToPdf(transition_id),
+          ref_pdf = trans.TransitionIdToPdf(num_ali[cur_time]);
+      if (!one_silence_class)  // old behavior
+        frame_acc[a] = (pdf == ref_pdf && !phone_is_sil) ? 1.0 : 0.0;
+      else
+        frame_acc[a] = (pdf == ref_pdf || both_sil) ? 1.0 : 0.0;
+    } else {
+      if (!one_silence_class)  // old behavior
+        frame_acc[a] = (phone == ref_phone && !phone_is_sil) ? 1.0 : 0.0;
+      else
+        frame_acc[a] = (phone == ref_phone || both_sil) ? 1.0 : 0.0;
+    }
+  }
+
   alpha_smbr[0] = 0.0;
   // Second Pass Forward, calculate forward for MPFE/SMBR
-  for (StateId s = 0; s < num_states; s++) {
-    double this_alpha = alpha[s];
-    for (ArcIterator<Lattice> aiter(lat, s); !aiter.Done(); aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      double arc_like = -ConvertToCost(arc.weight);
-      double frame_acc = 0.0;
-      if (arc.ilabel != 0) {
-        int32 cur_time = state_times[s];
-        int32 phone = trans.TransitionIdToPhone(arc.ilabel),
-            ref_phone = trans.TransitionIdToPhone(num_ali[cur_time]);
-        bool phone_is_sil = std::binary_search(silence_phones.begin(),
-                                               silence_phones.end(),
-                                               phone),
-            ref_phone_is_sil = std::binary_search(silence_phones.begin(),
-                                                  silence_phones.end(),
-                                                  ref_phone),
-            both_sil = phone_is_sil && ref_phone_is_sil;
-        if (!is_mpfe) { // smbr.
-          int32 pdf = trans.TransitionIdToPdf(arc.ilabel),
-              ref_pdf = trans.TransitionIdToPdf(num_ali[cur_time]);
-          if (!one_silence_class)  // old behavior
-            frame_acc = (pdf == ref_pdf && !phone_is_sil) ? 1.0 : 0.0;
-          else
-            frame_acc = (pdf == ref_pdf || both_sil) ? 1.0 : 0.0;
-        } else {
-          if (!one_silence_class)  // old behavior
-            frame_acc = (phone == ref_phone && !phone_is_sil) ? 1.0 : 0.0;
-          else
-            frame_acc = (phone == ref_phone || both_sil) ? 1.0 : 0.0;
-        }
-      }
-      double arc_scale = Exp(alpha[s] + arc_like - alpha[arc.nextstate]);
-      alpha_smbr[arc.nextstate] += arc_scale * (alpha_smbr[s] + frame_acc);
+  for (int32 s = 0; s < num_states; s++) {
+    for (int32 a = csr.arc_begin[s]; a < csr.arc_begin[s + 1]; a++) {
+      int32 nextstate = csr.arc_dest[a];
+      double arc_scale = Exp(alpha[s] + csr.arc_like[a] - alpha[nextstate]);
+      alpha_smbr[nextstate] += arc_scale * (alpha_smbr[s] + frame_acc[a]);
     }
-    Weight f = lat.Final(s);
-    if (f != Weight::Zero()) {
-      double final_like = this_alpha - (f.Value1() + f.Value2());
+    if (csr.final_like[s] != kLogZeroDouble) {
+      double final_like = alpha[s] + csr.final_like[s];
       double arc_scale = Exp(final_like - tot_forward_prob);
       tot_forward_score += arc_scale * alpha_smbr[s];
       KALDI_ASSERT(state_times[s] == max_time &&
@@ -909,47 +867,21 @@ BaseFloat LatticeForwardBackwardMpeVariants(
     }
   }
   // Second Pass Backward, collect Mpe style posteriors
-  for (StateId s = num_states-1; s >= 0; s--) {
-    for (ArcIterator<Lattice> aiter(lat, s); !aiter.Done(); aiter.Next()) {
-      const Arc &arc = aiter.Value();
-      double arc_like = -ConvertToCost(arc.weight),
-          arc_beta = beta[arc.nextstate] + arc_like;
-      double frame_acc = 0.0;
-      int32 transition_id = arc.ilabel;
-      if (arc.ilabel != 0) {
-        int32 cur_time = state_times[s];
-        int32 phone = trans.TransitionIdToPhone(arc.ilabel),
-            ref_phone = trans.TransitionIdToPhone(num_ali[cur_time]);
-        bool phone_is_sil = std::binary_search(silence_phones.begin(),
-                                               silence_phones.end(), phone),
-            ref_phone_is_sil = std::binary_search(silence_phones.begin(),
-                                                  silence_phones.end(),
-                                                  ref_phone),
-            both_sil = phone_is_sil && ref_phone_is_sil;
-        if (!is_mpfe) { // smbr.
-          int32 pdf = trans.TransitionIdToPdf(arc.ilabel),
-              ref_pdf = trans.TransitionIdToPdf(num_ali[cur_time]);
-          if (!one_silence_class)  // old behavior
-            frame_acc = (pdf == ref_pdf && !phone_is_sil) ? 1.0 : 0.0;
-          else
-            frame_acc = (pdf == ref_pdf || both_sil) ? 1.0 : 0.0;
-        } else {
-          if (!one_silence_class)  // old behavior
-            frame_acc = (phone == ref_phone && !phone_is_sil) ? 1.0 : 0.0;
-          else
-            frame_acc = (phone == ref_phone || both_sil) ? 1.0 : 0.0;
-        }
-      }
-      double arc_scale = Exp(beta[arc.nextstate] + arc_like - beta[s]);
+  for (int32 s = num_states-1; s >= 0; s--) {
+    for (int32 a = csr.arc_begin[s]; a < csr.arc_begin[s + 1]; a++) {
+      int32 nextstate = csr.arc_dest[a];
+      double arc_beta = beta[nextstate] + csr.arc_like[a];
+      int32 transition_id = csr.arc_ilabel[a];
+      double arc_scale = Exp(arc_beta - beta[s]);
       // check arc_scale NAN,
       // this is to prevent partial paths in Lattices
       // i.e., paths don't survive to the final state
       if (KALDI_ISNAN(arc_scale)) arc_scale = 0;
-      beta_smbr[s] += arc_scale * (beta_smbr[arc.nextstate] + frame_acc);
+      beta_smbr[s] += arc_scale * (beta_smbr[nextstate] + frame_acc[a]);
 
       if (transition_id != 0) { // Arc has a transition-id on it [not epsilon]
         double posterior = Exp(alpha[s] + arc_beta - tot_forward_prob);
-        double acc_diff = alpha_smbr[s] + frame_acc + beta_smbr[arc.nextstate]
+        double acc_diff = alpha_smbr[s] + frame_acc[a] + beta_smbr[nextstate]
                                - tot_forward_score;
         double posterior_smbr = posterior * acc_diff;
         (*post)[state_times[s]].push_back(std::make_pair(transition_id,
@@ -104,6 +104,65 @@ double ComputeLatticeAlphasAndBetas(const LatticeType &lat,
                                     std::vector<double> *beta);
 
 
+/// LatticeCsr is a topologically sorted Lattice or CompactLattice flattened
+/// into arrays for the forward-backward computations.  The arcs are in
+/// compressed-sparse-row (CSR) order: the arcs leaving state s are those with
+/// index in [arc_begin[s], arc_begin[s+1]).  The incoming arcs of each state
+/// are indexed too, so that both the alpha and the beta recursions gather
+/// their terms for a state into a contiguous array and take a single
+/// log-sum-exp of it (see LogSumExpArray()), instead of calling LogAdd() once
+/// per arc through an ArcIterator.
+struct LatticeCsr {
+  int32 num_states;
+  std::vector<int32> arc_begin;  // size num_states + 1.
+  std::vector<int32> arc_src;
+  std::vector<int32> arc_dest;
+  std::vector<int32> arc_ilabel;
+  std::vector<double> arc_like;  // negated total (graph + acoustic) cost.
+  std::vector<double> arc_acoustic_cost;  // the acoustic cost (Value2()).
+  std::vector<double> final_like;  // negated final cost; -inf if not final.
+  std::vector<double> final_acoustic_cost;
+  std::vector<int32> in_arc_begin;  // size num_states + 1.
+  std::vector<int32> in_arcs;  // arc indexes; those entering state s are
+                               // in_arcs[in_arc_begin[s] ... in_arc_begin[s+1]-1].
+  LatticeCsr(): num_states(0) { }
+};
+
+/// Flattens 'lat' into 'csr'.  Returns false, with a warning, if 'lat' is not
+/// topologically sorted or its start state is not 0.  Instantiated for
+/// Lattice and CompactLattice.
+template<typename LatticeType>
+bool ConvertToLatticeCsr(const LatticeType &lat, LatticeCsr *csr);
+
+/// Returns log(sum_i exp(x[i])) over the n values in x, or their maximum if
+/// 'viterbi' is true; returns kLogZeroDouble if n == 0.  The maximum is
+/// found first, so only one log is needed, and the two loops over x are
+/// simple enough to be vectorized.
+inline double LogSumExpArray(const double *x, int32 n, bool viterbi = false) {
+  if (n == 0) return kLogZeroDouble;
+  double max = x[0];
+  for (int32 i = 1; i < n; i++)
+    max = std::max(max, x[i]);
+  if (viterbi || n == 1 || max == kLogZeroDouble)
+    return max;
+  double sum = 0.0;
+  for (int32 i = 0; i < n; i++)
+    sum += Exp(x[i] - max);
+  return max + Log(sum);
+}
+
+/// Computes the (normal or Viterbi) alphas of the lattice in 'csr', as negated
+/// costs not including the final-probs; returns the total forward
+/// log-probability (or best-path negated cost) including the final-probs.
+double LatticeCsrAlphas(const LatticeCsr &csr, bool viterbi,
+                        std::vector<double> *alpha);
+
+/// Computes the (normal or Viterbi) betas of the lattice in 'csr', as negated
+/// costs including the final-probs; returns (*beta)[0].
+double LatticeCsrBetas(const LatticeCsr &csr, bool viterbi,
+                       std::vector<double> *beta);
+
+
 /// Topologically sort the compact lattice if not already topologically sorted.
 /// Will crash if the lattice cannot be topologically sorted.
 void TopSortCompactLatticeIfNeeded(CompactLattice *clat);
@@ -0,0 +1,94 @@
+// lat/sausages-test.cc
+
+// Copyright 2026  agent <agent@local>
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "lat/kaldi-lattice.h"
+#include "lat/sausages.h"
+#include "fstext/rand-fst.h"
+
+
+namespace kaldi {
+using namespace fst;
+
+CompactLattice *RandConnectedCompactLattice() {
+  RandFstOptions opts;
+  opts.acyclic = true;
+  Lattice *fst = fst::RandPairFst<LatticeArc>(opts);
+  CompactLattice *cfst = new CompactLattice;
+  ConvertLattice(*fst, cfst);
+  delete fst;
+  Connect(cfst);
+  return cfst;
+}
+
+void AssertSausageStatsEqual(const MinimumBayesRisk &mbr1,
+                             const MinimumBayesRisk &mbr2) {
+  const std::vector<std::vector<std::pair<int32, BaseFloat> > >
+      &stats1 = mbr1.GetSausageStats(), &stats2 = mbr2.GetSausageStats();
+  KALDI_ASSERT(stats1.size() == stats2.size());
+  for (size_t q = 0; q < stats1.size(); q++) {
+    KALDI_ASSERT(stats1[q].size() == stats2[q].size());
+    for (size_t j = 0; j < stats1[q].size(); j++)
+      KALDI_ASSERT(ApproxEqual(stats1[q][j].second, stats2[q][j].second));
+  }
+}
+
+// With a band wider than the lattice, the banded computation must be the same
+// as the full one; with a narrow band, each bin must still have posteriors
+// summing to one.
+void TestMinimumBayesRiskBand() {
+  CompactLattice *clat = RandConnectedCompactLattice();
+  if (clat->Start() == kNoStateId) {  // empty lattice.
+    delete clat;
+    return;
+  }
+  MinimumBayesRiskOptions opts;
+  MinimumBayesRisk mbr(*clat, opts);
+  const std::vector<int32> &one_best = mbr.GetOneBest();
+
+  MinimumBayesRisk mbr_full(*clat, one_best, opts);
+  opts.band = 100000;
+  MinimumBayesRisk mbr_wide(*clat, one_best, opts);
+  KALDI_ASSERT(mbr_full.GetOneBest() == mbr_wide.GetOneBest());
+  KALDI_ASSERT(ApproxEqual(mbr_full.GetBayesRisk(), mbr_wide.GetBayesRisk()));
+  AssertSausageStatsEqual(mbr_full, mbr_wide);
+
+  opts.band = 1 + Rand() % 3;
+  opts.tolerance = 0.1 * (Rand() % 3);
+  MinimumBayesRisk mbr_narrow(*clat, opts);
+  KALDI_ASSERT(mbr_narrow.GetBayesRisk() >= 0.0);
+  const std::vector<std::vector<std::pair<int32, BaseFloat> > > &stats =
+      mbr_narrow.GetSausageStats();
+  for (size_t q = 0; q < stats.size(); q++) {
+    double sum = 0.0;
+    for (size_t j = 0; j < stats[q].size(); j++)
+      sum += stats[q][j].second;
+    KALDI_ASSERT(ApproxEqual(sum, 1.0, 0.01));
+  }
+  delete clat;
+}
+
+} // end namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 20; i++)
+    TestMinimumBayesRiskBand();
+  KALDI_LOG << "Success.";
+}
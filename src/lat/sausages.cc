@@ -28,9 +28,19 @@ namespace kaldi {
 void MinimumBayesRisk::MbrDecode() {
 
   for (size_t counter = 0; ; counter++) {
+    if (opts_.band > 0 && hyp_times_.size() == R_.size())
+      NormalizeEpsTimes(R_, &hyp_times_);
+    else
+      hyp_times_.clear();
     NormalizeEps(&R_);
+    double L_prev = L_;
     AccStats(); // writes to gamma_
     double delta_Q = 0.0; // change in objective function.
+    // With a band, each iteration places the band using the latest bins, so
+    // the objective is not guaranteed to decrease; if it went up, we keep the
+    // current hypothesis and stop.
+    bool update = opts_.decode_mbr &&
+        !(opts_.band > 0 && L_prev != 0 && L_ > L_prev);
 
     one_best_times_.clear();
     one_best_confidences_.clear();
@@ -38,7 +48,7 @@ void MinimumBayesRisk::MbrDecode() {
     // Caution: q in the line below is (q-1) in the algorithm
     // in the paper; both R_ and gamma_ are indexed by q-1.
     for (size_t q = 0; q < R_.size(); q++) {
-      if (opts_.decode_mbr) { // This loop updates R_ [indexed same as gamma_].
+      if (update) { // This loop updates R_ [indexed same as gamma_].
         // gamma_[i] is sorted in reverse order so most likely one is first.
         const std::vector<std::pair<int32, BaseFloat> > &this_gamma = gamma_[q];
         double old_gamma = 0, new_gamma = this_gamma[0].second;
@@ -96,7 +106,11 @@ void MinimumBayesRisk::MbrDecode() {
       }
     }
     KALDI_VLOG(2) << "Iter = " << counter << ", delta-Q = " << delta_Q;
-    if (delta_Q == 0) break;
+    // delta_Q is never positive; with the default tolerance of zero we stop
+    // only when the hypothesis did not change.
+    if (-delta_Q <= opts_.tolerance) break;
+    if (opts_.band > 0)
+      hyp_times_ = sausage_times_;  // place the next band using the bins.
     if (counter > 100) {
       KALDI_WARN << "Iterating too many times in MbrDecode; stopping.";
       break;
@@ -127,43 +141,146 @@ void MinimumBayesRisk::NormalizeEps(std::vector<int32> *vec) {
   (*vec)[0] = 0;
 }
 
+// static
+void MinimumBayesRisk::NormalizeEpsTimes(
+    const std::vector<int32> &vec,
+    std::vector<std::pair<BaseFloat, BaseFloat> > *times) {
+  KALDI_ASSERT(vec.size() == times->size());
+  std::vector<std::pair<BaseFloat, BaseFloat> > word_times;
+  for (size_t i = 0; i < vec.size(); i++)
+    if (vec[i] != 0)
+      word_times.push_back((*times)[i]);
+  times->resize(1 + word_times.size() * 2);
+  BaseFloat prev_end = 0.0;
+  for (size_t i = 0; i < word_times.size(); i++) {
+    (*times)[i*2] = std::make_pair(prev_end,
+                                   std::max(prev_end, word_times[i].first));
+    (*times)[i*2 + 1] = word_times[i];
+    prev_end = std::max(prev_end, word_times[i].second);
+  }
+  times->back() = std::make_pair(prev_end, prev_end);
+}
+
+size_t MinimumBayesRisk::ComputeBand(int32 N, int32 Q) {
+  band_.resize(N+1);
+  if (opts_.band > 0 && hyp_times_.size() == static_cast<size_t>(Q)) {
+    // end_time[q] is the latest end time of hypothesis positions 1...q, and
+    // begin_time[q] the earliest begin time of positions q...Q; position 0
+    // (nothing aligned yet) is at time zero.  Both are non-decreasing, so the
+    // positions overlapping [t - band, t + band] form the range lo...hi
+    // computed below.
+    std::vector<BaseFloat> end_time(Q+1), begin_time(Q+1);
+    end_time[0] = 0.0;
+    for (int32 q = 1; q <= Q; q++)
+      end_time[q] = std::max(end_time[q-1], hyp_times_[q-1].second);
+    begin_time[Q] = hyp_times_[Q-1].first;
+    for (int32 q = Q - 1; q >= 1; q--)
+      begin_time[q] = std::min(begin_time[q+1], hyp_times_[q-1].first);
+    begin_time[0] = std::min<BaseFloat>(begin_time[1], 0.0);
+    for (int32 n = 1; n <= N; n++) {
+      BaseFloat t = state_times_[n];
+      int32 lo = std::lower_bound(end_time.begin(), end_time.end(),
+                                  t - opts_.band) - end_time.begin(),
+          hi = std::upper_bound(begin_time.begin(), begin_time.end(),
+                                t + opts_.band) - begin_time.begin() - 1;
+      lo = std::min(lo, Q);
+      hi = std::max(hi, 0);
+      band_[n].lo = std::min(lo, hi);
+      band_[n].hi = std::max(lo, hi);
+    }
+    band_[1].lo = 0;
+    band_[N].hi = Q;
+    // The recursion for an arc into node n starts at position lo of n, so
+    // that position has to be in the band of the arc's start node (the
+    // positions above that start node's band are then reached by the third
+    // term of the min expression, see ComputeArcEditDistance()).  This goes
+    // backward, so the bands of preceding nodes are final before they are
+    // themselves looked at as end nodes.
+    for (int32 n = N; n >= 2; n--) {
+      for (size_t i = 0; i < pre_[n].size(); i++) {
+        BandRange &s_band = band_[arcs_[pre_[n][i]].start_node];
+        s_band.lo = std::min(s_band.lo, band_[n].lo);
+        s_band.hi = std::max(s_band.hi, band_[n].lo);
+      }
+    }
+  } else {
+    for (int32 n = 1; n <= N; n++) {
+      band_[n].lo = 0;
+      band_[n].hi = Q;
+    }
+  }
+  size_t size = 0;
+  for (int32 n = 1; n <= N; n++) {
+    band_[n].offset = size;
+    size += band_[n].hi - band_[n].lo + 1;
+  }
+  return size;
+}
+
+void MinimumBayesRisk::ComputeArcEditDistance(
+    const Arc &arc, const std::vector<double> &alpha_dash,
+    Vector<double> *alpha_dash_arc, std::vector<char> *b_arc) {
+  const BandRange &band = band_[arc.end_node], &s_band = band_[arc.start_node];
+  int32 s_a = arc.start_node, w_a = arc.word;
+  const double inf = std::numeric_limits<double>::infinity();
+  for (int32 q = band.lo; q <= band.hi; q++) {
+    // a1,a2,a3 are the 3 parts of the min expression of line 17.  Terms that
+    // refer to positions outside the bands are infinite; ComputeBand()
+    // ensures that a2 exists at the start of the band, and a3 after that.
+    double a2 = (q <= s_band.hi ?
+                 alpha_dash[DashIndex(s_a, q)] + l(w_a, 0, true) : inf);
+    if (q == 0) {
+      (*alpha_dash_arc)(q) = a2;  // line 14.
+      if (b_arc != NULL) (*b_arc)[q] = 2;
+      continue;
+    }
+    int32 r_q = r(q);
+    double a1 = (q > s_band.lo && q <= s_band.hi + 1 ?
+                 alpha_dash[DashIndex(s_a, q-1)] + l(w_a, r_q) : inf),
+        a3 = (q > band.lo ? (*alpha_dash_arc)(q-1) + l(0, r_q) : inf);
+    char b;
+    double a;
+    if (a1 <= a2) {
+      if (a1 <= a3) { b = 1; a = a1; }
+      else { b = 3; a = a3; }
+    } else {
+      if (a2 <= a3) { b = 2; a = a2; }
+      else { b = 3; a = a3; }
+    }
+    (*alpha_dash_arc)(q) = a;
+    if (b_arc != NULL) (*b_arc)[q] = b;
+  }
+}
+
 double MinimumBayesRisk::EditDistance(int32 N, int32 Q,
                                       Vector<double> &alpha,
-                                      Matrix<double> &alpha_dash,
+                                      std::vector<double> &alpha_dash,
                                       Vector<double> &alpha_dash_arc) {
   alpha(1) = 0.0; // = log(1).  Line 5.
-  alpha_dash(1, 0) = 0.0; // Line 5.
-  for (int32 q = 1; q <= Q; q++)
-    alpha_dash(1, q) = alpha_dash(1, q-1) + l(0, r(q)); // Line 7.
+  alpha_dash[DashIndex(1, 0)] = 0.0; // Line 5.
+  for (int32 q = 1; q <= band_[1].hi; q++)
+    alpha_dash[DashIndex(1, q)] =
+        alpha_dash[DashIndex(1, q-1)] + l(0, r(q)); // Line 7.
+  std::vector<double> terms;  // the terms of the sum on line 10.
   for (int32 n = 2; n <= N; n++) {
-    double alpha_n = kLogZeroDouble;
+    terms.resize(pre_[n].size());
     for (size_t i = 0; i < pre_[n].size(); i++) {
       const Arc &arc = arcs_[pre_[n][i]];
-      alpha_n = LogAdd(alpha_n, alpha(arc.start_node) + arc.loglike);
+      terms[i] = alpha(arc.start_node) + arc.loglike;
     }
-    alpha(n) = alpha_n; // Line 10.
-    // Line 11 omitted: matrix was initialized to zero.
+    alpha(n) = LogSumExpArray(terms.data(), terms.size()); // Line 10.
+    // Line 11 omitted: array was initialized to zero.
+    const BandRange &band = band_[n];
     for (size_t i = 0; i < pre_[n].size(); i++) {
       const Arc &arc = arcs_[pre_[n][i]];
-      int32 s_a = arc.start_node, w_a = arc.word;
-      BaseFloat p_a = arc.loglike;
-      for (int32 q = 0; q <= Q; q++) {
-        if (q == 0) {
-          alpha_dash_arc(q) = // line 15.
-              alpha_dash(s_a, q) + l(w_a, 0, true);
-        } else {  // a1,a2,a3 are the 3 parts of min expression of line 17.
-          int32 r_q = r(q);
-          double a1 = alpha_dash(s_a, q-1) + l(w_a, r_q),
-              a2 = alpha_dash(s_a, q) + l(w_a, 0, true),
-              a3 = alpha_dash_arc(q-1) + l(0, r_q);
-          alpha_dash_arc(q) = std::min(a1, std::min(a2, a3));
-        }
-        // line 19:
-        alpha_dash(n, q) += Exp(alpha(s_a) + p_a - alpha(n)) * alpha_dash_arc(q);
-      }
+      ComputeArcEditDistance(arc, alpha_dash, &alpha_dash_arc, NULL);
+      double post = Exp(alpha(arc.start_node) + arc.loglike - alpha(n));
+      double *alpha_dash_n = &(alpha_dash[band.offset]);
+      for (int32 q = band.lo; q <= band.hi; q++) // line 19:
+        alpha_dash_n[q - band.lo] += post * alpha_dash_arc(q);
     }
   }
-  return alpha_dash(N, Q); // line 23.
+  return alpha_dash[DashIndex(N, Q)]; // line 23.
 }
 
 // Figure 5 in the paper.
@@ -173,12 +290,15 @@ void MinimumBayesRisk::AccStats() {
   int32 N = static_cast<int32>(pre_.size()) - 1,
       Q = static_cast<int32>(R_.size());
 
+  // alpha_dash and beta_dash are stored only over the band of each node
+  // (which is all of 0...Q unless opts_.band > 0); see DashIndex().
+  size_t dash_size = ComputeBand(N, Q);
   Vector<double> alpha(N+1); // index (1...N)
-  Matrix<double> alpha_dash(N+1, Q+1); // index (1...N, 0...Q)
+  std::vector<double> alpha_dash(dash_size); // index DashIndex(n, q)
   Vector<double> alpha_dash_arc(Q+1); // index 0...Q
-  Matrix<double> beta_dash(N+1, Q+1); // index (1...N, 0...Q)
+  std::vector<double> beta_dash(dash_size); // index DashIndex(n, q)
   Vector<double> beta_dash_arc(Q+1); // index 0...Q
-  std::vector<char> b_arc(Q+1); // integer in {1,2,3}; index 1...Q
+  std::vector<char> b_arc(Q+1); // integer in {1,2,3}; index 0...Q
   std::vector<map<int32, double> > gamma(Q+1); // temp. form of gamma.
   // index 1...Q [word] -> occ.
 
@@ -189,40 +309,32 @@ void MinimumBayesRisk::AccStats() {
   std::vector<map<int32, double> > tau_b(Q+1), tau_e(Q+1);
 
   double Ltmp = EditDistance(N, Q, alpha, alpha_dash, alpha_dash_arc);
-  if (L_ != 0 && Ltmp > L_) { // L_ != 0 is to rule out 1st iter.
+  if (L_ != 0 && Ltmp > L_ && opts_.band <= 0) { // L_ != 0 is to rule out
+    // 1st iter; with a band, MbrDecode() handles this.
     KALDI_WARN << "Edit distance increased: " << Ltmp << " > "
                << L_;
   }
   L_ = Ltmp;
   KALDI_VLOG(2) << "L = " << L_;
   // omit line 10: zero when initialized.
-  beta_dash(N, Q) = 1.0; // Line 11.
+  beta_dash[DashIndex(N, Q)] = 1.0; // Line 11.
   for (int32 n = N; n >= 2; n--) {
+    const BandRange &band = band_[n];
     for (size_t i = 0; i < pre_[n].size(); i++) {
       const Arc &arc = arcs_[pre_[n][i]];
       int32 s_a = arc.start_node, w_a = arc.word;
       BaseFloat p_a = arc.loglike;
-      alpha_dash_arc(0) = alpha_dash(s_a, 0) + l(w_a, 0, true); // line 14.
-      for (int32 q = 1; q <= Q; q++) { // this loop == lines 15-18.
-        int32 r_q = r(q);
-        double a1 = alpha_dash(s_a, q-1) + l(w_a, r_q),
-            a2 = alpha_dash(s_a, q) + l(w_a, 0, true),
-            a3 = alpha_dash_arc(q-1) + l(0, r_q);
-        if (a1 <= a2) {
-          if (a1 <= a3) { b_arc[q] = 1; alpha_dash_arc(q) = a1; }
-          else { b_arc[q] = 3; alpha_dash_arc(q) = a3; }
-        } else {
-          if (a2 <= a3) { b_arc[q] = 2; alpha_dash_arc(q) = a2; }
-          else { b_arc[q] = 3; alpha_dash_arc(q) = a3; }
-        }
-      }
-      beta_dash_arc.SetZero(); // line 19.
-      for (int32 q = Q; q >= 1; q--) {
+      // lines 14-18; for q == 0, b_arc is 2, which gives line 26 below.
+      ComputeArcEditDistance(arc, alpha_dash, &alpha_dash_arc, &b_arc);
+      double post = Exp(alpha(s_a) + p_a - alpha(n));
+      for (int32 q = band.lo; q <= band.hi; q++)
+        beta_dash_arc(q) = 0.0; // line 19.
+      for (int32 q = band.hi; q >= band.lo; q--) {
         // line 21:
-        beta_dash_arc(q) += Exp(alpha(s_a) + p_a - alpha(n)) * beta_dash(n, q);
+        beta_dash_arc(q) += post * beta_dash[DashIndex(n, q)];
         switch (static_cast<int>(b_arc[q])) { // lines 22 and 23:
           case 1:
-            beta_dash(s_a, q-1) += beta_dash_arc(q);
+            beta_dash[DashIndex(s_a, q-1)] += beta_dash_arc(q);
             // next: gamma(q, w(a)) += beta_dash_arc(q)
             AddToMap(w_a, beta_dash_arc(q), &(gamma[q]));
             // next: accumulating times, see decl for tau_b,tau_e
@@ -230,7 +342,7 @@ void MinimumBayesRisk::AccStats() {
             AddToMap(w_a, state_times_[n] * beta_dash_arc(q), &(tau_e[q]));
             break;
           case 2:
-            beta_dash(s_a, q) += beta_dash_arc(q);
+            beta_dash[DashIndex(s_a, q)] += beta_dash_arc(q);
             break;
           case 3:
             beta_dash_arc(q-1) += beta_dash_arc(q);
@@ -247,13 +359,12 @@ void MinimumBayesRisk::AccStats() {
             KALDI_ERR << "Invalid b_arc value"; // error in code.
         }
       }
-      beta_dash_arc(0) += Exp(alpha(s_a) + p_a - alpha(n)) * beta_dash(n, 0);
-      beta_dash(s_a, 0) += beta_dash_arc(0); // line 26.
     }
   }
   beta_dash_arc.SetZero(); // line 29.
   for (int32 q = Q; q >= 1; q--) {
-    beta_dash_arc(q) += beta_dash(1, q);
+    if (q <= band_[1].hi)
+      beta_dash_arc(q) += beta_dash[DashIndex(1, q)];
     beta_dash_arc(q-1) += beta_dash_arc(q);
     AddToMap(0, beta_dash_arc(q), &(gamma[q]));
     // the statements below are actually redundant because
@@ -378,7 +489,30 @@ MinimumBayesRisk::MinimumBayesRisk(const CompactLattice &clat_in,
   // numbered state, thanks to CreateSuperFinal and the topological
   // sorting.
 
-  { // Now set R_ to one best in the FST.
+  L_ = 0.0; // Set current edit-distance to 0 [just so we know
+  // when we're on the 1st iter.]
+
+  bool have_one_best = false;
+  if (opts_.band > 0) {
+    // We need the times of the one-best words to place the band on the first
+    // iteration, so take the best path before removing the alignments.
+    CompactLattice best_path;
+    CompactLatticeShortestPath(clat, &best_path);
+    std::vector<int32> words, begin_times, lengths;
+    if (CompactLatticeToWordAlignment(best_path, &words, &begin_times,
+                                      &lengths)) {
+      for (size_t i = 0; i < words.size(); i++) {
+        if (words[i] == 0) continue;
+        R_.push_back(words[i]);
+        hyp_times_.push_back(std::make_pair(
+            static_cast<BaseFloat>(begin_times[i]),
+            static_cast<BaseFloat>(begin_times[i] + lengths[i])));
+      }
+      have_one_best = true;
+    }
+  }
+
+  if (!have_one_best) { // Now set R_ to one best in the FST.
     RemoveAlignmentsFromCompactLattice(&clat); // will be more efficient
     // in best-path if we do this.
     Lattice lat;
@@ -392,8 +526,6 @@ MinimumBayesRisk::MinimumBayesRisk(const CompactLattice &clat_in,
     GetLinearSymbolSequence(fst_shortest_path, &alignment, &words, &weight);
     KALDI_ASSERT(alignment.empty()); // we removed the alignment.
     R_ = words;
-    L_ = 0.0; // Set current edit-distance to 0 [just so we know
-    // when we're on the 1st iter.]
   }
 
   MbrDecode();
@@ -423,6 +555,7 @@ MinimumBayesRisk::MinimumBayesRisk(const CompactLattice &clat_in,
 
   R_ = words;
   sausage_times_ = times;
+  hyp_times_ = times;
   L_ = 0.0;
 
   MbrDecode();
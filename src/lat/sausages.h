@@ -60,14 +60,34 @@ struct MinimumBayesRiskOptions {
   bool decode_mbr;
   /// Boolean configuration parameter: if true, the 1-best path will 'keep' the <eps> bins,
   bool print_silence;
-
-  MinimumBayesRiskOptions() : decode_mbr(true), print_silence(false)
+  /// If >0, the edit-distance alignment of each lattice node is only computed
+  /// for the hypothesis positions whose times are within this many frames of
+  /// the node's time (plus whatever is needed to keep the recursion
+  /// consistent), i.e. over a window that slides along the lattice.  This
+  /// makes the time and memory linear in the length of the lattice instead of
+  /// quadratic.  The window is placed using the times of the current
+  /// hypothesis; if those are not known (hypothesis supplied without times)
+  /// the first iteration is done without a band.
+  int32 band;
+  /// We stop iterating once the bound on the decrease in the expected number
+  /// of errors over an iteration is no more than this.
+  BaseFloat tolerance;
+
+  MinimumBayesRiskOptions() : decode_mbr(true), print_silence(false),
+                              band(0), tolerance(0.0)
   { }
   void Register(OptionsItf *opts) {
     opts->Register("decode-mbr", &decode_mbr, "If true, do Minimum Bayes Risk "
                    "decoding (else, Maximum a Posteriori)");
     opts->Register("print-silence", &print_silence, "Keep the inter-word '<eps>' "
                    "bins in the 1-best output (ctm, <eps> can be a 'silence' or a 'deleted' word)");
+    opts->Register("mbr-band", &band, "If >0, only align each lattice node "
+                   "with the hypothesis positions within this many frames of "
+                   "it; makes MBR decoding linear-time in the length of the "
+                   "lattice (0 = align with the whole hypothesis).");
+    opts->Register("mbr-tolerance", &tolerance, "Stop iterating MBR decoding "
+                   "once the bound on the decrease in expected errors per "
+                   "iteration is no more than this.");
   }
 };
 
@@ -166,7 +186,7 @@ class MinimumBayesRisk {
   /// Figure 4 of the paper; called from AccStats (Fig. 5)
   double EditDistance(int32 N, int32 Q,
                       Vector<double> &alpha,
-                      Matrix<double> &alpha_dash,
+                      std::vector<double> &alpha_dash,
                       Vector<double> &alpha_dash_arc);
 
   /// Figure 5 of the paper.  Outputs to gamma_ and L_.
@@ -179,6 +199,13 @@ class MinimumBayesRisk {
   // epsilon (0).  (But if no words in vec, just one epsilon)
   static void NormalizeEps(std::vector<int32> *vec);
 
+  // Does to "times" (which has the same size as "vec") what NormalizeEps
+  // does to "vec": keeps the times of the words, and gives each inserted
+  // epsilon the interval between the words around it.
+  static void NormalizeEpsTimes(
+      const std::vector<int32> &vec,
+      std::vector<std::pair<BaseFloat, BaseFloat> > *times);
+
   // delta() is a constant used in the algorithm, which penalizes
   // the use of certain epsilon transitions in the edit-distance which would cause
   // words not to show up in the accumulated edit-distance statistics.
@@ -204,6 +231,34 @@ class MinimumBayesRisk {
     BaseFloat loglike;
   };
 
+  /// The range of hypothesis positions lo...hi (in 0...Q) for which we compute
+  /// the edit-distance quantities of a lattice node, and where they are
+  /// stored in the arrays indexed by DashIndex().
+  struct BandRange {
+    int32 lo;
+    int32 hi;
+    size_t offset;
+  };
+
+  /// Works out band_ for the current R_, from hyp_times_ if opts_.band > 0
+  /// and the times are known, else every node gets the whole range 0...Q.
+  /// Returns the total size of the arrays indexed by DashIndex().
+  size_t ComputeBand(int32 N, int32 Q);
+
+  /// Returns the index of (node n, position q) in the banded versions of the
+  /// alpha_dash and beta_dash matrices of the paper.  q must be in the band.
+  inline size_t DashIndex(int32 n, int32 q) const {
+    return band_[n].offset + (q - band_[n].lo);
+  }
+
+  /// Lines 14-18 of Figure 5 (and 14-17 of Figure 4): computes
+  /// alpha_dash_arc(q) for 'arc' over the band of its end node, and if b_arc
+  /// is non-NULL records which term of the min expression was taken.
+  void ComputeArcEditDistance(const Arc &arc,
+                              const std::vector<double> &alpha_dash,
+                              Vector<double> *alpha_dash_arc,
+                              std::vector<char> *b_arc);
+
   MinimumBayesRiskOptions opts_;
 
 
@@ -223,6 +278,13 @@ class MinimumBayesRisk {
   // epsilons between each word and at the beginning and end.  R in paper...
   // caution: indexed from zero, not from 1 as in paper.
 
+  std::vector<std::pair<BaseFloat, BaseFloat> > hyp_times_; // (start,end)
+  // times of each element of R_, used to place the band if opts_.band > 0;
+  // empty if not known.  Indexed from zero, like R_.
+
+  std::vector<BandRange> band_; // band of hypothesis positions for each node,
+  // indexed from 1 (same index as into pre_).
+
   double L_; // current averaged edit-distance between lattice and R_.
   // \hat{L} in paper.
 
@@ -23,6 +23,85 @@
 #include "lat/kaldi-lattice.h"
 #include "lat/word-align-lattice.h"
 #include "lat/lattice-functions.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// Word-aligns one lattice; run by PooledTaskSequencer.  The output is written
+// in the destructor, which is called in the original order of the lattices,
+// one at a time.
+class AlignWordsTask {
+ public:
+  // Takes ownership of 'clat'.
+  AlignWordsTask(const std::string &key, CompactLattice *clat,
+                 const TransitionModel &tmodel, const WordBoundaryInfo &info,
+                 BaseFloat max_expand, bool output_if_error, bool do_test,
+                 CompactLatticeWriter *clat_writer,
+                 int32 *num_done, int32 *num_err):
+      key_(key), clat_(clat), tmodel_(tmodel), info_(info),
+      max_expand_(max_expand), output_if_error_(output_if_error),
+      do_test_(do_test), ok_(false), clat_writer_(clat_writer),
+      num_done_(num_done), num_err_(num_err) { }
+
+  void operator () () {
+    int32 max_states;
+    if (max_expand_ > 0) max_states = 1000 + max_expand_ * clat_->NumStates();
+    else max_states = 0;
+
+    ok_ = WordAlignLattice(*clat_, tmodel_, info_, max_states, &aligned_clat_);
+
+    if (do_test_ && ok_)
+      TestWordAlignedLattice(*clat_, tmodel_, info_, aligned_clat_);
+    delete clat_;
+    clat_ = NULL;
+    if (aligned_clat_.Start() != fst::kNoStateId)
+      TopSortCompactLatticeIfNeeded(&aligned_clat_);
+  }
+
+  ~AlignWordsTask() {
+    if (!ok_) {
+      (*num_err_)++;
+      if (!output_if_error_)
+        KALDI_WARN << "Lattice for " << key_
+                   << " did not align correctly, producing no output.";
+      else {
+        if (aligned_clat_.Start() != fst::kNoStateId) {
+          KALDI_WARN << "Outputting partial lattice for " << key_;
+          clat_writer_->Write(key_, aligned_clat_);
+        } else {
+          KALDI_WARN << "Empty aligned lattice for " << key_
+                     << ", producing no output.";
+        }
+      }
+    } else {
+      if (aligned_clat_.Start() == fst::kNoStateId) {
+        (*num_err_)++;
+        KALDI_WARN << "Lattice was empty for key " << key_;
+      } else {
+        (*num_done_)++;
+        KALDI_VLOG(2) << "Aligned lattice for " << key_;
+        clat_writer_->Write(key_, aligned_clat_);
+      }
+    }
+    delete clat_;
+  }
+
+ private:
+  std::string key_;
+  CompactLattice *clat_;
+  const TransitionModel &tmodel_;
+  const WordBoundaryInfo &info_;
+  BaseFloat max_expand_;
+  bool output_if_error_;
+  bool do_test_;
+  bool ok_;
+  CompactLattice aligned_clat_;
+  CompactLatticeWriter *clat_writer_;
+  int32 *num_done_;
+  int32 *num_err_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -46,7 +125,8 @@ int main(int argc, char *argv[]) {
     BaseFloat max_expand = 0.0;
     bool output_if_error = true;
     bool do_test = false;
-    
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
+
     po.Register("output-error-lats", &output_if_error, "Output lattices that aligned "
                 "with errors (e.g. due to force-out");
     po.Register("test", &do_test, "Test the algorithm while running it.");
@@ -55,6 +135,8 @@ int main(int argc, char *argv[]) {
                 "This can be used to prevent this program consuming excessive memory "
                 "if there is a mismatch on the command-line or a 'problem' lattice.");
     
+    sequencer_config.Register(&po);
+
     WordBoundaryInfoNewOpts opts;
     opts.Register(&po);
 
@@ -81,46 +163,17 @@ int main(int argc, char *argv[]) {
     
     int32 num_done = 0, num_err = 0;
     
-    for (; !clat_reader.Done(); clat_reader.Next()) {
-      std::string key = clat_reader.Key();
-      const CompactLattice &clat = clat_reader.Value();
-
-      CompactLattice aligned_clat;
-      int32 max_states;
-      if (max_expand > 0) max_states = 1000 + max_expand * clat.NumStates();
-      else max_states = 0;
-      
-      bool ok = WordAlignLattice(clat, tmodel, info, max_states, &aligned_clat);
-      
-      if (do_test && ok)
-        TestWordAlignedLattice(clat, tmodel, info, aligned_clat);
-
-      if (!ok) {
-        num_err++;
-        if (!output_if_error)
-          KALDI_WARN << "Lattice for " << key
-                     << " did not align correctly, producing no output.";
-        else {
-          if (aligned_clat.Start() != fst::kNoStateId) {
-            KALDI_WARN << "Outputting partial lattice for " << key;
-            TopSortCompactLatticeIfNeeded(&aligned_clat);
-            clat_writer.Write(key, aligned_clat);
-          } else {
-            KALDI_WARN << "Empty aligned lattice for " << key
-                       << ", producing no output.";
-          }
-        }
-      } else {
-        if (aligned_clat.Start() == fst::kNoStateId) {
-          num_err++;
-          KALDI_WARN << "Lattice was empty for key " << key;
-        } else {
-          num_done++;
-          KALDI_VLOG(2) << "Aligned lattice for " << key;
-          TopSortCompactLatticeIfNeeded(&aligned_clat);
-          clat_writer.Write(key, aligned_clat);
-        }
+    {
+      PooledTaskSequencer<AlignWordsTask> sequencer(sequencer_config);
+      for (; !clat_reader.Done(); clat_reader.Next()) {
+        std::string key = clat_reader.Key();
+        CompactLattice *clat = new CompactLattice(clat_reader.Value());
+        clat_reader.FreeCurrent();
+        sequencer.Run(new AlignWordsTask(key, clat, tmodel, info, max_expand,
+                                         output_if_error, do_test,
+                                         &clat_writer, &num_done, &num_err));
       }
+      sequencer.Wait();
     }
     KALDI_LOG << "Successfully aligned " << num_done << " lattices; "
               << num_err << " had errors.";
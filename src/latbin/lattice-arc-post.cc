@@ -42,10 +42,11 @@ class ArcPosteriorComputer {
   int32 OutputPosteriors(const std::string &utterance,
                          std::ostream &os) {
     int32 num_post = 0;
-    if (!ComputeCompactLatticeAlphas(clat_, &alpha_))
-      return num_post;
-    if (!ComputeCompactLatticeBetas(clat_, &beta_))
+    LatticeCsr csr;
+    if (!ConvertToLatticeCsr(clat_, &csr))
       return num_post;
+    LatticeCsrAlphas(csr, false, &alpha_);
+    LatticeCsrBetas(csr, false, &beta_);
 
     CompactLatticeStateTimes(clat_, &state_times_);
     if (clat_.Start() < 0)
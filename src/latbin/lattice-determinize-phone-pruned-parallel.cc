@@ -140,7 +140,7 @@ int main(int argc, char *argv[]) {
     // Writes as compact lattice.
     CompactLatticeWriter compact_lat_writer(lats_wspecifier);
 
-    TaskSequencer<DeterminizeLatticeTask> sequencer(sequencer_opts);
+    PooledTaskSequencer<DeterminizeLatticeTask> sequencer(sequencer_opts);
 
     int32 n_done = 0, n_warn = 0;
 
@@ -144,7 +144,7 @@ int main(int argc, char *argv[]) {
     
     // Write as compact lattice.
     CompactLatticeWriter compact_lat_writer(lats_wspecifier); 
-    TaskSequencer<DeterminizeLatticeTask> sequencer(sequencer_config);
+    PooledTaskSequencer<DeterminizeLatticeTask> sequencer(sequencer_config);
     
     int32 n_done = 0, n_warn = 0;
 
@@ -28,6 +28,108 @@
 #include "lat/kaldi-lattice.h"
 #include "lat/lattice-functions.h"
 #include "lat/compose-lattice-pruned.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// Rescores one lattice; this is run by PooledTaskSequencer, possibly in
+// parallel with other lattices.  The objects referred to by the constructor arguments
+// are shared between tasks and must be thread safe (or only read).
+class RescoreLatticeTask {
+ public:
+  // Takes ownership of 'clat'.  Exactly one of 'lm_to_subtract_fst' and
+  // 'const_arpa' is non-NULL.
+  RescoreLatticeTask(const std::string &key,
+                     CompactLattice *clat,
+                     const ComposeLatticePrunedOptions &compose_opts,
+                     BaseFloat lm_scale,
+                     BaseFloat acoustic_scale,
+                     int32 max_ngram_order,
+                     const fst::VectorFst<fst::StdArc> *lm_to_subtract_fst,
+                     const ConstArpaLm *const_arpa,
+                     const rnnlm::RnnlmComputeStateInfo &info,
+                     rnnlm::RnnlmComputeStateCache *cache,
+                     CompactLatticeWriter *clat_writer,
+                     int32 *num_done, int32 *num_err):
+      key_(key), clat_(clat), compose_opts_(compose_opts),
+      lm_scale_(lm_scale), acoustic_scale_(acoustic_scale),
+      max_ngram_order_(max_ngram_order),
+      lm_to_subtract_fst_(lm_to_subtract_fst), const_arpa_(const_arpa),
+      info_(info), cache_(cache), clat_writer_(clat_writer),
+      num_done_(num_done), num_err_(num_err) { }
+
+  void operator () () {
+    using fst::StdArc;
+    // The deterministic FSTs have per-object state, so each task has its own.
+    fst::DeterministicOnDemandFst<StdArc> *lm_to_subtract_det;
+    if (const_arpa_ != NULL)
+      lm_to_subtract_det = new ConstArpaLmDeterministicFst(*const_arpa_);
+    else
+      lm_to_subtract_det = new fst::BackoffDeterministicOnDemandFst<StdArc>(
+          *lm_to_subtract_fst_);
+    fst::ScaleDeterministicOnDemandFst lm_to_subtract_det_scale(
+        -lm_scale_, lm_to_subtract_det);
+    rnnlm::KaldiRnnlmDeterministicFst lm_to_add_orig(max_ngram_order_, info_,
+                                                     cache_);
+    fst::ScaleDeterministicOnDemandFst lm_to_add(lm_scale_, &lm_to_add_orig);
+
+    // Before composing with the LM FST, we scale the lattice weights
+    // by the inverse of "lm_scale".  We'll later scale by "lm_scale".
+    // We do it this way so we can determinize and it will give the
+    // right effect (taking the "best path" through the LM) regardless
+    // of the sign of lm_scale.
+    if (acoustic_scale_ != 1.0) {
+      fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale_), clat_);
+    }
+    TopSortCompactLatticeIfNeeded(clat_);
+
+    fst::ComposeDeterministicOnDemandFst<StdArc> combined_lms(
+        &lm_to_subtract_det_scale, &lm_to_add);
+
+    // Composes lattice with language model.
+    ComposeCompactLatticePruned(compose_opts_, *clat_,
+                                &combined_lms, &composed_clat_);
+    delete clat_;
+    clat_ = NULL;
+    delete lm_to_subtract_det;
+
+    if (composed_clat_.NumStates() != 0 && acoustic_scale_ != 1.0) {
+      fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale_),
+                        &composed_clat_);
+    }
+  }
+
+  // The output is written in the destructor, which PooledTaskSequencer calls
+  // in the original order of the lattices, one at a time.
+  ~RescoreLatticeTask() {
+    if (composed_clat_.NumStates() == 0) {
+      // Something went wrong.  A warning will already have been printed.
+      (*num_err_)++;
+    } else {
+      clat_writer_->Write(key_, composed_clat_);
+      (*num_done_)++;
+    }
+    delete clat_;
+  }
+
+ private:
+  std::string key_;
+  CompactLattice *clat_;
+  const ComposeLatticePrunedOptions &compose_opts_;
+  BaseFloat lm_scale_;
+  BaseFloat acoustic_scale_;
+  int32 max_ngram_order_;
+  const fst::VectorFst<fst::StdArc> *lm_to_subtract_fst_;
+  const ConstArpaLm *const_arpa_;
+  const rnnlm::RnnlmComputeStateInfo &info_;
+  rnnlm::RnnlmComputeStateCache *cache_;
+  CompactLattice composed_clat_;
+  CompactLatticeWriter *clat_writer_;
+  int32 *num_done_;
+  int32 *num_err_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -65,6 +167,8 @@ int main(int argc, char *argv[]) {
     BaseFloat lm_scale = 0.5;
     BaseFloat acoustic_scale = 0.1;
     bool use_carpa = false;
+    int32 state_cache_size = 0;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
 
     po.Register("lm-scale", &lm_scale, "Scaling factor for <lm-to-add>; its negative "
                 "will be applied to <lm-to-subtract>.");
@@ -78,8 +182,17 @@ int main(int argc, char *argv[]) {
     po.Register("use-const-arpa", &use_carpa, "If true, read the old-LM file "
                 "as a const-arpa file as opposed to an FST file");
 
+    po.Register("state-cache-size", &state_cache_size, "If >0, the "
+                "maximum number of RNNLM states, keyed by (truncated) word "
+                "history, kept in a cache shared by all lattices and threads. "
+                "Saves time, but with --max-ngram-order>0 the output then "
+                "depends on the order in which lattices are processed (and "
+                "so, with --num-threads>1, on thread timing).  Each state "
+                "holds a copy of the nnet3 computation's memory.");
+
     opts.Register(&po);
     compose_opts.Register(&po);
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -102,30 +215,18 @@ int main(int argc, char *argv[]) {
     lats_wspecifier = po.GetArg(5);
 
     // for G.fst
-    fst::ScaleDeterministicOnDemandFst *lm_to_subtract_det_scale = NULL;
-    fst::BackoffDeterministicOnDemandFst<StdArc> *lm_to_subtract_det_backoff = NULL;
     VectorFst<StdArc> *lm_to_subtract_fst = NULL;
 
     // for G.carpa
     ConstArpaLm* const_arpa = NULL;
-    fst::DeterministicOnDemandFst<StdArc> *carpa_lm_to_subtract_fst = NULL;
 
     KALDI_LOG << "Reading old LMs...";
     if (use_carpa) {
       const_arpa = new ConstArpaLm();
-      ReadKaldiObject(lm_to_subtract_rxfilename, const_arpa);
-      carpa_lm_to_subtract_fst = new ConstArpaLmDeterministicFst(*const_arpa);
-      lm_to_subtract_det_scale
-        = new fst::ScaleDeterministicOnDemandFst(-lm_scale,
-                                                 carpa_lm_to_subtract_fst);
+      const_arpa->ReadMapped(lm_to_subtract_rxfilename);
     } else {
       lm_to_subtract_fst = fst::ReadAndPrepareLmFst(
           lm_to_subtract_rxfilename);
-      lm_to_subtract_det_backoff =
-        new fst::BackoffDeterministicOnDemandFst<StdArc>(*lm_to_subtract_fst);
-      lm_to_subtract_det_scale =
-           new fst::ScaleDeterministicOnDemandFst(-lm_scale,
-                                                  lm_to_subtract_det_backoff);
     }
 
     kaldi::nnet3::Nnet rnnlm;
@@ -137,6 +238,12 @@ int main(int argc, char *argv[]) {
     ReadKaldiObject(word_embedding_rxfilename, &word_embedding_mat);
 
     const rnnlm::RnnlmComputeStateInfo info(opts, rnnlm, word_embedding_mat);
+    rnnlm::RnnlmComputeStateCache *cache = NULL;
+    if (state_cache_size > 0)
+      cache = new rnnlm::RnnlmComputeStateCache(state_cache_size);
+
+    if (acoustic_scale == 0.0)
+      KALDI_ERR << "Acoustic scale cannot be zero.";
 
     // Reads and writes as compact lattice.
     SequentialCompactLatticeReader compact_lattice_reader(lats_rspecifier);
@@ -144,60 +251,26 @@ int main(int argc, char *argv[]) {
 
     int32 num_done = 0, num_err = 0;
 
-    rnnlm::KaldiRnnlmDeterministicFst* lm_to_add_orig = 
-         new rnnlm::KaldiRnnlmDeterministicFst(max_ngram_order, info);
-
-    for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
-      fst::DeterministicOnDemandFst<StdArc> *lm_to_add =
-         new fst::ScaleDeterministicOnDemandFst(lm_scale, lm_to_add_orig);
-
-      std::string key = compact_lattice_reader.Key();
-      CompactLattice clat = compact_lattice_reader.Value();
-      compact_lattice_reader.FreeCurrent();
-
-      // Before composing with the LM FST, we scale the lattice weights
-      // by the inverse of "lm_scale".  We'll later scale by "lm_scale".
-      // We do it this way so we can determinize and it will give the
-      // right effect (taking the "best path" through the LM) regardless
-      // of the sign of lm_scale.
-      if (acoustic_scale != 1.0) {
-        fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale), &clat);
+    {
+      PooledTaskSequencer<RescoreLatticeTask> sequencer(sequencer_config);
+      for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
+        std::string key = compact_lattice_reader.Key();
+        CompactLattice *clat = new CompactLattice();
+        *clat = compact_lattice_reader.Value();
+        compact_lattice_reader.FreeCurrent();
+        sequencer.Run(new RescoreLatticeTask(
+            key, clat, compose_opts, lm_scale, acoustic_scale,
+            max_ngram_order, lm_to_subtract_fst, const_arpa, info, cache,
+            &compact_lattice_writer, &num_done, &num_err));
       }
-      TopSortCompactLatticeIfNeeded(&clat);
-
-      fst::ComposeDeterministicOnDemandFst<StdArc> combined_lms(
-          lm_to_subtract_det_scale, lm_to_add);
-
-      // Composes lattice with language model.
-      CompactLattice composed_clat;
-      ComposeCompactLatticePruned(compose_opts, clat,
-                                  &combined_lms, &composed_clat);
-
-      lm_to_add_orig->Clear();
-
-      if (composed_clat.NumStates() == 0) {
-        // Something went wrong.  A warning will already have been printed.
-        num_err++;
-      } else {
-        if (acoustic_scale != 1.0) {
-          if (acoustic_scale == 0.0)
-            KALDI_ERR << "Acoustic scale cannot be zero.";
-          fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale),
-                            &composed_clat);
-        }
-        compact_lattice_writer.Write(key, composed_clat);
-        num_done++;
-      }
-      delete lm_to_add;
+      sequencer.Wait();
     }
 
+    if (cache != NULL)
+      cache->PrintStats();
+    delete cache;
     delete lm_to_subtract_fst;
-    delete lm_to_add_orig;
-    delete lm_to_subtract_det_backoff;
-    delete lm_to_subtract_det_scale;
-
     delete const_arpa;
-    delete carpa_lm_to_subtract_fst;
 
     KALDI_LOG << "Overall, succeeded for " << num_done
               << " lattices, failed for " << num_err;
@@ -26,6 +26,107 @@
 #include "lat/kaldi-lattice.h"
 #include "lat/lattice-functions.h"
 #include "lat/compose-lattice-pruned.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// Rescores one lattice; run by PooledTaskSequencer.  The LMs are shared
+// between tasks (they are only read), but each task wraps them in its own
+// deterministic on-demand FSTs, which have per-object state.
+class RescoreLatticePrunedTask {
+ public:
+  // Takes ownership of 'clat'.  Exactly one of 'lm_to_add_fst' and
+  // 'lm_to_add_const_arpa' is non-NULL.
+  RescoreLatticePrunedTask(const std::string &key, CompactLattice *clat,
+                           const ComposeLatticePrunedOptions &compose_opts,
+                           BaseFloat lm_scale, BaseFloat acoustic_scale,
+                           const fst::VectorFst<fst::StdArc> &lm_to_subtract_fst,
+                           const fst::VectorFst<fst::StdArc> *lm_to_add_fst,
+                           const ConstArpaLm *lm_to_add_const_arpa,
+                           CompactLatticeWriter *clat_writer,
+                           int32 *num_done, int32 *num_err):
+      key_(key), clat_(clat), compose_opts_(compose_opts),
+      lm_scale_(lm_scale), acoustic_scale_(acoustic_scale),
+      lm_to_subtract_fst_(lm_to_subtract_fst), lm_to_add_fst_(lm_to_add_fst),
+      lm_to_add_const_arpa_(lm_to_add_const_arpa), clat_writer_(clat_writer),
+      num_done_(num_done), num_err_(num_err) { }
+
+  void operator () () {
+    using fst::StdArc;
+    fst::BackoffDeterministicOnDemandFst<StdArc> lm_to_subtract_det_backoff(
+        lm_to_subtract_fst_);
+    fst::ScaleDeterministicOnDemandFst lm_to_subtract_det_scale(
+        -lm_scale_, &lm_to_subtract_det_backoff);
+
+    fst::DeterministicOnDemandFst<StdArc> *lm_to_add_orig = NULL,
+        *lm_to_add = NULL;
+    if (lm_to_add_const_arpa_ != NULL) {
+      lm_to_add = new ConstArpaLmDeterministicFst(*lm_to_add_const_arpa_);
+    } else {
+      lm_to_add = new fst::BackoffDeterministicOnDemandFst<StdArc>(
+          *lm_to_add_fst_);
+    }
+    if (lm_scale_ != 1.0) {
+      lm_to_add_orig = lm_to_add;
+      lm_to_add = new fst::ScaleDeterministicOnDemandFst(lm_scale_,
+                                                         lm_to_add_orig);
+    }
+
+    if (acoustic_scale_ != 1.0) {
+      fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale_), clat_);
+    }
+    TopSortCompactLatticeIfNeeded(clat_);
+
+    //   It shouldn't make a difference in which order we provide the
+    // arguments to the composition; either way should work.  They are both
+    // acceptors so the result is the same either way.
+    fst::ComposeDeterministicOnDemandFst<StdArc> combined_lms(
+        &lm_to_subtract_det_scale, lm_to_add);
+
+    ComposeCompactLatticePruned(compose_opts_,
+                                *clat_,
+                                &combined_lms,
+                                &composed_clat_);
+    delete clat_;
+    clat_ = NULL;
+    delete lm_to_add_orig;
+    delete lm_to_add;
+
+    if (composed_clat_.NumStates() != 0 && acoustic_scale_ != 1.0) {
+      fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale_),
+                        &composed_clat_);
+    }
+  }
+
+  // The output is written in the destructor, which PooledTaskSequencer calls
+  // in the original order of the lattices, one at a time.
+  ~RescoreLatticePrunedTask() {
+    if (composed_clat_.NumStates() == 0) {
+      // Something went wrong.  A warning will already have been printed.
+      (*num_err_)++;
+    } else {
+      clat_writer_->Write(key_, composed_clat_);
+      (*num_done_)++;
+    }
+    delete clat_;
+  }
+
+ private:
+  std::string key_;
+  CompactLattice *clat_;
+  const ComposeLatticePrunedOptions &compose_opts_;
+  BaseFloat lm_scale_;
+  BaseFloat acoustic_scale_;
+  const fst::VectorFst<fst::StdArc> &lm_to_subtract_fst_;
+  const fst::VectorFst<fst::StdArc> *lm_to_add_fst_;
+  const ConstArpaLm *lm_to_add_const_arpa_;
+  CompactLattice composed_clat_;
+  CompactLatticeWriter *clat_writer_;
+  int32 *num_done_;
+  int32 *num_err_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -60,6 +161,7 @@ int main(int argc, char *argv[]) {
     BaseFloat lm_scale = 1.0;
     BaseFloat acoustic_scale = 1.0;
     bool add_const_arpa = false;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
 
     po.Register("lm-scale", &lm_scale, "Scaling factor for <lm-to-add>; its negative "
                 "will be applied to <lm-to-subtract>.");
@@ -69,7 +171,7 @@ int main(int argc, char *argv[]) {
     po.Register("add-const-arpa", &add_const_arpa, "If true, <lm-to-add> is expected"
                 "to be in const-arpa format; if false it's expected to be in FST"
                 "format.");
-
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -89,30 +191,10 @@ int main(int argc, char *argv[]) {
     VectorFst<StdArc> *lm_to_add_fst = NULL;
     ConstArpaLm const_arpa;
     if (add_const_arpa) {
-      ReadKaldiObject(lm_to_add_rxfilename, &const_arpa);
+      const_arpa.ReadMapped(lm_to_add_rxfilename);
     } else {
       lm_to_add_fst = fst::ReadAndPrepareLmFst(lm_to_add_rxfilename);
     }
-    fst::BackoffDeterministicOnDemandFst<StdArc> lm_to_subtract_det_backoff(
-        *lm_to_subtract_fst);
-    fst::ScaleDeterministicOnDemandFst lm_to_subtract_det_scale(
-        -lm_scale, &lm_to_subtract_det_backoff);
-
-
-    fst::DeterministicOnDemandFst<StdArc> *lm_to_add_orig = NULL,
-        *lm_to_add = NULL;
-    if (add_const_arpa) {
-      lm_to_add = new ConstArpaLmDeterministicFst(const_arpa);
-    } else {
-      lm_to_add = new fst::BackoffDeterministicOnDemandFst<StdArc>(
-          *lm_to_add_fst);
-    }
-    if (lm_scale != 1.0) {
-      lm_to_add_orig = lm_to_add;
-      lm_to_add = new fst::ScaleDeterministicOnDemandFst(lm_scale,
-                                                         lm_to_add_orig);
-    }
-
     KALDI_LOG << "Done.";
 
     // We read and write as CompactLattice.
@@ -123,47 +205,26 @@ int main(int argc, char *argv[]) {
 
     int32 num_done = 0, num_err = 0;
 
-    for (; !clat_reader.Done(); clat_reader.Next()) {
-      std::string key = clat_reader.Key();
-      CompactLattice &clat = clat_reader.Value();
-
-      if (acoustic_scale != 1.0) {
-        fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale), &clat);
-      }
-      TopSortCompactLatticeIfNeeded(&clat);
-
-      // To avoid memory gradually increasing with time, we reconstruct the
-      // composed-LM FST for each lattice we process.
-      //   It shouldn't make a difference in which order we provide the
-      // arguments to the composition; either way should work.  They are both
-      // acceptors so the result is the same either way.
-      fst::ComposeDeterministicOnDemandFst<StdArc> combined_lms(
-          &lm_to_subtract_det_scale, lm_to_add);
-
-      CompactLattice composed_clat;
-      ComposeCompactLatticePruned(compose_opts,
-                                  clat,
-                                  &combined_lms,
-                                  &composed_clat);
-
-      if (composed_clat.NumStates() == 0) {
-        // Something went wrong.  A warning will already have been printed.
-        num_err++;
-      } else {
-        if (acoustic_scale != 1.0) {
-          if (acoustic_scale == 0.0)
-            KALDI_ERR << "Acoustic scale cannot be zero.";
-          fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale),
-                            &composed_clat);
-        }
-        compact_lattice_writer.Write(key, composed_clat);
-        num_done++;
+    if (acoustic_scale == 0.0)
+      KALDI_ERR << "Acoustic scale cannot be zero.";
+
+    {
+      PooledTaskSequencer<RescoreLatticePrunedTask> sequencer(
+          sequencer_config);
+      for (; !clat_reader.Done(); clat_reader.Next()) {
+        std::string key = clat_reader.Key();
+        CompactLattice *clat = new CompactLattice(clat_reader.Value());
+        clat_reader.FreeCurrent();
+        sequencer.Run(new RescoreLatticePrunedTask(
+            key, clat, compose_opts, lm_scale, acoustic_scale,
+            *lm_to_subtract_fst, lm_to_add_fst,
+            (add_const_arpa ? &const_arpa : NULL),
+            &compact_lattice_writer, &num_done, &num_err));
       }
+      sequencer.Wait();
     }
     delete lm_to_subtract_fst;
     delete lm_to_add_fst;
-    delete lm_to_add_orig;
-    delete lm_to_add;
 
     KALDI_LOG << "Overall, succeeded for " << num_done
               << " lattices, failed for " << num_err;
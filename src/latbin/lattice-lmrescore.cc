@@ -24,6 +24,128 @@
 #include "fstext/fstext-lib.h"
 #include "fstext/kaldi-fst-io.h"
 #include "lat/kaldi-lattice.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// The LM FST (in the lattice semiring) together with the tables TableCompose
+// builds for it.  Both cache what they compute and so cannot be shared
+// between threads; LmComposeContextPool gives each running task its own.
+struct LmComposeContext {
+  fst::Fst<LatticeArc> *lm_fst;
+  fst::TableComposeCache<fst::Fst<LatticeArc> > compose_cache;
+  LmComposeContext(const fst::Fst<LatticeArc> &fst,
+                   const fst::TableComposeOptions &opts):
+      lm_fst(fst.Copy(true)), compose_cache(opts) { }
+  ~LmComposeContext() {
+    // The matcher in compose_cache refers to lm_fst, so delete it first.
+    delete compose_cache.matcher;
+    compose_cache.matcher = NULL;
+    delete lm_fst;
+  }
+};
+
+// Keeps the LmComposeContext objects not currently in use, so that their
+// caches are reused from one lattice to the next.  At most one object per
+// thread is ever created.
+class LmComposeContextPool {
+ public:
+  LmComposeContextPool(const fst::Fst<LatticeArc> &lm_fst,
+                       const fst::TableComposeOptions &opts):
+      lm_fst_(lm_fst), opts_(opts) { }
+
+  LmComposeContext *Get() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_.empty())
+      return new LmComposeContext(lm_fst_, opts_);
+    LmComposeContext *ans = free_.back();
+    free_.pop_back();
+    return ans;
+  }
+
+  void Release(LmComposeContext *context) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_.push_back(context);
+  }
+
+  ~LmComposeContextPool() { DeletePointers(&free_); }
+
+ private:
+  const fst::Fst<LatticeArc> &lm_fst_;
+  fst::TableComposeOptions opts_;
+  std::mutex mutex_;
+  std::vector<LmComposeContext*> free_;
+};
+
+// Rescores one lattice; run by PooledTaskSequencer.  The output is written in
+// the destructor, which is called in the original order of the lattices, one
+// at a time.
+class LmRescoreTask {
+ public:
+  // Takes ownership of 'lat'.
+  LmRescoreTask(const std::string &key, Lattice *lat, BaseFloat lm_scale,
+                LmComposeContextPool *contexts,
+                CompactLatticeWriter *clat_writer,
+                int32 *n_done, int32 *n_fail):
+      key_(key), lat_(lat), lm_scale_(lm_scale), contexts_(contexts),
+      clat_writer_(clat_writer), n_done_(n_done), n_fail_(n_fail) { }
+
+  void operator () () {
+    if (lm_scale_ != 0.0) {
+      // Only need to modify it if LM scale nonzero.
+      // Before composing with the LM FST, we scale the lattice weights
+      // by the inverse of "lm_scale".  We'll later scale by "lm_scale".
+      // We do it this way so we can determinize and it will give the
+      // right effect (taking the "best path" through the LM) regardless
+      // of the sign of lm_scale.
+      fst::ScaleLattice(fst::GraphLatticeScale(1.0 / lm_scale_), lat_);
+      ArcSort(lat_, fst::OLabelCompare<LatticeArc>());
+
+      Lattice composed_lat;
+      // Could just do, more simply: Compose(lat, lm_fst, &composed_lat);
+      // and not have the compose cache at all.
+      // The command below is faster, though; it's constant not
+      // logarithmic in vocab size.
+      LmComposeContext *context = contexts_->Get();
+      TableCompose(*lat_, *(context->lm_fst), &composed_lat,
+                   &(context->compose_cache));
+      contexts_->Release(context);
+
+      Invert(&composed_lat); // make it so word labels are on the input.
+      DeterminizeLattice(composed_lat, &clat_);
+      fst::ScaleLattice(fst::GraphLatticeScale(lm_scale_), &clat_);
+    } else {
+      // zero scale so nothing to do.
+      ConvertLattice(*lat_, &clat_);
+    }
+    delete lat_;
+    lat_ = NULL;
+  }
+
+  ~LmRescoreTask() {
+    if (clat_.Start() == fst::kNoStateId && lm_scale_ != 0.0) {
+      KALDI_WARN << "Empty lattice for utterance " << key_
+                 << " (incompatible LM?)";
+      (*n_fail_)++;
+    } else {
+      clat_writer_->Write(key_, clat_);
+      (*n_done_)++;
+    }
+    delete lat_;
+  }
+
+ private:
+  std::string key_;
+  Lattice *lat_;
+  BaseFloat lm_scale_;
+  LmComposeContextPool *contexts_;
+  CompactLattice clat_;
+  CompactLatticeWriter *clat_writer_;
+  int32 *n_done_;
+  int32 *n_fail_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -45,11 +167,13 @@ int main(int argc, char *argv[]) {
     ParseOptions po(usage);
     BaseFloat lm_scale = 1.0;
     int32 num_states_cache = 50000;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
 
     po.Register("lm-scale", &lm_scale, "Scaling factor for language model costs; frequently 1.0 or -1.0");
     po.Register("num-states-cache", &num_states_cache,
                 "Number of states we cache when mapping LM FST to lattice type. "
                 "More -> more memory but faster.");
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -93,7 +217,7 @@ int main(int argc, char *argv[]) {
     // The following is an optimization for the TableCompose
     // composition: it stores certain tables that enable fast
     // lookup of arcs during composition.
-    fst::TableComposeCache<fst::Fst<LatticeArc> > lm_compose_cache(compose_opts);
+    LmComposeContextPool lm_compose_contexts(lm_fst, compose_opts);
 
     // Read as regular lattice-- this is the form we need it in for efficient
     // composition and determinization.
@@ -104,45 +228,18 @@ int main(int argc, char *argv[]) {
 
     int32 n_done = 0, n_fail = 0;
 
-    for (; !lattice_reader.Done(); lattice_reader.Next()) {
-      std::string key = lattice_reader.Key();
-      Lattice lat = lattice_reader.Value();
-      lattice_reader.FreeCurrent();
-      if (lm_scale != 0.0) {
-        // Only need to modify it if LM scale nonzero.
-        // Before composing with the LM FST, we scale the lattice weights
-        // by the inverse of "lm_scale".  We'll later scale by "lm_scale".
-        // We do it this way so we can determinize and it will give the
-        // right effect (taking the "best path" through the LM) regardless
-        // of the sign of lm_scale.
-        fst::ScaleLattice(fst::GraphLatticeScale(1.0 / lm_scale), &lat);
-        ArcSort(&lat, fst::OLabelCompare<LatticeArc>());
-
-        Lattice composed_lat;
-        // Could just do, more simply: Compose(lat, lm_fst, &composed_lat);
-        // and not have lm_compose_cache at all.
-        // The command below is faster, though; it's constant not
-        // logarithmic in vocab size.
-        TableCompose(lat, lm_fst, &composed_lat, &lm_compose_cache);
-
-        Invert(&composed_lat); // make it so word labels are on the input.
-        CompactLattice determinized_lat;
-        DeterminizeLattice(composed_lat, &determinized_lat);
-        fst::ScaleLattice(fst::GraphLatticeScale(lm_scale), &determinized_lat);
-        if (determinized_lat.Start() == fst::kNoStateId) {
-          KALDI_WARN << "Empty lattice for utterance " << key << " (incompatible LM?)";
-          n_fail++;
-        } else {
-          compact_lattice_writer.Write(key, determinized_lat);
-          n_done++;
-        }
-      } else {
-        // zero scale so nothing to do.
-        n_done++;
-        CompactLattice compact_lat;
-        ConvertLattice(lat, &compact_lat);
-        compact_lattice_writer.Write(key, compact_lat);
+    {
+      PooledTaskSequencer<LmRescoreTask> sequencer(sequencer_config);
+      for (; !lattice_reader.Done(); lattice_reader.Next()) {
+        std::string key = lattice_reader.Key();
+        Lattice *lat = new Lattice(lattice_reader.Value());
+        lattice_reader.FreeCurrent();
+        sequencer.Run(new LmRescoreTask(key, lat, lm_scale,
+                                        &lm_compose_contexts,
+                                        &compact_lattice_writer,
+                                        &n_done, &n_fail));
       }
+      sequencer.Wait();
     }
 
     KALDI_LOG << "Done " << n_done << " lattices, failed for " << n_fail;
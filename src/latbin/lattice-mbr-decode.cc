@@ -61,6 +61,9 @@ int main(int argc, char *argv[]) {
     po.Register("one-best-times", &one_best_times, "If true, output times "
                 "corresponding to one-best, not whole sausage.");
 
+    MinimumBayesRiskOptions mbr_opts;
+    mbr_opts.Register(&po);
+
     po.Read(argc, argv);
 
     if (po.NumArgs() < 2 || po.NumArgs() > 5) {
@@ -100,7 +103,7 @@ int main(int argc, char *argv[]) {
       clat_reader.FreeCurrent();
       fst::ScaleLattice(fst::LatticeScale(lm_scale, acoustic_scale), &clat);
 
-      MinimumBayesRisk mbr(clat);
+      MinimumBayesRisk mbr(clat, mbr_opts);
 
       if (trans_wspecifier != "")
         trans_writer.Write(key, mbr.GetOneBest());
@@ -24,6 +24,73 @@
 #include "fstext/fstext-lib.h"
 #include "lat/kaldi-lattice.h"
 #include "lat/lattice-functions.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// Prunes one lattice; run by PooledTaskSequencer.  The output and the
+// statistics are written in the destructor, which is called in the original
+// order of the lattices, one at a time.
+class PruneLatticeTask {
+ public:
+  // Takes ownership of 'clat'.
+  PruneLatticeTask(const std::string &key, CompactLattice *clat,
+                   BaseFloat acoustic_scale, BaseFloat beam,
+                   CompactLatticeWriter *clat_writer,
+                   int32 *n_done, int32 *n_err,
+                   int64 *n_arcs_in, int64 *n_arcs_out,
+                   int64 *n_states_in, int64 *n_states_out):
+      key_(key), clat_(clat), acoustic_scale_(acoustic_scale), beam_(beam),
+      ok_(true), clat_writer_(clat_writer), n_done_(n_done), n_err_(n_err),
+      n_arcs_in_(n_arcs_in), n_arcs_out_(n_arcs_out),
+      n_states_in_(n_states_in), n_states_out_(n_states_out) { }
+
+  void operator () () {
+    fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale_), clat_);
+    narcs_ = NumArcs(*clat_);
+    nstates_ = clat_->NumStates();
+    if (!PruneLattice(beam_, clat_))
+      ok_ = false;
+    fst::ScaleLattice(fst::AcousticLatticeScale(1.0/acoustic_scale_), clat_);
+  }
+
+  ~PruneLatticeTask() {
+    if (!ok_) {
+      KALDI_WARN << "Error pruning lattice for utterance " << key_;
+      (*n_err_)++;
+    }
+    int64 pruned_narcs = NumArcs(*clat_),
+        pruned_nstates = clat_->NumStates();
+    *n_arcs_in_ += narcs_;
+    *n_states_in_ += nstates_;
+    *n_arcs_out_ += pruned_narcs;
+    *n_states_out_ += pruned_nstates;
+    KALDI_LOG << "For utterance " << key_ << ", pruned #states from "
+              << nstates_ << " to " << pruned_nstates << " and #arcs from "
+              << narcs_ << " to " << pruned_narcs;
+    clat_writer_->Write(key_, *clat_);
+    (*n_done_)++;
+    delete clat_;
+  }
+
+ private:
+  std::string key_;
+  CompactLattice *clat_;
+  BaseFloat acoustic_scale_;
+  BaseFloat beam_;
+  bool ok_;
+  int64 narcs_;
+  int64 nstates_;
+  CompactLatticeWriter *clat_writer_;
+  int32 *n_done_;
+  int32 *n_err_;
+  int64 *n_arcs_in_;
+  int64 *n_arcs_out_;
+  int64 *n_states_in_;
+  int64 *n_states_out_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -43,12 +110,14 @@ int main(int argc, char *argv[]) {
     BaseFloat acoustic_scale = 1.0;
     BaseFloat inv_acoustic_scale = 1.0;
     BaseFloat beam = 10.0;
-    
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
+
     po.Register("acoustic-scale", &acoustic_scale, "Scaling factor for acoustic likelihoods");
     po.Register("inv-acoustic-scale", &inv_acoustic_scale, "An alternative way of setting the "
                 "acoustic scale: you can set its inverse.");
     po.Register("beam", &beam, "Pruning beam [applied after acoustic scaling]");
-    
+    sequencer_config.Register(&po);
+
     po.Read(argc, argv);
 
     if (po.NumArgs() != 2) {
@@ -75,29 +144,19 @@ int main(int argc, char *argv[]) {
     if (acoustic_scale == 0.0)
       KALDI_ERR << "Do not use a zero acoustic scale (cannot be inverted)";
     
-    for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
-      std::string key = compact_lattice_reader.Key();
-      CompactLattice clat = compact_lattice_reader.Value();
-      compact_lattice_reader.FreeCurrent();
-      fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale), &clat);
-      int64 narcs = NumArcs(clat), nstates = clat.NumStates();
-      n_arcs_in += narcs;
-      n_states_in += nstates;
-      CompactLattice pruned_clat(clat);
-      if (!PruneLattice(beam, &pruned_clat)) {
-        KALDI_WARN << "Error pruning lattice for utterance " << key;
-        n_err++;
+    {
+      PooledTaskSequencer<PruneLatticeTask> sequencer(sequencer_config);
+      for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
+        std::string key = compact_lattice_reader.Key();
+        CompactLattice *clat =
+            new CompactLattice(compact_lattice_reader.Value());
+        compact_lattice_reader.FreeCurrent();
+        sequencer.Run(new PruneLatticeTask(
+            key, clat, acoustic_scale, beam, &compact_lattice_writer,
+            &n_done, &n_err, &n_arcs_in, &n_arcs_out,
+            &n_states_in, &n_states_out));
       }
-      int64 pruned_narcs = NumArcs(pruned_clat),          
-          pruned_nstates = pruned_clat.NumStates();
-      n_arcs_out += pruned_narcs;
-      n_states_out += pruned_nstates;
-      KALDI_LOG << "For utterance " << key << ", pruned #states from "
-                << nstates << " to " << pruned_nstates << " and #arcs from "
-                << narcs << " to " << pruned_narcs;
-      fst::ScaleLattice(fst::AcousticLatticeScale(1.0/acoustic_scale), &pruned_clat);
-      compact_lattice_writer.Write(key, pruned_clat);
-      n_done++;
+      sequencer.Wait();
     }
 
     BaseFloat den = (n_done > 0 ? static_cast<BaseFloat>(n_done) : 1.0);
@@ -20,9 +20,86 @@
 
 #include "util/common-utils.h"
 #include "util/kaldi-table.h"
+#include "util/kaldi-thread.h"
 #include "lat/sausages.h"
 #include <numeric>
 
+namespace kaldi {
+
+// Does the MBR decoding of one lattice; run by PooledTaskSequencer.  The ctm
+// lines are written in the destructor, which is called in the original order
+// of the lattices, one at a time.
+class LatticeToCtmConfTask {
+ public:
+  // Takes ownership of 'clat'.  If have_one_best is false, the initial
+  // hypothesis is the 1-best of the lattice and 'one_best' and 'times' are
+  // ignored; 'times' is only used if have_times is true.
+  LatticeToCtmConfTask(const std::string &key, CompactLattice *clat,
+                       const std::vector<int32> &one_best,
+                       const std::vector<std::pair<BaseFloat,BaseFloat> > &times,
+                       bool have_one_best, bool have_times,
+                       const MinimumBayesRiskOptions &mbr_opts,
+                       BaseFloat frame_shift, std::ostream *ctm_stream,
+                       int32 *n_done, int32 *n_words,
+                       BaseFloat *tot_bayes_risk):
+      key_(key), clat_(clat), one_best_(one_best), times_(times),
+      have_one_best_(have_one_best), have_times_(have_times),
+      mbr_opts_(mbr_opts), frame_shift_(frame_shift), mbr_(NULL),
+      ctm_stream_(ctm_stream), n_done_(n_done), n_words_(n_words), tot_bayes_risk_(tot_bayes_risk) { }
+
+  void operator () () {
+    if (!have_one_best_) {
+      mbr_ = new MinimumBayesRisk(*clat_, mbr_opts_);
+    } else if (!have_times_) {
+      mbr_ = new MinimumBayesRisk(*clat_, one_best_, mbr_opts_); // no 'times',
+    } else {
+      // with initial 'times' of the bins,
+      mbr_ = new MinimumBayesRisk(*clat_, one_best_, times_, mbr_opts_);
+    }
+    delete clat_;
+    clat_ = NULL;
+  }
+
+  ~LatticeToCtmConfTask() {
+    const std::vector<BaseFloat> &conf = mbr_->GetOneBestConfidences();
+    const std::vector<int32> &words = mbr_->GetOneBest();
+    const std::vector<std::pair<BaseFloat, BaseFloat> > &times =
+        mbr_->GetOneBestTimes();
+    KALDI_ASSERT(conf.size() == words.size() && words.size() == times.size());
+    for (size_t i = 0; i < words.size(); i++) {
+      KALDI_ASSERT(words[i] != 0 || mbr_opts_.print_silence); // Should not have epsilons.
+      (*ctm_stream_) << key_ << " 1 " << (frame_shift_ * times[i].first) << ' '
+                     << (frame_shift_ * (times[i].second-times[i].first)) << ' '
+                     << words[i] << ' ' << conf[i] << '\n';
+    }
+    KALDI_LOG << "For utterance " << key_ << ", Bayes Risk "
+              << mbr_->GetBayesRisk() << ", avg. confidence per-word "
+              << std::accumulate(conf.begin(),conf.end(),0.0) / words.size();
+    (*n_done_)++;
+    *n_words_ += mbr_->GetOneBest().size();
+    *tot_bayes_risk_ += mbr_->GetBayesRisk();
+    delete mbr_;
+    delete clat_;
+  }
+
+ private:
+  std::string key_;
+  CompactLattice *clat_;
+  std::vector<int32> one_best_;
+  std::vector<std::pair<BaseFloat,BaseFloat> > times_;
+  bool have_one_best_;
+  bool have_times_;
+  const MinimumBayesRiskOptions &mbr_opts_;
+  BaseFloat frame_shift_;
+  MinimumBayesRisk *mbr_;
+  std::ostream *ctm_stream_;
+  int32 *n_done_;
+  int32 *n_words_;
+  BaseFloat *tot_bayes_risk_;
+};
+
+}  // namespace kaldi
+
 int main(int argc, char *argv[]) {
   try {
     using namespace kaldi;
@@ -61,6 +138,7 @@ int main(int argc, char *argv[]) {
     BaseFloat acoustic_scale = 1.0, inv_acoustic_scale = 1.0, lm_scale = 1.0;
     BaseFloat frame_shift = 0.01;
     int32 confidence_digits = 2;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
 
     std::string word_syms_filename;
     po.Register("acoustic-scale", &acoustic_scale, "Scaling factor for "
@@ -73,6 +151,8 @@ int main(int argc, char *argv[]) {
     po.Register("confidence-digits", &confidence_digits, "Number of decimal digits for confidences in 'ctm'.");
 
 
+    sequencer_config.Register(&po);
+
     MinimumBayesRiskOptions mbr_opts;
     mbr_opts.Register(&po);
 
@@ -129,56 +209,38 @@ int main(int argc, char *argv[]) {
     int32 n_done = 0, n_words = 0;
     BaseFloat tot_bayes_risk = 0.0;
 
-    for (; !clat_reader.Done(); clat_reader.Next()) {
-      std::string key = clat_reader.Key();
-      CompactLattice clat = clat_reader.Value();
-      clat_reader.FreeCurrent();
-      fst::ScaleLattice(fst::LatticeScale(lm_scale, acoustic_scale), &clat);
-
-      MinimumBayesRisk *mbr = NULL;
-
-      if (one_best_rspecifier == "") {
-        mbr = new MinimumBayesRisk(clat, mbr_opts);
-      } else {
-        // check,
-        if (!one_best_reader.HasKey(key)) {
-          KALDI_WARN << "No 1-best present for utterance " << key;
-          continue;
-        }
-        if (times_rspecifier != "" && !times_reader.HasKey(key)) {
-          KALDI_WARN << "No 'times' present for utterance " << key;
-          continue;
-        }
-        // get the 'mbr' decoding object,
-        if (times_rspecifier == "") {
-          const std::vector<int32> &one_best = one_best_reader.Value(key);
-          mbr = new MinimumBayesRisk(clat, one_best, mbr_opts); // no 'times',
-        } else {
-          // with initial 'times' of the bins,
-          const std::vector<int32> &one_best = one_best_reader.Value(key);
-          const std::vector<std::pair<BaseFloat,BaseFloat> > &times = times_reader.Value(key);
-          mbr = new MinimumBayesRisk(clat, one_best, times, mbr_opts);
+    {
+      PooledTaskSequencer<LatticeToCtmConfTask> sequencer(sequencer_config);
+      std::vector<int32> one_best;
+      std::vector<std::pair<BaseFloat,BaseFloat> > times;
+      for (; !clat_reader.Done(); clat_reader.Next()) {
+        std::string key = clat_reader.Key();
+
+        if (one_best_rspecifier != "") {
+          // check,
+          if (!one_best_reader.HasKey(key)) {
+            KALDI_WARN << "No 1-best present for utterance " << key;
+            continue;
+          }
+          if (times_rspecifier != "" && !times_reader.HasKey(key)) {
+            KALDI_WARN << "No 'times' present for utterance " << key;
+            continue;
+          }
+          one_best = one_best_reader.Value(key);
+          if (times_rspecifier != "")
+            times = times_reader.Value(key);
         }
-      }
 
-      const std::vector<BaseFloat> &conf = mbr->GetOneBestConfidences();
-      const std::vector<int32> &words = mbr->GetOneBest();
-      const std::vector<std::pair<BaseFloat, BaseFloat> > &times =
-          mbr->GetOneBestTimes();
-      KALDI_ASSERT(conf.size() == words.size() && words.size() == times.size());
-      for (size_t i = 0; i < words.size(); i++) {
-        KALDI_ASSERT(words[i] != 0 || mbr_opts.print_silence); // Should not have epsilons.
-        ko.Stream() << key << " 1 " << (frame_shift * times[i].first) << ' '
-                    << (frame_shift * (times[i].second-times[i].first)) << ' '
-                    << words[i] << ' ' << conf[i] << '\n';
+        CompactLattice *clat = new CompactLattice(clat_reader.Value());
+        clat_reader.FreeCurrent();
+        fst::ScaleLattice(fst::LatticeScale(lm_scale, acoustic_scale), clat);
+
+        sequencer.Run(new LatticeToCtmConfTask(
+            key, clat, one_best, times, one_best_rspecifier != "",
+            times_rspecifier != "", mbr_opts,
+            frame_shift, &(ko.Stream()), &n_done, &n_words, &tot_bayes_risk));
       }
-      KALDI_LOG << "For utterance " << key << ", Bayes Risk "
-                << mbr->GetBayesRisk() << ", avg. confidence per-word "
-                << std::accumulate(conf.begin(),conf.end(),0.0) / words.size();
-      n_done++;
-      n_words += mbr->GetOneBest().size();
-      tot_bayes_risk += mbr->GetBayesRisk();
-      delete mbr;
+      sequencer.Wait();
     }
 
     KALDI_LOG << "Done " << n_done << " lattices.";
@@ -80,6 +80,7 @@ class TestableArpaFileParser : public ArpaFileParser {
         read_complete_(false),
         last_order_(0) { }
   void Validate(CountedArray<int32> counts, CountedArray<NGramTestData> ngrams);
+  const std::vector<NGramTestData> &NGrams() const { return ngrams_; }
 
  private:
   // ArpaFileParser overrides.
@@ -194,15 +195,63 @@ ngram 3=2\n\
     { 17, -0.3, { 1, 4, 5 },  0.0 },
     { 18, -0.2, { 4, 5, 2 },  0.0 } };
 
-  ArpaParseOptions options;
-  options.bos_symbol = 1;
-  options.eos_symbol = 2;
+  for (int32 num_threads = 1; num_threads <= 3; num_threads++) {
+    ArpaParseOptions options;
+    options.bos_symbol = 1;
+    options.eos_symbol = 2;
+    options.num_threads = num_threads;
+
+    TestableArpaFileParser parser(options, NULL);
+    std::istringstream stm(integer_lm, std::ios_base::in);
+    parser.Read(stm);
+    parser.Validate(MakeCountedArray(expect_counts),
+                    MakeCountedArray(expect_ngrams));
+  }
+}
 
-  TestableArpaFileParser parser(options, NULL);
-  std::istringstream stm(integer_lm, std::ios_base::in);
-  parser.Read(stm);
-  parser.Validate(MakeCountedArray(expect_counts),
-                  MakeCountedArray(expect_ngrams));
+// Read an integer LM large enough to be parsed in several batches, with
+// several threads, and check that the result is the same as with one thread.
+void ReadLargeIntegerLmMultiThreaded() {
+  KALDI_LOG << "ReadLargeIntegerLmMultiThreaded()";
+
+  int32 num_unigrams = 40000 + RandInt(0, 1000),
+      num_bigrams = 70000 + RandInt(0, 1000);
+  std::ostringstream lm;
+  lm << "\\data\\\nngram 1=" << num_unigrams << "\nngram 2="
+     << num_bigrams << "\n\n\\1-grams:\n";
+  for (int32 i = 1; i <= num_unigrams; i++) {
+    lm << -0.001 * RandInt(1, 5000) << '\t' << i;
+    if (i % 3 != 0)
+      lm << '\t' << -0.001 * RandInt(1, 5000);
+    lm << '\n';
+    if (i % 1000 == 0)
+      lm << '\n';  // Blank lines are allowed.
+  }
+  lm << "\n\\2-grams:\n";
+  for (int32 i = 0; i < num_bigrams; i++)
+    lm << -0.001 * RandInt(1, 5000) << '\t' << RandInt(1, num_unigrams)
+       << ' ' << RandInt(3, num_unigrams) << '\n';
+  lm << "\n\\end\\\n";
+
+  std::vector<NGramTestData> ngrams[2];
+  for (int32 i = 0; i < 2; i++) {
+    ArpaParseOptions options;
+    options.bos_symbol = 1;
+    options.eos_symbol = 2;
+    options.num_threads = (i == 0 ? 1 : 4);
+    TestableArpaFileParser parser(options, NULL);
+    std::istringstream stm(lm.str(), std::ios_base::in);
+    parser.Read(stm);
+    ngrams[i] = parser.NGrams();
+  }
+  KALDI_ASSERT(ngrams[0].size() == num_unigrams + num_bigrams);
+  KALDI_ASSERT(ngrams[0].size() == ngrams[1].size());
+  for (size_t i = 0; i < ngrams[0].size(); i++) {
+    const NGramTestData &a = ngrams[0][i], &b = ngrams[1][i];
+    KALDI_ASSERT(a.line_number == b.line_number &&
+                 std::equal(a.words, a.words + kMaxOrder, b.words) &&
+                 a.logprob == b.logprob && a.backoff == b.backoff);
+  }
 }
 
 // \xCE\xB2 = UTF-8 for Greek beta, to churn some UTF-8 cranks.
@@ -368,6 +417,7 @@ void ReadSymbolicLmWithOovTests() {
 
 int main(int argc, char *argv[]) {
   kaldi::ReadIntegerLmLogconvExpectSuccess();
+  kaldi::ReadLargeIntegerLmMultiThreaded();
   kaldi::ReadSymbolicLmNoOovTests();
   kaldi::ReadSymbolicLmWithOovTests();
 }
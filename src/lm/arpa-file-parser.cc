@@ -20,15 +20,147 @@
 
 #include <fst/fstlib.h>
 
+#include <algorithm>
 #include <sstream>
 
 #include "base/kaldi-error.h"
 #include "base/kaldi-math.h"
 #include "lm/arpa-file-parser.h"
+#include "util/kaldi-thread.h"
 #include "util/text-utils.h"
 
 namespace kaldi {
 
+namespace {
+
+// Number of n-gram lines parsed by each thread in one batch.
+const size_t kLinesPerThread = 16384;
+
+enum NGramLineStatus {
+  kNGramOk,
+  kNGramSkipped,  // OOV word with kSkipNGram; 'message' says why.
+  kNGramError     // Invalid line; 'message' says why.
+};
+
+struct ParsedNGramLine {
+  NGram ngram;
+  NGramLineStatus status;
+  std::string message;
+};
+
+// Parses one data line of the "\N-grams:" section, with N == order.  This
+// does not print anything, so that it can be called from several threads at
+// once; it does not modify 'symbols' unless options.oov_handling is
+// kAddToSymbols.
+void ParseNGramLine(const ArpaParseOptions &options,
+                    fst::SymbolTable *symbols,
+                    int32 order, bool is_highest,
+                    const std::string &line,
+                    ParsedNGramLine *out) {
+  NGram &ngram = out->ngram;
+  out->status = kNGramError;
+  out->message.clear();
+
+  std::vector<std::string> col;
+  SplitStringToVector(line, " \t", true, &col);
+
+  if (col.size() < 1 + order || col.size() > 2 + order ||
+      (is_highest && col.size() != 1 + order)) {
+    out->message = "Invalid n-gram data line";
+    return;
+  }
+
+  // Parse out n-gram logprob and, if present, backoff weight.
+  if (!ConvertStringToReal(col[0], &ngram.logprob)) {
+    out->message = "invalid n-gram logprob '" + col[0] + "'";
+    return;
+  }
+  ngram.backoff = 0.0;
+  if (col.size() > order + 1) {
+    if (!ConvertStringToReal(col[order + 1], &ngram.backoff)) {
+      out->message = "invalid backoff weight '" + col[order + 1] + "'";
+      return;
+    }
+  }
+  // Convert to natural log.
+  ngram.logprob *= M_LN10;
+  ngram.backoff *= M_LN10;
+
+  ngram.words.resize(order);
+  for (int32 index = 0; index < order; ++index) {
+    const std::string &word_str = col[1 + index];
+    int32 word;
+    if (symbols) {
+      // Symbol table provided, so symbol labels are expected.
+      if (options.oov_handling == ArpaParseOptions::kAddToSymbols) {
+        word = symbols->AddSymbol(word_str);
+      } else {
+        word = symbols->Find(word_str);
+        if (word == -1) { // fst::kNoSymbol
+          switch (options.oov_handling) {
+            case ArpaParseOptions::kReplaceWithUnk:
+              word = options.unk_symbol;
+              break;
+            case ArpaParseOptions::kSkipNGram:
+              out->status = kNGramSkipped;
+              out->message = "skipped: word '" + word_str +
+                  "' not in symbol table";
+              return;
+            default:
+              out->message = "word '" + word_str + "' not in symbol table";
+              return;
+          }
+        }
+      }
+    } else {
+      // Symbols not provided, LM file should contain integers.
+      if (!ConvertStringToInteger(word_str, &word) || word < 0) {
+        out->message = "invalid symbol '" + word_str + "'";
+        return;
+      }
+    }
+    // Whichever way we got it, an epsilon is invalid.
+    if (word == 0) {
+      out->message = "epsilon symbol '" + word_str + "' is illegal in ARPA LM";
+      return;
+    }
+    ngram.words[index] = word;
+  }
+  out->status = kNGramOk;
+}
+
+// Parses a batch of n-gram lines; each thread does a contiguous range.
+class NGramLineParserClass: public MultiThreadable {
+ public:
+  NGramLineParserClass(const ArpaParseOptions *options,
+                       fst::SymbolTable *symbols,
+                       int32 order, bool is_highest,
+                       const std::vector<std::string> *lines,
+                       std::vector<ParsedNGramLine> *parsed):
+      options_(options), symbols_(symbols), order_(order),
+      is_highest_(is_highest), lines_(lines), parsed_(parsed) { }
+
+  void operator() () {
+    size_t num_lines = lines_->size(),
+        block_size = (num_lines + num_threads_ - 1) / num_threads_,
+        begin = std::min(num_lines, thread_id_ * block_size),
+        end = std::min(num_lines, begin + block_size);
+    for (size_t i = begin; i < end; i++)
+      ParseNGramLine(*options_, symbols_, order_, is_highest_,
+                     (*lines_)[i], &((*parsed_)[i]));
+  }
+
+ private:
+  const ArpaParseOptions *options_;
+  fst::SymbolTable *symbols_;
+  int32 order_;
+  bool is_highest_;
+  const std::vector<std::string> *lines_;
+  std::vector<ParsedNGramLine> *parsed_;
+};
+
+}  // namespace
+
 ArpaFileParser::ArpaFileParser(const ArpaParseOptions& options,
                                fst::SymbolTable* symbols)
     : options_(options), symbols_(symbols),
@@ -129,8 +261,19 @@ void ArpaFileParser::Read(std::istream &is) {
   // Signal that grammar order and n-gram counts are known.
   HeaderAvailable();
 
-  NGram ngram;
-  ngram.words.reserve(ngram_counts_.size());
+  // Adding words to the symbol table has to be done in file order, so we
+  // cannot parse in parallel in that case.
+  int32 num_threads = options_.num_threads;
+  if (num_threads < 1 || (symbols_ != NULL &&
+                          options_.oov_handling ==
+                          ArpaParseOptions::kAddToSymbols))
+    num_threads = 1;
+  size_t batch_size = num_threads * kLinesPerThread;
+  std::vector<std::string> batch_lines;
+  std::vector<int32> batch_line_numbers;
+  std::vector<ParsedNGramLine> parsed;
+  batch_lines.reserve(batch_size);
+  batch_line_numbers.reserve(batch_size);
 
   // Processes "\N-grams:" section.
   for (int32 cur_order = 1; cur_order <= ngram_counts_.size(); ++cur_order) {
@@ -147,101 +290,84 @@ void ArpaFileParser::Read(std::istream &is) {
       PARSE_ERR << "invalid directive, expecting '" << keyword.str() << "'";
     }
     KALDI_LOG << "Reading " << current_line_ << " section.";
+    bool is_highest = (cur_order == ngram_counts_.size());
 
     int32 ngram_count = 0;
-    while (++line_number_, getline(is, current_line_) && !is.eof()) {
-      if (current_line_.find_first_not_of(" \n\t\r") == std::string::npos) {
-        continue;
-      }
-      if (current_line_[0] == '\\') {
-        TrimTrailingWhitespace(&current_line_);
-        std::ostringstream next_keyword;
-        next_keyword << "\\" << cur_order + 1 << "-grams:";
-        if ((current_line_ != next_keyword.str()) &&
-            (current_line_ != "\\end\\")) {
-          if (ShouldWarn()) {
-            KALDI_WARN << "ignoring possible directive '" << current_line_
-                       << "' expecting '" << next_keyword.str() << "'";
-
-            if (warning_count_ > 0 &&
-                warning_count_ > static_cast<uint32>(options_.max_warnings)) {
-              KALDI_WARN << "Of " << warning_count_ << " parse warnings, "
-                         << options_.max_warnings << " were reported. "
-                         << "Run program with --max-arpa-warnings=-1 "
-                         << "to see all warnings";
+    bool section_done = false;
+    while (!section_done) {
+      // Reads a batch of n-gram lines of the current order; the section ends
+      // at the next directive or at the end of the file.
+      batch_lines.clear();
+      batch_line_numbers.clear();
+      while (batch_lines.size() < batch_size) {
+        if (!(++line_number_, getline(is, current_line_) && !is.eof())) {
+          section_done = true;
+          break;
+        }
+        if (current_line_.find_first_not_of(" \n\t\r") == std::string::npos) {
+          continue;
+        }
+        if (current_line_[0] == '\\') {
+          TrimTrailingWhitespace(&current_line_);
+          std::ostringstream next_keyword;
+          next_keyword << "\\" << cur_order + 1 << "-grams:";
+          if ((current_line_ != next_keyword.str()) &&
+              (current_line_ != "\\end\\")) {
+            if (ShouldWarn()) {
+              KALDI_WARN << "ignoring possible directive '" << current_line_
+                         << "' expecting '" << next_keyword.str() << "'";
+
+              if (warning_count_ > 0 &&
+                  warning_count_ > static_cast<uint32>(options_.max_warnings)) {
+                KALDI_WARN << "Of " << warning_count_ << " parse warnings, "
+                           << options_.max_warnings << " were reported. "
+                           << "Run program with --max-arpa-warnings=-1 "
+                           << "to see all warnings";
+              }
             }
+          } else {
+            section_done = true;
+            break;
           }
-        } else {
-          break;
         }
+        batch_lines.push_back(current_line_);
+        batch_line_numbers.push_back(line_number_);
       }
+      if (batch_lines.empty())
+        continue;
 
-      std::vector<std::string> col;
-      SplitStringToVector(current_line_, " \t", true, &col);
-
-      if (col.size() < 1 + cur_order ||
-          col.size() > 2 + cur_order ||
-          (cur_order == ngram_counts_.size() && col.size() != 1 + cur_order)) {
-        PARSE_ERR << "Invalid n-gram data line";
+      if (parsed.size() < batch_lines.size())
+        parsed.resize(batch_lines.size());
+      {
+        NGramLineParserClass c(&options_, symbols_, cur_order, is_highest,
+                               &batch_lines, &parsed);
+        // With zero threads, MultiThreader runs in this thread.
+        MultiThreader<NGramLineParserClass> m(num_threads == 1 ? 0 :
+                                              num_threads, c);
       }
-      ++ngram_count;
 
-      // Parse out n-gram logprob and, if present, backoff weight.
-      if (!ConvertStringToReal(col[0], &ngram.logprob)) {
-        PARSE_ERR << "invalid n-gram logprob '" << col[0] << "'";
-      }
-      ngram.backoff = 0.0;
-      if (col.size() > cur_order + 1) {
-        if (!ConvertStringToReal(col[cur_order + 1], &ngram.backoff))
-          PARSE_ERR << "invalid backoff weight '" << col[cur_order + 1] << "'";
-      }
-      // Convert to natural log.
-      ngram.logprob *= M_LN10;
-      ngram.backoff *= M_LN10;
-
-      ngram.words.resize(cur_order);
-      bool skip_ngram = false;
-      for (int32 index = 0; !skip_ngram && index < cur_order; ++index) {
-        int32 word;
-        if (symbols_) {
-          // Symbol table provided, so symbol labels are expected.
-          if (options_.oov_handling == ArpaParseOptions::kAddToSymbols) {
-            word = symbols_->AddSymbol(col[1 + index]);
-          } else {
-            word = symbols_->Find(col[1 + index]);
-            if (word == -1) { // fst::kNoSymbol
-              switch (options_.oov_handling) {
-                case ArpaParseOptions::kReplaceWithUnk:
-                  word = options_.unk_symbol;
-                  break;
-                case ArpaParseOptions::kSkipNGram:
-                  if (ShouldWarn())
-                    KALDI_WARN << LineReference() << " skipped: word '"
-                               << col[1 + index] << "' not in symbol table";
-                  skip_ngram = true;
-                  break;
-                default:
-                  PARSE_ERR << "word '"  << col[1 + index]
-                            << "' not in symbol table";
-              }
-            }
-          }
+      // Consumes the batch in file order.  current_line_ and line_number_
+      // are set to each n-gram's line, for LineReference(), and are restored
+      // afterwards as they may hold the directive that ended the section.
+      std::string saved_line;
+      saved_line.swap(current_line_);
+      int32 saved_line_number = line_number_;
+      for (size_t i = 0; i < batch_lines.size(); i++) {
+        current_line_.swap(batch_lines[i]);
+        line_number_ = batch_line_numbers[i];
+        ParsedNGramLine &line = parsed[i];
+        if (line.status == kNGramError)
+          PARSE_ERR << line.message;
+        ++ngram_count;
+        if (line.status == kNGramSkipped) {
+          if (ShouldWarn())
+            KALDI_WARN << LineReference() << " " << line.message;
         } else {
-          // Symbols not provided, LM file should contain integers.
-          if (!ConvertStringToInteger(col[1 + index], &word) || word < 0) {
-            PARSE_ERR << "invalid symbol '" << col[1 + index] << "'";
-          }
+          ConsumeNGram(line.ngram);
         }
-        // Whichever way we got it, an epsilon is invalid.
-        if (word == 0) {
-          PARSE_ERR << "epsilon symbol '" << col[1 + index]
-                    << "' is illegal in ARPA LM";
-        }
-        ngram.words[index] = word;
-      }
-      if (!skip_ngram) {
-        ConsumeNGram(ngram);
       }
+      current_line_.swap(saved_line);
+      line_number_ = saved_line_number;
     }
     if (ngram_count > ngram_counts_[cur_order - 1]) {
       PARSE_ERR << "header said there would be " << ngram_counts_[cur_order - 1]
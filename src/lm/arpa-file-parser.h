@@ -44,7 +44,7 @@ struct ArpaParseOptions {
 
   ArpaParseOptions():
       bos_symbol(-1), eos_symbol(-1), unk_symbol(-1),
-      oov_handling(kRaiseError), max_warnings(30) { }
+      oov_handling(kRaiseError), max_warnings(30), num_threads(1) { }
 
   void Register(OptionsItf *opts) {
     // Registering only the max_warnings count, since other options are
@@ -53,6 +53,10 @@ struct ArpaParseOptions {
     opts->Register("max-arpa-warnings", &max_warnings,
                    "Maximum warnings to report on ARPA parsing, "
                    "0 to disable, -1 to show all");
+    opts->Register("arpa-parse-threads", &num_threads,
+                   "Number of threads used to parse the n-gram lines of the "
+                   "ARPA file (they are still consumed in file order).  Not "
+                   "used when new words are added to the symbol table.");
   }
 
   int32 bos_symbol;  ///< Symbol for <s>, Required non-epsilon.
@@ -60,6 +64,7 @@ struct ArpaParseOptions {
   int32 unk_symbol;  ///< Symbol for <unk>, Required for kReplaceWithUnk.
   OovHandling oov_handling;  ///< How to handle OOV words in the file.
   int32 max_warnings;  ///< Maximum warnings to report, <0 unlimited.
+  int32 num_threads;  ///< Number of threads parsing n-gram lines.
 };
 
 /**
@@ -92,7 +97,10 @@ class ArpaFileParser {
   ArpaFileParser(const ArpaParseOptions& options, fst::SymbolTable* symbols);
   virtual ~ArpaFileParser();
 
-  /// Read ARPA LM file from a stream.
+  /// Read ARPA LM file from a stream.  The n-gram lines are read in batches,
+  /// each batch being parsed by Options().num_threads threads, but
+  /// ConsumeNGram() is always called from the calling thread and in the
+  /// file order.
   void Read(std::istream &is);
 
   /// Parser options.
@@ -114,7 +114,7 @@ template <class HistKey>
 class ArpaLmCompilerImpl : public ArpaLmCompilerImplInterface {
  public:
   ArpaLmCompilerImpl(ArpaLmCompiler* parent, fst::StdVectorFst* fst,
-                     Symbol sub_eps);
+                     Symbol sub_eps, size_t expected_num_states);
 
   virtual void ConsumeNGram(const NGram &ngram, bool is_highest);
 
@@ -136,9 +136,15 @@ class ArpaLmCompilerImpl : public ArpaLmCompilerImplInterface {
 
 template <class HistKey>
 ArpaLmCompilerImpl<HistKey>::ArpaLmCompilerImpl(
-    ArpaLmCompiler* parent, fst::StdVectorFst* fst, Symbol sub_eps)
+    ArpaLmCompiler* parent, fst::StdVectorFst* fst, Symbol sub_eps,
+    size_t expected_num_states)
     : parent_(parent), fst_(fst), bos_symbol_(parent->Options().bos_symbol),
       eos_symbol_(parent->Options().eos_symbol), sub_eps_(sub_eps) {
+  // Reserving space up front avoids the reallocations (and the temporary
+  // doubling of memory they cause) as a large grammar is read.
+  fst_->ReserveStates(expected_num_states);
+  history_.reserve(expected_num_states);
+
   // The algorithm maintains state per history. The 0-gram is a special state
   // for empty history. All unigrams (including BOS) backoff into this state.
   StateId zerogram = fst_->AddState();
@@ -293,10 +299,18 @@ void ArpaLmCompiler::HeaderAvailable() {
   if (Options().oov_handling == ArpaParseOptions::kAddToSymbols)
     max_symbol += NgramCounts()[0];
 
+  // There is one state per n-gram, except for the highest order ones, plus a
+  // few special states.
+  size_t expected_num_states = 3;
+  for (size_t i = 0; i + 1 < NgramCounts().size(); i++)
+    expected_num_states += NgramCounts()[i];
+
   if (NgramCounts().size() <= 4 && max_symbol < OptimizedHistKey::kMaxData) {
-    impl_ = new ArpaLmCompilerImpl<OptimizedHistKey>(this, &fst_, sub_eps_);
+    impl_ = new ArpaLmCompilerImpl<OptimizedHistKey>(this, &fst_, sub_eps_,
+                                                     expected_num_states);
   } else {
-    impl_ = new ArpaLmCompilerImpl<GeneralHistKey>(this, &fst_, sub_eps_);
+    impl_ = new ArpaLmCompilerImpl<GeneralHistKey>(this, &fst_, sub_eps_,
+                                                   expected_num_states);
     KALDI_LOG << "Reverting to slower state tracking because model is large: "
               << NgramCounts().size() << "-gram with symbols up to "
               << max_symbol;
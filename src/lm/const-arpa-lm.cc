@@ -17,7 +17,17 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#ifndef _MSC_VER
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
 #include <limits>
 #include <sstream>
 #include <utility>
@@ -205,6 +215,10 @@ class ConstArpaLmBuilder : public ArpaFileParser {
   // Writes ConstArpaLm.
   void Write(std::ostream &os, bool binary) const;
 
+  // Writes ConstArpaLm in the mappable layout; see
+  // ConstArpaLm::WriteMappable().
+  void WriteMappable(std::ostream &os) const;
+
   void SetMaxAddressOffset(const int32 max_address_offset) {
     KALDI_WARN << "You are changing <max_address_offset_>; the default should "
         << "not be changed unless you are in testing mode.";
@@ -266,6 +280,13 @@ class ConstArpaLmBuilder : public ArpaFileParser {
 
 void ConstArpaLmBuilder::HeaderAvailable() {
   ngram_order_ = NgramCounts().size();
+  // We create an LmState for every n-gram except those of the highest order
+  // (unless it is a unigram model); reserving avoids rehashing.
+  size_t num_states = 0;
+  for (int32 i = 0; i < ngram_order_; i++)
+    if (i + 1 < ngram_order_ || ngram_order_ == 1)
+      num_states += NgramCounts()[i];
+  seq_to_state_.reserve(num_states);
 }
 
 void ConstArpaLmBuilder::ConsumeNGram(const NGram &ngram) {
@@ -494,6 +515,28 @@ void ConstArpaLmBuilder::Write(std::ostream &os, bool binary) const {
   const_arpa_lm.Write(os, binary);
 }
 
+void ConstArpaLmBuilder::WriteMappable(std::ostream &os) const {
+  KALDI_ASSERT(is_built_);
+  ConstArpaLm const_arpa_lm(
+      Options().bos_symbol, Options().eos_symbol, Options().unk_symbol,
+      ngram_order_, num_words_, overflow_buffer_size_, lm_states_size_,
+      unigram_states_, overflow_buffer_, lm_states_);
+  const_arpa_lm.WriteMappable(os);
+}
+
+ConstArpaLm::~ConstArpaLm() {
+  if (memory_assigned_) {
+    if (mapped_data_ == NULL)
+      delete[] lm_states_;
+    delete[] unigram_states_;
+    delete[] overflow_buffer_;
+  }
+#ifndef _MSC_VER
+  if (mapped_data_ != NULL)
+    munmap(mapped_data_, mapped_size_);
+#endif
+}
+
 void ConstArpaLm::Write(std::ostream &os, bool binary) const {
   KALDI_ASSERT(initialized_);
   if (!binary) {
@@ -520,6 +563,12 @@ void ConstArpaLm::Write(std::ostream &os, bool binary) const {
   }
   WriteToken(os, binary, "</LmStates>");
 
+  WriteUnigramAndOverflow(os);
+  WriteToken(os, binary, "</ConstArpaLm>");
+}
+
+void ConstArpaLm::WriteUnigramAndOverflow(std::ostream &os) const {
+  bool binary = true;
   // Unigram section. We write memory offset to disk instead of the absolute
   // pointers.
   WriteToken(os, binary, "<LmUnigram>");
@@ -567,7 +616,48 @@ void ConstArpaLm::Write(std::ostream &os, bool binary) const {
   delete[] tmp_overflow_address;
   tmp_overflow_address = NULL;
   WriteToken(os, binary, "</LmOverflow>");
-  WriteToken(os, binary, "</ConstArpaLm>");
+}
+
+void ConstArpaLm::WriteMappable(std::ostream &os) const {
+  KALDI_ASSERT(initialized_);
+  bool binary = true;
+  WriteToken(os, binary, "<ConstArpaLmMapped>");
+
+  // Misc info.
+  WriteToken(os, binary, "<LmInfo>");
+  WriteBasicType(os, binary, bos_symbol_);
+  WriteBasicType(os, binary, eos_symbol_);
+  WriteBasicType(os, binary, unk_symbol_);
+  WriteBasicType(os, binary, ngram_order_);
+  WriteToken(os, binary, "</LmInfo>");
+
+  // LmStates section, preceded by enough padding that the data is aligned.
+  WriteToken(os, binary, "<LmStates>");
+  WriteBasicType(os, binary, lm_states_size_);
+  WriteToken(os, binary, "<Padding>");
+  int64 pos = static_cast<int64>(os.tellp());
+  if (pos < 0) {
+    KALDI_ERR << "Cannot write ConstArpaLm in the mappable layout to this "
+              << "stream: it has to be written to a file, not a pipe.";
+  }
+  // An int32 is written as one byte for the size, then 4 bytes.
+  pos += 1 + sizeof(int32);
+  int32 padding = (kMapAlignment - pos % kMapAlignment) % kMapAlignment;
+  WriteBasicType(os, binary, padding);
+  std::vector<char> zeros(padding, 0);
+  if (padding > 0)
+    os.write(&(zeros[0]), padding);
+  KALDI_ASSERT(!os.good() ||
+               static_cast<int64>(os.tellp()) % kMapAlignment == 0);
+  os.write(reinterpret_cast<char *>(lm_states_),
+           sizeof(int32) * lm_states_size_);
+  if (!os.good()) {
+    KALDI_ERR << "ConstArpaLm <LmStates> section writing failed.";
+  }
+  WriteToken(os, binary, "</LmStates>");
+
+  WriteUnigramAndOverflow(os);
+  WriteToken(os, binary, "</ConstArpaLmMapped>");
 }
 
 void ConstArpaLm::Read(std::istream &is, bool binary) {
@@ -590,7 +680,14 @@ void ConstArpaLm::ReadInternal(std::istream &is, bool binary) {
     KALDI_ERR << "text-mode reading is not implemented for ConstArpaLm.";
   }
 
-  ExpectToken(is, binary, "<ConstArpaLm>");
+  // The mappable layout (see WriteMappable()) only differs by its tokens and
+  // by the padding before the <LmStates> data.
+  std::string token;
+  ReadToken(is, binary, &token);
+  bool mappable_layout = (token == "<ConstArpaLmMapped>");
+  if (!mappable_layout && token != "<ConstArpaLm>") {
+    KALDI_ERR << "Expected token <ConstArpaLm>, got " << token;
+  }
 
   // Misc info.
   ExpectToken(is, binary, "<LmInfo>");
@@ -603,6 +700,12 @@ void ConstArpaLm::ReadInternal(std::istream &is, bool binary) {
   // LmStates section.
   ExpectToken(is, binary, "<LmStates>");
   ReadBasicType(is, binary, &lm_states_size_);
+  if (mappable_layout) {
+    int32 padding;
+    ExpectToken(is, binary, "<Padding>");
+    ReadBasicType(is, binary, &padding);
+    is.ignore(padding);
+  }
   lm_states_ = new int32[lm_states_size_];
   is.read(reinterpret_cast<char *>(lm_states_),
           sizeof(int32) * lm_states_size_);
@@ -610,7 +713,16 @@ void ConstArpaLm::ReadInternal(std::istream &is, bool binary) {
     KALDI_ERR << "ConstArpaLm <LmStates> section reading failed.";
   }
   ExpectToken(is, binary, "</LmStates>");
+  memory_assigned_ = true;
+
+  ReadUnigramAndOverflow(is);
+  ExpectToken(is, binary, mappable_layout ? "</ConstArpaLmMapped>" :
+              "</ConstArpaLm>");
+  FinishRead();
+}
 
+void ConstArpaLm::ReadUnigramAndOverflow(std::istream &is) {
+  bool binary = true;
   // Unigram section. We write memory offset to disk instead of the absolute
   // pointers.
   ExpectToken(is, binary, "<LmUnigram>");
@@ -650,8 +762,9 @@ void ConstArpaLm::ReadInternal(std::istream &is, bool binary) {
   delete[] tmp_overflow_address;
   tmp_overflow_address = NULL;
   ExpectToken(is, binary, "</LmOverflow>");
-  ExpectToken(is, binary, "</ConstArpaLm>");
+}
 
+void ConstArpaLm::FinishRead() {
   KALDI_ASSERT(ngram_order_ > 0);
   KALDI_ASSERT(bos_symbol_ < num_words_ && bos_symbol_ > 0);
   KALDI_ASSERT(eos_symbol_ < num_words_ && eos_symbol_ > 0);
@@ -662,6 +775,72 @@ void ConstArpaLm::ReadInternal(std::istream &is, bool binary) {
   initialized_ = true;
 }
 
+void ConstArpaLm::ReadMapped(const std::string &rxfilename) {
+  KALDI_ASSERT(!initialized_);
+#ifndef _MSC_VER
+  if (ClassifyRxfilename(rxfilename) == kFileInput) {
+    std::ifstream is(rxfilename.c_str(), std::ios::binary);
+    bool binary;
+    if (!is.good() || !InitKaldiInputStream(is, &binary))
+      KALDI_ERR << "Could not open ConstArpaLm file " << rxfilename;
+    std::streampos start = is.tellg();
+    std::string token;
+    if (binary && is.peek() != 4)  // 4 would be the old format.
+      ReadToken(is, binary, &token);
+    if (token == "<ConstArpaLmMapped>") {
+      ExpectToken(is, binary, "<LmInfo>");
+      ReadBasicType(is, binary, &bos_symbol_);
+      ReadBasicType(is, binary, &eos_symbol_);
+      ReadBasicType(is, binary, &unk_symbol_);
+      ReadBasicType(is, binary, &ngram_order_);
+      ExpectToken(is, binary, "</LmInfo>");
+      ExpectToken(is, binary, "<LmStates>");
+      ReadBasicType(is, binary, &lm_states_size_);
+      int32 padding;
+      ExpectToken(is, binary, "<Padding>");
+      ReadBasicType(is, binary, &padding);
+      is.ignore(padding);
+      int64 data_offset = static_cast<int64>(is.tellg());
+      is.seekg(sizeof(int32) * lm_states_size_, std::ios::cur);
+      ExpectToken(is, binary, "</LmStates>");
+
+      int fd = open(rxfilename.c_str(), O_RDONLY);
+      if (fd < 0)
+        KALDI_ERR << "Could not open " << rxfilename << ": " << strerror(errno);
+      struct stat stat_buf;
+      if (fstat(fd, &stat_buf) != 0 ||
+          data_offset + static_cast<int64>(sizeof(int32)) * lm_states_size_ >
+          static_cast<int64>(stat_buf.st_size)) {
+        close(fd);
+        KALDI_ERR << "ConstArpaLm file " << rxfilename << " is truncated.";
+      }
+      mapped_size_ = stat_buf.st_size;
+      void *data = mmap(NULL, mapped_size_, PROT_READ, MAP_SHARED, fd, 0);
+      close(fd);  // the mapping stays valid.
+      if (data == MAP_FAILED)
+        KALDI_ERR << "Could not map " << rxfilename << ": " << strerror(errno);
+      mapped_data_ = data;
+      KALDI_ASSERT(data_offset % sizeof(int32) == 0);
+      // We never write to lm_states_.
+      lm_states_ = reinterpret_cast<int32*>(static_cast<char*>(data) +
+                                            data_offset);
+
+      ReadUnigramAndOverflow(is);
+      ExpectToken(is, binary, "</ConstArpaLmMapped>");
+      FinishRead();
+      KALDI_VLOG(1) << "Mapped " << (mapped_size_ >> 20)
+                    << " MB of ConstArpaLm data from " << rxfilename;
+      return;
+    }
+    // Not in the mappable layout: read it from the stream we already have.
+    is.seekg(start);
+    Read(is, binary);
+    return;
+  }
+#endif
+  ReadKaldiObject(rxfilename, this);
+}
+
 void ConstArpaLm::ReadInternalOldFormat(std::istream &is, bool binary) {
   KALDI_ASSERT(!initialized_);
   if (!binary) {
@@ -1073,12 +1252,21 @@ bool ConstArpaLmDeterministicFst::GetArc(StateId s,
 
 bool BuildConstArpaLm(const ArpaParseOptions& options,
                       const std::string& arpa_rxfilename,
-                      const std::string& const_arpa_wxfilename) {
+                      const std::string& const_arpa_wxfilename,
+                      bool mappable) {
   ConstArpaLmBuilder lm_builder(options);
   KALDI_LOG << "Reading " << arpa_rxfilename;
   Input ki(arpa_rxfilename);
   lm_builder.Read(ki.Stream());
-  WriteKaldiObject(lm_builder, const_arpa_wxfilename, true);
+  if (mappable) {
+    if (ClassifyWxfilename(const_arpa_wxfilename) != kFileOutput)
+      KALDI_ERR << "The mappable layout can only be written to a file, not "
+                << const_arpa_wxfilename;
+    Output ko(const_arpa_wxfilename, true);
+    lm_builder.WriteMappable(ko.Stream());
+  } else {
+    WriteKaldiObject(lm_builder, const_arpa_wxfilename, true);
+  }
   return true;
 }
 
@@ -217,6 +217,8 @@ class ConstArpaLm {
     lm_states_ = NULL;
     unigram_states_ = NULL;
     overflow_buffer_ = NULL;
+    mapped_data_ = NULL;
+    mapped_size_ = 0;
     memory_assigned_ = false;
     initialized_ = false;
   }
@@ -242,25 +244,46 @@ class ConstArpaLm {
     KALDI_ASSERT(unk_symbol_ < num_words_ &&
                  (unk_symbol_ > 0 || unk_symbol_ == -1));
     lm_states_end_ = lm_states_ + lm_states_size_ - 1;
+    mapped_data_ = NULL;
+    mapped_size_ = 0;
     memory_assigned_ = false;
     initialized_ = true;
   }
 
-  ~ConstArpaLm() {
-    if (memory_assigned_) {
-      delete[] lm_states_;
-      delete[] unigram_states_;
-      delete[] overflow_buffer_;
-    }
-  }
+  ~ConstArpaLm();
 
   // Reads the ConstArpaLm format language model. It calls ReadInternal() or
-  // ReadInternalOldFormat() to do the actual reading.
+  // ReadInternalOldFormat() to do the actual reading.  This accepts both the
+  // normal layout and the mappable layout written by WriteMappable().
   void Read(std::istream &is, bool binary);
 
   // Writes the language model in ConstArpaLm format.
   void Write(std::ostream &os, bool binary) const;
 
+  // Writes the language model in the "mappable" layout of the ConstArpaLm
+  // format: this is as Write(), except that the <LmStates> data, which is
+  // nearly all of the file, is padded so it starts at an offset in the file
+  // that is a multiple of kMapAlignment.  ReadMapped() can then map it into
+  // memory instead of reading it.  The stream must be a binary stream whose
+  // tellp() gives the position in the file (i.e. a file, not a pipe), with
+  // the binary-mode header already written, as by class Output.
+  void WriteMappable(std::ostream &os) const;
+
+  // Loads the language model from 'rxfilename'.  If it is a regular file in
+  // the mappable layout (see WriteMappable()), the <LmStates> data is mapped
+  // into memory read-only rather than read, so loading takes time proportional
+  // to the vocabulary size rather than to the size of the LM, and processes
+  // that use the same LM share its pages in the page cache.  Otherwise (or if
+  // mapping is not supported on this platform) this falls back to reading it,
+  // as ReadKaldiObject() would.
+  void ReadMapped(const std::string &rxfilename);
+
+  // Returns true if the LM data is mapped from a file (see ReadMapped()).
+  bool IsMapped() const { return mapped_data_ != NULL; }
+
+  // Alignment of the <LmStates> data in the mappable layout.
+  static const int32 kMapAlignment = 4096;
+
   // Creates Arpa format language model from ConstArpaLm format, and writes it
   // to output stream. This will be useful in testing.
   void WriteArpa(std::ostream &os) const;
@@ -288,6 +311,17 @@ class ConstArpaLm {
   // format, ReadInternal() will be called.
   void ReadInternalOldFormat(std::istream &is, bool binary);
 
+  // Writes the <LmUnigram> and <LmOverflow> sections, which are the same in
+  // both layouts.
+  void WriteUnigramAndOverflow(std::ostream &os) const;
+
+  // Reads the <LmUnigram> and <LmOverflow> sections; requires lm_states_ to
+  // be set.
+  void ReadUnigramAndOverflow(std::istream &is);
+
+  // Checks the LM info once everything is read, and sets lm_states_end_.
+  void FinishRead();
+
   // Loops up n-gram probability for given word sequence. Backoff is handled by
   // recursively calling this function.
   float GetNgramLogprobRecurse(const int32 word,
@@ -322,9 +356,14 @@ class ConstArpaLm {
                         std::vector<ArpaLine> *output) const;
 
   // We assign memory in Read(). If it is called, we have to release memory in
-  // the destructor.
+  // the destructor.  (If the LM was mapped, lm_states_ points into the
+  // mapping and is not deleted.)
   bool memory_assigned_;
 
+  // The memory mapping of the file, if ReadMapped() mapped it, else NULL.
+  void *mapped_data_;
+  size_t mapped_size_;
+
   // Makes sure that the language model has been loaded before using it.
   bool initialized_;
 
@@ -419,9 +458,13 @@ class ConstArpaLmDeterministicFst
 // Reads in an Arpa format language model and converts it into ConstArpaLm
 // format. We assume that the words in the input Arpa format language model have
 // been converted into integers.
+// If 'mappable' is true, writes the mappable layout (see
+// ConstArpaLm::WriteMappable()), which requires const_arpa_wxfilename to be a
+// file.
 bool BuildConstArpaLm(const ArpaParseOptions& options,
                       const std::string& arpa_rxfilename,
-                      const std::string& const_arpa_wxfilename);
+                      const std::string& const_arpa_wxfilename,
+                      bool mappable = false);
 
 }  // namespace kaldi
 
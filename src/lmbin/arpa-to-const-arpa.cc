@@ -45,7 +45,12 @@ int main(int argc, char *argv[]) {
     kaldi::ParseOptions po(usage);
 
     ArpaParseOptions options;
+    bool mappable = false;
     options.Register(&po);
+    po.Register("mappable", &mappable, "If true, write the language model in "
+                "a page-aligned layout that lattice-rescoring programs can "
+                "memory-map instead of reading it (it can still be read "
+                "normally).  The output must be a file.");
 
     // Ideally, these registrations would be in ArpaParseOptions, but some
     // programs want integers and other want symbols, so we register them
@@ -76,7 +81,7 @@ int main(int argc, char *argv[]) {
         const_arpa_wxfilename = po.GetOptArg(2);
 
     bool ans = BuildConstArpaLm(options, arpa_rxfilename,
-                                const_arpa_wxfilename);
+                                const_arpa_wxfilename, mappable);
     if (ans)
       return 0;
     else
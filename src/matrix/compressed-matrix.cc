@@ -21,9 +21,236 @@
 
 #include "matrix/compressed-matrix.h"
 #include <algorithm>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 namespace kaldi {
 
+// The functions below do the conversions of FloatToUint16(), FloatToUint8(),
+// FloatToChar() and CharToFloat() of class CompressedMatrix for many elements
+// at once, using AVX2 if it was enabled at compile time (e.g. by adding -mavx2
+// or -march=native to CXXFLAGS).  Each returns the number of elements it
+// processed, a multiple of 8, and the caller converts the rest one at a time.
+// Without AVX2, or for types other than float, they process nothing.  They
+// perform the same operations as the scalar code in the same precision
+// (including the parts that it does in double), so the results are bitwise
+// identical.
+
+// Converts floats to integers as
+//  static_cast<int>(clamp((value - min_value) / range, 0, 1) * max_int + 0.499).
+template<typename Real, typename IntType>
+static inline int32 FloatsToInts(float min_value, float range, int32 max_int,
+                                 const Real *data, int32 dim, IntType *out) {
+  return 0;
+}
+
+// Converts integers to floats as min_value + value * increment.
+template<typename IntType, typename Real>
+static inline int32 IntsToFloats(float min_value, float increment,
+                                 const IntType *data, int32 dim, Real *out) {
+  return 0;
+}
+
+// Converts a column with stride 'stride' to bytes, as FloatToChar() does.
+template<typename Real>
+static inline int32 FloatsToChars(float p0, float p25, float p75, float p100,
+                                  const Real *data, MatrixIndexT stride,
+                                  int32 dim, uint8 *out) {
+  return 0;
+}
+
+#ifdef __AVX2__
+// Converts (value - min_value) / range, clamped to [0, 1], to 8 integers.
+static inline __m256i FloatsToIntsAvx2(__m256 value, __m256 min_value,
+                                       __m256 range, __m256 max_int) {
+  __m256 f = _mm256_div_ps(_mm256_sub_ps(value, min_value), range);
+  f = _mm256_max_ps(_mm256_min_ps(f, _mm256_set1_ps(1.0)),
+                    _mm256_setzero_ps());
+  f = _mm256_mul_ps(f, max_int);
+  // The scalar code adds 0.499 in double.
+  const __m256d c = _mm256_set1_pd(0.499);
+  __m128i lo = _mm256_cvttpd_epi32(
+      _mm256_add_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(f)), c)),
+      hi = _mm256_cvttpd_epi32(
+          _mm256_add_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(f, 1)), c));
+  return _mm256_set_m128i(hi, lo);
+}
+
+static inline int32 FloatsToInts(float min_value, float range, int32 max_int,
+                                 const float *data, int32 dim, uint16 *out) {
+  const __m256 min_v = _mm256_set1_ps(min_value),
+      range_v = _mm256_set1_ps(range),
+      max_v = _mm256_set1_ps(max_int);
+  int32 i = 0;
+  for (; i + 8 <= dim; i += 8) {
+    __m256i n = FloatsToIntsAvx2(_mm256_loadu_ps(data + i), min_v, range_v,
+                                 max_v);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+                     _mm_packus_epi32(_mm256_castsi256_si128(n),
+                                      _mm256_extracti128_si256(n, 1)));
+  }
+  return i;
+}
+
+static inline int32 FloatsToInts(float min_value, float range, int32 max_int,
+                                 const float *data, int32 dim, uint8 *out) {
+  const __m256 min_v = _mm256_set1_ps(min_value),
+      range_v = _mm256_set1_ps(range),
+      max_v = _mm256_set1_ps(max_int);
+  int32 i = 0;
+  for (; i + 8 <= dim; i += 8) {
+    __m256i n = FloatsToIntsAvx2(_mm256_loadu_ps(data + i), min_v, range_v,
+                                 max_v);
+    __m128i n16 = _mm_packus_epi32(_mm256_castsi256_si128(n),
+                                   _mm256_extracti128_si256(n, 1));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i),
+                     _mm_packus_epi16(n16, n16));
+  }
+  return i;
+}
+
+static inline int32 IntsToFloats(float min_value, float increment,
+                                 const uint16 *data, int32 dim, float *out) {
+  const __m256 min_v = _mm256_set1_ps(min_value),
+      inc_v = _mm256_set1_ps(increment);
+  int32 i = 0;
+  for (; i + 8 <= dim; i += 8) {
+    __m256i n = _mm256_cvtepu16_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)));
+    _mm256_storeu_ps(out + i, _mm256_add_ps(
+        min_v, _mm256_mul_ps(_mm256_cvtepi32_ps(n), inc_v)));
+  }
+  return i;
+}
+
+static inline int32 IntsToFloats(float min_value, float increment,
+                                 const uint8 *data, int32 dim, float *out) {
+  const __m256 min_v = _mm256_set1_ps(min_value),
+      inc_v = _mm256_set1_ps(increment);
+  int32 i = 0;
+  for (; i + 8 <= dim; i += 8) {
+    __m256i n = _mm256_cvtepu8_epi32(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(data + i)));
+    _mm256_storeu_ps(out + i, _mm256_add_ps(
+        min_v, _mm256_mul_ps(_mm256_cvtepi32_ps(n), inc_v)));
+  }
+  return i;
+}
+
+static inline int32 FloatsToChars(float p0, float p25, float p75, float p100,
+                                  const float *data, MatrixIndexT stride,
+                                  int32 dim, uint8 *out) {
+  // Each element is in one of three ranges, [p0, p25), [p25, p75) and
+  // [p75, p100], which map to bytes [0, 64], [64, 192] and [192, 255].  We
+  // select the parameters of each element's range and do the computation of
+  // FloatToChar() for that range.
+  const __m256 p0_v = _mm256_set1_ps(p0), p25_v = _mm256_set1_ps(p25),
+      p75_v = _mm256_set1_ps(p75),
+      d0 = _mm256_set1_ps(p25 - p0), d1 = _mm256_set1_ps(p75 - p25),
+      d2 = _mm256_set1_ps(p100 - p75),
+      n0 = _mm256_set1_ps(64), n1 = _mm256_set1_ps(128),
+      n2 = _mm256_set1_ps(63);
+  const __m256i c0 = _mm256_setzero_si256(), c64 = _mm256_set1_epi32(64),
+      c192 = _mm256_set1_epi32(192), c255 = _mm256_set1_epi32(255);
+  const __m256d half = _mm256_set1_pd(0.5);
+  const __m256i index = _mm256_mullo_epi32(
+      _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0), _mm256_set1_epi32(stride));
+  int32 i = 0;
+  for (; i + 8 <= dim; i += 8) {
+    __m256 value = _mm256_i32gather_ps(data + i * stride, index, 4);
+    __m256 lt25 = _mm256_cmp_ps(value, p25_v, _CMP_LT_OQ),
+        lt75 = _mm256_cmp_ps(value, p75_v, _CMP_LT_OQ);
+    __m256 base = _mm256_blendv_ps(_mm256_blendv_ps(p75_v, p25_v, lt75),
+                                   p0_v, lt25),
+        diff = _mm256_blendv_ps(_mm256_blendv_ps(d2, d1, lt75), d0, lt25),
+        n = _mm256_blendv_ps(_mm256_blendv_ps(n2, n1, lt75), n0, lt25);
+    __m256i lt25_i = _mm256_castps_si256(lt25),
+        lt75_i = _mm256_castps_si256(lt75),
+        lower = _mm256_blendv_epi8(_mm256_blendv_epi8(c192, c64, lt75_i),
+                                   c0, lt25_i),
+        upper = _mm256_blendv_epi8(_mm256_blendv_epi8(c255, c192, lt75_i),
+                                   c64, lt25_i);
+    __m256 f = _mm256_mul_ps(_mm256_div_ps(_mm256_sub_ps(value, base), diff),
+                             n);
+    // The scalar code adds 0.5 in double.
+    __m128i lo = _mm256_cvttpd_epi32(
+        _mm256_add_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(f)), half)),
+        hi = _mm256_cvttpd_epi32(
+            _mm256_add_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(f, 1)), half));
+    __m256i ans = _mm256_add_epi32(lower, _mm256_set_m128i(hi, lo));
+    ans = _mm256_min_epi32(_mm256_max_epi32(ans, lower), upper);
+    __m128i ans16 = _mm_packus_epi32(_mm256_castsi256_si128(ans),
+                                     _mm256_extracti128_si256(ans, 1));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i),
+                     _mm_packus_epi16(ans16, ans16));
+  }
+  return i;
+}
+#endif  // __AVX2__
+
+// Converts bytes to a column with stride 'stride', as CharToFloat() does.
+template<typename Real>
+static inline int32 CharsToFloats(float p0, float p25, float p75, float p100,
+                                  const uint8 *data, int32 dim,
+                                  Real *out, MatrixIndexT stride) {
+#ifdef __AVX2__
+  // As in FloatsToChars(), we select the parameters of the range that each
+  // byte is in: [0, 64], (64, 192] or (192, 255].
+  const __m256 p0_v = _mm256_set1_ps(p0), p25_v = _mm256_set1_ps(p25),
+      p75_v = _mm256_set1_ps(p75),
+      d0 = _mm256_set1_ps(p25 - p0), d1 = _mm256_set1_ps(p75 - p25),
+      d2 = _mm256_set1_ps(p100 - p75);
+  const __m256i c64 = _mm256_set1_epi32(64), c192 = _mm256_set1_epi32(192);
+  const __m256d s0 = _mm256_set1_pd(1/64.0), s1 = _mm256_set1_pd(1/128.0),
+      s2 = _mm256_set1_pd(1/63.0);
+  int32 i = 0;
+  for (; i + 8 <= dim; i += 8) {
+    __m256i value = _mm256_cvtepu8_epi32(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(data + i)));
+    __m256i gt64 = _mm256_cmpgt_epi32(value, c64),
+        gt192 = _mm256_cmpgt_epi32(value, c192);
+    __m256 gt64_f = _mm256_castsi256_ps(gt64),
+        gt192_f = _mm256_castsi256_ps(gt192);
+    __m256 base = _mm256_blendv_ps(_mm256_blendv_ps(p0_v, p25_v, gt64_f),
+                                   p75_v, gt192_f),
+        diff = _mm256_blendv_ps(_mm256_blendv_ps(d0, d1, gt64_f), d2, gt192_f);
+    __m256i lower = _mm256_blendv_epi8(_mm256_and_si256(gt64, c64), c192,
+                                       gt192);
+    // The scalar code multiplies by (value - lower) in float, and does the
+    // rest in double.
+    __m256 prod = _mm256_mul_ps(
+        diff, _mm256_cvtepi32_ps(_mm256_sub_epi32(value, lower)));
+    __m128 f[2];
+    for (int32 h = 0; h < 2; h++) {
+      __m128i gt64_h = (h == 0 ? _mm256_castsi256_si128(gt64) :
+                        _mm256_extracti128_si256(gt64, 1)),
+          gt192_h = (h == 0 ? _mm256_castsi256_si128(gt192) :
+                     _mm256_extracti128_si256(gt192, 1));
+      __m256d scale = _mm256_blendv_pd(
+          _mm256_blendv_pd(s0, s1,
+                           _mm256_castsi256_pd(_mm256_cvtepi32_epi64(gt64_h))),
+          s2, _mm256_castsi256_pd(_mm256_cvtepi32_epi64(gt192_h)));
+      __m128 prod_h = (h == 0 ? _mm256_castps256_ps128(prod) :
+                       _mm256_extractf128_ps(prod, 1)),
+          base_h = (h == 0 ? _mm256_castps256_ps128(base) :
+                    _mm256_extractf128_ps(base, 1));
+      f[h] = _mm256_cvtpd_ps(_mm256_add_pd(
+          _mm256_cvtps_pd(base_h),
+          _mm256_mul_pd(_mm256_cvtps_pd(prod_h), scale)));
+    }
+    float buf[8];
+    _mm_storeu_ps(buf, f[0]);
+    _mm_storeu_ps(buf + 4, f[1]);
+    for (int32 j = 0; j < 8; j++)
+      out[(i + j) * stride] = buf[j];
+  }
+  return i;
+#else
+  return 0;
+#endif
+}
+
 //static
 MatrixIndexT CompressedMatrix::DataSize(const GlobalHeader &header) {
   // Returns size in bytes of the data.
@@ -168,7 +395,9 @@ void CompressedMatrix::CopyFromMat(
     int32 num_rows = mat.NumRows(), num_cols = mat.NumCols();
     for (int32 r = 0; r < num_rows; r++) {
       const Real *row_data = mat.RowData(r);
-      for (int32 c = 0; c < num_cols; c++)
+      for (int32 c = FloatsToInts(global_header.min_value, global_header.range,
+                                  65535, row_data, num_cols, data);
+           c < num_cols; c++)
         data[c] = FloatToUint16(global_header, row_data[c]);
       data += num_cols;
     }
@@ -179,7 +408,9 @@ void CompressedMatrix::CopyFromMat(
     int32 num_rows = mat.NumRows(), num_cols = mat.NumCols();
     for (int32 r = 0; r < num_rows; r++) {
       const Real *row_data = mat.RowData(r);
-      for (int32 c = 0; c < num_cols; c++)
+      for (int32 c = FloatsToInts(global_header.min_value, global_header.range,
+                                  255, row_data, num_cols, data);
+           c < num_cols; c++)
         data[c] = FloatToUint8(global_header, row_data[c]);
       data += num_cols;
     }
@@ -514,7 +745,9 @@ void CompressedMatrix::CompressColumn(
       p75 = Uint16ToFloat(global_header, header->percentile_75),
       p100 = Uint16ToFloat(global_header, header->percentile_100);
 
-  for (int32 i = 0; i < num_rows; i++) {
+  for (int32 i = FloatsToChars(p0, p25, p75, p100, data, stride, num_rows,
+                               byte_data);
+       i < num_rows; i++) {
     Real this_data = data[i * stride];
     byte_data[i] = FloatToChar(p0, p25, p75, p100, this_data);
   }
@@ -640,7 +873,9 @@ void CompressedMatrix::CopyToMat(MatrixBase<Real> *mat,
           p25 = Uint16ToFloat(*h, per_col_header->percentile_25),
           p75 = Uint16ToFloat(*h, per_col_header->percentile_75),
           p100 = Uint16ToFloat(*h, per_col_header->percentile_100);
-      for (int32 j = 0; j < num_rows; j++, byte_data++) {
+      int32 j = CharsToFloats(p0, p25, p75, p100, byte_data, num_rows,
+                              mat->Data() + i, mat->Stride());
+      for (byte_data += j; j < num_rows; j++, byte_data++) {
         float f = CharToFloat(p0, p25, p75, p100, *byte_data);
         (*mat)(j, i) = f;
       }
@@ -651,7 +886,9 @@ void CompressedMatrix::CopyToMat(MatrixBase<Real> *mat,
         increment = h->range * (1.0 / 65535.0);
     for (int32 i = 0; i < num_rows; i++) {
       Real *row_data = mat->RowData(i);
-      for (int32 j = 0; j < num_cols; j++)
+      for (int32 j = IntsToFloats(min_value, increment, data, num_cols,
+                                  row_data);
+           j < num_cols; j++)
         row_data[j] = min_value + data[j] * increment;
       data += num_cols;
     }
@@ -662,7 +899,9 @@ void CompressedMatrix::CopyToMat(MatrixBase<Real> *mat,
     const uint8 *data = reinterpret_cast<const uint8*>(h + 1);
     for (int32 i = 0; i < num_rows; i++) {
       Real *row_data = mat->RowData(i);
-      for (int32 j = 0; j < num_cols; j++)
+      for (int32 j = IntsToFloats(min_value, increment, data, num_cols,
+                                  row_data);
+           j < num_cols; j++)
         row_data[j] = min_value + data[j] * increment;
       data += num_cols;
     }
@@ -809,7 +1048,9 @@ void CompressedMatrix::CopyToMat(int32 row_offset,
           p25 = Uint16ToFloat(*h, per_col_header->percentile_25),
           p75 = Uint16ToFloat(*h, per_col_header->percentile_75),
           p100 = Uint16ToFloat(*h, per_col_header->percentile_100);
-      for (int32 j = 0; j < tgt_rows; j++, byte_data++) {
+      int32 j = CharsToFloats(p0, p25, p75, p100, byte_data, tgt_rows,
+                              dest->Data() + i, dest->Stride());
+      for (byte_data += j; j < tgt_rows; j++, byte_data++) {
         float f = CharToFloat(p0, p25, p75, p100, *byte_data);
         (*dest)(j, i) = f;
       }
@@ -822,7 +1063,9 @@ void CompressedMatrix::CopyToMat(int32 row_offset,
 
     for (int32 row = 0; row < tgt_rows; row++) {
       Real *dest_row = dest->RowData(row);
-      for (int32 col = 0; col < tgt_cols; col++)
+      for (int32 col = IntsToFloats(min_value, increment, data, tgt_cols,
+                                    dest_row);
+           col < tgt_cols; col++)
         dest_row[col] = min_value + increment * data[col];
       data += num_cols;
     }
@@ -834,7 +1077,9 @@ void CompressedMatrix::CopyToMat(int32 row_offset,
         increment = h->range * (1.0 / 255.0);
     for (int32 row = 0; row < tgt_rows; row++) {
       Real *dest_row = dest->RowData(row);
-      for (int32 col = 0; col < tgt_cols; col++)
+      for (int32 col = IntsToFloats(min_value, increment, data, tgt_cols,
+                                    dest_row);
+           col < tgt_cols; col++)
         dest_row[col] = min_value + increment * data[col];
       data += num_cols;
     }
@@ -254,6 +254,42 @@ static void UnitTestAddVecToColsSpeed() {
   CsvResult<Real>(__func__, sizes.size(), t.Elapsed(), "seconds");
 }
 
+template<typename Real>
+static void UnitTestCompressedMatrixSpeed() {
+  Timer t;
+  // A typical feature matrix: 1000 frames of 40-dimensional features.
+  MatrixIndexT num_rows = 1000, num_cols = 40;
+  Matrix<Real> M(num_rows, num_cols), M2(num_rows, num_cols);
+  M.SetRandn();
+  CompressionMethod methods[] = { kSpeechFeature, kTwoByteAuto, kOneByteAuto };
+  const char *names[] = { "Compress/kSpeechFeature", "Compress/kTwoByteAuto",
+                          "Compress/kOneByteAuto" },
+      *uncompress_names[] = { "Uncompress/kSpeechFeature",
+                              "Uncompress/kTwoByteAuto",
+                              "Uncompress/kOneByteAuto" };
+  for (int32 i = 0; i < 3; i++) {
+    CompressedMatrix cmat;
+    int32 iter = 0;
+    BaseFloat time_in_secs = 0.1;
+    Timer t1;
+    for (; t1.Elapsed() < time_in_secs; iter++)
+      cmat.CopyFromMat(M, methods[i]);
+    BaseFloat melems = (num_rows * num_cols * static_cast<BaseFloat>(iter)) /
+        (t1.Elapsed() * 1.0e+06);
+    CsvResult<Real>(names[i], num_cols, melems, "million elements/s");
+
+    iter = 0;
+    Timer t2;
+    for (; t2.Elapsed() < time_in_secs; iter++)
+      cmat.CopyToMat(&M2);
+    melems = (num_rows * num_cols * static_cast<BaseFloat>(iter)) /
+        (t2.Elapsed() * 1.0e+06);
+    CsvResult<Real>(uncompress_names[i], num_cols, melems,
+                    "million elements/s");
+  }
+  CsvResult<Real>(__func__, num_cols, t.Elapsed(), "seconds");
+}
+
 template<typename Real> static void MatrixUnitSpeedTest() {
   UnitTestRealFftSpeed<Real>();
   UnitTestSplitRadixRealFftSpeed<Real>();
@@ -263,6 +299,7 @@ template<typename Real> static void MatrixUnitSpeedTest() {
   UnitTestAddColSumMatSpeed<Real>();
   UnitTestAddVecToRowsSpeed<Real>();
   UnitTestAddVecToColsSpeed<Real>();
+  UnitTestCompressedMatrixSpeed<Real>();
 }
 
 } // namespace kaldi
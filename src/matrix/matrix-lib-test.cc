@@ -4463,6 +4463,41 @@ static void UnitTestExtractCompressedMatrix() {
   }
 }
 
+// Checks that the ways of uncompressing a CompressedMatrix give exactly the
+// same values: CopyToMat() may use vectorized code, while CopyRowToVec() and
+// CopyColToVec() convert one element at a time.
+template<typename Real>
+static void UnitTestCompressedMatrixConsistency() {
+  CompressionMethod methods[] = { kSpeechFeature, kTwoByteAuto, kOneByteAuto };
+  for (int32 i = 0; i < 30; i++) {
+    MatrixIndexT num_rows = 1 + Rand() % 40, num_cols = 1 + Rand() % 40;
+    Matrix<Real> big_mat(num_rows, num_cols + Rand() % 3);
+    big_mat.SetRandn();
+    SubMatrix<Real> mat(big_mat, 0, num_rows, 0, num_cols);
+    CompressedMatrix cmat(mat, methods[i % 3]);
+
+    Matrix<Real> full(num_rows, num_cols);
+    cmat.CopyToMat(&full);
+    Vector<Real> row(num_cols), col(num_rows);
+    for (MatrixIndexT r = 0; r < num_rows; r++) {
+      cmat.CopyRowToVec(r, &row);
+      for (MatrixIndexT c = 0; c < num_cols; c++)
+        KALDI_ASSERT(full(r, c) == row(c));
+    }
+    for (MatrixIndexT c = 0; c < num_cols; c++) {
+      cmat.CopyColToVec(c, &col);
+      for (MatrixIndexT r = 0; r < num_rows; r++)
+        KALDI_ASSERT(full(r, c) == col(r));
+    }
+    MatrixIndexT row_offset = Rand() % num_rows, col_offset = Rand() % num_cols;
+    Matrix<Real> part(num_rows - row_offset, num_cols - col_offset);
+    cmat.CopyToMat(row_offset, col_offset, &part);
+    for (MatrixIndexT r = 0; r < part.NumRows(); r++)
+      for (MatrixIndexT c = 0; c < part.NumCols(); c++)
+        KALDI_ASSERT(part(r, c) == full(r + row_offset, c + col_offset));
+  }
+}
+
 
 template<typename Real>
 static void UnitTestTridiag() {
@@ -4603,6 +4638,7 @@ template<typename Real> static void MatrixUnitTest(bool full_test) {
   UnitTestCompressedMatrix<Real>();
   UnitTestCompressedMatrix2<Real>();
   UnitTestExtractCompressedMatrix<Real>();
+  UnitTestCompressedMatrixConsistency<Real>();
   UnitTestResize<Real>();
   UnitTestResizeCopyDataDifferentStrideType<Real>();
   UnitTestNonsymmetricPower<Real>();
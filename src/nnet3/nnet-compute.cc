@@ -511,6 +511,7 @@ void NnetComputer::GetPointers(int32 indexes_multi_index,
 
 void NnetComputer::Run() {
   NVTX_RANGE(__func__);
+  KALDI_PROFILE_SCOPE("NnetComputer::Run");
   const std::vector<NnetComputation::Command> &c = computation_.commands;
   int32 num_commands = c.size();
 
@@ -21,6 +21,7 @@
 #include <sstream>
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
+#include "util/kaldi-mapped-table.h"
 #include "hmm/transition-model.h"
 #include "hmm/posterior.h"
 #include "nnet3/nnet-example.h"
@@ -222,7 +223,9 @@ int main(int argc, char *argv[]) {
     SequentialGeneralMatrixReader feat_reader(feature_rspecifier);
     RandomAccessPosteriorReader pdf_post_reader(pdf_post_rspecifier);
     NnetExampleWriter example_writer(examples_wspecifier);
-    RandomAccessBaseFloatMatrixReader online_ivector_reader(
+    // The iVectors are usually given as an scp file; this maps the archives
+    // it refers to instead of opening and reading them for each utterance.
+    RandomAccessBaseFloatMappedMatrixReader online_ivector_reader(
         online_ivector_rspecifier);
 
     int32 num_err = 0;
@@ -235,7 +238,7 @@ int main(int argc, char *argv[]) {
         num_err++;
       } else {
         const Posterior &pdf_post = pdf_post_reader.Value(key);
-        const Matrix<BaseFloat> *online_ivector_feats = NULL;
+        const MatrixBase<BaseFloat> *online_ivector_feats = NULL;
         if (!online_ivector_rspecifier.empty()) {
           if (!online_ivector_reader.HasKey(key)) {
             KALDI_WARN << "No iVectors for utterance " << key;
@@ -1,4 +1,4 @@
-// nnet3bin/nnet3-latgen-faster.cc
+// nnet3bin/nnet3-latgen-faster-lookahead.cc
 
 // Copyright 2012-2015   Johns Hopkins University (author: Daniel Povey)
 //                2014   Guoguo Chen
@@ -29,6 +29,129 @@
 #include "nnet3/nnet-utils.h"
 #include "base/timer.h"
 
+namespace kaldi {
+namespace nnet3 {
+
+// Reads the grammar FST for DynamicComposeFst.  G may be of any type that
+// ReadFstKaldiGeneric() reads (mkgraph_lookahead.sh writes Gr.fst as a const
+// or ngram FST).  Its backoff arcs have the disambiguation symbol #0 (possibly
+// relabeled) on their input side and epsilon on their output side, while
+// BackoffDeterministicOnDemandFst expects epsilon on both; we find them as
+// the arcs with epsilon output and nonzero input, and replace their input
+// label with epsilon.
+fst::VectorFst<fst::StdArc> *ReadBackoffGrammar(
+    const std::string &g_rxfilename) {
+  using fst::StdArc;
+  fst::VectorFst<StdArc> *g_fst =
+      fst::CastOrConvertToVectorFst(fst::ReadFstKaldiGeneric(g_rxfilename));
+  StdArc::Label backoff_symbol = 0;  // 0 until we have seen it.
+  for (fst::StateIterator<fst::VectorFst<StdArc> > siter(*g_fst);
+       !siter.Done(); siter.Next()) {
+    for (fst::MutableArcIterator<fst::VectorFst<StdArc> >
+             aiter(g_fst, siter.Value()); !aiter.Done(); aiter.Next()) {
+      StdArc arc = aiter.Value();
+      if (arc.olabel != 0 || arc.ilabel == 0)
+        continue;
+      if (backoff_symbol == 0)
+        backoff_symbol = arc.ilabel;
+      else if (arc.ilabel != backoff_symbol)
+        KALDI_ERR << "Expected G to have one backoff symbol on its "
+                  << "epsilon-output arcs, saw " << backoff_symbol << " and "
+                  << arc.ilabel << " in " << g_rxfilename;
+      arc.ilabel = 0;
+      aiter.SetValue(arc);
+    }
+  }
+  if (backoff_symbol == 0)
+    KALDI_WARN << "Found no backoff arcs in " << g_rxfilename;
+  else
+    KALDI_VLOG(1) << "Backoff symbol of G is " << backoff_symbol;
+  fst::ArcSort(g_fst, fst::ILabelCompare<StdArc>());
+  return g_fst;
+}
+
+// Decodes all utterances in 'feature_reader' with 'decode_fst', which is
+// either the OpenFst lookahead composition or a DynamicComposeFst.
+template <typename FST>
+void DecodeAllUtterances(
+    const FST &decode_fst,
+    const LatticeFasterDecoderConfig &config,
+    const NnetSimpleComputationOptions &decodable_opts,
+    const TransitionModel &trans_model,
+    const AmNnetSimple &am_nnet,
+    const fst::SymbolTable *word_syms,
+    bool determinize, bool allow_partial,
+    const std::string &ivector_rspecifier,
+    const std::string &online_ivector_rspecifier,
+    int32 online_ivector_period,
+    SequentialBaseFloatMatrixReader *feature_reader,
+    RandomAccessBaseFloatVectorReaderMapped *ivector_reader,
+    RandomAccessBaseFloatMatrixReader *online_ivector_reader,
+    CachingOptimizingCompiler *compiler,
+    Int32VectorWriter *alignment_writer,
+    Int32VectorWriter *words_writer,
+    CompactLatticeWriter *compact_lattice_writer,
+    LatticeWriter *lattice_writer,
+    double *tot_like, int64 *frame_count,
+    int32 *num_success, int32 *num_fail,
+    fst::DynamicComposeFst *dynamic_fst) {
+  LatticeFasterDecoderTpl<FST> decoder(decode_fst, config);
+
+  for (; !feature_reader->Done(); feature_reader->Next()) {
+    std::string utt = feature_reader->Key();
+    const Matrix<BaseFloat> &features (feature_reader->Value());
+    if (features.NumRows() == 0) {
+      KALDI_WARN << "Zero-length utterance: " << utt;
+      (*num_fail)++;
+      continue;
+    }
+    const Matrix<BaseFloat> *online_ivectors = NULL;
+    const Vector<BaseFloat> *ivector = NULL;
+    if (!ivector_rspecifier.empty()) {
+      if (!ivector_reader->HasKey(utt)) {
+        KALDI_WARN << "No iVector available for utterance " << utt;
+        (*num_fail)++;
+        continue;
+      } else {
+        ivector = &ivector_reader->Value(utt);
+      }
+    }
+    if (!online_ivector_rspecifier.empty()) {
+      if (!online_ivector_reader->HasKey(utt)) {
+        KALDI_WARN << "No online iVector available for utterance " << utt;
+        (*num_fail)++;
+        continue;
+      } else {
+        online_ivectors = &online_ivector_reader->Value(utt);
+      }
+    }
+
+    DecodableAmNnetSimple nnet_decodable(
+        decodable_opts, trans_model, am_nnet,
+        features, ivector, online_ivectors,
+        online_ivector_period, compiler);
+
+    // Composed state-ids may only be invalidated between utterances.
+    if (dynamic_fst != NULL)
+      dynamic_fst->MaybeResetStateTable();
+
+    double like;
+    if (DecodeUtteranceLatticeFaster(
+            decoder, nnet_decodable, trans_model, word_syms, utt,
+            decodable_opts.acoustic_scale, determinize, allow_partial,
+            alignment_writer, words_writer, compact_lattice_writer,
+            lattice_writer,
+            &like)) {
+      *tot_like += like;
+      *frame_count += nnet_decodable.NumFramesReady();
+      (*num_success)++;
+    } else (*num_fail)++;
+  }
+}
+
+}  // namespace nnet3
+}  // namespace kaldi
+
 
 int main(int argc, char *argv[]) {
   // note: making this program work with GPUs is as simple as initializing the
@@ -46,11 +169,16 @@ int main(int argc, char *argv[]) {
         "Generate lattices using nnet3 neural net model and standalone HCL.fst\n"
         "and G.fst using online composition with lookahead.\n"
         "Usage: nnet3-latgen-faster-lookahead [options] <nnet-in> <hcl-fst-in> <g-fst-in> <disambig-syms> "
-        "<features-rspecifier> <lattice-wspecifier> [ <words-wspecifier> [<alignments-wspecifier>] ]\n";
+        "<features-rspecifier> <lattice-wspecifier> [ <words-wspecifier> [<alignments-wspecifier>] ]\n"
+        "With --dynamic-compose=true, the composition is done by the decoder's\n"
+        "own engine (see DynamicComposeFst), whose arc cache has a bounded\n"
+        "memory budget, instead of OpenFst's ComposeFst.\n";
     ParseOptions po(usage);
     Timer timer;
     bool allow_partial = false;
+    bool dynamic_compose = false;
     LatticeFasterDecoderConfig config;
+    fst::DynamicComposeFstOptions compose_opts;
     NnetSimpleComputationOptions decodable_opts;
 
     std::string word_syms_filename;
@@ -60,10 +188,14 @@ int main(int argc, char *argv[]) {
     int32 online_ivector_period = 0;
     config.Register(&po);
     decodable_opts.Register(&po);
+    compose_opts.Register(&po);
     po.Register("word-symbol-table", &word_syms_filename,
                 "Symbol table for words [for debug output]");
     po.Register("allow-partial", &allow_partial,
                 "If true, produce output even if end state was not reached.");
+    po.Register("dynamic-compose", &dynamic_compose, "If true, compose HCL "
+                "and G with DynamicComposeFst, which has a bounded cache, "
+                "rather than with OpenFst lookahead composition.");
     po.Register("ivectors", &ivector_rspecifier, "Rspecifier for "
                 "iVectors as vectors (i.e. not estimated online); per utterance "
                 "by default, or per speaker if you provide the --utt2spk option.");
@@ -134,7 +266,7 @@ int main(int argc, char *argv[]) {
 
     double tot_like = 0.0;
     kaldi::int64 frame_count = 0;
-    int num_success = 0, num_fail = 0;
+    int32 num_success = 0, num_fail = 0;
     // this compiler object allows caching of computations across
     // different utterances.
     CachingOptimizingCompiler compiler(am_nnet.GetNnet(),
@@ -143,67 +275,53 @@ int main(int argc, char *argv[]) {
     if (ClassifyRspecifier(fst_in_str, NULL, NULL) == kNoRspecifier) {
       SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
 
-      fst::Fst<StdArc> *hcl_fst = fst::StdFst::Read(fst_in_str);
-      fst::Fst<StdArc> *g_fst = fst::StdFst::Read(g_in_str);
-      fst::LookaheadFst<StdArc, int32> *decode_fst =
-                       fst::LookaheadComposeFst(*hcl_fst,
-                                                *g_fst,
-                                                disambig_in);
-      timer.Reset();
-
-      {
-        LatticeFasterDecoder decoder(*decode_fst, config);
-
-        for (; !feature_reader.Done(); feature_reader.Next()) {
-          std::string utt = feature_reader.Key();
-          const Matrix<BaseFloat> &features (feature_reader.Value());
-          if (features.NumRows() == 0) {
-            KALDI_WARN << "Zero-length utterance: " << utt;
-            num_fail++;
-            continue;
-          }
-          const Matrix<BaseFloat> *online_ivectors = NULL;
-          const Vector<BaseFloat> *ivector = NULL;
-          if (!ivector_rspecifier.empty()) {
-            if (!ivector_reader.HasKey(utt)) {
-              KALDI_WARN << "No iVector available for utterance " << utt;
-              num_fail++;
-              continue;
-            } else {
-              ivector = &ivector_reader.Value(utt);
-            }
-          }
-          if (!online_ivector_rspecifier.empty()) {
-            if (!online_ivector_reader.HasKey(utt)) {
-              KALDI_WARN << "No online iVector available for utterance " << utt;
-              num_fail++;
-              continue;
-            } else {
-              online_ivectors = &online_ivector_reader.Value(utt);
-            }
-          }
-
-          DecodableAmNnetSimple nnet_decodable(
-              decodable_opts, trans_model, am_nnet,
-              features, ivector, online_ivectors,
-              online_ivector_period, &compiler);
-
-          double like;
-          if (DecodeUtteranceLatticeFaster(
-                  decoder, nnet_decodable, trans_model, word_syms, utt,
-                  decodable_opts.acoustic_scale, determinize, allow_partial,
-                  &alignment_writer, &words_writer, &compact_lattice_writer,
-                  &lattice_writer,
-                  &like)) {
-            tot_like += like;
-            frame_count += nnet_decodable.NumFramesReady();
-            num_success++;
-          } else num_fail++;
+      if (!dynamic_compose) {
+        fst::Fst<StdArc> *hcl_fst = fst::StdFst::Read(fst_in_str);
+        fst::Fst<StdArc> *g_fst = fst::StdFst::Read(g_in_str);
+        fst::LookaheadFst<StdArc, int32> *decode_fst =
+                         fst::LookaheadComposeFst(*hcl_fst,
+                                                  *g_fst,
+                                                  disambig_in);
+        timer.Reset();
+
+        DecodeAllUtterances<fst::Fst<StdArc> >(
+            *decode_fst, config, decodable_opts, trans_model, am_nnet,
+            word_syms, determinize, allow_partial, ivector_rspecifier,
+            online_ivector_rspecifier, online_ivector_period, &feature_reader,
+            &ivector_reader, &online_ivector_reader, &compiler,
+            &alignment_writer, &words_writer, &compact_lattice_writer,
+            &lattice_writer, &tot_like, &frame_count, &num_success, &num_fail,
+            NULL);
+        delete decode_fst; // delete this only after decoder goes out of scope.
+        delete hcl_fst;
+        delete g_fst;
+      } else {
+        fst::Fst<StdArc> *hcl_fst = fst::ReadFstKaldiGeneric(fst_in_str);
+        fst::ConstFst<StdArc> *hcl_const_fst =
+            dynamic_cast<fst::ConstFst<StdArc>*>(hcl_fst);
+        if (hcl_const_fst == NULL) {  // Copy to ConstFst.
+          hcl_const_fst = new fst::ConstFst<StdArc>(*hcl_fst);
+          delete hcl_fst;
         }
+        fst::VectorFst<StdArc> *g_fst = ReadBackoffGrammar(g_in_str);
+        fst::BackoffDeterministicOnDemandFst<StdArc> g_det_fst(*g_fst);
+        fst::DynamicComposeFst decode_fst(compose_opts, *hcl_const_fst,
+                                          &g_det_fst, disambig_in);
+        timer.Reset();
+
+        DecodeAllUtterances(decode_fst, config, decodable_opts, trans_model,
+                            am_nnet, word_syms, determinize, allow_partial,
+                            ivector_rspecifier, online_ivector_rspecifier,
+                            online_ivector_period, &feature_reader,
+                            &ivector_reader, &online_ivector_reader,
+                            &compiler, &alignment_writer, &words_writer,
+                            &compact_lattice_writer, &lattice_writer,
+                            &tot_like, &frame_count, &num_success, &num_fail,
+                            &decode_fst);
+        decode_fst.PrintStats();
+        delete hcl_const_fst;
+        delete g_fst;
       }
-      delete decode_fst; // delete this only after decoder goes out of scope.
-      delete hcl_fst;
-      delete g_fst;
     } else { // We have different FSTs for different utterances.
       KALDI_ERR << "Not supported for lookahead";
     }
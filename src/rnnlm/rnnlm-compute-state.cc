@@ -93,20 +93,42 @@ RnnlmComputeState* RnnlmComputeState::GetSuccessorState(int32 next_word) const {
 }
 
 void RnnlmComputeState::AddWord(int32 word_index) {
-  KALDI_ASSERT(word_index > 0 && word_index < info_.word_embedding_mat.NumRows());
-  previous_word_ = word_index;
-  AdvanceChunk();
+  AddWords(std::vector<RnnlmComputeState*>(1, this),
+           std::vector<int32>(1, word_index));
+}
 
-  const CuMatrix<BaseFloat> &word_embedding_mat = info_.word_embedding_mat;
-  if (info_.opts.normalize_probs) {
-    CuVector<BaseFloat> log_probs(info_.word_embedding_mat.NumRows());
+void RnnlmComputeState::AddWords(const std::vector<RnnlmComputeState*> &states,
+                                 const std::vector<int32> &words) {
+  KALDI_ASSERT(states.size() == words.size());
+  if (states.empty()) return;
+  const RnnlmComputeStateInfo &info = states[0]->info_;
+  const CuMatrix<BaseFloat> &word_embedding_mat = info.word_embedding_mat;
+  int32 num_states = states.size();
+  for (int32 i = 0; i < num_states; i++) {
+    KALDI_ASSERT(&(states[i]->info_) == &info);
+    KALDI_ASSERT(words[i] > 0 && words[i] < word_embedding_mat.NumRows());
+    states[i]->previous_word_ = words[i];
+    states[i]->AdvanceChunk();
+  }
 
-    log_probs.AddMatVec(1.0, word_embedding_mat, kNoTrans,
-                        predicted_word_embedding_->Row(0), 0.0);
+  if (info.opts.normalize_probs) {
+    CuMatrix<BaseFloat> predicted(num_states, word_embedding_mat.NumCols(),
+                                  kUndefined);
+    for (int32 i = 0; i < num_states; i++)
+      predicted.Row(i).CopyFromVec(states[i]->predicted_word_embedding_->Row(0));
+    CuMatrix<BaseFloat> log_probs(num_states, word_embedding_mat.NumRows(),
+                                  kUndefined);
+    log_probs.AddMatMat(1.0, predicted, kNoTrans,
+                        word_embedding_mat, kTrans, 0.0);
     log_probs.ApplyExp();
 
     // We excluding the <eps> symbol which is always 0.
-    normalization_factor_ = log(log_probs.Range(1, log_probs.Dim() - 1).Sum());
+    CuVector<BaseFloat> sums(num_states);
+    sums.AddColSumMat(1.0, log_probs.ColRange(1, log_probs.NumCols() - 1),
+                      0.0);
+    Vector<BaseFloat> sums_cpu(sums);
+    for (int32 i = 0; i < num_states; i++)
+      states[i]->normalization_factor_ = log(sums_cpu(i));
   }
 }
 
@@ -128,14 +150,14 @@ void RnnlmComputeState::GetLogProbOfWords(CuMatrixBase<BaseFloat> *output) const
   const CuMatrix<BaseFloat> &word_embedding_mat = info_.word_embedding_mat;
 
   KALDI_ASSERT(output->NumRows() == 1
-                && output->NumCols() == word_embedding_mat.NumCols());
+                && output->NumCols() == word_embedding_mat.NumRows());
   output->Row(0).AddMatVec(1.0, word_embedding_mat, kNoTrans,
                    predicted_word_embedding_->Row(0), 0.0);
 
   // Even without explicit normalization, the log-probs will be close to
   // correctly normalized due to the way the model was trained.
   if (info_.opts.normalize_probs) {
-    output->Add(normalization_factor_);
+    output->Add(-normalization_factor_);
   }
 
   // making sure <eps> has almost 0 prob
@@ -41,6 +41,10 @@ struct RnnlmComputeStateComputationOptions {
   int32 eos_index;
   // This is not needed for computation; included only for ease of scripting.
   int32 brk_index;
+  // Maximum number of RNNLM states that KaldiRnnlmDeterministicFst advances
+  // together (see RnnlmComputeState::AddWords()); only used if
+  // normalize_probs is true.
+  int32 state_batch_size;
   nnet3::NnetOptimizeOptions optimize_config;
   nnet3::NnetComputeOptions compute_config;
   RnnlmComputeStateComputationOptions():
@@ -48,7 +52,8 @@ struct RnnlmComputeStateComputationOptions {
       normalize_probs(false),
       bos_index(-1),
       eos_index(-1),
-      brk_index(-1)
+      brk_index(-1),
+      state_batch_size(16)
       { }
 
   void Register(OptionsItf *opts) {
@@ -64,6 +69,12 @@ struct RnnlmComputeStateComputationOptions {
     opts->Register("brk-symbol", &brk_index, "Index in wordlist representing "
                    "the break symbol. It is not needed in the computation "
                    "and we are including it for ease of scripting");
+    opts->Register("state-batch-size", &state_batch_size, "In lattice "
+                   "rescoring with --normalize-probs=true, the maximum number "
+                   "of pending RNNLM states that are advanced together, so "
+                   "that their normalizers are computed with one matrix "
+                   "multiplication.  Ignored if --normalize-probs=false, in "
+                   "which case each state is computed only when needed.");
 
     // Register the optimization options with the prefix "optimization".
     ParseOptions optimization_opts("optimization", opts);
@@ -116,15 +127,32 @@ class RnnlmComputeState {
   /// Return the log-prob that the model predicts for the provided word-index,
   /// given the previous history determined by the sequence of calls to AddWord()
   /// (implicitly starting with the BOS symbol).
+  /// If opts.normalize_probs is false this is just the dot product of the
+  /// predicted embedding with the embedding of this word, so it does not
+  /// depend on the vocabulary size; this relies on the model being
+  /// approximately self-normalized, which the training objective encourages
+  /// (see ProcessRnnlmOutput() in rnnlm-example-utils.h).
   BaseFloat LogProbOfWord(int32 word_index) const;
 
   // This function computes logprobs of all words and set it to output Matrix
   // Note: (*output)(0, 0) corresponds to <eps> symbol and it should NEVER be
   // used in any computation by the caller. To avoid causing unexpected issues,
-  // we here set it to a very small number
+  // we here set it to a very small number.
+  // This costs O(vocabulary size); if you only need the log-probs of some
+  // words, call LogProbOfWord() for each of them.
   void GetLogProbOfWords(CuMatrixBase<BaseFloat>* output) const;
   /// Advance the state of the RNNLM by appending this word to the word sequence.
   void AddWord(int32 word_index);
+
+  /// Does states[i]->AddWord(words[i]) for each i, for states that share the
+  /// same RnnlmComputeStateInfo.  Each state is still advanced by its own
+  /// nnet3 computation (the looped computation holds the recurrent state of
+  /// a single sequence), but if opts.normalize_probs is true the
+  /// normalizers, which need the scores of the whole vocabulary, are
+  /// computed with a single matrix-matrix product for all the states rather
+  /// than a matrix-vector product per state.
+  static void AddWords(const std::vector<RnnlmComputeState*> &states,
+                       const std::vector<int32> &words);
  private:
   /// This function does the computation for the next chunk.
   void AdvanceChunk();
@@ -19,6 +19,7 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <utility>
 
 #include "rnnlm/rnnlm-lattice-rescoring.h"
@@ -28,11 +29,46 @@
 namespace kaldi {
 namespace rnnlm {
 
+RnnlmComputeStateCache::RnnlmComputeStateCache(size_t capacity):
+    capacity_(capacity), num_hits_(0), num_misses_(0) { }
+
+RnnlmComputeStateCache::StatePtr RnnlmComputeStateCache::Find(
+    const std::vector<int32> &wseq) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  MapType::iterator iter = map_.find(wseq);
+  if (iter == map_.end()) {
+    num_misses_++;
+    return StatePtr();
+  }
+  num_hits_++;
+  // Move it to the front of the list.
+  lru_list_.splice(lru_list_.begin(), lru_list_, iter->second);
+  return iter->second->second;
+}
+
+void RnnlmComputeStateCache::Insert(const std::vector<int32> &wseq,
+                                    const StatePtr &state) {
+  if (capacity_ == 0) return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (map_.count(wseq) != 0)
+    return;  // another thread got there first.
+  lru_list_.push_front(std::make_pair(wseq, state));
+  map_[wseq] = lru_list_.begin();
+  while (map_.size() > capacity_) {
+    map_.erase(lru_list_.back().first);
+    lru_list_.pop_back();
+  }
+}
+
+void RnnlmComputeStateCache::PrintStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  KALDI_LOG << "RNNLM state cache: " << num_hits_ << " hits, " << num_misses_
+            << " misses (hit rate "
+            << (num_hits_ / std::max<double>(num_hits_ + num_misses_, 1.0))
+            << "), " << map_.size() << " states cached.";
+}
+
 KaldiRnnlmDeterministicFst::~KaldiRnnlmDeterministicFst() {
-  int32 size = state_to_rnnlm_state_.size();
-  for (int32 i = 0; i < size; i++)
-    delete state_to_rnnlm_state_[i];
-  
   state_to_rnnlm_state_.resize(0);
   state_to_wseq_.resize(0);
   wseq_to_state_.clear();
@@ -41,37 +77,86 @@ KaldiRnnlmDeterministicFst::~KaldiRnnlmDeterministicFst() {
 void KaldiRnnlmDeterministicFst::Clear() {
   // This function is similar to the destructor but we retain the 0-th entries
   // in each map which corresponds to the <bos> state.
-  int32 size = state_to_rnnlm_state_.size();
-  for (int32 i = 1; i < size; i++)
-    delete state_to_rnnlm_state_[i];
-  
   state_to_rnnlm_state_.resize(1);
   state_to_wseq_.resize(1);
+  state_to_predecessor_.resize(1);
+  pending_states_.clear();
+  arc_cache_.clear();
   wseq_to_state_.clear();
   wseq_to_state_[state_to_wseq_[0]] = 0;
 }
 
 KaldiRnnlmDeterministicFst::KaldiRnnlmDeterministicFst(int32 max_ngram_order,
-    const RnnlmComputeStateInfo &info) {
+    const RnnlmComputeStateInfo &info,
+    RnnlmComputeStateCache *cache) {
   max_ngram_order_ = max_ngram_order;
   bos_index_ = info.opts.bos_index;
   eos_index_ = info.opts.eos_index;
+  // Batching only saves time when the normalizers have to be computed, so
+  // otherwise we don't compute any states before they are needed.
+  state_batch_size_ = (info.opts.normalize_probs ?
+                       std::max(info.opts.state_batch_size, 1) : 1);
+  cache_ = cache;
 
   std::vector<Label> bos_seq;
   bos_seq.push_back(bos_index_);
   state_to_wseq_.push_back(bos_seq);
-  RnnlmComputeState *decodable_rnnlm = new RnnlmComputeState(info, bos_index_);
+  RnnlmComputeStateCache::StatePtr decodable_rnnlm;
+  if (cache_ != NULL)
+    decodable_rnnlm = cache_->Find(bos_seq);
+  if (!decodable_rnnlm) {
+    decodable_rnnlm.reset(new RnnlmComputeState(info, bos_index_));
+    if (cache_ != NULL)
+      cache_->Insert(bos_seq, decodable_rnnlm);
+  }
   wseq_to_state_[bos_seq] = 0;
   start_state_ = 0;
 
   state_to_rnnlm_state_.push_back(decodable_rnnlm);
+  state_to_predecessor_.push_back(std::make_pair(fst::kNoStateId, 0));
+}
+
+void KaldiRnnlmDeterministicFst::ComputePendingStates(StateId s) {
+  std::vector<StateId> batch(1, s);
+  while (static_cast<int32>(batch.size()) < state_batch_size_ &&
+         !pending_states_.empty()) {
+    StateId t = pending_states_.back();
+    pending_states_.pop_back();
+    if (t != s && !state_to_rnnlm_state_[t])
+      batch.push_back(t);
+  }
+  // 'to_compute' are the states in the batch that are not in the cache.
+  std::vector<StateId> to_compute;
+  std::vector<RnnlmComputeState*> rnnlm_states;
+  std::vector<int32> words;
+  for (size_t i = 0; i < batch.size(); i++) {
+    if (cache_ != NULL) {
+      state_to_rnnlm_state_[batch[i]] = cache_->Find(state_to_wseq_[batch[i]]);
+      if (state_to_rnnlm_state_[batch[i]])
+        continue;
+    }
+    const std::pair<StateId, Label> &pred = state_to_predecessor_[batch[i]];
+    // The predecessor was computed before GetArc() created this state.
+    to_compute.push_back(batch[i]);
+    rnnlm_states.push_back(
+        new RnnlmComputeState(*(state_to_rnnlm_state_[pred.first])));
+    words.push_back(pred.second);
+  }
+  RnnlmComputeState::AddWords(rnnlm_states, words);
+  for (size_t i = 0; i < to_compute.size(); i++) {
+    state_to_rnnlm_state_[to_compute[i]].reset(rnnlm_states[i]);
+    if (cache_ != NULL)
+      cache_->Insert(state_to_wseq_[to_compute[i]],
+                     state_to_rnnlm_state_[to_compute[i]]);
+  }
 }
 
 fst::StdArc::Weight KaldiRnnlmDeterministicFst::Final(StateId s) {
   /// At this point, we have created the state.
   KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
+  EnsureComputed(s);
 
-  RnnlmComputeState* rnn = state_to_rnnlm_state_[s];
+  const RnnlmComputeState *rnn = state_to_rnnlm_state_[s].get();
   return Weight(-rnn->LogProbOfWord(eos_index_));
 }
 
@@ -79,9 +164,17 @@ bool KaldiRnnlmDeterministicFst::GetArc(StateId s, Label ilabel,
                                         fst::StdArc *oarc) {
   /// At this point, we have created the state.
   KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
+  std::pair<StateId, Label> key(s, ilabel);
+  unordered_map<std::pair<StateId, Label>, fst::StdArc,
+                PairHasher<int32> >::const_iterator iter = arc_cache_.find(key);
+  if (iter != arc_cache_.end()) {
+    *oarc = iter->second;
+    return true;
+  }
+  EnsureComputed(s);
 
   std::vector<Label> word_seq = state_to_wseq_[s];
-  const RnnlmComputeState* rnnlm = state_to_rnnlm_state_[s];
+  const RnnlmComputeState *rnnlm = state_to_rnnlm_state_[s].get();
 
   BaseFloat logprob = rnnlm->LogProbOfWord(ilabel);
 
@@ -102,10 +195,13 @@ bool KaldiRnnlmDeterministicFst::GetArc(StateId s, Label ilabel,
   std::pair<IterType, bool> result = wseq_to_state_.insert(wseq_state_pair);
 
   // If the pair was just inserted, then also add it to state_to_* structures.
+  // Its RNNLM state is computed when it is first needed.
   if (result.second == true) {
-    RnnlmComputeState *rnnlm2 = rnnlm->GetSuccessorState(ilabel);
+    KALDI_ASSERT(ilabel > 0);
+    pending_states_.push_back(state_to_wseq_.size());
     state_to_wseq_.push_back(word_seq);
-    state_to_rnnlm_state_.push_back(rnnlm2);
+    state_to_rnnlm_state_.push_back(RnnlmComputeStateCache::StatePtr());
+    state_to_predecessor_.push_back(std::make_pair(s, ilabel));
   }
 
   // Creates the arc.
@@ -113,6 +209,7 @@ bool KaldiRnnlmDeterministicFst::GetArc(StateId s, Label ilabel,
   oarc->olabel = ilabel;
   oarc->nextstate = result.first->second;
   oarc->weight = Weight(-logprob);
+  arc_cache_[key] = *oarc;
   return true;
 }
 
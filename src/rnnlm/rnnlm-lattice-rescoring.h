@@ -22,6 +22,9 @@
 #ifndef KALDI_RNNLM_RNNLM_LATTICE_RESCORING_H_
 #define KALDI_RNNLM_RNNLM_LATTICE_RESCORING_H_
 
+#include <list>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -33,6 +36,77 @@
 namespace kaldi {
 namespace rnnlm {
 
+/*
+  RnnlmComputeStateCache is a bounded cache of computed RNNLM states, keyed by
+  word history (as truncated by KaldiRnnlmDeterministicFst), that can be
+  shared by several KaldiRnnlmDeterministicFst objects, across utterances and
+  threads, so that common histories such as sentence starts and frequent
+  n-gram prefixes are computed only once.  When it holds more than 'capacity'
+  states the least recently used ones are dropped.  It is thread safe.
+
+  Note: if histories are truncated (max-ngram-order > 0), the RNNLM state used
+  for a history is that of whichever full history reached it first, so with
+  a shared cache the results may depend on the order in which lattices are
+  processed; this is of the same nature as the approximation that
+  max-ngram-order already makes.
+*/
+class RnnlmComputeStateCache {
+ public:
+  typedef std::shared_ptr<const RnnlmComputeState> StatePtr;
+
+  explicit RnnlmComputeStateCache(size_t capacity);
+
+  /// Returns the state for history 'wseq' if it is cached (and marks it as
+  /// most recently used), else an empty pointer.
+  StatePtr Find(const std::vector<int32> &wseq);
+
+  /// Adds 'state' as the state for history 'wseq', unless that history is
+  /// already cached.
+  void Insert(const std::vector<int32> &wseq, const StatePtr &state);
+
+  /// Prints statistics (hits, misses, size) with KALDI_LOG.
+  void PrintStats() const;
+
+ private:
+  typedef std::list<std::pair<std::vector<int32>, StatePtr> > ListType;
+  typedef unordered_map<std::vector<int32>, ListType::iterator,
+                        VectorHasher<int32> > MapType;
+
+  size_t capacity_;
+  // Most recently used first.
+  ListType lru_list_;
+  MapType map_;
+  int64 num_hits_;
+  int64 num_misses_;
+  mutable std::mutex mutex_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(RnnlmComputeStateCache);
+};
+
+/*
+  KaldiRnnlmDeterministicFst presents the RNNLM as a DeterministicOnDemandFst
+  whose states correspond to word histories (truncated to max_ngram_order - 1
+  words if max_ngram_order > 0).
+
+  GetArc() only needs the RNNLM output of its source state, so the RNNLM state
+  of the destination state is not computed at that point: the new state is
+  marked as pending, and its RNNLM state is computed the first time GetArc()
+  or Final() is called on it.  Many of the states created while composing a
+  lattice with pruning are never visited, so this saves their computation.
+  If opts.normalize_probs is true, when a pending state has to be computed, up
+  to opts.state_batch_size - 1 of the most recently created other pending
+  states (typically its siblings, which the composition is about to visit) are
+  computed together with it, so that their normalizers are computed together;
+  see RnnlmComputeState::AddWords().
+
+  Only the words actually requested are scored (one dot product per distinct
+  (state, word) pair, whose result is cached), so unless
+  opts.normalize_probs is true the cost does not depend on the vocabulary
+  size.
+
+  If a RnnlmComputeStateCache is supplied, states are looked up there before
+  being computed, and computed states are added to it.
+*/
 class KaldiRnnlmDeterministicFst
     : public fst::DeterministicOnDemandFst<fst::StdArc> {
  public:
@@ -40,9 +114,10 @@ class KaldiRnnlmDeterministicFst
   typedef fst::StdArc::StateId StateId;
   typedef fst::StdArc::Label Label;
 
-  // Does not take ownership.
+  // Does not take ownership.  'cache' may be NULL.
   KaldiRnnlmDeterministicFst(int32 max_ngram_order,
-      const RnnlmComputeStateInfo &info);
+      const RnnlmComputeStateInfo &info,
+      RnnlmComputeStateCache *cache = NULL);
   ~KaldiRnnlmDeterministicFst();
 
   void Clear();
@@ -60,19 +135,44 @@ class KaldiRnnlmDeterministicFst
  private:
   typedef unordered_map
       <std::vector<Label>, StateId, VectorHasher<Label> > MapType;
+
+  // Makes sure the RNNLM state of state s has been computed; if not, computes
+  // it together with other pending states.
+  inline void EnsureComputed(StateId s) {
+    if (!state_to_rnnlm_state_[s])
+      ComputePendingStates(s);
+  }
+  void ComputePendingStates(StateId s);
+
   StateId start_state_;
   int32 max_ngram_order_;
   int32 bos_index_;
   int32 eos_index_;
+  int32 state_batch_size_;
+  RnnlmComputeStateCache *cache_;
 
   MapType wseq_to_state_;
 
   // Mapping from state-id to history sequence>
   std::vector<std::vector<Label> > state_to_wseq_;
 
-  // Mapping from state-id to RNNLM states.
-  // The pointers are owned in this class
-  std::vector<RnnlmComputeState*> state_to_rnnlm_state_;
+  // Mapping from state-id to RNNLM states; NULL for pending states, whose
+  // RNNLM state has not been computed yet.  The states are shared with
+  // cache_, if there is one.
+  std::vector<RnnlmComputeStateCache::StatePtr> state_to_rnnlm_state_;
+
+  // For pending states: the state they were reached from, and the word.
+  std::vector<std::pair<StateId, Label> > state_to_predecessor_;
+
+  // The pending states in the order they were created; may also contain
+  // states that have been computed since, which are skipped.
+  std::vector<StateId> pending_states_;
+
+  // Arcs already returned by GetArc(), indexed by (state, word).  Pruned
+  // composition often asks for the same arc several times, from different
+  // lattice states that share an LM history.
+  unordered_map<std::pair<StateId, Label>, fst::StdArc,
+                PairHasher<int32> > arc_cache_;
 
 };
 
@@ -216,6 +216,32 @@ template<class BasicType> class BasicHolder {
 };
 
 
+// ConvertTokenToBasicType converts a token in the simple formats of
+// ConvertTokenToInteger() and ConvertTokenToReal() to a basic type, with the
+// same result as ReadBasicType() in text mode; it returns false for other
+// formats, and always for bool.
+template<class BasicType>
+inline bool ConvertTokenToBasicType(const char *begin, const char *end,
+                                    BasicType *t) {
+  return ConvertTokenToInteger(begin, end, t);
+}
+template<>
+inline bool ConvertTokenToBasicType(const char *begin, const char *end,
+                                    float *t) {
+  return ConvertTokenToReal(begin, end, t);
+}
+template<>
+inline bool ConvertTokenToBasicType(const char *begin, const char *end,
+                                    double *t) {
+  return ConvertTokenToReal(begin, end, t);
+}
+template<>
+inline bool ConvertTokenToBasicType(const char *begin, const char *end,
+                                    bool *t) {
+  return false;
+}
+
+
 /// A Holder for a vector of basic types, e.g.
 /// std::vector<int32>, std::vector<float>, and so on.
 /// Note: a basic type is defined as a type for which ReadBasicType
@@ -277,6 +303,10 @@ template<class BasicType> class BasicVectorHolder {
             (is.eof() ? "[eof]" : "");
         return false;  // probably eof.  fail in any case.
       }
+      if (ReadLineFast(line))
+        return true;
+      // Some token was not a plain number, so read the line as a stream,
+      // which handles all the formats that ReadBasicType() does.
       std::istringstream line_is(line);
       try {
         while (1) {
@@ -330,6 +360,31 @@ template<class BasicType> class BasicVectorHolder {
 
   ~BasicVectorHolder() { }
  private:
+  // Reads the whitespace-separated tokens of 'line' into t_ without using a
+  // stream, if they are all in the formats that ConvertTokenToBasicType()
+  // handles; otherwise returns false.  This is much faster than the stream.
+  bool ReadLineFast(const std::string &line) {
+    const char *p = line.c_str(), *end = p + line.size();
+    t_.clear();
+    while (true) {
+      while (p != end && isspace(static_cast<unsigned char>(*p)))
+        p++;
+      if (p == end)
+        return true;
+      const char *token_end = p;
+      while (token_end != end &&
+             !isspace(static_cast<unsigned char>(*token_end)))
+        token_end++;
+      BasicType bt;
+      if (!ConvertTokenToBasicType(p, token_end, &bt)) {
+        t_.clear();
+        return false;
+      }
+      t_.push_back(bt);
+      p = token_end;
+    }
+  }
+
   KALDI_DISALLOW_COPY_AND_ASSIGN(BasicVectorHolder);
   T t_;
 };
@@ -715,18 +770,18 @@ class TokenVectorHolder {
 
   // Reads into the holder.
   bool Read(std::istream &is) {
-    t_.clear();
-
     // there is no binary/non-binary mode.
 
     std::string line;
     getline(is, line);  // this will discard the \n, if present.
     if (is.fail()) {
+      t_.clear();
       KALDI_WARN << "BasicVectorHolder::Read, error reading line " << (is.eof()
                                                                        ? "[eof]" : "");
       return false;  // probably eof.  fail in any case.
     }
     const char *white_chars = " \t\n\r\f\v";
+    // This overwrites t_, reusing the memory of its strings.
     SplitStringToVector(line, white_chars, true, &t_);  // true== omit
     // empty strings e.g. between spaces.
     return true;
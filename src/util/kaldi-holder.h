@@ -97,6 +97,12 @@ template<class SomeType> class GenericHolder {
   /// object can write the data how it likes.
   static bool Write(std::ostream &os, bool binary, const T &t);
 
+  /// WriteCompact() is optional.  If a holder has it, it is used instead of
+  /// Write() (in binary mode) when the wspecifier has the "compact" option; it
+  /// should write a more compact, possibly lossy, binary form of the object
+  /// that Read() can recognize.  See CompactLatticeHolder for an example.
+  //  static bool WriteCompact(std::ostream &os, const T &t);
+
   /// Reads into the holder.  Must work out from the stream (which will be
   /// opened on Windows in binary mode if the IsReadInBinary() function of this
   /// class returns true, and text mode otherwise) whether the actual data is
@@ -271,6 +277,16 @@ bool ExtractRangeSpecifier(const std::string &rxfilename_with_range,
                            std::string *data_rxfilename,
                            std::string *range);
 
+/// Parses a matrix range specifier such as "0:39,:" or ":,5:10" for a matrix
+/// with 'rows' rows and 'cols' columns into the first and last row and
+/// column.  Missing numbers are filled in from the matrix dimensions.  The
+/// last row may be up to 2 past the end of the matrix (see ExtractObjectRange
+/// for why), so callers should clamp it.  Dies with KALDI_ERR on error.
+bool ParseMatrixRangeSpecifier(const std::string &range,
+                               const int rows, const int cols,
+                               std::vector<int32> *row_range,
+                               std::vector<int32> *col_range);
+
 
 /// @} end "addtogroup holders"
 
@@ -0,0 +1,145 @@
+// util/kaldi-mapped-table-test.cc
+
+// Copyright 2026  agent <agent@local>
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "util/kaldi-mapped-table.h"
+#include "util/kaldi-table.h"
+
+namespace kaldi {
+
+// Writes random matrices with "ark,scp" and "ark,idx", plus an scp file with
+// ranges, an archive of compressed matrices and an scp file that also refers
+// to single-matrix files and pipes, and checks that we read the same as
+// RandomAccessTableReader does.
+template<typename Real>
+void UnitTestMappedMatrixReader() {
+  int32 num_utts = 1 + Rand() % 10;
+  std::vector<std::string> keys(num_utts);
+  std::vector<Matrix<Real> > mats(num_utts);
+  {
+    TableWriter<KaldiObjectHolder<Matrix<Real> > >
+        scp_writer("ark,scp:tmpm.ark,tmpm.scp"),
+        idx_writer("ark,idx:tmpi.ark");
+    TableWriter<KaldiObjectHolder<CompressedMatrix> >
+        compressed_writer("ark,scp:tmpc.ark,tmpc.scp");
+    for (int32 i = 0; i < num_utts; i++) {
+      std::ostringstream os;
+      // Keys of different lengths, so some of the data is misaligned.
+      os << "utt" << std::string(Rand() % 8, 'x') << i;
+      keys[i] = os.str();
+      if (Rand() % 5 != 0) {  // else leave it empty.
+        mats[i].Resize(1 + Rand() % 10, 1 + Rand() % 10);
+        mats[i].SetRandn();
+      }
+      scp_writer.Write(keys[i], mats[i]);
+      idx_writer.Write(keys[i], mats[i]);
+      compressed_writer.Write(keys[i], CompressedMatrix(mats[i]));
+    }
+  }
+  {
+    // Make an scp with ranges, from the one we wrote.
+    std::vector<std::pair<std::string, std::string> > lines;
+    KALDI_ASSERT(ReadScriptFile("tmpm.scp", true, &lines) &&
+                 lines.size() == static_cast<size_t>(num_utts));
+    Output ko("tmpr.scp", false);
+    for (int32 i = 0; i < num_utts; i++) {
+      int32 rows = mats[i].NumRows(), cols = mats[i].NumCols();
+      if (rows == 0) {
+        ko.Stream() << keys[i] << ' ' << lines[i].second << '\n';
+      } else {
+        int32 r = Rand() % rows, c = Rand() % cols;
+        ko.Stream() << keys[i] << ' ' << lines[i].second << '[' << r << ':'
+                    << (r + Rand() % (rows - r)) << ',' << c << ':'
+                    << (c + Rand() % (cols - c)) << "]\n";
+      }
+    }
+  }
+
+  {
+    // Make an scp where some matrices are in files of their own, some of
+    // which are read through a pipe.
+    std::vector<std::pair<std::string, std::string> > lines;
+    KALDI_ASSERT(ReadScriptFile("tmpm.scp", true, &lines));
+    Output ko("tmpx.scp", false);
+    for (int32 i = 0; i < num_utts; i++) {
+      std::ostringstream filename;
+      filename << "tmpx" << i << ".mat";
+      WriteKaldiObject(mats[i], filename.str(), Rand() % 2 == 0);
+      switch (Rand() % 3) {
+        case 0: ko.Stream() << keys[i] << ' ' << lines[i].second << '\n';
+          break;
+        case 1: ko.Stream() << keys[i] << ' ' << filename.str() << '\n';
+          break;
+        default: ko.Stream() << keys[i] << " cat " << filename.str()
+                             << " |\n";
+      }
+    }
+  }
+
+  const char *rspecifiers[] = { "scp:tmpm.scp", "ark,idx:tmpi.ark",
+                                "idx,ark,o:tmpi.ark", "scp:tmpr.scp",
+                                "scp:tmpc.scp", "ark:tmpm.ark",
+                                "scp:tmpx.scp" };
+  for (size_t i = 0; i < sizeof(rspecifiers) / sizeof(char*); i++) {
+    RandomAccessMappedMatrixReader<Real> reader(rspecifiers[i]);
+    RandomAccessTableReader<KaldiObjectHolder<Matrix<Real> > >
+        ref_reader(rspecifiers[i]);
+    KALDI_ASSERT(!reader.HasKey("foo"));
+    for (int32 j = 0; j < 2 * num_utts; j++) {
+      const std::string &key = keys[Rand() % num_utts];
+      KALDI_ASSERT(reader.HasKey(key));
+      const MatrixBase<Real> &value = reader.Value(key);
+      const Matrix<Real> &ref = ref_reader.Value(key);
+      KALDI_ASSERT(value.NumRows() == ref.NumRows() &&
+                   value.NumCols() == ref.NumCols());
+      if (ref.NumRows() != 0)
+        KALDI_ASSERT(value.ApproxEqual(ref, 0.0));
+    }
+    KALDI_ASSERT(reader.Close() && !reader.IsOpen());
+  }
+
+  RandomAccessMappedMatrixReader<Real> reader;
+  KALDI_ASSERT(!reader.Open("ark:nonexistent.ark"));
+  KALDI_ASSERT(!reader.IsOpen());
+
+  unlink("tmpc.ark");
+  unlink("tmpc.scp");
+  unlink("tmpx.scp");
+  for (int32 i = 0; i < num_utts; i++) {
+    std::ostringstream filename;
+    filename << "tmpx" << i << ".mat";
+    unlink(filename.str().c_str());
+  }
+  unlink("tmpm.ark");
+  unlink("tmpm.scp");
+  unlink("tmpi.ark");
+  unlink("tmpi.ark.idx");
+  unlink("tmpr.scp");
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 10; i++) {
+    UnitTestMappedMatrixReader<float>();
+    UnitTestMappedMatrixReader<double>();
+  }
+  std::cout << "Test OK.\n";
+  return 0;
+}
@@ -0,0 +1,276 @@
+// util/kaldi-mapped-table.cc
+
+// Copyright 2026  agent <agent@local>
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _MSC_VER
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+
+#include "util/kaldi-mapped-table.h"
+#include "util/kaldi-holder.h"
+#include "util/kaldi-table.h"
+
+namespace kaldi {
+
+template<typename Real>
+RandomAccessMappedMatrixReader<Real>::RandomAccessMappedMatrixReader(
+    const std::string &rspecifier): reader_(NULL), view_(NULL) {
+  if (rspecifier != "" && !Open(rspecifier))
+    KALDI_ERR << "Error opening RandomAccessMappedMatrixReader with "
+              << "rspecifier: " << rspecifier;
+}
+
+template<typename Real>
+bool RandomAccessMappedMatrixReader<Real>::Open(const std::string &rspecifier) {
+  if (IsOpen())
+    KALDI_ERR << "Already open; call Close() first.";
+  std::string rxfilename;
+  RspecifierOptions opts;
+  RspecifierType rs = ClassifyRspecifier(rspecifier, &rxfilename, &opts);
+  std::vector<std::pair<std::string, std::string> > lines;
+  if (rs == kScriptRspecifier) {
+    if (!ReadScriptFile(rxfilename, true, &lines))
+      return false;  // ReadScriptFile will have printed a warning.
+  } else if (rs == kArchiveRspecifier && opts.indexed &&
+             ClassifyRxfilename(rxfilename) == kFileInput) {
+    if (!ReadScriptFile(rxfilename + ".idx", true, &lines))
+      return false;
+    for (size_t i = 0; i < lines.size(); i++)
+      lines[i].second = rxfilename + ":" + lines[i].second;
+  } else {
+    reader_ = new RandomAccessTableReader<KaldiObjectHolder<Matrix<Real> > >();
+    if (!reader_->Open(rspecifier)) {
+      delete reader_;
+      reader_ = NULL;
+      return false;
+    }
+  }
+  rspecifier_ = rspecifier;
+  for (size_t i = 0; i < lines.size(); i++) {
+    if (!AddEntry(lines[i].first, lines[i].second)) {
+      Close();
+      return false;
+    }
+  }
+  return true;
+}
+
+template<typename Real>
+bool RandomAccessMappedMatrixReader<Real>::AddEntry(
+    const std::string &key, const std::string &location) {
+  std::string data_rxfilename = location, range;
+  if (!location.empty() && location[location.size() - 1] == ']' &&
+      !ExtractRangeSpecifier(location, &data_rxfilename, &range)) {
+    KALDI_WARN << "Invalid range specifier in " << location;
+    return false;
+  }
+  Entry entry;
+  entry.file = -1;
+  entry.offset = 0;
+  entry.range = range;
+  size_t pos = data_rxfilename.find_last_of(':');
+  if (ClassifyRxfilename(data_rxfilename) == kOffsetFileInput &&
+      pos != std::string::npos &&
+      ConvertStringToInteger(data_rxfilename.substr(pos + 1), &entry.offset) &&
+      entry.offset >= 0) {
+    std::string filename = data_rxfilename.substr(0, pos);
+    std::unordered_map<std::string, int32, StringHasher>::const_iterator iter =
+        file_indexes_.find(filename);
+    if (iter == file_indexes_.end()) {
+      AddFile(filename);
+      iter = file_indexes_.find(filename);
+    }
+    entry.file = iter->second;
+  } else {
+    // E.g. "foo.mat" or "gunzip -c foo.gz |"; we read it when asked to.
+    entry.rxfilename = data_rxfilename;
+  }
+  if (!entries_.insert(std::make_pair(key, entry)).second) {
+    KALDI_WARN << "Duplicate key " << key << " in " << rspecifier_;
+    return false;
+  }
+  return true;
+}
+
+template<typename Real>
+void RandomAccessMappedMatrixReader<Real>::AddFile(
+    const std::string &filename) {
+  MappedFile file;
+  file.filename = filename;
+  file.data = NULL;
+  file.size = 0;
+#ifndef _MSC_VER
+  // If anything fails here we leave the file unmapped; reading from it will
+  // then give the error, if there is one, as RandomAccessTableReader would.
+  int fd = open(filename.c_str(), O_RDONLY);
+  struct stat stat_buf;
+  if (fd >= 0 && fstat(fd, &stat_buf) == 0 && S_ISREG(stat_buf.st_mode) &&
+      stat_buf.st_size > 0) {
+    void *data = mmap(NULL, stat_buf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data != MAP_FAILED) {
+      file.data = static_cast<char*>(data);
+      file.size = stat_buf.st_size;
+    } else {
+      KALDI_WARN << "Could not map " << filename << " (will read it instead): "
+                 << strerror(errno);
+    }
+  }
+  if (fd >= 0)
+    close(fd);  // the mapping stays valid.
+#endif
+  file_indexes_[filename] = files_.size();
+  files_.push_back(file);
+}
+
+template<typename Real>
+bool RandomAccessMappedMatrixReader<Real>::HasKey(
+    const std::string &key) const {
+  if (!IsOpen())
+    KALDI_ERR << "RandomAccessMappedMatrixReader is not open.";
+  if (reader_ != NULL)
+    return reader_->HasKey(key);
+  return entries_.count(key) != 0;
+}
+
+template<typename Real>
+const MatrixBase<Real> &RandomAccessMappedMatrixReader<Real>::Value(
+    const std::string &key) {
+  if (!IsOpen())
+    KALDI_ERR << "RandomAccessMappedMatrixReader is not open.";
+  if (reader_ != NULL)
+    return reader_->Value(key);
+  typename std::unordered_map<std::string, Entry, StringHasher>::const_iterator
+      iter = entries_.find(key);
+  if (iter == entries_.end())
+    KALDI_ERR << "No such key " << key << " in " << rspecifier_;
+  const Entry &entry = iter->second;
+  delete view_;
+  view_ = NULL;
+  if (entry.file < 0 || files_[entry.file].data == NULL)
+    return ReadValue(entry);
+  const MappedFile &file = files_[entry.file];
+
+  // An uncompressed binary matrix in an archive looks like
+  // "\0B" "FM " <4> <int32 rows> <4> <int32 cols> <rows * cols floats>,
+  // with "DM " for doubles.
+  const char *token = (sizeof(Real) == 4 ? "FM " : "DM ");
+  const int64 header_size = 15;
+  const char *begin = file.data + entry.offset;
+  int32 num_rows, num_cols;
+  if (entry.offset + header_size > static_cast<int64>(file.size) ||
+      begin[0] != '\0' || begin[1] != 'B' ||
+      std::memcmp(begin + 2, token, 3) != 0 ||
+      begin[5] != 4 || begin[10] != 4)
+    return ReadValue(entry);  // e.g. a compressed matrix.
+  std::memcpy(&num_rows, begin + 6, sizeof(int32));
+  std::memcpy(&num_cols, begin + 11, sizeof(int32));
+  if (num_rows < 0 || num_cols < 0 ||
+      entry.offset + header_size +
+      static_cast<int64>(num_rows) * num_cols * sizeof(Real) >
+      static_cast<int64>(file.size))
+    KALDI_ERR << "Matrix for key " << key << " in " << file.filename
+              << " is truncated or corrupted.";
+  const char *data = begin + header_size;
+
+  int32 row_offset = 0, col_offset = 0,
+      range_rows = num_rows, range_cols = num_cols;
+  if (!entry.range.empty()) {
+    std::vector<int32> row_range, col_range;
+    ParseMatrixRangeSpecifier(entry.range, num_rows, num_cols,
+                              &row_range, &col_range);  // dies on error.
+    row_offset = row_range[0];
+    range_rows = std::min(row_range[1], num_rows - 1) - row_range[0] + 1;
+    col_offset = col_range[0];
+    range_cols = col_range[1] - col_range[0] + 1;
+  }
+  const size_t row_bytes = sizeof(Real) * num_cols;
+  const char *first = data + row_bytes * row_offset + sizeof(Real) * col_offset;
+  if (reinterpret_cast<size_t>(data) % sizeof(Real) == 0) {
+    // The caller only gets a const reference, so nothing writes through this
+    // pointer to the read-only mapping.
+    view_ = new SubMatrix<Real>(
+        const_cast<Real*>(reinterpret_cast<const Real*>(first)),
+        range_rows, range_cols, num_cols);
+    return *view_;
+  }
+  // We never form a Real* to misaligned data; memcpy() copies the bytes.
+  buffer_.Resize(range_rows, range_cols, kUndefined);
+  for (int32 r = 0; r < range_rows; r++)
+    std::memcpy(buffer_.RowData(r), first + row_bytes * r,
+                sizeof(Real) * range_cols);
+  return buffer_;
+}
+
+template<typename Real>
+const MatrixBase<Real> &RandomAccessMappedMatrixReader<Real>::ReadValue(
+    const Entry &entry) {
+  std::ostringstream data_rxfilename;  // e.g. foo.ark:12407
+  if (entry.file < 0)
+    data_rxfilename << entry.rxfilename;
+  else
+    data_rxfilename << files_[entry.file].filename << ':' << entry.offset;
+  bool binary;
+  Input input(data_rxfilename.str(), &binary);
+  buffer_.Read(input.Stream(), binary);
+  if (!entry.range.empty()) {
+    Matrix<Real> range_matrix;
+    ExtractObjectRange(buffer_, entry.range, &range_matrix);
+    buffer_.Swap(&range_matrix);
+  }
+  return buffer_;
+}
+
+template<typename Real>
+bool RandomAccessMappedMatrixReader<Real>::Close() {
+  if (!IsOpen())
+    KALDI_ERR << "Close() called on RandomAccessMappedMatrixReader that was "
+              << "not open.";
+  if (reader_ != NULL) {
+    bool ans = reader_->Close();
+    delete reader_;
+    reader_ = NULL;
+    rspecifier_ = "";
+    return ans;
+  }
+  delete view_;
+  view_ = NULL;
+  buffer_.Resize(0, 0);
+#ifndef _MSC_VER
+  for (size_t i = 0; i < files_.size(); i++)
+    if (files_[i].data != NULL)
+      munmap(files_[i].data, files_[i].size);
+#endif
+  files_.clear();
+  file_indexes_.clear();
+  entries_.clear();
+  rspecifier_ = "";
+  return true;
+}
+
+template class RandomAccessMappedMatrixReader<float>;
+template class RandomAccessMappedMatrixReader<double>;
+
+}  // namespace kaldi
@@ -0,0 +1,146 @@
+// util/kaldi-mapped-table.h
+
+// Copyright 2026  agent <agent@local>
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_UTIL_KALDI_MAPPED_TABLE_H_
+#define KALDI_UTIL_KALDI_MAPPED_TABLE_H_
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "matrix/kaldi-matrix.h"
+#include "util/kaldi-table.h"
+#include "util/stl-utils.h"
+
+namespace kaldi {
+
+/// \addtogroup table_types
+/// @{
+
+/// RandomAccessMappedMatrixReader gives random access to matrices, like
+/// RandomAccessTableReader<KaldiObjectHolder<Matrix<Real> > >, but instead of
+/// reading the archive files it maps them into memory (mmap()), so that
+/// looking up a matrix usually neither reads nor allocates it; the operating
+/// system reads the pages of the file when they are first used, and can share
+/// them between processes.
+///
+/// The archives are mapped if the rspecifier is either
+///   scp:foo.scp  where the scp file has lines like "key foo.ark:12407",
+///                possibly with a range such as "key foo.ark:12407[0:99]"
+///                (as written with "ark,scp:foo.ark,foo.scp"), or
+///   ark,idx:foo.ark  for an archive written with an index (see the "idx"
+///                option in kaldi-table.h).
+/// Lines of the scp file that are not of that form (e.g. "key foo.mat" or
+/// "key gunzip -c foo.gz |"), and files that can't be mapped, are read when
+/// they are looked up, as RandomAccessTableReader would read them.
+/// The other rspecifier options are ignored: as the offsets are known, the
+/// order and number of lookups don't matter.  For any other rspecifier (e.g.
+/// an archive without an index, or a pipe) we just use a
+/// RandomAccessTableReader.
+///
+/// Value() returns a SubMatrix of the mapped file if the matrix was written
+/// uncompressed, in binary mode, with the same precision as Real, and its data
+/// is aligned to sizeof(Real).  Otherwise it returns a copy: misaligned data
+/// is copied row by row (we can't make a view of it, as C++ doesn't allow
+/// misaligned pointers and vectorized loops may rely on their alignment), and
+/// other matrices (e.g. compressed ones, as written by
+/// "copy-feats --compress=true") are read as RandomAccessTableReader would
+/// read them.  The copy is common: the data follows the key and a 15-byte
+/// header, so its alignment depends on the length of the key and of what
+/// precedes it in the archive, and in a typical archive only about 1 in 4
+/// float matrices and 1 in 8 double matrices are aligned.  Copying a
+/// misaligned matrix still avoids opening, seeking and parsing the file, which
+/// RandomAccessTableReader does for each lookup in an scp file.  On Windows,
+/// where we don't map files, Value() always reads the matrix.
+///
+/// The matrix returned by Value() is valid until the next call to Value() or
+/// Close().
+template<typename Real>
+class RandomAccessMappedMatrixReader {
+ public:
+  RandomAccessMappedMatrixReader(): reader_(NULL), view_(NULL) { }
+
+  /// Like the default constructor plus Open(), but dies on error.  An empty
+  /// rspecifier leaves the reader closed.
+  explicit RandomAccessMappedMatrixReader(const std::string &rspecifier);
+
+  /// Reads the scp file or archive index and maps the archives, or opens a
+  /// RandomAccessTableReader for other rspecifiers; returns false on error.
+  bool Open(const std::string &rspecifier);
+
+  bool IsOpen() const { return !rspecifier_.empty(); }
+
+  bool HasKey(const std::string &key) const;
+
+  /// Dies if the key is not present or the data is not a matrix.
+  const MatrixBase<Real> &Value(const std::string &key);
+
+  /// Unmaps the files; this invalidates the matrix returned by Value().
+  bool Close();
+
+  ~RandomAccessMappedMatrixReader() { if (IsOpen()) Close(); }
+
+ private:
+  struct MappedFile {
+    std::string filename;
+    char *data;  // NULL if not mapped (e.g. on Windows); we read it instead.
+    size_t size;
+  };
+  struct Entry {
+    int32 file;  // Index into files_, or -1 if not in a file we can map.
+    int64 offset;
+    std::string rxfilename;  // Where to read the matrix from, if file == -1.
+    std::string range;  // Range specifier, e.g. "0:99" or "0:99,3:5", or "".
+  };
+
+  // Adds an entry like "foo.ark:12407" or "foo.ark:12407[0:99]", mapping the
+  // file if we have not seen it yet.  Entries of other forms, such as
+  // "foo.mat" or "gunzip -c foo.gz |", are read when they are looked up.
+  // Returns false on error.
+  bool AddEntry(const std::string &key, const std::string &location);
+
+  // Adds 'filename' to files_, mapped if possible.
+  void AddFile(const std::string &filename);
+
+  // Reads the entry through a stream into buffer_ (used if not mapped, or
+  // if the data is not an uncompressed binary Matrix<Real>).
+  const MatrixBase<Real> &ReadValue(const Entry &entry);
+
+  std::string rspecifier_;
+  std::vector<MappedFile> files_;
+  std::unordered_map<std::string, int32, StringHasher> file_indexes_;
+  std::unordered_map<std::string, Entry, StringHasher> entries_;
+  // Used instead of the above for rspecifiers whose archives we don't map.
+  RandomAccessTableReader<KaldiObjectHolder<Matrix<Real> > > *reader_;
+  SubMatrix<Real> *view_;  // The last value, if a view of a mapped file.
+  Matrix<Real> buffer_;    // The last value, if a copy.
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(RandomAccessMappedMatrixReader);
+};
+
+typedef RandomAccessMappedMatrixReader<BaseFloat>
+    RandomAccessBaseFloatMappedMatrixReader;
+typedef RandomAccessMappedMatrixReader<double>
+    RandomAccessDoubleMappedMatrixReader;
+
+/// @}
+
+}  // namespace kaldi
+
+#endif  // KALDI_UTIL_KALDI_MAPPED_TABLE_H_
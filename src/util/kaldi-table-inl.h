@@ -24,8 +24,13 @@
 #define KALDI_UTIL_KALDI_TABLE_INL_H_
 
 #include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
 #include <string>
 #include <thread>
+#include <type_traits>
 #include <utility>
 #include <vector>
 #include <errno.h>
@@ -34,6 +39,7 @@
 #include "util/text-utils.h"
 #include "util/stl-utils.h"  // for StringHasher.
 #include "util/kaldi-semaphore.h"
+#include "util/kaldi-thread.h"
 
 
 namespace kaldi {
@@ -696,6 +702,256 @@ template<class Holder>  class SequentialTableReaderArchiveImpl:
   } state_;
 };
 
+// This is used for sequential reading of scp files with the 'bg=N' modifier
+// (N > 1).  It keeps up to N entries of the scp file being read at once by a
+// ThreadPool of N threads, each entry into its own Holder, and returns them in
+// the order of the scp file.  Each load uses an Input object from a small pool
+// (at most one per entry in flight), so that consecutive entries in the same
+// archive can still be reached by fseek().
+template<class Holder>
+class SequentialTableReaderParallelScriptImpl:
+      public SequentialTableReaderImplBase<Holder> {
+ public:
+  typedef typename Holder::T T;
+
+  SequentialTableReaderParallelScriptImpl(): script_error_(false),
+                                             pool_(NULL) { }
+
+  virtual bool Open(const std::string &rspecifier) {
+    if (IsOpen())
+      if (!Close())  // call Close() yourself to suppress this exception.
+        KALDI_ERR << "Error closing previous input: "
+                  << "rspecifier was " << rspecifier_;
+    bool binary;
+    rspecifier_ = rspecifier;
+    RspecifierType rs = ClassifyRspecifier(rspecifier, &script_rxfilename_,
+                                           &opts_);
+    KALDI_ASSERT(rs == kScriptRspecifier && opts_.num_background_threads > 0);
+    if (!script_input_.Open(script_rxfilename_, &binary)) {
+      KALDI_WARN << "Failed to open script file "
+                 << PrintableRxfilename(script_rxfilename_);
+      return false;
+    }
+    if (binary) {
+      KALDI_WARN << "Script file should not be binary file.";
+      script_input_.Close();
+      return false;
+    }
+    script_error_ = false;
+    pool_ = new ThreadPool(opts_.num_background_threads);
+    FillWindow();
+    WaitForFront();
+    return true;
+  }
+
+  virtual bool IsOpen() const { return pool_ != NULL; }
+
+  virtual bool Done() const {
+    KALDI_ASSERT(IsOpen());
+    return window_.empty();
+  }
+
+  virtual std::string Key() {
+    if (!IsOpen() || window_.empty())
+      KALDI_ERR << "Key() called on TableReader object at the wrong time.";
+    return window_.front()->key;
+  }
+
+  virtual T &Value() {
+    if (!IsOpen() || window_.empty())
+      KALDI_ERR << "Value() called on TableReader object at the wrong time.";
+    Entry *entry = window_.front();
+    if (!entry->ok)
+      KALDI_ERR << "Failed to load object from "
+                << PrintableRxfilename(entry->data_rxfilename)
+                << (entry->range.empty() ? "" : "[" + entry->range + "]")
+                << " (to suppress this error, add the permissive "
+                << "(p, ) option to the rspecifier.";
+    return entry->holder.Value();
+  }
+
+  virtual void FreeCurrent() {
+    if (!IsOpen() || window_.empty()) {
+      KALDI_WARN << "FreeCurrent called at the wrong time.";
+      return;
+    }
+    window_.front()->holder.Clear();
+    window_.front()->ok = false;
+  }
+
+  virtual void SwapHolder(Holder *other_holder) {
+    (void) Value();  // Dies with KALDI_ERR if the object could not be loaded.
+    window_.front()->holder.Swap(other_holder);
+  }
+
+  virtual void Next() {
+    if (!IsOpen() || window_.empty())
+      KALDI_ERR << "Next() called on TableReader object at the wrong time.";
+    delete window_.front();
+    window_.pop_front();
+    FillWindow();
+    WaitForFront();
+  }
+
+  // Returns false if the scp file had an invalid line or was a pipe that
+  // ended with error status (unless permissive).
+  virtual bool Close() {
+    if (!IsOpen())
+      KALDI_ERR << "Close() called on input that was not open.";
+    delete pool_;  // Waits for the entries being read.
+    pool_ = NULL;
+    for (size_t i = 0; i < window_.size(); i++)
+      delete window_[i];
+    window_.clear();
+    DeletePointers(&inputs_);
+    inputs_.clear();
+    int32 status = 0;
+    if (script_input_.IsOpen())
+      status = script_input_.Close();
+    if (script_error_ || status != 0) {
+      if (opts_.permissive) {
+        KALDI_WARN << "Close() called on scp file with read error, ignoring the"
+            " error because permissive mode specified.";
+        return true;
+      }
+      return false;
+    }
+    return true;
+  }
+
+  virtual ~SequentialTableReaderParallelScriptImpl() {
+    if (IsOpen() && !Close())
+      KALDI_ERR << "TableReader: reading script file failed: from scp "
+                << PrintableRxfilename(script_rxfilename_);
+  }
+
+ private:
+  struct Entry {
+    std::string key;
+    std::string data_rxfilename;
+    std::string range;  // The range specifier, e.g. "0:9", or "".
+    Holder holder;
+    bool ok;    // True if the object (or range) was successfully loaded.
+    bool done;  // True once the load has finished; guarded by mutex_.
+    Entry(): ok(false), done(false) { }
+  };
+
+  // Reads scp lines and submits them for loading until there are
+  // opts_.num_background_threads entries in the window or the scp file ends.
+  void FillWindow() {
+    std::string line;
+    while (static_cast<int32>(window_.size()) < opts_.num_background_threads &&
+           script_input_.IsOpen()) {
+      if (!getline(script_input_.Stream(), line)) {
+        script_input_.Close();  // status is not checked, as in the
+                                // non-parallel reader.
+        break;
+      }
+      Entry *entry = new Entry();
+      std::string rest;
+      SplitStringOnFirstSpace(line, &entry->key, &rest);
+      bool ok = !entry->key.empty() && !rest.empty();
+      if (ok && rest[rest.size() - 1] == ']')
+        ok = ExtractRangeSpecifier(rest, &entry->data_rxfilename,
+                                   &entry->range);
+      else
+        entry->data_rxfilename = rest;
+      if (!ok) {
+        KALDI_WARN << "Reading rspecifier '" << rspecifier_
+                   << "', invalid line in scp file: " << line;
+        delete entry;
+        script_error_ = true;
+        script_input_.Close();
+        break;
+      }
+      window_.push_back(entry);
+      pool_->Submit(std::bind(
+          &SequentialTableReaderParallelScriptImpl<Holder>::Load, this, entry));
+    }
+  }
+
+  // Waits until the first entry of the window has been loaded; in permissive
+  // mode, entries that could not be loaded are skipped.
+  void WaitForFront() {
+    while (!window_.empty()) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!window_.front()->done)
+          cond_.wait(lock);
+      }
+      if (window_.front()->ok || !opts_.permissive)
+        return;
+      delete window_.front();
+      window_.pop_front();
+      FillWindow();
+    }
+  }
+
+  // Called in the pool's threads.
+  void Load(Entry *entry) {
+    Input *input = GetInput();
+    try {
+      bool ans = Holder::IsReadInBinary() ?
+          input->Open(entry->data_rxfilename, NULL) :
+          input->OpenTextMode(entry->data_rxfilename);
+      if (!ans) {
+        KALDI_WARN << "Failed to open file "
+                   << PrintableRxfilename(entry->data_rxfilename);
+      } else if (!entry->holder.Read(input->Stream())) {
+        KALDI_WARN << "Failed to load object from "
+                   << PrintableRxfilename(entry->data_rxfilename);
+      } else if (entry->range.empty()) {
+        entry->ok = true;
+      } else {
+        Holder range_holder;
+        // ExtractRange() throws if the object type doesn't support ranges.
+        if (range_holder.ExtractRange(entry->holder, entry->range)) {
+          entry->holder.Swap(&range_holder);
+          entry->ok = true;
+        } else {
+          KALDI_WARN << "Failed to load object from "
+                     << PrintableRxfilename(entry->data_rxfilename)
+                     << "[" << entry->range << "]";
+        }
+      }
+    } catch (...) {
+      // Errors must not escape into the ThreadPool; the main thread
+      // reports the failure if Value() is called.
+      entry->ok = false;
+    }
+    if (!entry->ok)
+      entry->holder.Clear();
+    std::lock_guard<std::mutex> lock(mutex_);
+    inputs_.push_back(input);
+    entry->done = true;
+    cond_.notify_all();
+  }
+
+  // Returns the most recently released Input, which is likely to have the
+  // same archive open, or a new one if all are in use.
+  Input *GetInput() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (inputs_.empty())
+      return new Input();
+    Input *ans = inputs_.back();
+    inputs_.pop_back();
+    return ans;
+  }
+
+  std::string rspecifier_;
+  RspecifierOptions opts_;
+  std::string script_rxfilename_;
+  Input script_input_;
+  bool script_error_;  // True if we read an invalid scp line.
+
+  ThreadPool *pool_;  // NULL when closed.
+  std::deque<Entry*> window_;  // Entries in scp order; the front one is
+                               // current.
+  std::vector<Input*> inputs_;  // Inputs not currently in use by Load().
+  std::mutex mutex_;  // Guards Entry::done and inputs_.
+  std::condition_variable cond_;
+};
+
 // this is for when someone adds the 'th' modifier; it wraps around the basic
 // implementation and allows it to do the reading in a background thread.
 template<class Holder>
@@ -874,7 +1130,13 @@ bool SequentialTableReader<Holder>::Open(const std::string &rspecifier) {
       impl_ = new SequentialTableReaderArchiveImpl<Holder>();
       break;
     case kScriptRspecifier:
-      impl_ = new SequentialTableReaderScriptImpl<Holder>();
+      if (opts.num_background_threads > 1) {
+        // "bg=N": the reader does its own reading in the background.
+        impl_ = new SequentialTableReaderParallelScriptImpl<Holder>();
+        opts.background = false;
+      } else {
+        impl_ = new SequentialTableReaderScriptImpl<Holder>();
+      }
       break;
     case kNoRspecifier: default:
       KALDI_WARN << "Invalid rspecifier " << rspecifier;
@@ -940,6 +1202,7 @@ SequentialTableReader<Holder>::Value() {
 
 template<class Holder>
 void SequentialTableReader<Holder>::Next() {
+  KALDI_PROFILE_SCOPE("SequentialTableReader::Next");
   CheckImpl();
   impl_->Next();
 }
@@ -959,6 +1222,32 @@ SequentialTableReader<Holder>::~SequentialTableReader() {
 
 
 
+// The following functions write an object via its Holder, using the holder's
+// WriteCompact() function if the "compact" option was given in the wspecifier
+// and the holder has one (the "int" overload is preferred, but only exists if
+// Holder::WriteCompact() does).
+template<class Holder>
+inline auto WriteHolderCompact(std::ostream &os, const typename Holder::T &t,
+                               int) -> decltype(Holder::WriteCompact(os, t)) {
+  return Holder::WriteCompact(os, t);
+}
+
+template<class Holder>
+inline bool WriteHolderCompact(std::ostream &os, const typename Holder::T &t,
+                               long) {
+  return Holder::Write(os, true, t);
+}
+
+template<class Holder>
+inline bool WriteHolderValue(std::ostream &os, const WspecifierOptions &opts,
+                             const typename Holder::T &t) {
+  if (opts.compact && opts.binary)
+    return WriteHolderCompact<Holder>(os, t, 0);
+  else
+    return Holder::Write(os, opts.binary, t);
+}
+
+
 template<class Holder> class TableWriterImplBase {
  public:
   typedef typename Holder::T T;
@@ -1014,9 +1303,22 @@ class TableWriterArchiveImpl: public TableWriterImplBase<Holder> {
                                            NULL,
                                            &opts_);
     KALDI_ASSERT(ws == kArchiveWspecifier);  // or wrongly called.
+    if (opts_.index && ClassifyWxfilename(archive_wxfilename_) != kFileOutput) {
+      KALDI_WARN << "The idx option requires the archive to be an actual "
+                 << "file: wspecifier = " << wspecifier;
+      state_ = kUninitialized;
+      return false;
+    }
 
     if (output_.Open(archive_wxfilename_, opts_.binary, false)) {  // false
                                                       // means no binary header.
+      if (opts_.index &&
+          !index_output_.Open(archive_wxfilename_ + ".idx", false, false)) {
+        // The index, like script files, is always in text mode.
+        output_.Close();  // Don't care about status: error anyway.
+        state_ = kUninitialized;
+        return false;
+      }
       state_ = kOpen;
       return true;
     } else {
@@ -1053,7 +1355,18 @@ class TableWriterArchiveImpl: public TableWriterImplBase<Holder> {
     if (!IsToken(key))  // e.g. empty string or has spaces...
       KALDI_ERR << "Using invalid key " << key;
     output_.Stream() << key << ' ';
-    if (!Holder::Write(output_.Stream(), opts_.binary, value)) {
+    if (opts_.index) {
+      // Record the position at which the object starts, as in the scp file
+      // of TableWriterBothImpl.
+      index_output_.Stream() << key << ' ' << output_.Stream().tellp() << '\n';
+      if (index_output_.Stream().fail()) {
+        KALDI_WARN << "Write failure to archive index "
+                   << PrintableWxfilename(archive_wxfilename_ + ".idx");
+        state_ = kWriteError;
+        return false;
+      }
+    }
+    if (!WriteHolderValue<Holder>(output_.Stream(), opts_, value)) {
       KALDI_WARN << "Write failure to "
                  << PrintableWxfilename(archive_wxfilename_);
       state_ = kWriteError;
@@ -1063,8 +1376,8 @@ class TableWriterArchiveImpl: public TableWriterImplBase<Holder> {
     // have succeeded, we fail because a previous Write failed and the archive
     // may be corrupted and unreadable.
 
-    if (opts_.flush)
-      Flush();
+    if (opts_.flush && !opts_.background)
+      Flush();  // With bg, TableWriterBackgroundImpl does the flushing.
     return true;
   }
 
@@ -1074,6 +1387,8 @@ class TableWriterArchiveImpl: public TableWriterImplBase<Holder> {
     switch (state_) {
       case kWriteError: case kOpen:
         output_.Stream().flush();  // Don't check error status.
+        if (index_output_.IsOpen())
+          index_output_.Stream().flush();
         return;
       default:
         KALDI_WARN << "Flush called on not-open writer.";
@@ -1085,6 +1400,8 @@ class TableWriterArchiveImpl: public TableWriterImplBase<Holder> {
       KALDI_ERR << "Close called on a stream that was not open."
                 << this->IsOpen() << ", " << output_.IsOpen();
     bool close_success = output_.Close();
+    if (index_output_.IsOpen() && !index_output_.Close())
+      close_success = false;
     if (!close_success) {
       KALDI_WARN << "Error closing stream: wspecifier is " << wspecifier_;
       state_ = kUninitialized;
@@ -1112,6 +1429,7 @@ class TableWriterArchiveImpl: public TableWriterImplBase<Holder> {
 
  private:
   Output output_;
+  Output index_output_;  // only open if opts_.index.
   WspecifierOptions opts_;
   std::string wspecifier_;
   std::string archive_wxfilename_;
@@ -1216,7 +1534,7 @@ class TableWriterScriptImpl: public TableWriterImplBase<Holder> {
                  << PrintableWxfilename(wxfilename);
       return false;
     }
-    if (!Holder::Write(output.Stream(), opts_.binary, value)
+    if (!WriteHolderValue<Holder>(output.Stream(), opts_, value)
         || !output.Close()) {
       KALDI_WARN << "Failed to write data to "
                  << PrintableWxfilename(wxfilename);
@@ -1381,7 +1699,7 @@ class TableWriterBothImpl: public TableWriterImplBase<Holder> {
     std::ostream &script_os = script_output_.Stream();
     script_output_.Stream() << key << ' ' << offset_rxfilename << '\n';
 
-    if (!Holder::Write(archive_output_.Stream(), opts_.binary, value)) {
+    if (!WriteHolderValue<Holder>(archive_output_.Stream(), opts_, value)) {
       KALDI_WARN << "Write failure to"
                  << PrintableWxfilename(archive_wxfilename_);
       state_ = kWriteError;
@@ -1406,8 +1724,8 @@ class TableWriterBothImpl: public TableWriterImplBase<Holder> {
     // have succeeded, we fail because a previous Write failed and the archive
     // may be corrupted and unreadable.
 
-    if (opts_.flush)
-      Flush();
+    if (opts_.flush && !opts_.background)
+      Flush();  // With bg, TableWriterBackgroundImpl does the flushing.
     return true;
   }
 
@@ -1463,6 +1781,165 @@ class TableWriterBothImpl: public TableWriterImplBase<Holder> {
 };
 
 
+// This is for when someone adds the 'bg' modifier to a wspecifier; it wraps
+// around the basic implementation and does the actual writing in a background
+// thread.  Write() copies the object into a queue of at most
+// opts.background_queue_size objects (waiting if the queue is full), and the
+// background thread serializes and writes them in order, so the caller only
+// waits for the output when it gets ahead of it by more than that.  With the
+// 'f' modifier, the background thread flushes whenever the queue becomes
+// empty rather than after every object.  Objects of types that cannot be
+// copied (e.g. MatrixBase) are written in the calling thread, after the queue
+// has been written.
+template<class Holder>
+class TableWriterBackgroundImpl: public TableWriterImplBase<Holder> {
+ public:
+  typedef typename Holder::T T;
+
+  explicit TableWriterBackgroundImpl(TableWriterImplBase<Holder> *base_writer):
+      base_writer_(base_writer), max_queued_(1), flush_(false),
+      busy_(false), error_(false), stop_(false) { }
+
+  // The base writer must already be open with the same wspecifier; this
+  // reads the options and starts the background thread.
+  virtual bool Open(const std::string &wspecifier) {
+    KALDI_ASSERT(base_writer_ != NULL && base_writer_->IsOpen());
+    WspecifierOptions opts;
+    ClassifyWspecifier(wspecifier, NULL, NULL, &opts);
+    KALDI_ASSERT(opts.background && opts.background_queue_size > 0);
+    max_queued_ = opts.background_queue_size;
+    flush_ = opts.flush;
+    thread_ = std::thread(&TableWriterBackgroundImpl<Holder>::RunInBackground,
+                          this);
+    return true;
+  }
+
+  virtual bool IsOpen() const { return base_writer_ != NULL; }
+
+  // Returns false if an earlier write, in the background thread, failed.
+  virtual bool Write(const std::string &key, const T &value) {
+    if (!IsToken(key))  // e.g. empty string or has spaces...
+      KALDI_ERR << "Using invalid key " << key;
+    T *copy = CopyValue(value, CanCopy());
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (copy == NULL) {
+      while (!queue_.empty() || busy_)
+        cond_.wait(lock);
+      if (!error_ && !base_writer_->Write(key, value))
+        error_ = true;
+      return !error_;
+    }
+    while (static_cast<int32>(queue_.size()) >= max_queued_ && !error_)
+      cond_.wait(lock);
+    if (error_) {
+      DeleteValue(copy, CanCopy());
+      return false;
+    }
+    queue_.push_back(std::make_pair(key, copy));
+    work_cond_.notify_one();
+    return true;
+  }
+
+  // Waits until everything queued has been written, then flushes.
+  virtual void Flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!queue_.empty() || busy_)
+      cond_.wait(lock);
+    base_writer_->Flush();
+  }
+
+  virtual bool Close() {
+    KALDI_ASSERT(base_writer_ != NULL && thread_.joinable());
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    work_cond_.notify_one();
+    thread_.join();  // The thread writes everything queued before exiting.
+    bool ans;
+    try {
+      ans = base_writer_->Close();
+    } catch (...) {
+      ans = false;
+    }
+    if (error_) {
+      KALDI_WARN << "Closing background writer after a write error "
+                 << "(relates to 'bg' modifier).";
+      ans = false;
+    }
+    delete base_writer_;
+    base_writer_ = NULL;
+    return ans;
+  }
+
+  virtual ~TableWriterBackgroundImpl() {
+    if (base_writer_ != NULL && !Close())
+      KALDI_ERR << "Error detected closing background writer "
+                << "(relates to 'bg' modifier)";
+  }
+
+ private:
+  // We dispatch on whether T can be copied, because for types like MatrixBase
+  // even "delete" would not compile.
+  typedef std::integral_constant<bool, std::is_copy_constructible<T>::value>
+      CanCopy;
+  static T *CopyValue(const T &value, std::true_type) { return new T(value); }
+  static T *CopyValue(const T &value, std::false_type) { return NULL; }
+  static void DeleteValue(T *value, std::true_type) { delete value; }
+  static void DeleteValue(T *value, std::false_type) { }
+
+  void RunInBackground() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      while (queue_.empty() && !stop_)
+        work_cond_.wait(lock);
+      if (queue_.empty())
+        return;  // stop_ is set and everything has been written.
+      // The object stays in the queue while we write it, so the queue size
+      // bounds the number of copies in memory.
+      const std::string &key = queue_.front().first;
+      T *value = queue_.front().second;
+      busy_ = true;
+      bool ans = false;
+      if (!error_) {
+        lock.unlock();
+        try {
+          ans = base_writer_->Write(key, *value);
+        } catch (...) {
+          // e.g. the key is not in the scp file of a 'scp:' wspecifier.
+          ans = false;
+        }
+        lock.lock();
+      }
+      DeleteValue(value, CanCopy());
+      queue_.pop_front();
+      if (!ans)
+        error_ = true;  // Later calls to Write() will return false.
+      if (queue_.empty() && flush_ && !error_) {
+        lock.unlock();
+        base_writer_->Flush();
+        lock.lock();
+      }
+      busy_ = false;
+      cond_.notify_all();
+    }
+  }
+
+  TableWriterImplBase<Holder> *base_writer_;  // NULL when closed.
+  int32 max_queued_;
+  bool flush_;
+  std::deque<std::pair<std::string, T*> > queue_;  // Objects yet to be
+                                                   // written, in order.
+  bool busy_;   // True while the background thread is using base_writer_.
+  bool error_;  // True if a write failed.
+  bool stop_;   // Set by Close().
+  std::mutex mutex_;  // Guards queue_, busy_, error_ and stop_.
+  std::condition_variable work_cond_;  // Waited on by the background thread.
+  std::condition_variable cond_;  // Waited on by the calling thread.
+  std::thread thread_;
+};
+
+
 template<class Holder>
 TableWriter<Holder>::TableWriter(const std::string &wspecifier): impl_(NULL) {
   if (wspecifier != "" && !Open(wspecifier))
@@ -1483,7 +1960,8 @@ bool TableWriter<Holder>::Open(const std::string &wspecifier) {
       KALDI_ERR << "Failed to close previously open writer.";
   }
   KALDI_ASSERT(impl_ == NULL);
-  WspecifierType wtype = ClassifyWspecifier(wspecifier, NULL, NULL, NULL);
+  WspecifierOptions opts;
+  WspecifierType wtype = ClassifyWspecifier(wspecifier, NULL, NULL, &opts);
   switch (wtype) {
     case kBothWspecifier:
       impl_ = new TableWriterBothImpl<Holder>();
@@ -1498,18 +1976,26 @@ bool TableWriter<Holder>::Open(const std::string &wspecifier) {
       KALDI_WARN << "ClassifyWspecifier: invalid wspecifier " << wspecifier;
       return false;
   }
-  if (impl_->Open(wspecifier)) {
-    return true;
-  } else {  // The class will have printed a more specific warning.
+  if (!impl_->Open(wspecifier)) {
+    // The class will have printed a more specific warning.
     delete impl_;
     impl_ = NULL;
     return false;
   }
+  if (opts.background) {
+    impl_ = new TableWriterBackgroundImpl<Holder>(impl_);
+    if (!impl_->Open(wspecifier)) {
+      // It should only return false on code error.
+      return false;
+    }
+  }
+  return true;
 }
 
 template<class Holder>
 void TableWriter<Holder>::Write(const std::string &key,
                                 const T &value) const {
+  KALDI_PROFILE_SCOPE("TableWriter::Write");
   CheckImpl();
   if (!impl_->Write(key, value))
     KALDI_ERR << "Error in TableWriter::Write";
@@ -2504,6 +2990,149 @@ class RandomAccessTableReaderUnsortedArchiveImpl:
 
 
 
+// This is the implementation of RandomAccessTableReader for archives read
+// with the "idx" option, e.g. "ark,idx:foo.ark".  It reads the index
+// foo.ark.idx (see the "idx" option of wspecifiers) into a hash from key to
+// byte offset, and reads each object by seeking directly to it, so it never
+// reads through the archive and only keeps the last object asked for in
+// memory.  It is like RandomAccessTableReaderScriptImpl reading an scp file
+// written with ark,scp, except that lookup is by hashing.
+template<class Holder>
+class RandomAccessTableReaderIndexedArchiveImpl:
+      public RandomAccessTableReaderImplBase<Holder> {
+ public:
+  typedef typename Holder::T T;
+
+  RandomAccessTableReaderIndexedArchiveImpl(): state_(kUninitialized) { }
+
+  virtual bool Open(const std::string &rspecifier) {
+    if (state_ != kUninitialized)
+      KALDI_ERR << "Opening already open RandomAccessTableReader:"
+                   " call Close first.";
+    rspecifier_ = rspecifier;
+    RspecifierType rs = ClassifyRspecifier(rspecifier,
+                                           &archive_rxfilename_,
+                                           &opts_);
+    KALDI_ASSERT(rs == kArchiveRspecifier && opts_.indexed);  // or wrongly
+                                                              // called.
+    if (ClassifyRxfilename(archive_rxfilename_) != kFileInput) {
+      KALDI_WARN << "The idx option requires the archive to be an actual "
+                 << "file: rspecifier is " << rspecifier;
+      return false;
+    }
+    std::string index_rxfilename = archive_rxfilename_ + ".idx";
+    std::vector<std::pair<std::string, std::string> > index;
+    if (!ReadScriptFile(index_rxfilename, true, &index)) {
+      KALDI_WARN << "Error reading archive index "
+                 << PrintableRxfilename(index_rxfilename);
+      return false;
+    }
+    offsets_.reserve(index.size());
+    for (size_t i = 0; i < index.size(); i++) {
+      int64 offset;
+      if (!ConvertStringToInteger(index[i].second, &offset) || offset < 0) {
+        KALDI_WARN << "Invalid offset " << index[i].second << " for key "
+                   << index[i].first << " in archive index "
+                   << PrintableRxfilename(index_rxfilename);
+        offsets_.clear();
+        return false;
+      }
+      if (!offsets_.insert(std::make_pair(index[i].first, offset)).second) {
+        KALDI_WARN << "Archive index " << PrintableRxfilename(index_rxfilename)
+                   << " contains duplicate key: " << index[i].first;
+        offsets_.clear();
+        return false;
+      }
+    }
+    state_ = kNoObject;
+    return true;
+  }
+
+  virtual bool HasKey(const std::string &key) {
+    // In permissive mode, we have to check that we can read the object
+    // before we assert that the key is there.
+    if (opts_.permissive)
+      return LoadObject(key);
+    CheckOpen();
+    return offsets_.count(key) != 0;
+  }
+
+  virtual const T &Value(const std::string &key) {
+    if (!LoadObject(key))
+      KALDI_ERR << "Could not get item for key " << key
+                << ", rspecifier is " << rspecifier_ << " [to ignore this, "
+                << "add the p, (permissive) option to the rspecifier.";
+    return holder_.Value();
+  }
+
+  virtual bool Close() {
+    CheckOpen();
+    holder_.Clear();
+    if (input_.IsOpen())
+      input_.Close();
+    offsets_.clear();
+    key_ = "";
+    state_ = kUninitialized;
+    // As with scp files, any errors of a "global" nature would have been
+    // detected in Open().
+    return true;
+  }
+
+  virtual ~RandomAccessTableReaderIndexedArchiveImpl() { }
+
+ private:
+  void CheckOpen() const {
+    if (state_ == kUninitialized)
+      KALDI_ERR << "RandomAccessTableReader object is not open.";
+  }
+
+  // Makes sure holder_ contains the object for 'key', reading it from the
+  // archive if needed; returns false if the key is not in the index or the
+  // object could not be read.
+  bool LoadObject(const std::string &key) {
+    CheckOpen();
+    if (state_ == kHaveObject && key == key_)
+      return true;
+    typename OffsetMap::const_iterator iter = offsets_.find(key);
+    if (iter == offsets_.end())
+      return false;
+    holder_.Clear();
+    state_ = kNoObject;
+    std::ostringstream data_rxfilename;  // e.g. foo.ark:12407
+    data_rxfilename << archive_rxfilename_ << ':' << iter->second;
+    // Input keeps the archive open if it is already open, and just seeks.
+    if (!input_.Open(data_rxfilename.str())) {
+      KALDI_WARN << "Error opening stream "
+                 << PrintableRxfilename(data_rxfilename.str());
+      return false;
+    }
+    if (!holder_.Read(input_.Stream())) {
+      KALDI_WARN << "Error reading object from stream "
+                 << PrintableRxfilename(data_rxfilename.str());
+      return false;
+    }
+    key_ = key;
+    state_ = kHaveObject;
+    return true;
+  }
+
+  typedef unordered_map<std::string, int64, StringHasher> OffsetMap;
+  OffsetMap offsets_;  // byte offset of each object in the archive.
+  Input input_;
+  Holder holder_;
+  std::string key_;  // key of the object in holder_, if state_ ==
+                     // kHaveObject.
+  RspecifierOptions opts_;
+  std::string rspecifier_;
+  std::string archive_rxfilename_;
+  enum {
+    kUninitialized,  // not open.
+    kNoObject,  // open; holder_ is empty.
+    kHaveObject  // holder_ contains the object for key_.
+  } state_;
+};
+
+
 template<class Holder>
 RandomAccessTableReader<Holder>::RandomAccessTableReader(const
                                                        std::string &rspecifier):
@@ -2524,7 +3153,9 @@ bool RandomAccessTableReader<Holder>::Open(const std::string &rspecifier) {
       impl_ = new RandomAccessTableReaderScriptImpl<Holder>();
       break;
     case kArchiveRspecifier:
-      if (opts.sorted) {
+      if (opts.indexed) {
+        impl_ = new RandomAccessTableReaderIndexedArchiveImpl<Holder>();
+      } else if (opts.sorted) {
         if (opts.called_sorted)  // "doubly" sorted case.
           impl_ = new RandomAccessTableReaderDSortedArchiveImpl<Holder>();
         else
@@ -2559,6 +3190,7 @@ bool RandomAccessTableReader<Holder>::HasKey(const std::string &key) {
 template<class Holder>
 const typename RandomAccessTableReader<Holder>::T&
 RandomAccessTableReader<Holder>::Value(const std::string &key) {
+  KALDI_PROFILE_SCOPE("RandomAccessTableReader::Value");
   CheckImpl();
   return impl_->Value(key);
 }
@@ -171,6 +171,39 @@ void UnitTestClassifyWspecifier() {
     KALDI_ASSERT(ans == kBothWspecifier && ark == "" && scp == "" &&
                  opts.binary == true && opts.flush == false);
   }
+
+  {
+    std::string a = "ark,scp,compact:foo.ark,foo.scp";
+    std::string ark = "x", scp = "y";
+    WspecifierOptions opts;
+    WspecifierType ans = ClassifyWspecifier(a, &ark, &scp, &opts);
+    KALDI_ASSERT(ans == kBothWspecifier && ark == "foo.ark" &&
+                 scp == "foo.scp" && opts.binary == true &&
+                 opts.compact == true);
+  }
+
+  {
+    std::string a = "ark,idx:foo.ark";
+    std::string ark = "x";
+    WspecifierOptions opts;
+    WspecifierType ans = ClassifyWspecifier(a, &ark, NULL, &opts);
+    KALDI_ASSERT(ans == kArchiveWspecifier && ark == "foo.ark" &&
+                 opts.index == true);
+  }
+
+  {
+    std::string a = "ark,scp,bg=4:foo.ark,foo.scp";
+    WspecifierOptions opts;
+    WspecifierType ans = ClassifyWspecifier(a, NULL, NULL, &opts);
+    KALDI_ASSERT(ans == kBothWspecifier && opts.background == true &&
+                 opts.background_queue_size == 4);
+  }
+
+  {
+    std::string a = "ark,scp,idx:foo.ark,foo.scp";  // idx only with ark.
+    WspecifierType ans = ClassifyWspecifier(a, NULL, NULL, NULL);
+    KALDI_ASSERT(ans == kNoWspecifier);
+  }
 }
 
 
@@ -318,6 +351,30 @@ void UnitTestClassifyRspecifier() {
     RspecifierType ans = ClassifyRspecifier(a, &b, NULL);
     KALDI_ASSERT(ans == kArchiveRspecifier && b == "a");
   }
+  {
+    std::string a = "p,idx,ark:a", b;
+    RspecifierOptions opts;
+    RspecifierType ans = ClassifyRspecifier(a, &b, &opts);
+    KALDI_ASSERT(ans == kArchiveRspecifier && b == "a" && opts.indexed &&
+                 opts.permissive);
+  }
+  {
+    std::string a = "bg=8,scp:a", b;
+    RspecifierOptions opts;
+    RspecifierType ans = ClassifyRspecifier(a, &b, &opts);
+    KALDI_ASSERT(ans == kScriptRspecifier && b == "a" && opts.background &&
+                 opts.num_background_threads == 8);
+  }
+  {
+    std::string a = "bg=0,scp:a";
+    RspecifierType ans = ClassifyRspecifier(a, NULL, NULL);
+    KALDI_ASSERT(ans == kNoRspecifier);
+  }
+  {
+    std::string a = "idx,scp:a";  // idx only makes sense for archives.
+    RspecifierType ans = ClassifyRspecifier(a, NULL, NULL);
+    KALDI_ASSERT(ans == kNoRspecifier);
+  }
 }
 
 void UnitTestTableSequentialInt32(bool binary) {
@@ -514,6 +571,38 @@ void UnitTestTableSequentialInt32VectorBoth(bool binary, bool read_scp) {
 }
 
 
+// Reads vectors of basic types from a hand-written text archive, with
+// tokens that BasicVectorHolder reads quickly and ones it reads with a stream.
+void UnitTestTableSequentialBasicVectorText() {
+  {
+    Output ko("tmpf", false);
+    ko.Stream() << "a 1 +2 -3\nb\nc 007\t 8 \nd 1.5\n";
+  }
+  std::vector<std::vector<int32> > v;
+  SequentialInt32VectorReader ir("ark:tmpf");
+  for (; !ir.Done(); ir.Next())
+    v.push_back(ir.Value());
+  KALDI_ASSERT(!ir.Close() && v.size() == 3);  // "1.5" is not an integer.
+  int32 a[] = { 1, 2, -3 };
+  KALDI_ASSERT(v[0] == std::vector<int32>(a, a + 3) && v[1].empty() &&
+               v[2].size() == 2 && v[2][0] == 7 && v[2][1] == 8);
+  {
+    Output ko("tmpf", false);
+    ko.Stream() << "a 1 -2.5e3 .25\nb 1e-2\t+4 -0 \nc 1 inf\n";
+  }
+  std::vector<std::vector<float> > f;
+  SequentialTableReader<BasicVectorHolder<float> > fr("ark:tmpf");
+  for (; !fr.Done(); fr.Next())
+    f.push_back(fr.Value());
+  KALDI_ASSERT(!fr.Close() && f.size() == 2);  // "inf" is not read.
+  KALDI_ASSERT(f[0].size() == 3 && f[0][0] == 1.0 && f[0][1] == -2500.0 &&
+               f[0][2] == 0.25);
+  KALDI_ASSERT(f[1].size() == 3 && f[1][0] == 1.0e-02f && f[1][1] == 4.0 &&
+               f[1][2] == 0.0);
+  unlink("tmpf");
+}
+
+
 // Writing as both and reading as archive.
 void UnitTestTableSequentialInt32PairVectorBoth(bool binary, bool read_scp) {
   int32 sz = Rand() % 10;
@@ -838,6 +927,174 @@ void UnitTestTableRandomBothDouble(bool binary, bool read_scp,
 }
 
 
+// Reads an scp file, some of whose lines have ranges, with "bg=N", which
+// loads up to N entries at once, and checks that we get the same as with the
+// plain script reader, in the same order.  In permissive mode the scp also
+// has an entry that can't be read, which both readers must skip.
+void UnitTestTableSequentialParallelScript(bool binary) {
+  int32 sz = Rand() % 20;
+  std::vector<std::string> k;
+  {
+    DoubleMatrixWriter writer(binary ? "b,ark,scp:tmpf,tmpf.scp" :
+                              "t,ark,scp:tmpf,tmpf.scp");
+    for (int32 i = 0; i < sz; i++) {
+      std::ostringstream os;
+      os << "key" << i;
+      k.push_back(os.str());
+      Matrix<double> m(1 + Rand() % 4, 1 + Rand() % 4);
+      m.SetRandn();
+      writer.Write(k[i], m);
+    }
+    KALDI_ASSERT(writer.Close());
+  }
+  bool permissive = (RandInt(0, 1) == 0);
+  {
+    std::vector<std::pair<std::string, std::string> > lines;
+    KALDI_ASSERT(ReadScriptFile("tmpf.scp", true, &lines) &&
+                 lines.size() == static_cast<size_t>(sz));
+    Output ko("tmpf_parallel.scp", false);
+    for (int32 i = 0; i < sz; i++) {
+      ko.Stream() << lines[i].first << ' ' << lines[i].second;
+      if (RandInt(0, 1) == 0)
+        ko.Stream() << "[0:0]";  // every matrix has at least one row.
+      ko.Stream() << '\n';
+      if (permissive && i == sz / 2)
+        ko.Stream() << "bad nonexistent.ark:0\n";
+    }
+  }
+  std::ostringstream parallel_rspecifier;
+  parallel_rspecifier << "bg=" << RandInt(1, 4)
+                      << (permissive ? ",scp,p:" : ",scp:")
+                      << "tmpf_parallel.scp";
+  SequentialDoubleMatrixReader reader(permissive ? "scp,p:tmpf_parallel.scp" :
+                                      "scp:tmpf_parallel.scp"),
+      parallel_reader(parallel_rspecifier.str());
+  int32 n = 0;
+  for (; !reader.Done(); reader.Next(), parallel_reader.Next(), n++) {
+    KALDI_ASSERT(!parallel_reader.Done() &&
+                 parallel_reader.Key() == reader.Key() &&
+                 parallel_reader.Value().ApproxEqual(reader.Value(), 0.0));
+  }
+  KALDI_ASSERT(parallel_reader.Done() && n == sz);
+  KALDI_ASSERT(reader.Close() && parallel_reader.Close());
+  unlink("tmpf");
+  unlink("tmpf.scp");
+  unlink("tmpf_parallel.scp");
+}
+
+// With "bg=2" the queue is often full, so Write() has to wait for the
+// background thread; the objects must still be written in order.
+void UnitTestTableBackgroundWriterInt32(bool binary) {
+  int32 sz = Rand() % 50;
+  std::vector<std::string> k;
+  std::vector<int32> v;
+  for (int32 i = 0; i < sz; i++) {
+    std::ostringstream os;
+    os << "key" << i;
+    k.push_back(os.str());
+    v.push_back(Rand());
+  }
+  {
+    Int32Writer writer(binary ? "bg=2,b,ark:tmpf" : "bg=2,t,ark:tmpf");
+    for (int32 i = 0; i < sz; i++)
+      writer.Write(k[i], v[i]);
+    KALDI_ASSERT(writer.Close());
+  }
+  std::vector<std::string> k2;
+  std::vector<int32> v2;
+  for (SequentialInt32Reader reader("ark:tmpf"); !reader.Done();
+       reader.Next()) {
+    k2.push_back(reader.Key());
+    v2.push_back(reader.Value());
+  }
+  KALDI_ASSERT(k2 == k && v2 == v);
+  unlink("tmpf");
+}
+
+// Writes matrices with "bg,f" to an archive and scp file, and reads them back
+// from both.
+void UnitTestTableBackgroundWriterDoubleMatrixBoth(bool binary) {
+  int32 sz = Rand() % 10;
+  std::vector<std::string> k;
+  std::vector<Matrix<double> > v(sz);
+  for (int32 i = 0; i < sz; i++) {
+    k.push_back(CharToString('a' + static_cast<char>(i)));
+    v[i].Resize(1 + Rand() % 4, 1 + Rand() % 4);
+    v[i].SetRandn();
+  }
+  {
+    DoubleMatrixWriter writer(binary ? "bg,f,b,ark,scp:tmpf,tmpf.scp" :
+                              "bg,f,t,ark,scp:tmpf,tmpf.scp");
+    for (int32 i = 0; i < sz; i++)
+      writer.Write(k[i], v[i]);
+    KALDI_ASSERT(writer.Close());
+  }
+  const char *rspecifiers[] = { "ark:tmpf", "scp:tmpf.scp" };
+  for (int32 r = 0; r < 2; r++) {
+    int32 i = 0;
+    for (SequentialDoubleMatrixReader reader(rspecifiers[r]); !reader.Done();
+         reader.Next(), i++) {
+      KALDI_ASSERT(i < sz && reader.Key() == k[i]);
+      if (binary) KALDI_ASSERT(reader.Value().ApproxEqual(v[i], 0.0));
+      else KALDI_ASSERT(reader.Value().ApproxEqual(v[i], 1.0e-05));
+    }
+    KALDI_ASSERT(i == sz);
+  }
+  unlink("tmpf");
+  unlink("tmpf.scp");
+}
+
+// MatrixBase cannot be copied, so with "bg" it is written in the calling
+// thread.
+void UnitTestTableBackgroundWriterMatrixBase(bool binary) {
+  Matrix<double> m(1 + Rand() % 4, 1 + Rand() % 4);
+  m.SetRandn();
+  {
+    TableWriter<KaldiObjectHolder<MatrixBase<double> > > writer(
+        binary ? "b,bg,ark:tmpf" : "t,bg,ark:tmpf");
+    writer.Write("a", m);
+    writer.Write("b", m.Range(0, 1, 0, m.NumCols()));
+    KALDI_ASSERT(writer.Close());
+  }
+  SequentialDoubleMatrixReader reader("ark:tmpf");
+  KALDI_ASSERT(reader.Key() == "a" && reader.Value().ApproxEqual(m));
+  reader.Next();
+  KALDI_ASSERT(reader.Key() == "b" && reader.Value().NumRows() == 1);
+  reader.Next();
+  KALDI_ASSERT(reader.Done());
+  unlink("tmpf");
+}
+
+void UnitTestTableRandomIndexedDoubleMatrix(bool binary) {
+  int32 sz = Rand() % 10;
+  std::vector<std::string> k;
+  std::vector<Matrix<double> > v(sz);
+  for (int32 i = 0; i < sz; i++) {
+    k.push_back(CharToString('a' + static_cast<char>(i)));
+    v[i].Resize(1 + Rand() % 4, 1 + Rand() % 4);
+    v[i].SetRandn();
+  }
+  RandomizeVector(&k);  // the archive need not be sorted.
+  {
+    DoubleMatrixWriter writer(binary ? "ark,idx:tmpf" : "ark,t,idx:tmpf");
+    for (int32 i = 0; i < sz; i++)
+      writer.Write(k[i], v[i]);
+    KALDI_ASSERT(writer.Close());
+  }
+  RandomAccessDoubleMatrixReader reader("idx,ark:tmpf");
+  KALDI_ASSERT(!reader.HasKey("zz"));
+  for (int32 n = 0; n < 2 * sz; n++) {
+    int32 i = Rand() % sz;
+    KALDI_ASSERT(reader.HasKey(k[i]));
+    const Matrix<double> &value = reader.Value(k[i]);
+    if (binary) KALDI_ASSERT(value.ApproxEqual(v[i], 0.0));
+    else KALDI_ASSERT(value.ApproxEqual(v[i], 1.0e-05));
+  }
+  KALDI_ASSERT(reader.Close());
+  unlink("tmpf");
+  unlink("tmpf.idx");
+}
+
 
 void UnitTestRangesMatrix(bool binary) {
   int32 archive_size = RandInt(1, 10);
@@ -1053,6 +1310,7 @@ int main() {
   UnitTestReadScriptFile();
   UnitTestClassifyWspecifier();
   UnitTestClassifyRspecifier();
+  UnitTestTableSequentialBasicVectorText();
   for (int i = 0; i < 10; i++) {
     bool b = (i == 0);
     UnitTestTableSequentialBool(b);
@@ -1060,6 +1318,11 @@ int main() {
     UnitTestTableSequentialInt32Script(b);
     UnitTestTableSequentialDouble(b);
     UnitTestRangesMatrix(b);
+    UnitTestTableRandomIndexedDoubleMatrix(b);
+    UnitTestTableSequentialParallelScript(b);
+    UnitTestTableBackgroundWriterInt32(b);
+    UnitTestTableBackgroundWriterDoubleMatrixBoth(b);
+    UnitTestTableBackgroundWriterMatrixBase(b);
     for (int j = 0; j < 2; j++) {
       bool c = (j == 0);
       UnitTestTableSequentialDoubleBoth(b, c);
@@ -64,18 +64,19 @@ bool ReadScriptFile(std::istream &is,
       return false;  // Empty line so invalid scp file format..
     }
 
-    std::string key, rest;
+    // Split the line straight into the output, to avoid copying it.
+    script_out->resize(script_out->size()+1);
+    std::string &key = script_out->back().first,
+        &rest = script_out->back().second;
     SplitStringOnFirstSpace(line, &key, &rest);
 
     if (key.empty() || rest.empty()) {
       if (warn)
         KALDI_WARN << "Invalid " << line_number << "'th line in script file"
                           <<":\"" << line << '"';
+      script_out->pop_back();
       return false;
     }
-    script_out->resize(script_out->size()+1);
-    script_out->back().first = key;
-    script_out->back().second = rest;
   }
   return true;
 }
@@ -148,6 +149,7 @@ WspecifierType ClassifyWspecifier(const std::string &wspecifier,
   //  ark,scp,f:filename, wxfilename ->  kBothWspecifier
   // or:
   //  scp,t,nf:rxfilename -> kScriptWspecifier
+  // and similarly bg or bg=N (write in the background).
 
   if (archive_wxfilename) archive_wxfilename->clear();
   if (script_wxfilename) script_wxfilename->clear();
@@ -164,6 +166,7 @@ WspecifierType ClassifyWspecifier(const std::string &wspecifier,
   // don't omit empty strings between commas.
 
   WspecifierType ws = kNoWspecifier;
+  bool index = false;
 
   if (opts != NULL)
     *opts = WspecifierOptions();  // Make sure all the defaults are as in the
@@ -183,6 +186,22 @@ WspecifierType ClassifyWspecifier(const std::string &wspecifier,
       if (opts) opts->binary = false;
     } else if (!strcmp(c, "p")) {
       if (opts) opts->permissive = true;
+    } else if (!strcmp(c, "compact")) {
+      if (opts) opts->compact = true;
+    } else if (!strcmp(c, "idx")) {
+      index = true;
+      if (opts) opts->index = true;
+    } else if (!strcmp(c, "bg")) {
+      if (opts) opts->background = true;
+    } else if (!strncmp(c, "bg=", 3)) {
+      int32 queue_size;
+      if (!ConvertStringToInteger(str.substr(3), &queue_size) ||
+          queue_size <= 0)
+        return kNoWspecifier;
+      if (opts) {
+        opts->background = true;
+        opts->background_queue_size = queue_size;
+      }
     } else if (!strcmp(c, "ark")) {
       if (ws == kNoWspecifier) ws = kArchiveWspecifier;
       else
@@ -198,6 +217,10 @@ WspecifierType ClassifyWspecifier(const std::string &wspecifier,
     }
   }
 
+  if (index && ws != kArchiveWspecifier)
+    return kNoWspecifier;  // "idx" is only supported when writing just an
+  // archive; with ark,scp the scp file already gives the offsets.
+
   switch (ws) {
     case kArchiveWspecifier:
       if (archive_wxfilename)
@@ -232,7 +255,8 @@ RspecifierType ClassifyRspecifier(const std::string &rspecifier,
   // We also allow the meaningless prefixes b, and t,
   // plus the options o (once), no (not-once),
   // s (sorted) and ns (not-sorted), p (permissive)
-  // and np (not-permissive).
+  // and np (not-permissive), idx (use the archive's index),
+  // and bg or bg=N (read ahead in the background).
   // so the following would be valid:
   //
   // f, o, b, np, ark:rxfilename  ->  kArchiveRspecifier
@@ -267,6 +291,7 @@ RspecifierType ClassifyRspecifier(const std::string &rspecifier,
   // don't omit empty strings between commas.
 
   RspecifierType rs = kNoRspecifier;
+  bool indexed = false;
 
   for (size_t i = 0; i < split_first_part.size(); i++) {
     const std::string &str = split_first_part[i];  // e.g. "b", "t", "f", "ark",
@@ -293,6 +318,18 @@ RspecifierType ClassifyRspecifier(const std::string &rspecifier,
       if (opts) opts->called_sorted = false;
     } else if (!strcmp(c, "bg")) {
       if (opts) opts->background = true;
+    } else if (!strncmp(c, "bg=", 3)) {
+      int32 num_threads;
+      if (!ConvertStringToInteger(str.substr(3), &num_threads) ||
+          num_threads <= 0)
+        return kNoRspecifier;
+      if (opts) {
+        opts->background = true;
+        opts->num_background_threads = num_threads;
+      }
+    } else if (!strcmp(c, "idx")) {
+      indexed = true;
+      if (opts) opts->indexed = true;
     } else if (!strcmp(c, "ark")) {
       if (rs == kNoRspecifier) rs = kArchiveRspecifier;
       else
@@ -307,6 +344,8 @@ RspecifierType ClassifyRspecifier(const std::string &rspecifier,
       return kNoRspecifier;  // Could not interpret this option.
     }
   }
+  if (indexed && rs != kArchiveRspecifier)
+    return kNoRspecifier;  // "idx" only makes sense for archives.
   if ((rs == kArchiveRspecifier || rs == kScriptRspecifier)
      && rxfilename != NULL)
     *rxfilename = after_colon;
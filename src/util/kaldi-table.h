@@ -71,12 +71,33 @@ typedef std::vector<std::string> KeyList;
 //  p means permissive mode, when writing to an "scp" file only: will ignore
 //     missing scp entries, i.e. won't write anything for those files but will
 //     return success status).
+//  compact means, in binary mode, use the holder's compact binary format if
+//     it has one (see WriteCompact() in kaldi-holder.h); it is ignored for
+//     other holders and in text mode.  The reader detects the format, so no
+//     option is needed when reading.
+//  idx means, when writing just an archive (not ark,scp), also write an index
+//     file whose name is the archive filename plus ".idx", with lines like
+//       key 12407
+//     where the number is the byte offset of the object in the archive (as
+//     in the scp file of ark,scp).  The archive must be an actual file.
+//     Random-access readers use the index if given the idx option (see the
+//     rspecifier documentation below).
+//  bg means "background": Write() copies the object and returns, and a
+//     background thread serializes and writes it, so that computation
+//     overlaps with output.  At most 16 objects wait to be written (Write()
+//     waits when there are more); bg=N sets this limit to N.  Write errors
+//     are reported by a later Write() or by Close().  With f, the stream is
+//     flushed whenever the background thread has written all it has, rather
+//     than after each object.
 //
 //  So the following are valid wspecifiers:
 //  ark,b,f:foo
 //  "ark,b,b:| gzip -c > foo"
 //  "ark,scp,t,nf:foo.ark,|gzip -c > foo.scp.gz"
 //  ark,b:-
+//  ark,scp,compact:foo.ark,foo.scp
+//  ark,idx:foo.ark
+//  "ark,bg=32:| gzip -c > foo.gz"
 //
 //  The meanings of rxfilename and wxfilename are as described in
 //  kaldi-io.h (they are filenames but include pipes, stdin/stdout
@@ -114,7 +135,14 @@ struct WspecifierOptions {
   bool binary;
   bool flush;
   bool permissive;  // will ignore absent scp entries.
-  WspecifierOptions(): binary(true), flush(false), permissive(false) { }
+  bool compact;  // use the holder's compact binary format, if any.
+  bool index;  // also write an index of byte offsets to <archive>.idx.
+  bool background;  // write in a background thread ("bg" or "bg=N").
+  int32 background_queue_size;  // with "bg", the maximum number of objects
+                                // waiting to be written.
+  WspecifierOptions(): binary(true), flush(false), permissive(false),
+                       compact(false), index(false), background(false),
+                       background_queue_size(16) { }
 };
 
 // ClassifyWspecifier returns the type of the wspecifier string,
@@ -189,6 +217,17 @@ bool WriteScriptFile(std::ostream &os,
 //       value, in a background thread.  Recommended when reading larger objects
 //       such as neural-net training examples, especially when you want to
 //       maximize GPU usage.
+//   bg=N (e.g. bg=8) is like bg, but for sequential reading of scp files it
+//       keeps up to N objects being read at once, by a pool of N threads, and
+//       still outputs them in the order of the scp file.  This helps when the
+//       scp file points into many archives on slow (e.g. networked) storage.
+//       For archives, bg=N is the same as bg.
+//   idx means the archive (which must be an actual file) has an index, as
+//       written with the idx option of wspecifiers.  It only makes a difference
+//       for random-access readers, which then read the index and seek directly
+//       to each object they are asked for, instead of reading through the
+//       archive and keeping objects in memory; the s, cs and o options are not
+//       needed.
 //
 //   b   is ignored [for scripting convenience]
 //   t   is ignored [for scripting convenience]
@@ -197,6 +236,8 @@ bool WriteScriptFile(std::ostream &os,
 //  So for instance the following would be a valid rspecifier:
 //
 //   "o, s, p, ark:gunzip -c foo.gz|"
+//   "p, idx, ark:foo.ark"
+//   "bg=8, scp:feats.scp"
 
 struct  RspecifierOptions {
   // These options only make a difference for the RandomAccessTableReader class.
@@ -211,9 +252,14 @@ struct  RspecifierOptions {
   bool background;  // For sequential readers, if the background option ("bg")
                     // is provided, it will read ahead to the next object in a
                     // background thread.
+  int32 num_background_threads;  // Number of reads kept in flight with "bg=N"
+                                 // (1 for plain "bg").
+  bool indexed;  // For random-access readers of archives, if the "idx" option
+                 // is provided, look objects up using <archive>.idx.
   RspecifierOptions(): once(false), sorted(false),
                        called_sorted(false), permissive(false),
-                       background(false) { }
+                       background(false), num_background_threads(1),
+                       indexed(false) { }
 };
 
 enum RspecifierType  {
@@ -122,6 +122,91 @@ void TestTaskSequencer() {
     KALDI_ASSERT(task_output[i] == i);
 }
 
+void TestPooledTaskSequencer() {
+  TaskSequencerConfig config;
+  config.num_threads = Rand() % 10;
+  if (Rand() % 2 == 1 )
+    config.num_threads_total = config.num_threads + Rand() % 5;
+
+  int32 num_tasks = Rand() % 200;
+
+  std::vector<int32> task_output;
+  {
+    PooledTaskSequencer<MyTaskClass> sequencer(config);
+    for (int32 i = 0; i < num_tasks; i++) {
+      sequencer.Run(new MyTaskClass(i, &task_output));
+    }
+    if (Rand() % 2 == 0) {
+      sequencer.Wait();
+      KALDI_ASSERT(task_output.size() == static_cast<size_t>(num_tasks));
+    }
+  }
+  KALDI_ASSERT(task_output.size() == static_cast<size_t>(num_tasks));
+  for (int32 i = 0; i < num_tasks; i++)
+    KALDI_ASSERT(task_output[i] == i);
+}
+
+// Output that takes a while, to check that Wait() waits for it.
+class MySlowOutputTaskClass {
+ public:
+  MySlowOutputTaskClass(int32 i, std::vector<int32> *vec): i_(i), vec_(vec) { }
+  void operator() () { }
+  ~MySlowOutputTaskClass() {
+    Sleep(0.001);
+    vec_->push_back(i_);
+  }
+ private:
+  int32 i_;
+  std::vector<int32> *vec_;
+};
+
+void TestPooledTaskSequencerWait() {
+  TaskSequencerConfig config;
+  config.num_threads = 1 + Rand() % 4;
+  int32 num_tasks = 1 + Rand() % 20;
+  std::vector<int32> task_output;
+  PooledTaskSequencer<MySlowOutputTaskClass> sequencer(config);
+  for (int32 i = 0; i < num_tasks; i++)
+    sequencer.Run(new MySlowOutputTaskClass(i, &task_output));
+  sequencer.Wait();
+  KALDI_ASSERT(task_output.size() == static_cast<size_t>(num_tasks));
+}
+
+void TestThreadPool() {
+  int32 num_tasks = Rand() % 1000;
+  std::vector<int32> counts(num_tasks, 0);
+  {
+    ThreadPool pool(1 + Rand() % 8);
+    for (int32 i = 0; i < num_tasks; i++)
+      pool.Submit([&counts, i]() { counts[i]++; });
+  }  // The destructor waits for the tasks.
+  for (int32 i = 0; i < num_tasks; i++)
+    KALDI_ASSERT(counts[i] == 1);
+}
+
+// The tasks wait for each other, so this only finishes if RunOnSharedThread()
+// starts all of them at once.
+void TestRunOnSharedThread() {
+  // This is sometimes more than the number of shared threads.
+  int32 num_tasks = 1 + Rand() % 100;
+  std::mutex mutex;
+  std::condition_variable cond;
+  int32 num_started = 0;
+  Semaphore finished;
+  for (int32 i = 0; i < num_tasks; i++) {
+    RunOnSharedThread([&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        num_started++;
+        cond.notify_all();
+        while (num_started < num_tasks)
+          cond.wait(lock);
+        lock.unlock();
+        finished.Signal();
+      });
+  }
+  for (int32 i = 0; i < num_tasks; i++)
+    finished.Wait();
+}
 
 }  // end namespace kaldi.
 
@@ -130,4 +215,10 @@ int main() {
   TestThreads();
   for (int32 i = 0; i < 10; i++)
     TestTaskSequencer();
+  for (int32 i = 0; i < 10; i++) {
+    TestPooledTaskSequencer();
+    TestPooledTaskSequencerWait();
+    TestThreadPool();
+    TestRunOnSharedThread();
+  }
 }
@@ -18,8 +18,12 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <chrono>
+
 #include "base/kaldi-common.h"
 #include "util/kaldi-thread.h"
+#include "util/stl-utils.h"
 
 namespace kaldi {
 int32 g_num_threads = 8;  // Initialize this global variable.
@@ -28,6 +32,155 @@ MultiThreadable::~MultiThreadable() {
   // default implementation does nothing
 }
 
+namespace {
+
+// How long a shared thread waits for a new task before exiting.
+const int32 kIdleSeconds = 10;
+
+// The threads used by RunOnSharedThread().  There are at most max_threads_ of
+// them; each waits for tasks on the queue, for up to kIdleSeconds, and exits
+// if it gets none.  A task that arrives when all of them are busy gets a
+// thread of its own, which exits when the task is done, so that tasks never
+// wait for each other to get a thread.
+class SharedThreads {
+ public:
+  SharedThreads(): num_threads_(0), num_idle_(0) {
+    max_threads_ = std::max<int32>(16, 2 * std::thread::hardware_concurrency());
+  }
+
+  void Run(const std::function<void()> &task) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    // Each queued task needs an idle thread that will take it; we count a
+    // thread as idle until it has taken a task, even if it has been woken.
+    if (tasks_.size() < num_idle_) {
+      tasks_.push_back(task);
+      lock.unlock();
+      cond_.notify_one();
+    } else if (num_threads_ < max_threads_) {
+      tasks_.push_back(task);
+      num_threads_++;
+      lock.unlock();
+      std::thread(&SharedThreads::RunThread, this).detach();
+    } else {
+      lock.unlock();
+      std::thread(task).detach();
+    }
+  }
+
+ private:
+  void RunThread() {
+    std::function<void()> task;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        num_idle_++;
+        bool got_task = cond_.wait_for(lock,
+                                       std::chrono::seconds(kIdleSeconds),
+                                       [this] { return !tasks_.empty(); });
+        num_idle_--;
+        if (!got_task) {
+          num_threads_--;
+          return;
+        }
+        task.swap(tasks_.front());
+        tasks_.pop_front();
+      }
+      task();
+      task = nullptr;  // Destroys whatever the task holds.
+    }
+  }
+
+  std::mutex mutex_;  // Protects the members below.
+  std::condition_variable cond_;  // Signaled when a task is queued.
+  std::deque<std::function<void()> > tasks_;
+  int32 max_threads_;
+  int32 num_threads_;  // Number of threads in the set.
+  size_t num_idle_;  // Number of threads waiting for a task.
+};
+
+}  // namespace
+
+void RunOnSharedThread(const std::function<void()> &task) {
+  // This is never deleted, as the threads may still be waiting on it when the
+  // program exits.
+  static SharedThreads *shared_threads = new SharedThreads();
+  shared_threads->Run(task);
+}
+
+ThreadPool::ThreadPool(int32 num_threads):
+    next_queue_(0), num_queued_(0), stop_(false) {
+  KALDI_ASSERT(num_threads > 0);
+  for (int32 i = 0; i < num_threads; i++)
+    queues_.push_back(new TaskQueue());
+  for (int32 i = 0; i < num_threads; i++)
+    threads_.push_back(std::thread(&ThreadPool::RunThread, this, i));
+}
+
+void ThreadPool::Submit(const std::function<void()> &task) {
+  TaskQueue *queue = queues_[next_queue_];
+  next_queue_ = (next_queue_ + 1) % queues_.size();
+  {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    queue->tasks.push_back(task);
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    num_queued_++;
+  }
+  cond_.notify_one();
+}
+
+bool ThreadPool::GetTask(int32 thread_index, std::function<void()> *task) {
+  int32 num_queues = queues_.size();
+  for (int32 i = 0; i < num_queues; i++) {
+    // First our own queue (oldest task first), then the others' (newest
+    // task first, to keep out of the way of their owners).
+    TaskQueue *queue = queues_[(thread_index + i) % num_queues];
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (queue->tasks.empty())
+      continue;
+    if (i == 0) {
+      task->swap(queue->tasks.front());
+      queue->tasks.pop_front();
+    } else {
+      task->swap(queue->tasks.back());
+      queue->tasks.pop_back();
+    }
+    lock.unlock();
+    std::lock_guard<std::mutex> count_lock(mutex_);
+    num_queued_--;
+    return true;
+  }
+  return false;
+}
+
+void ThreadPool::RunThread(int32 thread_index) {
+  std::function<void()> task;
+  while (true) {
+    if (GetTask(thread_index, &task)) {
+      task();
+      task = nullptr;  // Destroys whatever the task holds.
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (num_queued_ == 0 && !stop_)
+      cond_.wait(lock);
+    if (num_queued_ == 0 && stop_)
+      return;
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cond_.notify_all();
+  for (size_t i = 0; i < threads_.size(); i++)
+    threads_[i].join();
+  DeletePointers(&queues_);
+}
+
 
 
 }  // end namespace kaldi
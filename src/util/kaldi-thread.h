@@ -24,6 +24,10 @@
 
 #include <thread>
 #include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
 #include "itf/options-itf.h"
 #include "util/kaldi-semaphore.h"
 
@@ -53,6 +57,15 @@
 // destructor to have side effects such as outputting data.
 // Note: the destructor of TaskSequencer will wait for any remaining jobs that
 // are still running and will call the destructors.
+//
+// MultiThreader and TaskSequencer run each object on its own thread, which
+// they take from a process-wide set of threads that is kept between calls
+// (see RunOnSharedThread()), so that programs that use them repeatedly don't
+// create new threads each time.  In TaskSequencer, an object whose output is
+// waiting for an earlier, slow object keeps its thread busy.
+// PooledTaskSequencer has the same interface and guarantees, but runs the
+// objects on a fixed ThreadPool whose threads steal work from each other, and
+// bounds the number of objects that are waiting to be output.
 
 
 namespace kaldi {
@@ -64,6 +77,23 @@ extern int32 g_num_threads;  // Maximum number of threads (for programs that
 // should register it with their ParseOptions, as something like:
 // po.Register("num-threads", &g_num_threads, "Number of threads to use.");
 
+/// Runs 'task' on a thread of a process-wide set of threads that are kept
+/// alive between tasks: on an idle one if there is one, otherwise on a new
+/// thread, so the task starts right away, as it would on a thread of its own,
+/// and may block waiting for other tasks.  The set has at most twice as many
+/// threads as the hardware has (and at least 16); when they are all busy, the
+/// task gets a temporary thread.  Threads that have been idle for a while
+/// exit.  This does not wait for the task; the caller must arrange to know
+/// when it has finished (e.g. with a Semaphore).
+///
+/// We don't use a fixed set of threads with work queues, like ThreadPool
+/// below or ThreadPoolLight in cudadecoder/thread-pool-light.h, because the
+/// objects given to MultiThreader and TaskSequencer may block waiting for each
+/// other (e.g. each TaskSequencer object waits for the previous one), and
+/// would deadlock if they were queued behind each other.
+void RunOnSharedThread(const std::function<void()> &task);
+
+
 class MultiThreadable {
   // To create a function object that does part of the job, inherit from this
   // class, implement a copy constructor calling the default copy constructor
@@ -117,7 +147,7 @@ template<class C>
 class MultiThreader {
  public:
   MultiThreader(int32 num_threads, const C &c_in) :
-    threads_(std::max<int32>(1, num_threads)),
+    num_running_(0),
     cvec_(std::max<int32>(1, num_threads), c_in) {
     if (num_threads == 0) {
       // This is a special case with num_threads == 0, which behaves like with
@@ -127,20 +157,26 @@ class MultiThreader {
       cvec_[0].num_threads_ = 1;
       (cvec_[0])();
     } else {
-      for (int32 i = 0; i < threads_.size(); i++) {
+      num_running_ = cvec_.size();
+      for (int32 i = 0; i < num_running_; i++) {
         cvec_[i].thread_id_ = i;
-        cvec_[i].num_threads_ = threads_.size();
-        threads_[i] = std::thread(std::ref(cvec_[i]));
+        cvec_[i].num_threads_ = cvec_.size();
+        RunOnSharedThread(std::bind(&MultiThreader<C>::RunTask, this, i));
       }
     }
   }
   ~MultiThreader() {
-    for (size_t i = 0; i < threads_.size(); i++)
-      if (threads_[i].joinable())
-        threads_[i].join();
+    for (int32 i = 0; i < num_running_; i++)
+      finished_.Wait();
   }
  private:
-  std::vector<std::thread> threads_;
+  void RunTask(int32 i) {
+    (cvec_[i])();
+    finished_.Signal();
+  }
+
+  int32 num_running_;  // The number of objects run on other threads.
+  Semaphore finished_;  // Signaled when an object's operator () returns.
   std::vector<C> cvec_;
 };
 
@@ -202,22 +238,21 @@ class TaskSequencer {
     // put the new RunTaskArgsList object at head of the singly
     // linked list thread_list_.
     thread_list_ = new RunTaskArgsList(this, c, thread_list_);
-    thread_list_->thread = std::thread(TaskSequencer<C>::RunTask,
-                                       thread_list_);
+    RunOnSharedThread(std::bind(TaskSequencer<C>::RunTask, thread_list_));
   }
 
   void Wait() { // You call this at the end if it's more convenient
     // than waiting for the destructor.  It waits for all tasks to finish.
     if (thread_list_ != NULL) {
-      thread_list_->thread.join();
-      KALDI_ASSERT(thread_list_->tail == NULL); // thread would not
-      // have exited without setting tail to NULL.
+      thread_list_->done.Wait();
+      KALDI_ASSERT(thread_list_->tail == NULL); // task would not
+      // have finished without setting tail to NULL.
       delete thread_list_;
       thread_list_ = NULL;
     }
   }
 
-  /// The destructor waits for the last thread to exit.
+  /// The destructor waits for the last task to finish.
   ~TaskSequencer() {
     Wait();
   }
@@ -225,12 +260,14 @@ class TaskSequencer {
   struct RunTaskArgsList {
     TaskSequencer *me; // Think of this as a "this" pointer.
     C *c; // Clist element of the task we're expected
-    std::thread thread;
+    Semaphore done;  // Signaled when the task has finished, after deleting c
+    // and its tail.
     RunTaskArgsList *tail;
     RunTaskArgsList(TaskSequencer *me, C *c, RunTaskArgsList *tail):
         me(me), c(c), tail(tail) {}
   };
-  // This static function gets run in the threads that we create.
+  // This static function gets run on the threads given by
+  // RunOnSharedThread().
   static void RunTask(RunTaskArgsList *args) {
     // (1) run the job.
     (*(args->c))(); // call operator () on args->c, which does the computation.
@@ -241,10 +278,10 @@ class TaskSequencer {
     // (2) we want to destroy the object "c" now, by deleting it.  But for
     //     correct sequencing (this is the whole point of this class, it
     //     is intended to ensure the output of the program is in correct order),
-    //     we first wait till the previous thread, whose details will be in "tail",
+    //     we first wait till the previous task, whose details will be in "tail",
     //     is finished.
     if (args->tail != NULL) {
-      args->tail->thread.join();
+      args->tail->done.Wait();
     }
 
     delete args->c; // delete the object "c".  This may cause some output,
@@ -256,17 +293,20 @@ class TaskSequencer {
 
     if (args->tail != NULL) {
       KALDI_ASSERT(args->tail->tail == NULL); // Because we already
-      // did join on args->tail->thread, which means that
-      // thread was done, and before it exited, it would have
+      // waited for args->tail->done, which means that
+      // task was done, and before it finished, it would have
       // deleted and set to NULL its tail (which is the next line of code).
       delete args->tail;
       args->tail = NULL;
     }
-    // At this point we are exiting from the thread.  Signal the
+    // At this point the task is finished.  Signal the
     // "tot_threads_avail_" semaphore which is used to limit the total number of threads that are alive, including
     // not onlhy those that are in active computation in c->operator (), but those
     // that are waiting on I/O or other threads.
     args->me->tot_threads_avail_.Signal();
+    // This must be last: after it, the next task (or Wait()) may delete args
+    // and the TaskSequencer.
+    args->done.Signal();
   }
 
   int32 num_threads_; // copy of config.num_threads (since Semaphore doesn't store original count)
@@ -280,6 +320,150 @@ class TaskSequencer {
 
 };
 
+
+/// ThreadPool runs tasks on a fixed set of threads.  Each thread has its own
+/// queue of tasks; Submit() distributes tasks over the queues in turn, and a
+/// thread whose queue is empty takes tasks from the back of the other
+/// threads' queues ("work stealing"), so that a long task does not hold up
+/// the ones queued behind it.  Tasks are started roughly in the order they
+/// were submitted but may finish in any order.
+class ThreadPool {
+ public:
+  /// Starts 'num_threads' threads (which must be > 0).
+  explicit ThreadPool(int32 num_threads);
+
+  /// Queues a task; this does not block.
+  void Submit(const std::function<void()> &task);
+
+  int32 NumThreads() const { return threads_.size(); }
+
+  /// Waits for all queued tasks to finish, then stops the threads.
+  ~ThreadPool();
+
+ private:
+  struct TaskQueue {
+    std::mutex mutex;
+    std::deque<std::function<void()> > tasks;
+  };
+
+  void RunThread(int32 thread_index);
+
+  // Takes a task from the queue of thread 'thread_index', or else steals one
+  // from another queue; returns false if all queues were empty.
+  bool GetTask(int32 thread_index, std::function<void()> *task);
+
+  std::vector<TaskQueue*> queues_;
+  std::vector<std::thread> threads_;
+  int32 next_queue_;  // Queue for the next Submit(); only used by Submit().
+
+  std::mutex mutex_;  // Protects num_queued_ and stop_.
+  std::condition_variable cond_;  // Signaled when a task is queued.
+  int64 num_queued_;
+  bool stop_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(ThreadPool);
+};
+
+
+/// PooledTaskSequencer has the same interface as TaskSequencer and the same
+/// guarantee that the destructors of the objects are called sequentially,
+/// in the order Run() was called.  The operator () of the objects is run on
+/// a ThreadPool of config.num_threads threads.  Run() blocks while
+/// config.num_threads_total objects (default: num-threads plus 20) have been
+/// given to it and not yet destroyed, which bounds the memory used by
+/// finished objects waiting for an earlier, slower one.
+template<class C>
+class PooledTaskSequencer {
+ public:
+  PooledTaskSequencer(const TaskSequencerConfig &config):
+      num_threads_(config.num_threads),
+      max_pending_(config.num_threads_total > 0 ? config.num_threads_total :
+                   config.num_threads + 20),
+      pool_(NULL), draining_(false) {
+    KALDI_ASSERT((config.num_threads_total <= 0 ||
+                  config.num_threads_total >= config.num_threads) &&
+                 "num-threads-total, if specified, must be >= num-threads");
+    if (num_threads_ > 0)
+      pool_ = new ThreadPool(num_threads_);
+  }
+
+  /// This function takes ownership of the pointer "c", and will delete it
+  /// in the same sequence as Run was called on the jobs.
+  void Run(C *c) {
+    if (num_threads_ == 0) {  // run in main thread
+      (*c)();
+      delete c;
+      return;
+    }
+    Job *job = new Job(c);
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (pending_.size() >= static_cast<size_t>(max_pending_))
+        cond_.wait(lock);
+      pending_.push_back(job);
+    }
+    pool_->Submit(std::bind(&PooledTaskSequencer<C>::RunJob, this, job));
+  }
+
+  /// Waits for all objects to be run and destroyed (i.e. until their
+  /// destructors have returned).
+  void Wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!pending_.empty())
+      cond_.wait(lock);
+  }
+
+  ~PooledTaskSequencer() {
+    Wait();
+    delete pool_;
+  }
+
+ private:
+  struct Job {
+    C *c;
+    bool done;  // true once c's operator () has returned.
+    explicit Job(C *c): c(c), done(false) { }
+  };
+
+  // Runs in the pool's threads.
+  void RunJob(Job *job) {
+    (*(job->c))();
+    std::unique_lock<std::mutex> lock(mutex_);
+    job->done = true;
+    if (draining_)
+      return;  // Another thread is destroying finished objects; it will get
+               // to this one if it is next.
+    // Destroy finished objects from the front of the queue, in order.  Only
+    // one thread does this at a time, and it releases the lock while the
+    // destructors (which typically write output) are running.  A job stays
+    // in pending_ until its destructor has returned, so that Wait() waits
+    // for the output too.
+    draining_ = true;
+    while (!pending_.empty() && pending_.front()->done) {
+      Job *front = pending_.front();
+      lock.unlock();
+      delete front->c;
+      delete front;
+      lock.lock();
+      pending_.pop_front();
+      cond_.notify_all();
+    }
+    draining_ = false;
+  }
+
+  int32 num_threads_;
+  int32 max_pending_;
+  ThreadPool *pool_;
+
+  std::mutex mutex_;  // Protects pending_, the 'done' flags and draining_.
+  std::condition_variable cond_;  // Signaled when objects are destroyed.
+  std::deque<Job*> pending_;  // Jobs whose destructors have not returned, in
+                              // order of Run().
+  bool draining_;  // true while a thread is destroying finished objects.
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(PooledTaskSequencer);
+};
+
 } // namespace kaldi
 
 #endif  // KALDI_THREAD_KALDI_THREAD_H_
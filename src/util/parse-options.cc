@@ -369,6 +369,9 @@ int ParseOptions::Read(int argc, const char *const argv[]) {
     }
   }
 
+  if (!profile_output_.empty())
+    EnableProfiling(profile_output_);
+
   // process remaining arguments as positional
   for (; i < argc; i++) {
     if ((std::strcmp(argv[i], "--") == 0) && !double_dash_seen) {
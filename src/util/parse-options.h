@@ -48,6 +48,10 @@ class ParseOptions : public OptionsItf {
     RegisterStandard("help", &help_, "Print out usage message");
     RegisterStandard("verbose", &g_kaldi_verbose_level,
                      "Verbose level (higher->more logging)");
+    RegisterStandard("profile-output", &profile_output_,
+                     "If nonempty, time the instrumented parts of the program "
+                     "and write a report to this file at exit, and on SIGUSR1 "
+                     "(see EnableProfiling() in base/timer.h)");
   }
 
   /**
@@ -209,6 +213,8 @@ class ParseOptions : public OptionsItf {
   bool print_args_;     ///< variable for the implicit --print-args parameter
   bool help_;           ///< variable for the implicit --help parameter
   std::string config_;  ///< variable for the implicit --config parameter
+  std::string profile_output_;  ///< variable for the implicit
+                               ///< --profile-output parameter
   std::vector<std::string> positional_args_;
   const char *usage_;
   int argc_;
@@ -232,6 +232,81 @@ void TestConvertStringToReal() {
   KALDI_ASSERT(!ConvertStringToReal("-1.#QNANGARBAGE", &d));
 }
 
+// Checks that ConvertTokenToInteger() agrees with ConvertStringToInteger()
+// whenever it succeeds.
+template<class Int>
+void TestConvertTokenToInteger() {
+  const char *strs[] = { "0", "-0", "+0", "12345", "-12345", "+7", "255",
+                         "256", "-128", "-129", "65535", "65536",
+                         "2147483647", "2147483648", "-2147483648",
+                         "-2147483649", "999999999999999999",
+                         "-999999999999999999", "1234567890123456789",
+                         "", "-", "+", "--1", "1-", "1.0", "1e3", "0x10",
+                         " 1", "1 ", "a" };
+  for (size_t i = 0; i < sizeof(strs) / sizeof(char*); i++) {
+    std::string str(strs[i]);
+    Int a, b;
+    if (ConvertTokenToInteger(str.c_str(), str.c_str() + str.size(), &a))
+      KALDI_ASSERT(ConvertStringToInteger(str, &b) && a == b);
+  }
+  int32 i;
+  std::string str("12 34");
+  KALDI_ASSERT(ConvertTokenToInteger(str.c_str(), str.c_str() + 2, &i) &&
+               i == 12);
+  KALDI_ASSERT(!ConvertTokenToInteger(str.c_str(), str.c_str() + 3, &i));
+  KALDI_ASSERT(!ConvertTokenToInteger(str.c_str(), str.c_str(), &i));
+  char c;
+  KALDI_ASSERT(!ConvertTokenToInteger(str.c_str() + 3, str.c_str() + 5, &c) ||
+               c == 34);
+  uint32 u;
+  str = "-1";
+  KALDI_ASSERT(!ConvertTokenToInteger(str.c_str(), str.c_str() + 2, &u));
+}
+
+// Checks that ConvertTokenToReal() gives exactly what operator >> gives,
+// whenever it succeeds, on fixed and random strings.
+template<class Real>
+void TestConvertTokenToReal() {
+  std::vector<std::string> strs;
+  const char *fixed[] = { "1", "-1", "+1", "0", "-0", "1.5", ".5", "5.",
+                          "-.5e-3", "1e10", "1E+10", "1e-50", "1e50",
+                          "1e-400", "1e400", "-1e400", "3.4028235e38",
+                          "0.1234567890123456789", "", "-", "+", ".", "e",
+                          "1e", "1e+", "1.2.3", "1-", "--1", "1e1e1",
+                          "inf", "nan", "1.#INF", "0x10", "1f" };
+  for (size_t i = 0; i < sizeof(fixed) / sizeof(char*); i++)
+    strs.push_back(fixed[i]);
+  const char chars[] = "0123456789.eE+-";
+  for (int32 i = 0; i < 1000; i++) {
+    std::string str;
+    int32 length = Rand() % 8;
+    for (int32 j = 0; j < length; j++)
+      str += chars[Rand() % (sizeof(chars) - 1)];
+    strs.push_back(str);
+    std::ostringstream os;  // how we would write a number.
+    os << RandGauss() * exp(RandGauss() * 20.0);
+    strs.push_back(os.str());
+  }
+  int32 num_converted = 0;
+  for (size_t i = 0; i < strs.size(); i++) {
+    const std::string &str = strs[i];
+    Real a;
+    if (ConvertTokenToReal(str.c_str(), str.c_str() + str.size(), &a)) {
+      std::istringstream is(str);
+      Real b;
+      is >> b;
+      KALDI_ASSERT(!is.fail() && is.peek() == EOF && a == b);
+      num_converted++;
+    }
+  }
+  KALDI_ASSERT(num_converted > 1000);  // all the written numbers, at least.
+  Real d;
+  std::string str("1.5 2");
+  KALDI_ASSERT(ConvertTokenToReal(str.c_str(), str.c_str() + 3, &d) &&
+               d == 1.5);
+  KALDI_ASSERT(!ConvertTokenToReal(str.c_str(), str.c_str() + 4, &d));
+}
+
 template<class Real>
 void TestNan() {
   Real d;
@@ -523,6 +598,12 @@ int main() {
   TestConvertStringToInteger();
   TestConvertStringToReal<float>();
   TestConvertStringToReal<double>();
+  TestConvertTokenToInteger<int32>();
+  TestConvertTokenToInteger<int64>();
+  TestConvertTokenToInteger<uint16>();
+  TestConvertTokenToInteger<char>();
+  TestConvertTokenToReal<float>();
+  TestConvertTokenToReal<double>();
   TestTrim();
   TestSplitStringOnFirstSpace();
   TestIsToken();
@@ -26,6 +26,42 @@
 namespace kaldi {
 
 
+template<typename Real>
+static inline Real StringToReal(const char *str, char **end);
+template<>
+inline float StringToReal(const char *str, char **end) {
+  return strtof(str, end);
+}
+template<>
+inline double StringToReal(const char *str, char **end) {
+  return strtod(str, end);
+}
+
+template<typename Real>
+bool ConvertTokenToReal(const char *begin, const char *end, Real *out) {
+  if (begin == end)
+    return false;
+  for (const char *p = begin; p != end; p++) {
+    char c = *p;
+    if (!((c >= '0' && c <= '9') || c == '.' || c == 'e' || c == 'E' ||
+          c == '+' || c == '-'))
+      return false;
+  }
+  // The stream operators use strtof() and strtod() too, and fail on
+  // overflow.
+  char *stop;
+  Real r = StringToReal<Real>(begin, &stop);
+  if (stop != end || r - r != 0)
+    return false;
+  *out = r;
+  return true;
+}
+
+template
+bool ConvertTokenToReal(const char *begin, const char *end, float *out);
+template
+bool ConvertTokenToReal(const char *begin, const char *end, double *out);
+
 template<class F>
 bool SplitStringToFloats(const std::string &full,
                          const char *delim,
@@ -63,15 +99,24 @@ bool SplitStringToFloats(const std::string &full,
 void SplitStringToVector(const std::string &full, const char *delim,
                          bool omit_empty_strings,
                          std::vector<std::string> *out) {
-  size_t start = 0, found = 0, end = full.size();
-  out->clear();
+  size_t start = 0, found = 0, end = full.size(), num_out = 0;
+  // We assign to the strings already in 'out' where possible, which avoids
+  // allocating memory if it is reused.
   while (found != std::string::npos) {
     found = full.find_first_of(delim, start);
     // start != end condition is for when the delimiter is at the end
-    if (!omit_empty_strings || (found != start && start != end))
-      out->push_back(full.substr(start, found - start));
+    if (!omit_empty_strings || (found != start && start != end)) {
+      size_t length = (found == std::string::npos ? std::string::npos :
+                       found - start);
+      if (num_out < out->size())
+        (*out)[num_out].assign(full, start, length);
+      else
+        out->push_back(full.substr(start, length));
+      num_out++;
+    }
     start = found + 1;
   }
+  out->resize(num_out);
 }
 
 void JoinVectorToString(const std::vector<std::string> &vec_in,
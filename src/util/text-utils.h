@@ -136,6 +136,48 @@ bool ConvertStringToInteger(const std::string &str,
 }
 
 
+/// ConvertTokenToInteger is a fast, allocation-free version of
+/// ConvertStringToInteger for the common case of a token [begin, end) that
+/// consists of an optional sign and at most 18 decimal digits, such as "-12"
+/// or "+5".  It returns false for anything else (e.g. leading or trailing
+/// whitespace, or more digits), and if the integer does not fit in type Int;
+/// callers that need to handle such input can then use a slower method.
+template<class Int>
+bool ConvertTokenToInteger(const char *begin, const char *end, Int *out) {
+  KALDI_ASSERT_IS_INTEGER_TYPE(Int);
+  const char *p = begin;
+  bool negative = false;
+  if (p != end && (*p == '-' || *p == '+')) {
+    negative = (*p == '-');
+    p++;
+  }
+  if (p == end || end - p > 18)  // 18 digits can't overflow int64.
+    return false;
+  int64 i = 0;
+  for (; p != end; p++) {
+    if (*p < '0' || *p > '9')
+      return false;
+    i = i * 10 + (*p - '0');
+  }
+  if (negative) i = -i;
+  Int iInt = static_cast<Int>(i);
+  if (static_cast<int64>(iInt) != i ||
+      (i < 0 && !std::numeric_limits<Int>::is_signed))
+    return false;
+  *out = iInt;
+  return true;
+}
+
+/// ConvertTokenToReal is a fast, allocation-free way to convert a token
+/// [begin, end) that only contains the characters "0123456789.eE+-" to float
+/// or double, with the same result as reading it from a stream with
+/// operator >>.  It returns false if the token has any other characters
+/// (e.g. for "inf" or "nan"), is not entirely a number, or overflows.  The
+/// token must be followed by whitespace or the end of a null-terminated
+/// string, i.e. *end must be one of those.
+template<typename Real>
+bool ConvertTokenToReal(const char *begin, const char *end, Real *out);
+
 /// ConvertStringToReal converts a string into either float or double
 /// and returns false if there was any kind of problem (i.e. the string
 /// was not a floating point number or contained extra non-whitespace junk).